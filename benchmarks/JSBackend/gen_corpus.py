@@ -0,0 +1,274 @@
+#!/usr/bin/env python
+"""Generates the bitcode corpus for the JS backend benchmarks.
+
+Each module stresses a different part of the llc -march=js pipeline:
+
+  big_switch    huge switches (ExpandBigSwitches, Relooper)
+  nested_loops  deep loop nests with multi-level breaks (Relooper)
+  static_data   large constant and relocated globals (FlattenGlobals, the
+                memory initializer)
+  i64_heavy     64-bit and illegal-width integer arithmetic (ExpandI64,
+                ExpandLargeIntegers, PromoteIntegers)
+  simd          vector arithmetic, shuffles and selects (SIMD lowering)
+
+The modules are written as textual IR; llc reads them directly. Sizes are
+multiplied by --scale, so the same shapes can be used for quick runs and for
+stress runs.
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+
+HEADER = '''target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+'''
+
+
+class Rand(object):
+  """A tiny LCG so the corpus is identical on every run and Python version."""
+
+  def __init__(self, seed):
+    self.state = seed
+
+  def next(self, bound):
+    self.state = (self.state * 1103515245 + 12345) & 0x7fffffff
+    return self.state % bound
+
+
+def big_switch(scale):
+  out = [HEADER]
+  cases = 16384 * scale
+  out.append('define i32 @big_switch(i32 %x, i32* %p) {\n')
+  out.append('entry:\n  switch i32 %x, label %default [\n')
+  for i in range(cases):
+    out.append('    i32 %d, label %%c%d\n' % (i * 3, i))
+  out.append('  ]\n')
+  for i in range(cases):
+    out.append('c%d:\n' % i)
+    out.append('  store i32 %d, i32* %%p\n' % (i * 7))
+    out.append('  br label %exit\n')
+  out.append('default:\n  br label %exit\n')
+  out.append('exit:\n  %r = phi i32 ')
+  out.append(', '.join('[ %d, %%c%d ]' % (i, i) for i in range(cases)))
+  out.append(', [ -1, %default ]\n  ret i32 %r\n}\n')
+  return ''.join(out)
+
+
+def nested_loop_function(name, depth):
+  last = depth - 1
+  out = ['define i32 @%s(i32 %%n, i32* %%a) {\n' % name]
+  out.append('entry:\n  br label %h0\n')
+  for d in range(depth):
+    pred = 'entry' if d == 0 else 'b%d' % (d - 1)
+    out.append('h%d:\n' % d)
+    out.append('  %%i%d = phi i32 [ 0, %%%s ], [ %%n%d, %%latch%d ]\n' %
+               (d, pred, d, d))
+    out.append('  %%c%d = icmp slt i32 %%i%d, %%n\n' % (d, d))
+    out.append('  br i1 %%c%d, label %%b%d, label %%x%d\n' % (d, d, d))
+    out.append('b%d:\n' % d)
+    if d < last:
+      out.append('  br label %%h%d\n' % (d + 1))
+    else:
+      out.append('  %%p = getelementptr i32, i32* %%a, i32 %%i%d\n' % d)
+      out.append('  %v = load i32, i32* %p\n')
+      out.append('  %odd = and i32 %v, 1\n')
+      out.append('  %isodd = icmp ne i32 %odd, 0\n')
+      out.append('  br i1 %isodd, label %t, label %f\n')
+      out.append('t:\n  %v1 = mul i32 %v, 3\n  store i32 %v1, i32* %p\n')
+      # Leaving every loop at once needs labeled breaks.
+      out.append('  %stop = icmp eq i32 %v1, 12345\n')
+      out.append('  br i1 %%stop, label %%x0, label %%latch%d\n' % d)
+      out.append('f:\n  %v2 = lshr i32 %v, 1\n  store i32 %v2, i32* %p\n')
+      out.append('  br label %%latch%d\n' % d)
+    out.append('latch%d:\n' % d)
+    out.append('  %%n%d = add i32 %%i%d, 1\n' % (d, d))
+    out.append('  br label %%h%d\n' % d)
+    out.append('x%d:\n' % d)
+    if d == 0:
+      out.append('  ret i32 0\n')
+    else:
+      out.append('  br label %%latch%d\n' % (d - 1))
+  out.append('}\n\n')
+  return ''.join(out)
+
+
+def nested_loops(scale):
+  out = [HEADER]
+  for k in range(512 * scale):
+    out.append(nested_loop_function('loops%d' % k, 4 + k % 8))
+  return ''.join(out)
+
+
+def static_data(scale):
+  rand = Rand(1)
+  out = [HEADER]
+  tables = 64 * scale
+  size = 4096
+  for k in range(tables):
+    values = ', '.join('i32 %d' % rand.next(1 << 30) for _ in range(size))
+    out.append('@data%d = constant [%d x i32] [%s], align 4\n' %
+               (k, size, values))
+    text = ''.join(chr(ord('a') + rand.next(26)) for _ in range(1024))
+    out.append('@str%d = constant [1025 x i8] c"%s\\00", align 1\n' %
+               (k, text))
+  # Relocations into the tables.
+  refs = ', '.join(
+      'i32* getelementptr ([%d x i32], [%d x i32]* @data%d, i32 0, i32 %d)' %
+      (size, size, rand.next(tables), rand.next(size))
+      for _ in range(1024 * scale))
+  out.append('@ptrs = global [%d x i32*] [%s], align 4\n\n' %
+             (1024 * scale, refs))
+  out.append('define i32 @sum_data(i32 %i) {\n')
+  out.append('entry:\n')
+  for k in range(tables):
+    out.append('  %%p%d = getelementptr [%d x i32], [%d x i32]* @data%d, '
+               'i32 0, i32 %%i\n' % (k, size, size, k))
+    out.append('  %%v%d = load i32, i32* %%p%d\n' % (k, k))
+    prev = '0' if k == 0 else '%%s%d' % (k - 1)
+    out.append('  %%s%d = add i32 %s, %%v%d\n' % (k, prev, k))
+  out.append('  ret i32 %%s%d\n}\n' % (tables - 1))
+  return ''.join(out)
+
+
+I64_OPS = ['add', 'sub', 'mul', 'udiv', 'sdiv', 'urem', 'shl', 'lshr', 'ashr',
+           'and', 'or', 'xor']
+
+
+def i64_function(name, rand, length):
+  out = ['define i64 @%s(i64 %%a, i64 %%b, i64* %%p) {\n' % name]
+  out.append('entry:\n')
+  values = ['%a', '%b']
+  for i in range(length):
+    op = I64_OPS[rand.next(len(I64_OPS))]
+    lhs = values[rand.next(len(values))]
+    rhs = values[rand.next(len(values))]
+    if op in ('udiv', 'sdiv', 'urem'):
+      # Keep the divisor nonzero.
+      out.append('  %%d%d = or i64 %s, 1\n' % (i, rhs))
+      rhs = '%%d%d' % i
+    elif op in ('shl', 'lshr', 'ashr'):
+      out.append('  %%d%d = and i64 %s, 63\n' % (i, rhs))
+      rhs = '%%d%d' % i
+    out.append('  %%v%d = %s i64 %s, %s\n' % (i, op, lhs, rhs))
+    values.append('%%v%d' % i)
+    if i % 8 == 7:
+      out.append('  %%c%d = icmp ult i64 %%v%d, %s\n' % (i, i, lhs))
+      out.append('  %%s%d = select i1 %%c%d, i64 %%v%d, i64 %s\n' %
+                 (i, i, i, lhs))
+      out.append('  store i64 %%s%d, i64* %%p\n' % i)
+      values.append('%%s%d' % i)
+  out.append('  ret i64 %s\n}\n\n' % values[-1])
+  return ''.join(out)
+
+
+def wide_function(name):
+  # Illegal widths go through ExpandLargeIntegers and PromoteIntegers.
+  return '''define i64 @%s(i64 %%a, i64 %%b, i48* %%q) {
+entry:
+  %%wa = zext i64 %%a to i128
+  %%wb = zext i64 %%b to i128
+  %%hi = shl i128 %%wb, 64
+  %%w = or i128 %%wa, %%hi
+  %%sum = add i128 %%w, %%wa
+  %%top = lshr i128 %%sum, 64
+  %%r = trunc i128 %%top to i64
+  %%n = trunc i64 %%r to i48
+  %%m = add i48 %%n, 12345
+  store i48 %%m, i48* %%q
+  %%l = load i48, i48* %%q
+  %%x = zext i48 %%l to i64
+  ret i64 %%x
+}
+
+''' % name
+
+
+def i64_heavy(scale):
+  rand = Rand(2)
+  out = [HEADER]
+  for k in range(512 * scale):
+    out.append(i64_function('i64_%d' % k, rand, 64))
+    out.append(wide_function('wide_%d' % k))
+  return ''.join(out)
+
+
+def simd_function(name):
+  return '''define void @%(name)s(<4 x float>* %%a, <4 x float>* %%b, <4 x i32>* %%c, i32 %%n) {
+entry:
+  br label %%loop
+loop:
+  %%i = phi i32 [ 0, %%entry ], [ %%next, %%loop ]
+  %%pa = getelementptr <4 x float>, <4 x float>* %%a, i32 %%i
+  %%pb = getelementptr <4 x float>, <4 x float>* %%b, i32 %%i
+  %%pc = getelementptr <4 x i32>, <4 x i32>* %%c, i32 %%i
+  %%va = load <4 x float>, <4 x float>* %%pa, align 16
+  %%vb = load <4 x float>, <4 x float>* %%pb, align 16
+  %%vc = load <4 x i32>, <4 x i32>* %%pc, align 16
+  %%m = fmul <4 x float> %%va, %%vb
+  %%s = fadd <4 x float> %%m, %%va
+  %%sh = shufflevector <4 x float> %%s, <4 x float> %%vb, <4 x i32> <i32 0, i32 5, i32 2, i32 7>
+  %%gt = fcmp ogt <4 x float> %%sh, %%vb
+  %%sel = select <4 x i1> %%gt, <4 x float> %%sh, <4 x float> %%vb
+  %%ci = add <4 x i32> %%vc, <i32 1, i32 2, i32 3, i32 4>
+  %%cm = mul <4 x i32> %%ci, %%vc
+  %%e = extractelement <4 x i32> %%cm, i32 1
+  %%ins = insertelement <4 x i32> %%cm, i32 %%e, i32 3
+  store <4 x float> %%sel, <4 x float>* %%pa, align 16
+  store <4 x i32> %%ins, <4 x i32>* %%pc, align 16
+  %%next = add i32 %%i, 1
+  %%done = icmp eq i32 %%next, %%n
+  br i1 %%done, label %%exit, label %%loop
+exit:
+  ret void
+}
+
+''' % {'name': name}
+
+
+def simd(scale):
+  out = [HEADER]
+  for k in range(1024 * scale):
+    out.append(simd_function('simd_%d' % k))
+  return ''.join(out)
+
+
+GENERATORS = [
+    ('big_switch', big_switch),
+    ('nested_loops', nested_loops),
+    ('static_data', static_data),
+    ('i64_heavy', i64_heavy),
+    ('simd', simd),
+]
+
+
+def generate(out_dir, scale=1, only=None):
+  """Writes the corpus to out_dir and returns [(name, path)]."""
+  if not os.path.isdir(out_dir):
+    os.makedirs(out_dir)
+  modules = []
+  for name, generator in GENERATORS:
+    if only and name not in only:
+      continue
+    path = os.path.join(out_dir, '%s.ll' % name)
+    with open(path, 'w') as f:
+      f.write(generator(scale))
+    modules.append((name, path))
+  return modules
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('out_dir', help='Directory to write the modules to')
+  parser.add_argument('--scale', type=int, default=1,
+                      help='Size multiplier for every module')
+  args = parser.parse_args()
+  for name, path in generate(args.out_dir, args.scale):
+    print('%s: %s' % (name, path))
+
+
+if __name__ == '__main__':
+  main()
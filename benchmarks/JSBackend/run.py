@@ -0,0 +1,212 @@
+#!/usr/bin/env python
+"""Benchmarks llc -march=js on the generated corpus.
+
+For every module in the corpus (see gen_corpus.py) this runs llc with
+-time-passes and records:
+
+  - the wall time of the whole run and of every pass and timer region, which
+    includes the legalization passes, ExpandI64, the JS writer and the
+    Relooper,
+  - the peak resident set size of the llc process,
+  - the size of the emitted JavaScript.
+
+Each module is compiled --repeat times and the fastest time is kept. Results
+can be written as JSON with --save, and compared with a previous result given
+with --baseline.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_corpus
+
+# Passes and regions that are always listed, in addition to the slowest ones.
+KEY_TIMERS = [
+    'JavaScript backend',
+    'Relooper',
+    'Expand and lower illegal >i32 operations into 32-bit chunks',
+    'Expand integer types that are illegal in PNaCl',
+    'Promote integer types which are illegal in PNaCl',
+    'Flatten global variable initializers into byte arrays',
+    'ExpandBigSwitches',
+]
+
+TIME_COLUMN = re.compile(r'(\d+\.\d+)\s+\(\s*\d+\.\d+%\)')
+TIMER_LINE = re.compile(r'^\s*(?:\d+\.\d+\s+\(\s*\d+\.\d+%\)\s+)+(\S.*?)\s*$')
+
+
+def parse_time_passes(text):
+  """Returns {timer name: wall seconds} from -time-passes output.
+
+  Timers with the same name, such as passes that run twice, are summed.
+  """
+  timers = {}
+  for line in text.splitlines():
+    match = TIMER_LINE.match(line)
+    if not match:
+      continue
+    name = match.group(1)
+    if name == 'Total':
+      continue
+    # The last column is the wall time.
+    wall = float(TIME_COLUMN.findall(line)[-1])
+    timers[name] = timers.get(name, 0.0) + wall
+  return timers
+
+
+def run_llc(llc, module, output, extra_args):
+  """Runs llc once and returns (wall seconds, peak RSS in KiB, stderr)."""
+  args = [llc, '-time-passes', module, '-o', output] + extra_args
+  stderr_path = output + '.stderr'
+  with open(stderr_path, 'w') as stderr:
+    start = time.time()
+    proc = subprocess.Popen(args, stderr=stderr)
+    # wait4 gives the resource usage of this child alone.
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.time() - start
+  with open(stderr_path) as f:
+    text = f.read()
+  if status != 0:
+    sys.stderr.write(text)
+    raise RuntimeError('llc failed on %s' % module)
+  rss = usage.ru_maxrss
+  if sys.platform == 'darwin':
+    rss //= 1024 # bytes on macOS
+  return wall, rss, text
+
+
+def benchmark(llc, modules, out_dir, repeat, extra_args):
+  results = {}
+  for name, path in modules:
+    output = os.path.join(out_dir, '%s.js' % name)
+    best = None
+    for _ in range(repeat):
+      wall, rss, text = run_llc(llc, path, output, extra_args)
+      timers = parse_time_passes(text)
+      if best is None:
+        best = {'wall': wall, 'rss_kb': rss, 'timers': timers}
+        continue
+      best['wall'] = min(best['wall'], wall)
+      best['rss_kb'] = max(best['rss_kb'], rss)
+      for timer, seconds in timers.items():
+        best['timers'][timer] = min(best['timers'].get(timer, seconds),
+                                    seconds)
+    best['output_bytes'] = os.path.getsize(output)
+    results[name] = best
+  return results
+
+
+def shown_timers(result, top):
+  slowest = sorted(result['timers'].items(), key=lambda kv: -kv[1])[:top]
+  names = [name for name, _ in slowest]
+  names += [name for name in KEY_TIMERS
+            if name in result['timers'] and name not in names]
+  return names
+
+
+def format_delta(current, base):
+  if base is None:
+    return ''
+  if base == 0:
+    return '(new)' if current else ''
+  return '%+6.1f%%' % (100.0 * (current - base) / base)
+
+
+def report(results, baseline, top, threshold):
+  """Prints the results, and returns the metrics that regressed."""
+  regressions = []
+
+  def row(module, label, value, unit, base, check):
+    delta = format_delta(value, base)
+    flag = ''
+    if check and base and value > base * (1 + threshold / 100.0):
+      flag = '  <-- regression'
+      regressions.append('%s: %s' % (module, label))
+    print('  %-56s %12s%s%s' % (label[:56], unit % value,
+                                delta and '  ' + delta, flag))
+
+  for module in sorted(results):
+    result = results[module]
+    base = baseline.get(module) if baseline else None
+    print('%s' % module)
+    row(module, 'total wall time', result['wall'], '%.3fs',
+        base and base['wall'], True)
+    row(module, 'peak RSS', result['rss_kb'], '%dKiB',
+        base and base['rss_kb'], True)
+    # Output size is deterministic, so any growth is reported.
+    row(module, 'output size', result['output_bytes'], '%dB',
+        base and base['output_bytes'], False)
+    if base and result['output_bytes'] > base['output_bytes']:
+      regressions.append('%s: output size' % module)
+    for timer in shown_timers(result, top):
+      base_time = base and base['timers'].get(timer)
+      row(module, timer, result['timers'][timer], '%.4fs', base_time,
+          base_time is not None and base_time >= 0.01)
+  return regressions
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--llc', required=True, help='Path to llc')
+  parser.add_argument('--work-dir', default='.',
+                      help='Directory for the corpus and the outputs')
+  parser.add_argument('--scale', type=int, default=1,
+                      help='Size multiplier for the corpus')
+  parser.add_argument('--repeat', type=int, default=3,
+                      help='Runs per module; the fastest one is kept')
+  parser.add_argument('--only', action='append',
+                      help='Only run this module (may be repeated)')
+  parser.add_argument('--top', type=int, default=5,
+                      help='Number of slowest timers to list per module')
+  parser.add_argument('--baseline', help='JSON results to compare against')
+  parser.add_argument('--save', help='Write the results as JSON here')
+  parser.add_argument('--threshold', type=float, default=10.0,
+                      help='Slowdown in percent reported as a regression')
+  parser.add_argument('--fail-on-regression', action='store_true',
+                      help='Exit with an error if anything regressed')
+  parser.add_argument('llc_args', nargs='*',
+                      help='Extra llc arguments (after --)')
+  args = parser.parse_args()
+
+  corpus_dir = os.path.join(args.work_dir, 'corpus')
+  output_dir = os.path.join(args.work_dir, 'output')
+  if not os.path.isdir(output_dir):
+    os.makedirs(output_dir)
+  modules = gen_corpus.generate(corpus_dir, args.scale, args.only)
+
+  baseline = None
+  if args.baseline and os.path.exists(args.baseline):
+    with open(args.baseline) as f:
+      baseline = json.load(f)
+  elif args.baseline:
+    print('note: no baseline at %s yet' % args.baseline)
+
+  results = benchmark(args.llc, modules, output_dir, args.repeat,
+                      args.llc_args)
+  regressions = report(results, baseline, args.top, args.threshold)
+
+  if args.save:
+    with open(args.save, 'w') as f:
+      json.dump(results, f, indent=2, sort_keys=True)
+    print('results written to %s' % args.save)
+
+  if regressions:
+    print('\n%d regression(s):' % len(regressions))
+    for regression in regressions:
+      print('  ' + regression)
+    if args.fail_on_regression:
+      return 1
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -382,6 +382,10 @@ public:
   /// SelectionDAG ready to process a new block.
   void clear();
 
+  /// Make room in the CSE map for \p NumNodes nodes, so that building a large
+  /// block does not repeatedly grow and rehash it.
+  void reserveNodes(unsigned NumNodes) { CSEMap.reserve(NumNodes); }
+
   MachineFunction &getMachineFunction() const { return *MF; }
   const Pass *getPass() const { return SDAGISelPass; }
 
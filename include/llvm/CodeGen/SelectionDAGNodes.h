@@ -551,6 +551,10 @@ private:
   /// Unique id per SDNode in the DAG.
   int NodeId = -1;
 
+  /// Index of this node in the DAGCombiner worklist, or -1 if it is not on
+  /// the worklist.
+  int CombinerWorklistIndex = -1;
+
   /// The values that are used by this operation.
   SDUse *OperandList = nullptr;
 
@@ -680,6 +684,12 @@ public:
   /// Set unique node id.
   void setNodeId(int Id) { NodeId = Id; }
 
+  /// Return the index of this node in the DAGCombiner worklist, or -1.
+  int getCombinerWorklistIndex() const { return CombinerWorklistIndex; }
+
+  /// Set the index of this node in the DAGCombiner worklist.
+  void setCombinerWorklistIndex(int Index) { CombinerWorklistIndex = Index; }
+
   /// Return the node ordering.
   unsigned getIROrder() const { return IROrder; }
 
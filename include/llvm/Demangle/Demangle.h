@@ -7,6 +7,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#ifndef LLVM_DEMANGLE_DEMANGLE_H
+#define LLVM_DEMANGLE_DEMANGLE_H
+
 #include <cstddef>
 
 namespace llvm {
@@ -25,4 +28,28 @@ namespace llvm {
 
 char *itaniumDemangle(const char *mangled_name, char *buf, size_t *n,
                       int *status);
-}
+
+/// Demangles a sequence of Itanium names, reusing the parser's node arena and
+/// the output buffer from one name to the next. This avoids the per-name
+/// allocations of itaniumDemangle when demangling a whole symbol table.
+class ItaniumBatchDemangler {
+  void *Parser;
+  char *Buf;
+  size_t BufSize;
+
+public:
+  ItaniumBatchDemangler();
+  ~ItaniumBatchDemangler();
+
+  ItaniumBatchDemangler(const ItaniumBatchDemangler &) = delete;
+  ItaniumBatchDemangler &operator=(const ItaniumBatchDemangler &) = delete;
+
+  /// Demangle \p MangledName. Returns null if it is not a valid Itanium name.
+  /// Otherwise the returned string is owned by the demangler and stays valid
+  /// until the next call.
+  const char *demangle(const char *MangledName);
+  const char *demangle(const char *MangledName, size_t Length);
+};
+} // namespace llvm
+
+#endif
@@ -25,6 +25,7 @@
 #include "llvm/ExecutionEngine/Orc/OrcError.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/IR/Attributes.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
@@ -32,19 +33,25 @@
 #include "llvm/IR/GlobalAlias.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <functional>
 #include <iterator>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <utility>
@@ -63,6 +70,9 @@ namespace orc {
 /// added to the layer below. When a stub is called it triggers the extraction
 /// of the function body from the original module. The extracted body is then
 /// compiled and executed.
+///
+///   Optionally, functions can be compiled speculatively on a background thread
+/// pool before their stubs are first called (see enableSpeculation).
 template <typename BaseLayerT,
           typename CompileCallbackMgrT = JITCompileCallbackManager,
           typename IndirectStubsMgrT = IndirectStubsManager>
@@ -188,6 +198,13 @@ private:
     StaticGlobalRenamer StaticRenamer;
     SourceModulesList SourceModules;
     std::vector<BaseLayerModuleHandleT> BaseLayerHandles;
+    // The body addresses of the functions compiled so far, and the functions
+    // queued for speculative compilation.
+    std::map<Function*, JITTargetAddress> CompiledFunctions;
+    std::set<Function*> SpeculationQueued;
+    // Set, under the layer mutex, when the dylib is removed. Speculative
+    // compiles hold on to it, as they may run after the dylib is gone.
+    std::shared_ptr<bool> Removed = std::make_shared<bool>(false);
   };
 
   using LogicalDylibList = std::list<LogicalDylib>;
@@ -204,6 +221,21 @@ public:
   using IndirectStubsManagerBuilderT =
       std::function<std::unique_ptr<IndirectStubsMgrT>()>;
 
+  /// @brief Counts of the compiles done by this layer, and the time that
+  ///        callers of stubs spent waiting for them.
+  struct CompileStats {
+    /// Partitions compiled on the thread that called a stub.
+    unsigned SynchronousCompiles = 0;
+    /// Partitions compiled speculatively on the background thread pool.
+    unsigned SpeculativeCompiles = 0;
+    /// Stub calls that found their function already compiled, usually by
+    /// speculation that finished after the stub was entered.
+    unsigned CompiledBeforeCall = 0;
+    /// The total and the longest time a stub call blocked its caller.
+    std::chrono::nanoseconds TotalStallTime{0};
+    std::chrono::nanoseconds MaxStallTime{0};
+  };
+
   /// @brief Construct a compile-on-demand layer instance.
   CompileOnDemandLayer(BaseLayerT &BaseLayer, PartitioningFtor Partition,
                        CompileCallbackMgrT &CallbackMgr,
@@ -215,15 +247,53 @@ public:
         CloneStubsIntoPartitions(CloneStubsIntoPartitions) {}
 
   ~CompileOnDemandLayer() {
+    cancelSpeculation();
     // FIXME: Report error on log.
     while (!LogicalDylibs.empty())
       consumeError(removeModule(LogicalDylibs.begin()));
   }
 
+  /// @brief Compile functions speculatively on a background thread pool.
+  ///
+  ///   Once enabled, the function named EntryPoint in each module added to the
+  /// layer is compiled in the background, and so are, breadth first, the
+  /// functions that each compiled function calls directly. A stub that is
+  /// called before its function was compiled still compiles it on the calling
+  /// thread. Compiles share the LLVMContext of their source modules, so the
+  /// layer serializes them and its other operations with a mutex; the pool
+  /// takes them off the threads running JIT'd code. A NumThreads of zero
+  /// disables speculation.
+  void enableSpeculation(unsigned NumThreads, std::string EntryPoint = "main") {
+    std::unique_ptr<ThreadPool> OldPool;
+    {
+      std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
+      OldPool = std::move(SpeculationPool);
+      if (NumThreads)
+        SpeculationPool = llvm::make_unique<ThreadPool>(NumThreads);
+      SpeculationEntryPoint = std::move(EntryPoint);
+    }
+    // The tasks left in the old pool take the mutex, so it is destroyed, which
+    // waits for them, only once the mutex is released.
+  }
+
+  /// @brief Wait until all queued speculative compiles have finished.
+  void waitForSpeculation() {
+    if (SpeculationPool)
+      SpeculationPool->wait();
+  }
+
+  /// @brief Get the counts of compiles and the time callers of stubs spent
+  ///        waiting for them.
+  CompileStats getCompileStats() const {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
+    return Stats;
+  }
+
   /// @brief Add a module to the compile-on-demand layer.
   Expected<ModuleHandleT>
   addModule(std::shared_ptr<Module> M,
             std::shared_ptr<JITSymbolResolver> Resolver) {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
 
     LogicalDylibs.push_back(LogicalDylib());
     auto &LD = LogicalDylibs.back();
@@ -239,6 +309,7 @@ public:
 
   /// @brief Add extra modules to an existing logical module.
   Error addExtraModule(ModuleHandleT H, std::shared_ptr<Module> M) {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
     return addLogicalModule(*H, std::move(M));
   }
 
@@ -247,6 +318,9 @@ public:
   ///   This will remove all modules in the layers below that were derived from
   /// the module represented by H.
   Error removeModule(ModuleHandleT H) {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
+    // Speculative compiles queued for H check this before touching it.
+    *H->Removed = true;
     auto Err = H->removeModulesFromBaseLayer(BaseLayer);
     LogicalDylibs.erase(H);
     return Err;
@@ -257,6 +331,7 @@ public:
   /// @param ExportedSymbolsOnly If true, search only for exported symbols.
   /// @return A handle for the given named symbol, if it exists.
   JITSymbol findSymbol(StringRef Name, bool ExportedSymbolsOnly) {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
     for (auto LDI = LogicalDylibs.begin(), LDE = LogicalDylibs.end();
          LDI != LDE; ++LDI) {
       if (auto Sym = LDI->StubsMgr->findStub(Name, ExportedSymbolsOnly))
@@ -273,6 +348,7 @@ public:
   ///        below this one.
   JITSymbol findSymbolIn(ModuleHandleT H, const std::string &Name,
                          bool ExportedSymbolsOnly) {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
     return H->findSymbol(BaseLayer, Name, ExportedSymbolsOnly);
   }
 
@@ -285,6 +361,7 @@ public:
   //        callbacks, uncompiled IR, and no-longer-needed/reachable function
   //        implementations).
   Error updatePointer(std::string FuncName, JITTargetAddress FnBodyAddr) {
+    std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
     //Find out which logical dylib contains our symbol
     auto LDI = LogicalDylibs.begin();
     for (auto LDE = LogicalDylibs.end(); LDI != LDE; ++LDI) {
@@ -349,13 +426,25 @@ private:
             std::make_pair(CCInfo.getAddress(),
                            JITSymbolFlags::fromGlobalValue(F));
           CCInfo.setCompileAction([this, &LD, LMId, &F]() -> JITTargetAddress {
+              auto Start = std::chrono::steady_clock::now();
+              std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
+              bool Compiled = LD.CompiledFunctions.count(&F);
+              JITTargetAddress FnImplAddr = 0;
               if (auto FnImplAddrOrErr = this->extractAndCompile(LD, LMId, F))
-                return *FnImplAddrOrErr;
+                FnImplAddr = *FnImplAddrOrErr;
               else {
                 // FIXME: Report error, return to 'abort' or something similar.
                 consumeError(FnImplAddrOrErr.takeError());
-                return 0;
               }
+              if (Compiled)
+                ++Stats.CompiledBeforeCall;
+              else
+                ++Stats.SynchronousCompiles;
+              auto Stall = std::chrono::steady_clock::now() - Start;
+              Stats.TotalStallTime += Stall;
+              Stats.MaxStallTime = std::max<std::chrono::nanoseconds>(
+                  Stats.MaxStallTime, Stall);
+              return FnImplAddr;
             });
         } else
           return CCInfoOrErr.takeError();
@@ -365,6 +454,10 @@ private:
         return Err;
     }
 
+    if (SpeculationPool)
+      if (auto *Entry = SrcM.getFunction(SpeculationEntryPoint))
+        speculate(LD, LMId, *Entry);
+
     // If this module doesn't contain any globals, aliases, or module flags then
     // we can bail out early and avoid the overhead of creating and managing an
     // empty globals module.
@@ -492,6 +585,12 @@ private:
                     Function &F) {
     Module &SrcM = LD.getSourceModule(LMId);
 
+    // F may have been compiled since its stub was called, as part of another
+    // partition or speculatively.
+    auto Compiled = LD.CompiledFunctions.find(&F);
+    if (Compiled != LD.CompiledFunctions.end())
+      return Compiled->second;
+
     // If F is a declaration we must already have compiled it.
     if (F.isDeclaration())
       return 0;
@@ -501,6 +600,25 @@ private:
 
     JITTargetAddress CalledAddr = 0;
     auto Part = Partition(F);
+    // Leave out functions that were already compiled, as part of another
+    // partition or speculatively.
+    for (auto I = Part.begin(); I != Part.end();)
+      if ((*I)->isDeclaration() || LD.CompiledFunctions.count(*I))
+        I = Part.erase(I);
+      else
+        ++I;
+
+    // Find the functions that the partition calls directly, to speculate on
+    // them once it is compiled.
+    std::vector<Function*> Callees;
+    if (SpeculationPool)
+      for (auto *SubF : Part)
+        for (auto &I : instructions(*SubF))
+          if (auto CS = ImmutableCallSite(&I))
+            if (auto *Callee = CS.getCalledFunction())
+              if (!Callee->isDeclaration())
+                Callees.push_back(const_cast<Function*>(Callee));
+
     if (auto PartHOrErr = emitPartition(LD, LMId, Part)) {
       auto &PartH = *PartHOrErr;
       for (auto *SubF : Part) {
@@ -513,6 +631,7 @@ private:
             // return it from this function.
             if (SubF == &F)
               CalledAddr = FnBodyAddr;
+            LD.CompiledFunctions[SubF] = FnBodyAddr;
 
             // Update the function body pointer for the stub.
             if (auto EC = LD.StubsMgr->updatePointer(FnName, FnBodyAddr))
@@ -530,9 +649,45 @@ private:
     } else
       return PartHOrErr.takeError();
 
+    for (auto *Callee : Callees)
+      speculate(LD, LMId, *Callee);
+
     return CalledAddr;
   }
 
+  // Queues a speculative compile of F, unless it was compiled or queued
+  // already. Must be called with LayerMutex held.
+  void speculate(LogicalDylib &LD,
+                 typename LogicalDylib::SourceModuleHandle LMId, Function &F) {
+    if (F.isDeclaration() || !LD.SpeculationQueued.insert(&F).second)
+      return;
+    // Only functions with stubs are compiled on demand.
+    std::string Name = mangle(F.getName(), F.getParent()->getDataLayout());
+    if (!LD.StubsMgr->findStub(Name, false))
+      return;
+    std::shared_ptr<bool> Removed = LD.Removed;
+    SpeculationPool->async([this, &LD, Removed, LMId, &F]() {
+      if (CancelSpeculation)
+        return;
+      std::lock_guard<std::recursive_mutex> Lock(LayerMutex);
+      if (*Removed || LD.CompiledFunctions.count(&F))
+        return;
+      if (auto FnImplAddrOrErr = this->extractAndCompile(LD, LMId, F))
+        ++Stats.SpeculativeCompiles;
+      else
+        consumeError(FnImplAddrOrErr.takeError());
+    });
+  }
+
+  // Drops the queued speculative compiles and waits for the running ones.
+  void cancelSpeculation() {
+    if (!SpeculationPool)
+      return;
+    CancelSpeculation = true;
+    SpeculationPool->wait();
+    CancelSpeculation = false;
+  }
+
   template <typename PartitionT>
   Expected<BaseLayerModuleHandleT>
   emitPartition(LogicalDylib &LD,
@@ -619,6 +774,15 @@ private:
 
   LogicalDylibList LogicalDylibs;
   bool CloneStubsIntoPartitions;
+
+  // Serializes compiles, which may run on the speculation pool or on threads
+  // calling stubs, with the rest of the layer. Resolvers may call back into
+  // the layer while compiling, hence the recursive mutex.
+  mutable std::recursive_mutex LayerMutex;
+  CompileStats Stats;
+  std::unique_ptr<ThreadPool> SpeculationPool;
+  std::string SpeculationEntryPoint;
+  std::atomic<bool> CancelSpeculation{false};
 };
 
 } // end namespace orc
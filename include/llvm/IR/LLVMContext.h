@@ -37,6 +37,12 @@ class SMDiagnostic;
 class StringRef;
 class Twine;
 
+namespace remarks {
+
+class BinaryRemarkSerializer;
+
+} // end namespace remarks
+
 namespace yaml {
 
 class Output;
@@ -256,6 +262,17 @@ public:
   /// set, the handler is invoked for each diagnostic message.
   void setDiagnosticsOutputFile(std::unique_ptr<yaml::Output> F);
 
+  /// Return the binary remark file used to save optimization diagnostics, if
+  /// any. It is written to in addition to the YAML file.
+  remarks::BinaryRemarkSerializer *getDiagnosticsBinaryOutputFile();
+  /// Set the binary remark file used for optimization diagnostics.
+  void setDiagnosticsBinaryOutputFile(
+      std::unique_ptr<remarks::BinaryRemarkSerializer> F);
+
+  /// Return true if optimization diagnostics are saved in a file of either
+  /// format.
+  bool hasDiagnosticsOutputFile() const;
+
   /// \brief Get the prefix that should be printed in front of a diagnostic of
   ///        the given \p Severity
   static const char *getDiagnosticMessagePrefix(DiagnosticSeverity Severity);
@@ -416,6 +416,7 @@ void initializePNaClABIVerifyFunctionsPass(PassRegistry&);
 void initializePNaClABIVerifyModulePass(PassRegistry&);
 void initializePNaClSjLjEHPass(PassRegistry&);
 void initializePromoteI1OpsPass(PassRegistry&);
+void initializePromoteIntegerSignaturesPass(PassRegistry&);
 void initializePromoteIntegersPass(PassRegistry&);
 void initializeRemoveAsmMemoryPass(PassRegistry&);
 void initializeRenameEntryPointPass(PassRegistry&);
@@ -26,6 +26,7 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -152,6 +153,12 @@ private:
 
   VersionInfoType VersionInfo;
 
+  /// Per-section record of which relaxable fragments were found not to need
+  /// relaxation and which fragments may have changed size since. Only live
+  /// while layout() is running.
+  class RelaxationCache;
+  std::unique_ptr<RelaxationCache> RelaxCache;
+
   /// Evaluate a fixup to a relocatable expression and the value which should be
   /// placed into the fixup.
   ///
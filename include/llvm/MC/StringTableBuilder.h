@@ -10,9 +10,11 @@
 #ifndef LLVM_MC_STRINGTABLEBUILDER_H
 #define LLVM_MC_STRINGTABLEBUILDER_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/CachedHashString.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringRef.h"
+#include <array>
 #include <cstddef>
 #include <cstdint>
 
@@ -26,13 +28,23 @@ public:
   enum Kind { ELF, WinCOFF, MachO, RAW };
 
 private:
-  DenseMap<CachedHashStringRef, size_t> StringIndexMap;
+  /// The strings are sharded by the top bits of their hash so that
+  /// addParallel can deduplicate every shard independently.
+  static constexpr unsigned ShardBits = 4;
+  static constexpr unsigned NumShards = 1 << ShardBits;
+
+  using StringIndexMapTy = DenseMap<CachedHashStringRef, size_t>;
+  std::array<StringIndexMapTy, NumShards> StringIndexMap;
   size_t Size = 0;
   Kind K;
   unsigned Alignment;
   bool Finalized = false;
 
-  void finalizeStringTable(bool Optimize);
+  static unsigned getShard(CachedHashStringRef S) {
+    return S.hash() >> (32 - ShardBits);
+  }
+
+  void finalizeStringTable(bool Optimize, bool Parallel);
   void initSize();
 
 public:
@@ -45,10 +57,19 @@ public:
   size_t add(CachedHashStringRef S);
   size_t add(StringRef S) { return add(CachedHashStringRef(S)); }
 
+  /// Add all of \p Strings to the builder. This is equivalent to calling add
+  /// on each of them in order, but the strings are deduplicated on multiple
+  /// threads. Can only be used before the table is finalized.
+  void addParallel(ArrayRef<CachedHashStringRef> Strings);
+
   /// \brief Analyze the strings and build the final table. No more strings can
   /// be added after this point.
   void finalize();
 
+  /// Like finalize, but sort the strings for tail merging on multiple threads.
+  /// The resulting table is identical to the one finalize builds.
+  void finalizeParallel();
+
   /// Finalize the string table without reording it. In this mode, offsets
   /// returned by add will still be valid.
   void finalizeInOrder();
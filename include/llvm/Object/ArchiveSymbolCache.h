@@ -0,0 +1,122 @@
+//===- ArchiveSymbolCache.h - Persistent archive symbol index ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares ArchiveSymbolIndex, a compact serialized index from the
+// symbols in an archive's symbol table to the members defining them, and
+// ArchiveSymbolCache, which keeps these indexes on disk between runs.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_OBJECT_ARCHIVESYMBOLCACHE_H
+#define LLVM_OBJECT_ARCHIVESYMBOLCACHE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+namespace object {
+
+class Archive;
+
+/// An index of an archive's symbol table that can be used without opening
+/// the archive. It records where each member's data is, so that a member can
+/// be loaded without parsing the member headers, and a hash table from
+/// symbol names to the first member defining them.
+class ArchiveSymbolIndex {
+public:
+  struct Member {
+    /// The name of the member as stored in the archive.
+    StringRef Name;
+    /// For members of thin archives, the path of the member file. Empty
+    /// otherwise.
+    StringRef Path;
+    /// The offset of the member's header in the archive.
+    uint64_t HeaderOffset;
+    /// The offset of the member's data in the archive, and its size.
+    uint64_t Offset;
+    uint64_t Size;
+  };
+
+  struct Symbol {
+    StringRef Name;
+    uint32_t Member;
+  };
+
+  ~ArchiveSymbolIndex();
+
+  /// Builds the index for the symbol table of \p A.
+  static Expected<std::unique_ptr<ArchiveSymbolIndex>>
+  create(const Archive &A, uint64_t ArchiveSize = 0, int64_t ModTime = 0);
+
+  /// Reads an index written by write(). \p Buf must stay unchanged as the
+  /// index refers to it.
+  static Expected<std::unique_ptr<ArchiveSymbolIndex>>
+  read(std::unique_ptr<MemoryBuffer> Buf);
+
+  /// Writes the index in the format read by read().
+  void write(raw_ostream &OS) const;
+
+  bool isThin() const { return Thin; }
+  /// The archive size and modification time this index was built for.
+  uint64_t getArchiveSize() const { return ArchiveSize; }
+  int64_t getModTime() const { return ModTime; }
+
+  ArrayRef<Member> members() const { return Members; }
+  /// The symbols in the order of the archive's symbol table.
+  ArrayRef<Symbol> symbols() const { return Symbols; }
+
+  /// Returns the index of the first member that defines \p Name.
+  Optional<uint32_t> lookup(StringRef Name) const;
+
+  /// Returns the data of member \p I in \p ArchiveData, the contents of a
+  /// regular archive, after checking that the member header the index
+  /// recorded is still there and describes the same data.
+  Expected<StringRef> getMemberData(StringRef ArchiveData, uint32_t I) const;
+
+private:
+  class HashTable;
+
+  ArchiveSymbolIndex() = default;
+
+  std::unique_ptr<MemoryBuffer> Buf;
+  bool Thin = false;
+  uint64_t ArchiveSize = 0;
+  int64_t ModTime = 0;
+  std::vector<Member> Members;
+  std::vector<Symbol> Symbols;
+  std::unique_ptr<HashTable> Table;
+};
+
+/// A directory of ArchiveSymbolIndex files, keyed by the path, size and
+/// modification time of the archives they were built for.
+class ArchiveSymbolCache {
+public:
+  explicit ArchiveSymbolCache(StringRef Dir) : Dir(Dir) {}
+
+  /// Returns the index for the archive at \p Path. The index is read from the
+  /// cache if it is there and matches the archive, and is otherwise built
+  /// from the archive and stored in the cache. Failing to store the index is
+  /// not an error.
+  Expected<std::unique_ptr<ArchiveSymbolIndex>> getIndex(StringRef Path);
+
+private:
+  std::string Dir;
+};
+
+} // end namespace object
+} // end namespace llvm
+
+#endif // LLVM_OBJECT_ARCHIVESYMBOLCACHE_H
@@ -0,0 +1,122 @@
+//===- BinaryRemarks.h - Binary optimization remark files -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A compact binary format for optimization remark files, and the serializer
+// and parser for it.
+//
+// A file starts with the magic "RMRK" and a 32-bit format version, followed by
+// a sequence of records. All integers are little endian. Each record starts
+// with a one byte tag:
+//
+//   String record: tag 1, u32 length, the bytes of the string and a NUL.
+//
+//     Defines the next string of the file. Strings are referred to by their
+//     index, in order of definition, and each string is defined once, before
+//     the first record referring to it.
+//
+//   Remark record: tag 2, u8 type, u8 flags, u8 0, then the u32 string
+//   indices of the pass, remark and function name and the u32 number of
+//   arguments. If bit 0 of the flags is set, the u32 file index, line and
+//   column of the remark location follow, and if bit 1 is set, the u64
+//   hotness. Then come the arguments, each with the u32 string indices of
+//   its key and value and u32 flags, followed by a location if bit 0 of the
+//   flags is set.
+//
+// Since strings are defined where they are first used, a serializer never has
+// to seek back or hold more than the string table in memory, and a parser can
+// hand out the strings of a mapped file in place.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_REMARKS_BINARYREMARKS_H
+#define LLVM_REMARKS_BINARYREMARKS_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Remarks/Remark.h"
+#include "llvm/Support/Error.h"
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+class raw_ostream;
+
+namespace remarks {
+
+/// The magic at the start of every binary remark file.
+constexpr StringRef BinaryRemarkMagic("RMRK", 4);
+/// The version of the format that this implementation reads and writes.
+constexpr uint32_t BinaryRemarkVersion = 1;
+
+/// Writes remarks in the binary remark format. Records are collected in a
+/// buffer that is written to the stream whenever it fills up, and when the
+/// serializer is flushed or destroyed.
+class BinaryRemarkSerializer {
+public:
+  /// Creates a serializer writing to \p OS, starting with the file header.
+  explicit BinaryRemarkSerializer(raw_ostream &OS);
+  ~BinaryRemarkSerializer();
+
+  BinaryRemarkSerializer(const BinaryRemarkSerializer &) = delete;
+  BinaryRemarkSerializer &operator=(const BinaryRemarkSerializer &) = delete;
+
+  /// Appends \p R to the file.
+  void emit(const Remark &R);
+
+  /// Writes all buffered records to the stream.
+  void flush();
+
+private:
+  uint32_t getStringIndex(StringRef S);
+  void writeLocation(const RemarkLocation &Loc);
+  template <typename T> void write(T Value);
+
+  raw_ostream &OS;
+  StringMap<uint32_t> StringIndices;
+  SmallVector<char, 0> Buffer;
+};
+
+/// Parses a buffer holding a binary remark file. The strings of the parsed
+/// remarks point into the buffer, which has to outlive the parser and the
+/// remarks.
+class BinaryRemarkParser {
+public:
+  /// Returns true if \p Buffer starts like a binary remark file.
+  static bool isBinaryRemarkFile(StringRef Buffer) {
+    return Buffer.startswith(BinaryRemarkMagic);
+  }
+
+  /// Creates a parser for \p Buffer after checking its header.
+  static Expected<std::unique_ptr<BinaryRemarkParser>> create(StringRef Buffer);
+
+  /// Parses the next remark. Returns null at the end of the buffer. The
+  /// returned remark is valid until the next call.
+  Expected<const Remark *> next();
+
+private:
+  explicit BinaryRemarkParser(StringRef Buffer) : Buffer(Buffer) {}
+
+  Error parseString();
+  Error parseRemark();
+  Error readString(StringRef &S);
+  Error readLocation(RemarkLocation &Loc);
+  template <typename T> Error read(T &Value);
+
+  StringRef Buffer;
+  size_t Offset = 0;
+  std::vector<StringRef> Strings;
+  std::vector<Argument> Args;
+  Remark Current;
+};
+
+} // end namespace remarks
+} // end namespace llvm
+
+#endif // LLVM_REMARKS_BINARYREMARKS_H
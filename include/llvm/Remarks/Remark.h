@@ -0,0 +1,77 @@
+//===- Remark.h - Optimization remarks --------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines the in-memory form of an optimization remark that the remark
+// serializers write and the remark parsers produce.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_REMARKS_REMARK_H
+#define LLVM_REMARKS_REMARK_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+
+namespace llvm {
+namespace remarks {
+
+/// The type of a remark, which YAML remark files record as the tag of each
+/// remark document.
+enum class Type : uint8_t {
+  Passed,
+  Missed,
+  Analysis,
+  AnalysisFPCommute,
+  AnalysisAliasing,
+  Failure,
+  Last = Failure
+};
+
+/// Returns the YAML tag of remarks of type \p T, e.g. "!Passed".
+StringRef getTypeTag(Type T);
+
+/// Sets \p T to the remark type with the YAML tag \p Tag. Returns false if
+/// \p Tag is not the tag of a remark type.
+bool getTypeForTag(StringRef Tag, Type &T);
+
+/// A source location attached to a remark or to one of its arguments.
+struct RemarkLocation {
+  StringRef File;
+  unsigned Line = 0;
+  unsigned Column = 0;
+
+  bool isValid() const { return !File.empty(); }
+};
+
+/// A key-value pair the remark message is composed of.
+struct Argument {
+  StringRef Key;
+  StringRef Val;
+  RemarkLocation Loc;
+};
+
+/// A single optimization remark. The remark does not own any of its strings
+/// or arguments: remarks produced by a parser refer to the parsed buffer or
+/// to storage owned by the parser.
+struct Remark {
+  Type RemarkType = Type::Passed;
+  StringRef PassName;
+  StringRef RemarkName;
+  StringRef FunctionName;
+  RemarkLocation Loc;
+  Optional<uint64_t> Hotness;
+  ArrayRef<Argument> Args;
+};
+
+} // end namespace remarks
+} // end namespace llvm
+
+#endif // LLVM_REMARKS_REMARK_H
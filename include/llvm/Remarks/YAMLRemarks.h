@@ -0,0 +1,75 @@
+//===- YAMLRemarks.h - YAML optimization remark files -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Reading and writing optimization remark files in the YAML format that
+// -pass-remarks-output produces by default.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_REMARKS_YAMLREMARKS_H
+#define LLVM_REMARKS_YAMLREMARKS_H
+
+#include "llvm/Remarks/Remark.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/YAMLParser.h"
+#include "llvm/Support/YAMLTraits.h"
+#include <memory>
+#include <vector>
+
+namespace llvm {
+namespace remarks {
+
+/// Writes remarks as a stream of YAML documents, one per remark.
+class YAMLRemarkSerializer {
+public:
+  explicit YAMLRemarkSerializer(raw_ostream &OS);
+
+  /// Appends \p R to the file.
+  void emit(const Remark &R);
+
+private:
+  yaml::Output Out;
+};
+
+/// Parses a buffer holding a YAML remark file. Documents that are not
+/// mappings are skipped, as are keys that do not belong to a remark.
+class YAMLRemarkParser {
+public:
+  explicit YAMLRemarkParser(StringRef Buffer);
+
+  /// Parses the next remark. Returns null at the end of the buffer. The
+  /// returned remark is valid until the next call, while its strings live as
+  /// long as the parser and the buffer.
+  Expected<const Remark *> next();
+
+private:
+  Error parseRemark(yaml::MappingNode &Root);
+  Error parseLocation(yaml::Node &Node, RemarkLocation &Loc);
+  Error parseArgument(yaml::Node &Node);
+  Expected<StringRef> parseStr(yaml::Node &Node);
+  Expected<unsigned> parseUnsigned(yaml::Node &Node);
+  Error error(const Twine &Message, yaml::Node &Node);
+
+  SourceMgr SM;
+  std::string LastError;
+  std::unique_ptr<yaml::Stream> Stream;
+  yaml::document_iterator Doc;
+  BumpPtrAllocator Alloc;
+  StringSaver Saver{Alloc};
+  std::vector<Argument> Args;
+  Remark Current;
+};
+
+} // end namespace remarks
+} // end namespace llvm
+
+#endif // LLVM_REMARKS_YAMLREMARKS_H
@@ -38,13 +38,14 @@ FunctionPass *createExpandLargeIntegersPass();
 FunctionPass *createExpandStructRegsPass();
 FunctionPass *createInsertDivideCheckPass();
 FunctionPass *createNormalizeAlignmentPass();
+FunctionPass *createPromoteIntegersPass();
 FunctionPass *createRemoveAsmMemoryPass();
 FunctionPass *createResolvePNaClIntrinsicsPass();
 ModulePass *createAddPNaClExternalDeclsPass();
 ModulePass *createCanonicalizeMemIntrinsicsPass();
 ModulePass *createCleanupUsedGlobalsMetadataPass();
 ModulePass *createExpandArithWithOverflowPass();
-ModulePass *createExpandByValPass();
+ModulePass *createExpandByValPass(bool ScalarizeSmallStructs = false);
 ModulePass *createExpandCtorsPass();
 ModulePass *createExpandIndirectBrPass();
 ModulePass *createExpandSmallArgumentsPass();
@@ -56,7 +57,7 @@ ModulePass *createGlobalCleanupPass();
 ModulePass *createGlobalizeConstantVectorsPass();
 ModulePass *createInternalizeUsedGlobalsPass();
 ModulePass *createPNaClSjLjEHPass();
-ModulePass *createPromoteIntegersPass();
+ModulePass *createPromoteIntegerSignaturesPass();
 ModulePass *createReplacePtrsWithIntsPass();
 ModulePass *createResolveAliasesPass();
 ModulePass *createRewriteAtomicsPass();
@@ -41,6 +41,7 @@ class DominatorTree;
 class Function;
 class Instruction;
 class InvokeInst;
+class LLVMContext;
 class Loop;
 class LoopInfo;
 class Module;
@@ -60,6 +61,18 @@ std::unique_ptr<Module>
 CloneModule(const Module *M, ValueToValueMapTy &VMap,
             function_ref<bool(const GlobalValue *)> ShouldCloneDefinition);
 
+/// Return a copy of the specified module that lives in the context \p Ctx,
+/// rebuilding types, constants, attributes and metadata there directly
+/// instead of round-tripping through bitcode. \p M is only read, so once the
+/// copy exists the two modules can be used from different threads.
+///
+/// Returns nullptr if \p M contains something that cannot be rebuilt in
+/// another context yet: metadata other than generic tuples (for instance
+/// debug info), uniqued metadata cycles or operand bundles. Callers should
+/// fall back to a bitcode round trip in that case.
+std::unique_ptr<Module> CloneModuleIntoContext(const Module &M,
+                                               LLVMContext &Ctx);
+
 /// ClonedCodeInfo - This struct can be used to capture information about code
 /// being cloned, while it is being cloned.
 struct ClonedCodeInfo {
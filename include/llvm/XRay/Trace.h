@@ -14,8 +14,10 @@
 #define LLVM_XRAY_TRACE_H
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
@@ -65,6 +67,119 @@ public:
 /// |Filename|.
 Expected<Trace> loadTraceFile(StringRef Filename, bool Sort = false);
 
+class TraceRecordReader;
+
+/// A trace file that is mapped into memory and decoded on demand, so that
+/// tools can make a pass over traces that are larger than the memory they
+/// have. Opening the file only indexes the runs of records that belong to one
+/// thread, which are the thread buffers of FDR mode logs.
+///
+/// Example usage:
+///
+///   auto FileOrErr = openTraceFile("xray-log.something.xray");
+///   if (!FileOrErr) {
+///     // Handle the error here.
+///   }
+///   for (uint32_t TId : (*FileOrErr)->threads()) {
+///     TraceRecordReader Reader = (*FileOrErr)->records(TId);
+///     while (true) {
+///       Expected<const XRayRecord *> Record = Reader.next();
+///       // Handle errors, stop at null, or do something with the record.
+///     }
+///   }
+///
+class TraceFile {
+public:
+  /// A run of consecutive records in the file that belong to one thread. For
+  /// binary logs this is a range of bytes, for YAML logs a range of records.
+  struct ThreadBuffer {
+    uint64_t Offset;
+    uint64_t Size;
+    uint32_t TId;
+  };
+
+  /// Provides access to the XRay trace file header.
+  const XRayFileHeader &getFileHeader() const { return FileHeader; }
+
+  /// The thread buffers in the order in which they appear in the file.
+  ArrayRef<ThreadBuffer> buffers() const { return Buffers; }
+
+  /// The ids of the threads that have records, in the order in which they
+  /// first appear in the file.
+  ArrayRef<uint32_t> threads() const { return ThreadIds; }
+
+  /// Returns a reader over all records, in the order of the file.
+  TraceRecordReader records() const;
+
+  /// Returns a reader over the records of thread \p TId, in the order of the
+  /// file.
+  TraceRecordReader records(uint32_t TId) const;
+
+private:
+  friend Expected<std::unique_ptr<TraceFile>> openTraceFile(StringRef);
+  friend class TraceRecordReader;
+
+  enum class LogKind { Naive, FDR, YAML };
+
+  TraceFile(std::unique_ptr<sys::fs::mapped_file_region> Mapping)
+      : Mapping(std::move(Mapping)),
+        Data(this->Mapping->data(), this->Mapping->size()) {}
+
+  Error indexNaiveLog();
+  Error indexFDRLog();
+  Error indexYAMLLog();
+  /// Appends a buffer, or extends the last one if it is the preceding run of
+  /// records of the same thread.
+  void addBuffer(uint64_t Offset, uint64_t Size, uint32_t TId);
+  void groupBuffersByThread();
+
+  std::unique_ptr<sys::fs::mapped_file_region> Mapping;
+  StringRef Data;
+  LogKind Kind;
+  XRayFileHeader FileHeader;
+  std::vector<ThreadBuffer> Buffers;
+  /// The buffers ordered by thread, and the range of each thread in it.
+  std::vector<ThreadBuffer> BuffersByThread;
+  std::vector<std::pair<size_t, size_t>> ThreadRanges;
+  std::vector<uint32_t> ThreadIds;
+  /// YAML logs cannot be decoded incrementally, so they are loaded up front.
+  std::vector<XRayRecord> YAMLRecords;
+};
+
+/// Maps the trace file \p Filename into memory and indexes its thread
+/// buffers.
+Expected<std::unique_ptr<TraceFile>> openTraceFile(StringRef Filename);
+
+/// Decodes the records of a sequence of thread buffers one at a time.
+class TraceRecordReader {
+public:
+  TraceRecordReader(TraceRecordReader &&);
+  ~TraceRecordReader();
+
+  /// Decodes the next record. Returns null after the last record. The
+  /// returned record is valid until the next call.
+  Expected<const XRayRecord *> next();
+
+private:
+  friend class TraceFile;
+  struct FDRState;
+
+  TraceRecordReader(const TraceFile &File, ArrayRef<TraceFile::ThreadBuffer>);
+
+  Expected<bool> decodeNaiveRecord();
+  Expected<bool> decodeFDRRecord();
+  void startBuffer(const TraceFile::ThreadBuffer &Buffer);
+
+  const TraceFile &File;
+  ArrayRef<TraceFile::ThreadBuffer> Buffers;
+  /// The undecoded part of the current binary buffer.
+  StringRef Remaining;
+  /// The next and the end YAML record of the current buffer.
+  uint64_t YAMLIndex = 0, YAMLEnd = 0;
+  std::unique_ptr<FDRState> State;
+  XRayRecord Current;
+};
+
 } // namespace xray
 } // namespace llvm
 
@@ -21,6 +21,7 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ThreadPool.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/SplitModule.h"
 
 using namespace llvm;
@@ -49,6 +50,11 @@ std::unique_ptr<Module> llvm::splitCodeGen(
     return M;
   }
 
+  // Partitions cloned directly into their own contexts. These must outlive
+  // the thread pool below; each pair destroys its module before its context.
+  std::vector<std::pair<std::unique_ptr<LLVMContext>, std::unique_ptr<Module>>>
+      ClonedParts;
+
   // Create ThreadPool in nested scope so that threads will be joined
   // on destruction.
   {
@@ -59,11 +65,30 @@ std::unique_ptr<Module> llvm::splitCodeGen(
         std::move(M), OSs.size(),
         [&](std::unique_ptr<Module> MPart) {
           // We want to clone the module in a new context to multi-thread the
-          // codegen. We do it by serializing partition modules to bitcode
-          // (while still on the main thread, in order to avoid data races) and
-          // spinning up new threads which deserialize the partitions into
-          // separate contexts.
-          // FIXME: Provide a more direct way to do this in LLVM.
+          // codegen. Cloning reads the shared context, so it happens on the
+          // main thread to avoid data races; the clone is then handed to a
+          // worker thread which owns its context exclusively.
+          llvm::raw_pwrite_stream *ThreadOS = OSs[ThreadCount];
+          auto Ctx = llvm::make_unique<LLVMContext>();
+          if (std::unique_ptr<Module> MPartInCtx =
+                  CloneModuleIntoContext(*MPart, *Ctx)) {
+            if (!BCOSs.empty()) {
+              WriteBitcodeToFile(MPart.get(), *BCOSs[ThreadCount]);
+              BCOSs[ThreadCount]->flush();
+            }
+            ++ThreadCount;
+
+            Module *Part = MPartInCtx.get();
+            ClonedParts.emplace_back(std::move(Ctx), std::move(MPartInCtx));
+            CodegenThreadPool.async([TMFactory, FileType, ThreadOS, Part]() {
+              codegen(Part, *ThreadOS, TMFactory, FileType);
+            });
+            return;
+          }
+
+          // The partition contains metadata that cannot be rebuilt in another
+          // context directly (e.g. debug info), so serialize it to bitcode and
+          // let the worker thread deserialize it into a separate context.
           SmallString<0> BC;
           raw_svector_ostream BCOS(BC);
           WriteBitcodeToFile(MPart.get(), BCOS);
@@ -73,7 +98,7 @@ std::unique_ptr<Module> llvm::splitCodeGen(
             BCOSs[ThreadCount]->flush();
           }
 
-          llvm::raw_pwrite_stream *ThreadOS = OSs[ThreadCount++];
+          ++ThreadCount;
           // Enqueue the task
           CodegenThreadPool.async(
               [TMFactory, FileType, ThreadOS](const SmallString<0> &BC) {
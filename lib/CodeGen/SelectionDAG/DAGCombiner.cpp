@@ -129,14 +129,12 @@ namespace {
     ///
     /// The worklist will not contain duplicates but may contain null entries
     /// due to nodes being deleted from the underlying DAG.
-    SmallVector<SDNode *, 64> Worklist;
-
-    /// \brief Mapping from an SDNode to its position on the worklist.
     ///
-    /// This is used to find and remove nodes from the worklist (by nulling
-    /// them) when they are deleted from the underlying DAG. It relies on
-    /// stable indices of nodes within the worklist.
-    DenseMap<SDNode *, unsigned> WorklistMap;
+    /// Each node on the worklist records its (stable) position in
+    /// SDNode::CombinerWorklistIndex, which is used to find and remove nodes
+    /// from the worklist (by nulling them) when they are deleted from the
+    /// underlying DAG, without a side table.
+    SmallVector<SDNode *, 64> Worklist;
 
     /// \brief Set of nodes which have been combined (at least once).
     ///
@@ -182,21 +180,40 @@ namespace {
       if (N->getOpcode() == ISD::HANDLENODE)
         return;
 
-      if (WorklistMap.insert(std::make_pair(N, Worklist.size())).second)
-        Worklist.push_back(N);
+      if (N->getCombinerWorklistIndex() >= 0)
+        return; // Already in the worklist.
+
+      N->setCombinerWorklistIndex(Worklist.size());
+      Worklist.push_back(N);
     }
 
     /// Remove all instances of N from the worklist.
     void removeFromWorklist(SDNode *N) {
       CombinedNodes.erase(N);
 
-      auto It = WorklistMap.find(N);
-      if (It == WorklistMap.end())
+      int Index = N->getCombinerWorklistIndex();
+      if (Index < 0)
         return; // Not in the worklist.
 
       // Null out the entry rather than erasing it to avoid a linear operation.
-      Worklist[It->second] = nullptr;
-      WorklistMap.erase(It);
+      Worklist[Index] = nullptr;
+      N->setCombinerWorklistIndex(-1);
+    }
+
+    /// Pop the next node off the worklist, or return null if it is empty.
+    SDNode *getNextWorklistEntry() {
+      // The Worklist holds the SDNodes in order, but it may contain null
+      // entries.
+      SDNode *N = nullptr;
+      while (!N && !Worklist.empty())
+        N = Worklist.pop_back_val();
+
+      if (N) {
+        assert(N->getCombinerWorklistIndex() >= 0 &&
+               "Found a worklist entry without a corresponding index!");
+        N->setCombinerWorklistIndex(-1);
+      }
+      return N;
     }
 
     void deleteAndRecombine(SDNode *N);
@@ -1410,6 +1427,7 @@ void DAGCombiner::Run(CombineLevel AtLevel) {
   LegalTypes = Level >= AfterLegalizeTypes;
 
   // Add all the dag nodes to the worklist.
+  Worklist.reserve(DAG.allnodes_size());
   for (SDNode &Node : DAG.allnodes())
     AddToWorklist(&Node);
 
@@ -1419,18 +1437,7 @@ void DAGCombiner::Run(CombineLevel AtLevel) {
   HandleSDNode Dummy(DAG.getRoot());
 
   // While the worklist isn't empty, find a node and try to combine it.
-  while (!WorklistMap.empty()) {
-    SDNode *N;
-    // The Worklist holds the SDNodes in order, but it may contain null entries.
-    do {
-      N = Worklist.pop_back_val();
-    } while (!N);
-
-    bool GoodWorklistEntry = WorklistMap.erase(N);
-    (void)GoodWorklistEntry;
-    assert(GoodWorklistEntry &&
-           "Found a worklist entry without a corresponding map entry!");
-
+  while (SDNode *N = getNextWorklistEntry()) {
     // If N has no uses, it is dead.  Make sure to revisit all N's operands once
     // N is deleted from the DAG, since they too may now be dead or may have a
     // reduced number of uses, allowing other xforms.
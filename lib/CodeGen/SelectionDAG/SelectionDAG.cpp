@@ -23,6 +23,7 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/Analysis/ValueTracking.h"
@@ -89,6 +90,12 @@ void SelectionDAG::DAGUpdateListener::NodeUpdated(SDNode*) {}
 
 #define DEBUG_TYPE "selectiondag"
 
+STATISTIC(MaxDAGNodes, "Maximum number of nodes in a single SelectionDAG");
+// The operand allocator is reset per function rather than per block (see
+// init()), so this is the high-water mark over the DAGs of one function.
+STATISTIC(MaxDAGOperandMemory,
+          "Maximum bytes of operand storage allocated for one function");
+
 static void NewSDValueDbgMsg(SDValue V, StringRef Msg, SelectionDAG *G) {
   DEBUG(
     dbgs() << Msg;
@@ -910,6 +917,11 @@ void SelectionDAG::init(MachineFunction &NewMF,
   TLI = getSubtarget().getTargetLowering();
   TSI = getSubtarget().getSelectionDAGInfo();
   Context = &MF->getFunction().getContext();
+
+  // Operand storage is kept across the blocks of a function (see clear()), but
+  // not across functions, since shuffle masks are never recycled.
+  OperandRecycler.clear(OperandAllocator);
+  OperandAllocator.Reset();
 }
 
 SelectionDAG::~SelectionDAG() {
@@ -970,9 +982,14 @@ SDNode *SelectionDAG::FindNodeOrInsertPos(const FoldingSetNodeID &ID,
 }
 
 void SelectionDAG::clear() {
+  MaxDAGNodes.updateMax(AllNodes.size());
+  MaxDAGOperandMemory.updateMax(OperandAllocator.getTotalMemory());
+
+  // Deallocating the nodes returns them and their operand lists to the
+  // recyclers, so the next block of the function reuses the same memory
+  // instead of growing and releasing the allocators block after block. The
+  // CSE map keeps its bucket array for the same reason.
   allnodes_clear();
-  OperandRecycler.clear(OperandAllocator);
-  OperandAllocator.Reset();
   CSEMap.clear();
 
   ExtendedValueTypeNodes.clear();
@@ -648,6 +648,10 @@ void SelectionDAGISel::SelectBasicBlock(BasicBlock::const_iterator Begin,
   // Allow creating illegal types during DAG building for the basic block.
   CurDAG->NewNodesMustHaveLegalTypes = false;
 
+  // Lowering creates roughly two uniqued nodes per instruction; size the CSE
+  // map for that up front.
+  CurDAG->reserveNodes(2 * std::distance(Begin, End));
+
   // Lower the instructions. If a call is emitted as a tail call, cease emitting
   // nodes for this block.
   for (BasicBlock::const_iterator I = Begin; I != End && !SDB->HasTailCall; ++I) {
@@ -40,7 +40,12 @@ static cl::opt<bool> PrintVolatile("interpreter-print-volatile", cl::Hidden,
 //===----------------------------------------------------------------------===//
 
 static void SetValue(Value *V, GenericValue Val, ExecutionContext &SF) {
-  SF.Values[V] = Val;
+  SF.Values[SF.Code->getSlot(V)] = std::move(Val);
+}
+
+// getRefValue - Return the value a slot reference of a decoded op refers to.
+static const GenericValue &getRefValue(int Ref, const ExecutionContext &SF) {
+  return Ref >= 0 ? SF.Values[Ref] : SF.Code->Constants[~Ref];
 }
 
 //===----------------------------------------------------------------------===//
@@ -851,8 +856,11 @@ void Interpreter::popStackAndReturnValueToCaller(Type *RetTy,
     ExecutionContext &CallingSF = ECStack.back();
     if (Instruction *I = CallingSF.Caller.getInstruction()) {
       // Save result...
-      if (!CallingSF.Caller.getType()->isVoidTy())
-        SetValue(I, Result, CallingSF);
+      // The caller has already stepped past the op that made the call.
+      const DecodedOp &Call = CallingSF.Code->Ops[CallingSF.PC - 1];
+      assert(Call.I == I && "Returning to the wrong instruction!");
+      if (Call.Dest >= 0)
+        CallingSF.Values[Call.Dest] = std::move(Result);
       if (InvokeInst *II = dyn_cast<InvokeInst> (I))
         SwitchToNewBasicBlock (II->getNormalDest (), CallingSF);
       CallingSF.Caller = CallSite();          // We returned from the call...
@@ -917,42 +925,45 @@ void Interpreter::visitIndirectBrInst(IndirectBrInst &I) {
 }
 
 
-// SwitchToNewBasicBlock - This method is used to jump to a new basic block.
-// This function handles the actual updating of block and instruction iterators
-// as well as execution of all of the PHI nodes in the destination block.
+// takeEdge - Move execution along a CFG edge of the current function.  This
+// updates the block and op index of the frame and executes the PHI nodes of the
+// destination block, which have been decoded into moves along the edge.
 //
-// This method does this because all of the PHI nodes must be executed
-// atomically, reading their inputs before any of the results are updated.  Not
-// doing this can cause problems if the PHI nodes depend on other PHI nodes for
-// their inputs.  If the input PHI node is updated before it is read, incorrect
-// results can happen.  Thus we use a two phase approach.
+// All of the PHI nodes must be executed atomically, reading their inputs before
+// any of the results are updated.  Not doing this can cause problems if the PHI
+// nodes depend on other PHI nodes for their inputs.  If the input PHI node is
+// updated before it is read, incorrect results can happen.  The decoder flags
+// the edges where this can happen, and those use a two phase approach.
 //
-void Interpreter::SwitchToNewBasicBlock(BasicBlock *Dest, ExecutionContext &SF){
-  BasicBlock *PrevBB = SF.CurBB;      // Remember where we came from...
-  SF.CurBB   = Dest;                  // Update CurBB to branch destination
-  SF.CurInst = SF.CurBB->begin();     // Update new instruction ptr...
-
-  if (!isa<PHINode>(SF.CurInst)) return;  // Nothing fancy to do
-
-  // Loop over all of the PHI nodes in the current block, reading their inputs.
-  std::vector<GenericValue> ResultValues;
-
-  for (; PHINode *PN = dyn_cast<PHINode>(SF.CurInst); ++SF.CurInst) {
-    // Search for the value corresponding to this previous bb...
-    int i = PN->getBasicBlockIndex(PrevBB);
-    assert(i != -1 && "PHINode doesn't contain entry for predecessor??");
-    Value *IncomingValue = PN->getIncomingValue(i);
-
-    // Save the incoming value for this PHI node...
-    ResultValues.push_back(getOperandValue(IncomingValue, SF));
+static void takeEdge(const DecodedEdge &Edge, ExecutionContext &SF) {
+  SF.CurBB = Edge.Dest;
+  SF.PC = Edge.Target;
+
+  const std::pair<int, int> *Move = SF.Code->Moves.data() + Edge.FirstMove;
+  const std::pair<int, int> *End = Move + Edge.NumMoves;
+  if (!Edge.ParallelMoves) {
+    for (; Move != End; ++Move)
+      SF.Values[Move->first] = getRefValue(Move->second, SF);
+    return;
   }
 
-  // Now loop over all of the PHI nodes setting their values...
-  SF.CurInst = SF.CurBB->begin();
-  for (unsigned i = 0; isa<PHINode>(SF.CurInst); ++SF.CurInst, ++i) {
-    PHINode *PN = cast<PHINode>(SF.CurInst);
-    SetValue(PN, ResultValues[i], SF);
-  }
+  SmallVector<GenericValue, 8> ResultValues;
+  for (const std::pair<int, int> *M = Move; M != End; ++M)
+    ResultValues.push_back(getRefValue(M->second, SF));
+  for (unsigned i = 0; Move != End; ++Move, ++i)
+    SF.Values[Move->first] = std::move(ResultValues[i]);
+}
+
+// SwitchToNewBasicBlock - This method is used to jump to a new basic block
+// from the current block of SF by instructions that are not decoded into a
+// specialized branch op, such as invoke and indirectbr.
+//
+void Interpreter::SwitchToNewBasicBlock(BasicBlock *Dest, ExecutionContext &SF){
+  std::pair<unsigned, unsigned> Range = SF.Code->BlockEdges.lookup(SF.CurBB);
+  for (unsigned i = Range.first; i != Range.second; ++i)
+    if (SF.Code->Edges[i].Dest == Dest)
+      return takeEdge(SF.Code->Edges[i], SF);
+  llvm_unreachable("Branch to a block that is not a successor!");
 }
 
 //===----------------------------------------------------------------------===//
@@ -1082,28 +1093,9 @@ void Interpreter::visitCallSite(CallSite CS) {
       SetValue(CS.getInstruction(), getOperandValue(*CS.arg_begin(), SF), SF);
       return;
     default:
-      // If it is an unknown intrinsic function, use the intrinsic lowering
-      // class to transform it into hopefully tasty LLVM code.
-      //
-      BasicBlock::iterator me(CS.getInstruction());
-      BasicBlock *Parent = CS.getInstruction()->getParent();
-      bool atBegin(Parent->begin() == me);
-      if (!atBegin)
-        --me;
-      IL->LowerIntrinsicCall(cast<CallInst>(CS.getInstruction()));
-
-      // Restore the CurInst pointer to the first instruction newly inserted, if
-      // any.
-      if (atBegin) {
-        SF.CurInst = Parent->begin();
-      } else {
-        SF.CurInst = me;
-        ++SF.CurInst;
-      }
-      return;
+      llvm_unreachable("Intrinsic was not lowered when decoding the caller!");
     }
 
-
   SF.Caller = CS;
   std::vector<GenericValue> ArgVals;
   const unsigned NumArgs = SF.Caller.arg_size();
@@ -2061,8 +2053,344 @@ GenericValue Interpreter::getOperandValue(Value *V, ExecutionContext &SF) {
   } else if (GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
     return PTOGV(getPointerToGlobal(GV));
   } else {
-    return SF.Values[V];
+    return SF.Values[SF.Code->getSlot(V)];
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                            Function Decoding
+//===----------------------------------------------------------------------===//
+
+const DecodedFunction &Interpreter::getDecodedFunction(Function *F) {
+  std::unique_ptr<DecodedFunction> &Code = DecodedFunctions[F];
+  if (!Code)
+    Code = decodeFunction(F);
+  return *Code;
+}
+
+static bool isScalarFPTy(Type *Ty) {
+  return Ty->isFloatTy() || Ty->isDoubleTy();
+}
+
+// isLoadableTy - Return true if values of type Ty can be loaded and stored by
+// the specialized memory ops.
+static bool isLoadableTy(Type *Ty) {
+  return Ty->isIntegerTy() || Ty->isPointerTy() || isScalarFPTy(Ty);
+}
+
+std::unique_ptr<DecodedFunction> Interpreter::decodeFunction(Function *F) {
+  // Lower the intrinsics we do not implement before decoding, so that the
+  // decoded ops never refer to instructions the lowering replaces.  Lowering an
+  // intrinsic may introduce calls to others, so repeat until none are left.
+  SmallVector<CallInst *, 8> Intrinsics;
+  do {
+    Intrinsics.clear();
+    for (BasicBlock &BB : *F)
+      for (Instruction &I : BB)
+        if (CallInst *CI = dyn_cast<CallInst>(&I))
+          if (Function *Callee = CI->getCalledFunction())
+            switch (Callee->getIntrinsicID()) {
+            case Intrinsic::not_intrinsic:
+            case Intrinsic::vastart:
+            case Intrinsic::vaend:
+            case Intrinsic::vacopy:
+              break;
+            default:
+              Intrinsics.push_back(CI);
+              break;
+            }
+    for (CallInst *CI : Intrinsics)
+      IL->LowerIntrinsicCall(CI);
+  } while (!Intrinsics.empty());
+
+  auto Code = llvm::make_unique<DecodedFunction>();
+  for (Argument &A : F->args())
+    Code->Slots[&A] = Code->NumSlots++;
+  for (BasicBlock &BB : *F)
+    for (Instruction &I : BB)
+      if (!I.getType()->isVoidTy())
+        Code->Slots[&I] = Code->NumSlots++;
+
+  // Constants are evaluated in a frame of their own, they never refer to the
+  // slots of one.
+  ExecutionContext ConstantSF;
+  ConstantSF.Code = Code.get();
+  DenseMap<Value *, int> ConstantRefs;
+  auto getRef = [&](Value *V, int &Ref) {
+    auto Slot = Code->Slots.find(V);
+    if (Slot != Code->Slots.end()) {
+      Ref = Slot->second;
+      return true;
+    }
+    if (!isa<Constant>(V))
+      return false;
+    auto Inserted = ConstantRefs.insert({V, ~int(Code->Constants.size())});
+    if (Inserted.second)
+      Code->Constants.push_back(getOperandValue(V, ConstantSF));
+    Ref = Inserted.first->second;
+    return true;
+  };
+
+  // Create the edges leaving BB, with the moves that implement the PHI nodes
+  // of each successor.
+  auto addEdges = [&](BasicBlock &BB) {
+    unsigned FirstEdge = Code->Edges.size();
+    const TerminatorInst *TI = BB.getTerminator();
+    for (unsigned i = 0, e = TI->getNumSuccessors(); i != e; ++i) {
+      BasicBlock *Succ = TI->getSuccessor(i);
+      DecodedEdge Edge = {Succ, 0, unsigned(Code->Moves.size()), 0, false};
+      for (PHINode &PN : Succ->phis()) {
+        int Ref;
+        bool Decoded = getRef(PN.getIncomingValueForBlock(&BB), Ref);
+        assert(Decoded && "PHI node has an incoming value without a slot!");
+        (void)Decoded;
+        Code->Moves.push_back({int(Code->getSlot(&PN)), Ref});
+        ++Edge.NumMoves;
+      }
+      // Moves that read a PHI of Succ have to see its value from before the
+      // edge was taken.
+      for (unsigned M = Edge.FirstMove, ME = M + Edge.NumMoves; M != ME; ++M) {
+        int Src = Code->Moves[M].second;
+        for (unsigned D = Edge.FirstMove; D != ME; ++D)
+          Edge.ParallelMoves |= Src == Code->Moves[D].first;
+      }
+      Code->Edges.push_back(Edge);
+    }
+    Code->BlockEdges[&BB] = {FirstEdge, unsigned(Code->Edges.size())};
+    return FirstEdge;
+  };
+
+  // Select a specialized op for I.  Returns false if I has to be executed by
+  // its visit* method.
+  auto decodeOp = [&](Instruction &I, DecodedOp &Op, unsigned FirstEdge) {
+    switch (I.getOpcode()) {
+    case Instruction::Add:  Op.Kind = DecodedOp::Add;  break;
+    case Instruction::Sub:  Op.Kind = DecodedOp::Sub;  break;
+    case Instruction::Mul:  Op.Kind = DecodedOp::Mul;  break;
+    case Instruction::UDiv: Op.Kind = DecodedOp::UDiv; break;
+    case Instruction::SDiv: Op.Kind = DecodedOp::SDiv; break;
+    case Instruction::URem: Op.Kind = DecodedOp::URem; break;
+    case Instruction::SRem: Op.Kind = DecodedOp::SRem; break;
+    case Instruction::And:  Op.Kind = DecodedOp::And;  break;
+    case Instruction::Or:   Op.Kind = DecodedOp::Or;   break;
+    case Instruction::Xor:  Op.Kind = DecodedOp::Xor;  break;
+    case Instruction::Shl:  Op.Kind = DecodedOp::Shl;  break;
+    case Instruction::LShr: Op.Kind = DecodedOp::LShr; break;
+    case Instruction::AShr: Op.Kind = DecodedOp::AShr; break;
+    case Instruction::FAdd: Op.Kind = DecodedOp::FAdd; break;
+    case Instruction::FSub: Op.Kind = DecodedOp::FSub; break;
+    case Instruction::FMul: Op.Kind = DecodedOp::FMul; break;
+    case Instruction::FDiv: Op.Kind = DecodedOp::FDiv; break;
+    case Instruction::FRem: Op.Kind = DecodedOp::FRem; break;
+
+    case Instruction::ICmp: {
+      Type *Ty = I.getOperand(0)->getType();
+      if (!Ty->isIntegerTy() && !Ty->isPointerTy())
+        return false;
+      Op.Kind = Ty->isIntegerTy() ? DecodedOp::ICmp : DecodedOp::ICmpPtr;
+      Op.Flags = cast<ICmpInst>(I).getPredicate();
+      return getRef(I.getOperand(0), Op.Ops[0]) &&
+             getRef(I.getOperand(1), Op.Ops[1]);
+    }
+    case Instruction::FCmp: {
+      Type *Ty = I.getOperand(0)->getType();
+      if (!isScalarFPTy(Ty))
+        return false;
+      Op.Kind = DecodedOp::FCmp;
+      Op.Flags = cast<FCmpInst>(I).getPredicate();
+      Op.Aux = Ty->isDoubleTy();
+      return getRef(I.getOperand(0), Op.Ops[0]) &&
+             getRef(I.getOperand(1), Op.Ops[1]);
+    }
+    case Instruction::Select:
+      if (!I.getOperand(0)->getType()->isIntegerTy())
+        return false;
+      Op.Kind = DecodedOp::Select;
+      return getRef(I.getOperand(0), Op.Ops[0]) &&
+             getRef(I.getOperand(1), Op.Ops[1]) &&
+             getRef(I.getOperand(2), Op.Ops[2]);
+
+    case Instruction::Trunc:
+    case Instruction::ZExt:
+    case Instruction::SExt:
+      if (!I.getType()->isIntegerTy())
+        return false;
+      Op.Kind = I.getOpcode() == Instruction::Trunc  ? DecodedOp::Trunc
+                : I.getOpcode() == Instruction::ZExt ? DecodedOp::ZExt
+                                                     : DecodedOp::SExt;
+      Op.Aux = I.getType()->getIntegerBitWidth();
+      return getRef(I.getOperand(0), Op.Ops[0]);
+    case Instruction::BitCast: {
+      Type *SrcTy = I.getOperand(0)->getType();
+      if (!(SrcTy->isPointerTy() && I.getType()->isPointerTy()) &&
+          !(SrcTy->isIntegerTy() && I.getType()->isIntegerTy()))
+        return false;
+      Op.Kind = DecodedOp::Copy;
+      return getRef(I.getOperand(0), Op.Ops[0]);
+    }
+    case Instruction::PtrToInt:
+      if (!I.getType()->isIntegerTy())
+        return false;
+      Op.Kind = DecodedOp::PtrToInt;
+      Op.Aux = I.getType()->getIntegerBitWidth();
+      return getRef(I.getOperand(0), Op.Ops[0]);
+    case Instruction::IntToPtr:
+      if (!I.getType()->isPointerTy())
+        return false;
+      Op.Kind = DecodedOp::IntToPtr;
+      Op.Aux = getDataLayout().getPointerSizeInBits();
+      return getRef(I.getOperand(0), Op.Ops[0]);
+
+    case Instruction::Load: {
+      LoadInst &LI = cast<LoadInst>(I);
+      if ((LI.isVolatile() && PrintVolatile) || !isLoadableTy(LI.getType()))
+        return false;
+      Op.Kind = DecodedOp::Load;
+      Op.Ty = LI.getType();
+      return getRef(LI.getPointerOperand(), Op.Ops[0]);
+    }
+    case Instruction::Store: {
+      StoreInst &SI = cast<StoreInst>(I);
+      Type *Ty = SI.getValueOperand()->getType();
+      if ((SI.isVolatile() && PrintVolatile) || !isLoadableTy(Ty))
+        return false;
+      Op.Kind = DecodedOp::Store;
+      Op.Ty = Ty;
+      return getRef(SI.getValueOperand(), Op.Ops[0]) &&
+             getRef(SI.getPointerOperand(), Op.Ops[1]);
+    }
+    case Instruction::GetElementPtr: {
+      GetElementPtrInst &GEP = cast<GetElementPtrInst>(I);
+      if (GEP.getType()->isVectorTy() ||
+          !getRef(GEP.getPointerOperand(), Op.Ops[0]))
+        return false;
+      // Fold the constant indices into a single offset.
+      int64_t Offset = 0;
+      SmallVector<std::pair<int, int64_t>, 4> Indices;
+      for (gep_type_iterator GTI = gep_type_begin(GEP), E = gep_type_end(GEP);
+           GTI != E; ++GTI) {
+        if (StructType *STy = GTI.getStructTypeOrNull()) {
+          unsigned Index = cast<ConstantInt>(GTI.getOperand())->getZExtValue();
+          Offset += getDataLayout().getStructLayout(STy)->getElementOffset(Index);
+          continue;
+        }
+        if (!GTI.getOperand()->getType()->isIntegerTy())
+          return false;
+        int64_t Scale = getDataLayout().getTypeAllocSize(GTI.getIndexedType());
+        if (ConstantInt *CI = dyn_cast<ConstantInt>(GTI.getOperand())) {
+          Offset += Scale * CI->getSExtValue();
+          continue;
+        }
+        int Ref;
+        if (!getRef(GTI.getOperand(), Ref))
+          return false;
+        Indices.push_back({Ref, Scale});
+      }
+      Op.Kind = DecodedOp::GEP;
+      Op.Aux = Code->GEPOffsets.size();
+      Op.Ops[1] = Code->GEPIndices.size();
+      Op.Ops[2] = Indices.size();
+      Code->GEPOffsets.push_back(Offset);
+      Code->GEPIndices.insert(Code->GEPIndices.end(), Indices.begin(),
+                               Indices.end());
+      return true;
+    }
+
+    case Instruction::Br: {
+      BranchInst &BI = cast<BranchInst>(I);
+      Op.Aux = FirstEdge;
+      if (BI.isUnconditional()) {
+        Op.Kind = DecodedOp::Br;
+        return true;
+      }
+      Op.Kind = DecodedOp::CondBr;
+      return getRef(BI.getCondition(), Op.Ops[0]);
+    }
+    case Instruction::Switch: {
+      SwitchInst &SI = cast<SwitchInst>(I);
+      if (!getRef(SI.getCondition(), Op.Ops[0]))
+        return false;
+      Op.Kind = DecodedOp::Switch;
+      Op.Aux = FirstEdge; // The default destination is successor 0.
+      Op.Ops[1] = Code->Cases.size();
+      Op.Ops[2] = SI.getNumCases();
+      for (auto Case : SI.cases()) {
+        int Ref;
+        getRef(Case.getCaseValue(), Ref);
+        Code->Cases.push_back({Ref, FirstEdge + Case.getSuccessorIndex()});
+      }
+      return true;
+    }
+    case Instruction::Ret: {
+      ReturnInst &RI = cast<ReturnInst>(I);
+      Op.Kind = DecodedOp::Ret;
+      Op.Ty = Type::getVoidTy(RI.getContext());
+      if (Value *RV = RI.getReturnValue()) {
+        Op.Ty = RV->getType();
+        Op.Flags = 1;
+        return getRef(RV, Op.Ops[0]);
+      }
+      return true;
+    }
+    case Instruction::Call: {
+      CallSite CS(&I);
+      Function *Callee = CS.getCalledFunction();
+      if ((Callee && Callee->isIntrinsic()) ||
+          !getRef(CS.getCalledValue(), Op.Ops[0]))
+        return false;
+      SmallVector<int, 8> Args;
+      for (Value *Arg : CS.args()) {
+        int Ref;
+        if (!getRef(Arg, Ref))
+          return false;
+        Args.push_back(Ref);
+      }
+      Op.Kind = DecodedOp::Call;
+      Op.Aux = Code->CallArgs.size();
+      Op.Ops[1] = Args.size();
+      Code->CallArgs.insert(Code->CallArgs.end(), Args.begin(), Args.end());
+      return true;
+    }
+    default:
+      return false;
+    }
+
+    // Binary operators on scalar integers, floats and doubles.
+    Type *Ty = I.getType();
+    if (Op.Kind >= DecodedOp::FAdd ? !isScalarFPTy(Ty) : !Ty->isIntegerTy())
+      return false;
+    Op.Flags = Ty->isDoubleTy();
+    return getRef(I.getOperand(0), Op.Ops[0]) &&
+           getRef(I.getOperand(1), Op.Ops[1]);
+  };
+
+  DenseMap<const BasicBlock *, unsigned> BlockStart;
+  for (BasicBlock &BB : *F) {
+    BlockStart[&BB] = Code->Ops.size();
+    unsigned FirstEdge = addEdges(BB);
+    for (Instruction &I : BB) {
+      if (isa<PHINode>(I))
+        continue;
+      DecodedOp Op;
+      Op.Kind = DecodedOp::Generic;
+      Op.Flags = 0;
+      Op.Aux = 0;
+      Op.Dest = I.getType()->isVoidTy() ? -1 : int(Code->getSlot(&I));
+      Op.Ops[0] = Op.Ops[1] = Op.Ops[2] = 0;
+      Op.Ty = nullptr;
+      Op.I = &I;
+      if (!decodeOp(I, Op, FirstEdge))
+        Op.Kind = DecodedOp::Generic;
+      Code->Ops.push_back(Op);
+    }
   }
+  for (DecodedEdge &Edge : Code->Edges)
+    Edge.Target = BlockStart.lookup(Edge.Dest);
+
+  DEBUG(dbgs() << "Decoded '" << F->getName() << "': " << Code->Ops.size()
+               << " ops, " << Code->NumSlots << " slots, "
+               << Code->Constants.size() << " constants\n");
+  return Code;
 }
 
 //===----------------------------------------------------------------------===//
@@ -2089,36 +2417,274 @@ void Interpreter::callFunction(Function *F, ArrayRef<GenericValue> ArgVals) {
     return;
   }
 
-  // Get pointers to first LLVM BB & Instruction in function.
-  StackFrame.CurBB     = &F->front();
-  StackFrame.CurInst   = StackFrame.CurBB->begin();
+  // Start at the first op of the decoded body.
+  StackFrame.Code  = &getDecodedFunction(F);
+  StackFrame.CurBB = &F->front();
+  StackFrame.PC    = 0;
+  StackFrame.Values.resize(StackFrame.Code->NumSlots);
 
   // Run through the function arguments and initialize their values...
   assert((ArgVals.size() == F->arg_size() ||
          (ArgVals.size() > F->arg_size() && F->getFunctionType()->isVarArg()))&&
          "Invalid number of values passed to function invocation!");
 
-  // Handle non-varargs arguments...
+  // Handle non-varargs arguments, which occupy the first slots...
   unsigned i = 0;
-  for (Function::arg_iterator AI = F->arg_begin(), E = F->arg_end(); 
-       AI != E; ++AI, ++i)
-    SetValue(&*AI, ArgVals[i], StackFrame);
+  for (unsigned e = F->arg_size(); i != e; ++i)
+    StackFrame.Values[i] = ArgVals[i];
 
   // Handle varargs arguments...
   StackFrame.VarArgs.assign(ArgVals.begin()+i, ArgVals.end());
 }
 
+void Interpreter::executeCallOp(const DecodedOp &Op, ExecutionContext &SF) {
+  SF.Caller = CallSite(Op.I);
+  SmallVector<GenericValue, 8> ArgVals;
+  const int *Arg = SF.Code->CallArgs.data() + Op.Aux;
+  for (const int *E = Arg + Op.Ops[1]; Arg != E; ++Arg)
+    ArgVals.push_back(getRefValue(*Arg, SF));
 
-void Interpreter::run() {
-  while (!ECStack.empty()) {
-    // Interpret a single instruction & increment the "PC".
-    ExecutionContext &SF = ECStack.back();  // Current stack frame
-    Instruction &I = *SF.CurInst++;         // Increment before execute
-
-    // Track the number of dynamic instructions executed.
-    ++NumDynamicInsts;
+  // To handle indirect calls, we must get the pointer value from the argument
+  // and treat it as a function pointer.
+  callFunction((Function*)GVTOP(getRefValue(Op.Ops[0], SF)), ArgVals);
+}
 
-    DEBUG(dbgs() << "About to interpret: " << I);
-    visit(I);   // Dispatch to one of the visit* methods...
+void Interpreter::executeRetOp(const DecodedOp &Op, ExecutionContext &SF) {
+  GenericValue Result;
+  if (Op.Flags)
+    Result = getRefValue(Op.Ops[0], SF);
+  popStackAndReturnValueToCaller(Op.Ty, std::move(Result));
+}
+
+static bool evaluateICmp(unsigned Predicate, const APInt &Src1,
+                         const APInt &Src2) {
+  switch (Predicate) {
+  case ICmpInst::ICMP_EQ:  return Src1.eq(Src2);
+  case ICmpInst::ICMP_NE:  return Src1.ne(Src2);
+  case ICmpInst::ICMP_ULT: return Src1.ult(Src2);
+  case ICmpInst::ICMP_SLT: return Src1.slt(Src2);
+  case ICmpInst::ICMP_UGT: return Src1.ugt(Src2);
+  case ICmpInst::ICMP_SGT: return Src1.sgt(Src2);
+  case ICmpInst::ICMP_ULE: return Src1.ule(Src2);
+  case ICmpInst::ICMP_SLE: return Src1.sle(Src2);
+  case ICmpInst::ICMP_UGE: return Src1.uge(Src2);
+  case ICmpInst::ICMP_SGE: return Src1.sge(Src2);
+  default:
+    llvm_unreachable("Invalid integer predicate!");
+  }
+}
+
+static bool evaluateFCmp(unsigned Predicate, double Src1, double Src2) {
+  bool Unordered = Src1 != Src1 || Src2 != Src2;
+  switch (Predicate) {
+  case FCmpInst::FCMP_FALSE: return false;
+  case FCmpInst::FCMP_OEQ:   return Src1 == Src2;
+  case FCmpInst::FCMP_OGT:   return Src1 > Src2;
+  case FCmpInst::FCMP_OGE:   return Src1 >= Src2;
+  case FCmpInst::FCMP_OLT:   return Src1 < Src2;
+  case FCmpInst::FCMP_OLE:   return Src1 <= Src2;
+  case FCmpInst::FCMP_ONE:   return !Unordered && Src1 != Src2;
+  case FCmpInst::FCMP_ORD:   return !Unordered;
+  case FCmpInst::FCMP_UNO:   return Unordered;
+  case FCmpInst::FCMP_UEQ:   return Unordered || Src1 == Src2;
+  case FCmpInst::FCMP_UGT:   return Unordered || Src1 > Src2;
+  case FCmpInst::FCMP_UGE:   return Unordered || Src1 >= Src2;
+  case FCmpInst::FCMP_ULT:   return Unordered || Src1 < Src2;
+  case FCmpInst::FCMP_ULE:   return Unordered || Src1 <= Src2;
+  case FCmpInst::FCMP_UNE:   return Src1 != Src2;
+  case FCmpInst::FCMP_TRUE:  return true;
+  default:
+    llvm_unreachable("Invalid FCmp predicate!");
   }
 }
+
+// With GCC compatible compilers each op handler jumps straight to the handler
+// of the next op through a table of label addresses, which gives every handler
+// its own indirect branch to predict.  Elsewhere, handlers return to a switch.
+#if defined(__GNUC__)
+#define INTERPRETER_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+void Interpreter::run() {
+#ifdef INTERPRETER_THREADED_DISPATCH
+  static const void *const OpHandlers[] = {
+#define HANDLE_DECODED_OP(Name) &&Do##Name,
+#include "DecodedOps.def"
+  };
+#define DISPATCH() goto *OpHandlers[Op->Kind]
+#define HANDLER(Name) case DecodedOp::Name: Do##Name
+#else
+#define DISPATCH() goto Dispatch
+#define HANDLER(Name) case DecodedOp::Name
+#endif
+
+  // Interpret a single op & increment the "PC".  No handler may have a live
+  // object with a destructor when it dispatches, as the indirect jump would
+  // skip its cleanup.
+#define NEXT()                                                                 \
+  do {                                                                         \
+    Op = &SF->Code->Ops[SF->PC++];                                             \
+    ++NumDynamicInsts;                                                         \
+    DEBUG(dbgs() << "About to interpret: " << *Op->I);                         \
+    DISPATCH();                                                                \
+  } while (0)
+  // Continue with whichever frame is on top of the stack after a call or a
+  // return, which may also have reallocated the stack.
+#define RESUME()                                                               \
+  do {                                                                         \
+    if (ECStack.empty())                                                       \
+      return;                                                                  \
+    SF = &ECStack.back();                                                      \
+    NEXT();                                                                    \
+  } while (0)
+#define SRC(N) getRefValue(Op->Ops[N], *SF)
+#define DEST SF->Values[Op->Dest]
+#define FP_BINARY_OPERATOR(OP)                                                 \
+  if (Op->Flags)                                                               \
+    DEST.DoubleVal = SRC(0).DoubleVal OP SRC(1).DoubleVal;                     \
+  else                                                                         \
+    DEST.FloatVal = SRC(0).FloatVal OP SRC(1).FloatVal;                        \
+  NEXT()
+
+  ExecutionContext *SF;
+  const DecodedOp *Op;
+  RESUME();
+
+#ifndef INTERPRETER_THREADED_DISPATCH
+Dispatch:
+#endif
+  switch (Op->Kind) {
+  HANDLER(Generic):
+    visit(*Op->I);   // Dispatch to one of the visit* methods...
+    RESUME();
+
+  HANDLER(Add):  DEST.IntVal = SRC(0).IntVal + SRC(1).IntVal; NEXT();
+  HANDLER(Sub):  DEST.IntVal = SRC(0).IntVal - SRC(1).IntVal; NEXT();
+  HANDLER(Mul):  DEST.IntVal = SRC(0).IntVal * SRC(1).IntVal; NEXT();
+  HANDLER(UDiv): DEST.IntVal = SRC(0).IntVal.udiv(SRC(1).IntVal); NEXT();
+  HANDLER(SDiv): DEST.IntVal = SRC(0).IntVal.sdiv(SRC(1).IntVal); NEXT();
+  HANDLER(URem): DEST.IntVal = SRC(0).IntVal.urem(SRC(1).IntVal); NEXT();
+  HANDLER(SRem): DEST.IntVal = SRC(0).IntVal.srem(SRC(1).IntVal); NEXT();
+  HANDLER(And):  DEST.IntVal = SRC(0).IntVal & SRC(1).IntVal; NEXT();
+  HANDLER(Or):   DEST.IntVal = SRC(0).IntVal | SRC(1).IntVal; NEXT();
+  HANDLER(Xor):  DEST.IntVal = SRC(0).IntVal ^ SRC(1).IntVal; NEXT();
+  HANDLER(Shl):
+    DEST.IntVal = SRC(0).IntVal.shl(
+        getShiftAmount(SRC(1).IntVal.getZExtValue(), SRC(0).IntVal));
+    NEXT();
+  HANDLER(LShr):
+    DEST.IntVal = SRC(0).IntVal.lshr(
+        getShiftAmount(SRC(1).IntVal.getZExtValue(), SRC(0).IntVal));
+    NEXT();
+  HANDLER(AShr):
+    DEST.IntVal = SRC(0).IntVal.ashr(
+        getShiftAmount(SRC(1).IntVal.getZExtValue(), SRC(0).IntVal));
+    NEXT();
+
+  HANDLER(FAdd): FP_BINARY_OPERATOR(+);
+  HANDLER(FSub): FP_BINARY_OPERATOR(-);
+  HANDLER(FMul): FP_BINARY_OPERATOR(*);
+  HANDLER(FDiv): FP_BINARY_OPERATOR(/);
+  HANDLER(FRem):
+    if (Op->Flags)
+      DEST.DoubleVal = fmod(SRC(0).DoubleVal, SRC(1).DoubleVal);
+    else
+      DEST.FloatVal = fmod(SRC(0).FloatVal, SRC(1).FloatVal);
+    NEXT();
+
+  HANDLER(ICmp):
+    DEST.IntVal = APInt(1, evaluateICmp(Op->Flags, SRC(0).IntVal,
+                                        SRC(1).IntVal));
+    NEXT();
+  HANDLER(ICmpPtr):
+    // Pointers compare as unsigned addresses, whatever the predicate.
+    DEST.IntVal = APInt(1, evaluateICmp(
+        ICmpInst::getUnsignedPredicate(ICmpInst::Predicate(Op->Flags)),
+        APInt(64, uintptr_t(SRC(0).PointerVal)),
+        APInt(64, uintptr_t(SRC(1).PointerVal))));
+    NEXT();
+  HANDLER(FCmp):
+    if (Op->Aux)
+      DEST.IntVal = APInt(1, evaluateFCmp(Op->Flags, SRC(0).DoubleVal,
+                                          SRC(1).DoubleVal));
+    else
+      DEST.IntVal = APInt(1, evaluateFCmp(Op->Flags, SRC(0).FloatVal,
+                                          SRC(1).FloatVal));
+    NEXT();
+  HANDLER(Select):
+    DEST = SRC(0).IntVal == 0 ? SRC(2) : SRC(1);
+    NEXT();
+
+  HANDLER(Trunc): DEST.IntVal = SRC(0).IntVal.trunc(Op->Aux); NEXT();
+  HANDLER(ZExt):  DEST.IntVal = SRC(0).IntVal.zext(Op->Aux); NEXT();
+  HANDLER(SExt):  DEST.IntVal = SRC(0).IntVal.sext(Op->Aux); NEXT();
+  HANDLER(Copy):  DEST = SRC(0); NEXT();
+  HANDLER(PtrToInt):
+    DEST.IntVal = APInt(Op->Aux, (intptr_t)SRC(0).PointerVal);
+    NEXT();
+  HANDLER(IntToPtr):
+    DEST.PointerVal = PointerTy(
+        intptr_t(SRC(0).IntVal.zextOrTrunc(Op->Aux).getZExtValue()));
+    NEXT();
+
+  HANDLER(Load):
+    LoadValueFromMemory(DEST, (GenericValue *)SRC(0).PointerVal, Op->Ty);
+    NEXT();
+  HANDLER(Store):
+    StoreValueToMemory(SRC(0), (GenericValue *)SRC(1).PointerVal, Op->Ty);
+    NEXT();
+  HANDLER(GEP): {
+    int64_t Total = SF->Code->GEPOffsets[Op->Aux];
+    const std::pair<int, int64_t> *Index =
+        SF->Code->GEPIndices.data() + Op->Ops[1];
+    for (const std::pair<int, int64_t> *E = Index + Op->Ops[2]; Index != E;
+         ++Index)
+      Total += getRefValue(Index->first, *SF).IntVal.getSExtValue() *
+               Index->second;
+    DEBUG(dbgs() << "GEP Index " << Total << " bytes.\n");
+    DEST.PointerVal = (char *)SRC(0).PointerVal + Total;
+    NEXT();
+  }
+
+  HANDLER(Br):
+    takeEdge(SF->Code->Edges[Op->Aux], *SF);
+    NEXT();
+  HANDLER(CondBr):
+    // Successor 0 is taken if the condition is true, successor 1 otherwise.
+    takeEdge(SF->Code->Edges[Op->Aux + (SRC(0).IntVal == 0)], *SF);
+    NEXT();
+  HANDLER(Switch): {
+    const DecodedFunction &Code = *SF->Code;
+    const APInt &Cond = SRC(0).IntVal;
+    unsigned Edge = Op->Aux;   // No cases matched: use default
+    for (unsigned i = Op->Ops[1], e = i + Op->Ops[2]; i != e; ++i)
+      if (getRefValue(Code.Cases[i].first, *SF).IntVal == Cond) {
+        Edge = Code.Cases[i].second;
+        break;
+      }
+    takeEdge(Code.Edges[Edge], *SF);
+    NEXT();
+  }
+  HANDLER(Ret):
+    executeRetOp(*Op, *SF);
+    RESUME();
+  HANDLER(Call):
+    executeCallOp(*Op, *SF);
+    RESUME();
+  }
+  llvm_unreachable("Invalid decoded op!");
+
+#undef FP_BINARY_OPERATOR
+#undef DEST
+#undef SRC
+#undef RESUME
+#undef NEXT
+#undef HANDLER
+#undef DISPATCH
+}
+
+#ifdef INTERPRETER_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
@@ -14,6 +14,7 @@
 #ifndef LLVM_LIB_EXECUTIONENGINE_INTERPRETER_INTERPRETER_H
 #define LLVM_LIB_EXECUTIONENGINE_INTERPRETER_INTERPRETER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/IR/CallSite.h"
@@ -55,20 +56,79 @@ public:
 
 typedef std::vector<GenericValue> ValuePlaneTy;
 
+// DecodedOp - One instruction of a function in the form the interpreter loop
+// executes it.  Operands are slot references: a non-negative reference indexes
+// the values of the executing frame, a negative reference ~N indexes the
+// constant pool of the function.  Instructions that have no specialized
+// handler are decoded as Generic ops and dispatched through InstVisitor.
+//
+struct DecodedOp {
+  enum OpKind : uint8_t {
+#define HANDLE_DECODED_OP(Name) Name,
+#include "DecodedOps.def"
+  };
+
+  OpKind Kind;
+  uint8_t Flags;      // Compare predicate, or 1 for double precision FP ops
+  unsigned Aux;       // Bit width, or first index into a DecodedFunction table
+  int Dest;           // Slot of the result, -1 if the instruction has none
+  int Ops[3];         // Slot references of the operands
+  Type *Ty;           // Type loaded, stored or returned
+  Instruction *I;     // The instruction this op was decoded from
+};
+
+// DecodedEdge - A CFG edge of a decoded function, with the PHI nodes of the
+// destination block resolved into moves from slot references to PHI slots.
+//
+struct DecodedEdge {
+  BasicBlock *Dest;
+  unsigned Target;        // Index of the first non-PHI op of Dest
+  unsigned FirstMove;     // Range of this edge in DecodedFunction::Moves
+  unsigned NumMoves;
+  bool ParallelMoves;     // Some move reads a PHI that the edge writes
+};
+
+// DecodedFunction - The decoded form of a function body.  Arguments and
+// instructions with a value are numbered densely so that a stack frame holds
+// them in a flat array, and constants are evaluated once into a pool.
+//
+struct DecodedFunction {
+  std::vector<DecodedOp> Ops;
+  std::vector<GenericValue> Constants;
+  std::vector<DecodedEdge> Edges;
+  std::vector<std::pair<int, int>> Moves;         // (PHI slot, incoming ref)
+  std::vector<int> CallArgs;                      // Argument refs of calls
+  std::vector<std::pair<int, unsigned>> Cases;    // (case ref, edge) of switches
+  std::vector<std::pair<int, int64_t>> GEPIndices; // (index ref, scale)
+  std::vector<int64_t> GEPOffsets;                // Constant part of each GEP
+  DenseMap<const Value *, unsigned> Slots;
+  // Edges leaving each block, in the successor order of its terminator.
+  DenseMap<const BasicBlock *, std::pair<unsigned, unsigned>> BlockEdges;
+  unsigned NumSlots = 0;
+
+  unsigned getSlot(const Value *V) const {
+    auto I = Slots.find(V);
+    assert(I != Slots.end() && "Value has no slot in this function!");
+    return I->second;
+  }
+};
+
 // ExecutionContext struct - This struct represents one stack frame currently
 // executing.
 //
 struct ExecutionContext {
   Function             *CurFunction;// The currently executing function
   BasicBlock           *CurBB;      // The currently executing BB
-  BasicBlock::iterator  CurInst;    // The next instruction to execute
+  const DecodedFunction *Code;      // The decoded body of CurFunction
+  unsigned              PC;         // Index of the next op to execute in Code
   CallSite             Caller;     // Holds the call that called subframes.
                                    // NULL if main func or debugger invoked fn
-  std::map<Value *, GenericValue> Values; // LLVM values used in this invocation
+  ValuePlaneTy         Values;     // Slots of the values of this invocation
   std::vector<GenericValue>  VarArgs; // Values passed through an ellipsis
   AllocaHolder Allocas;            // Track memory allocated by alloca
 
-  ExecutionContext() : CurFunction(nullptr), CurBB(nullptr), CurInst(nullptr) {}
+  ExecutionContext()
+      : CurFunction(nullptr), CurBB(nullptr), Code(nullptr), PC(0) {}
 };
 
 // Interpreter - This class represents the entirety of the interpreter.
@@ -85,6 +145,9 @@ class Interpreter : public ExecutionEngine, public InstVisitor<Interpreter> {
   // registered with the atexit() library function.
   std::vector<Function*> AtExitHandlers;
 
+  // The decoded bodies of the functions called so far.
+  DenseMap<Function *, std::unique_ptr<DecodedFunction>> DecodedFunctions;
+
 public:
   explicit Interpreter(std::unique_ptr<Module> M);
   ~Interpreter() override;
@@ -194,6 +257,13 @@ private:  // Helper functions
   //
   void SwitchToNewBasicBlock(BasicBlock *Dest, ExecutionContext &SF);
 
+  // getDecodedFunction - Return the decoded body of F, decoding it on first
+  // use.  Decoding lowers the intrinsic calls in F that the interpreter does
+  // not implement itself.
+  //
+  const DecodedFunction &getDecodedFunction(Function *F);
+  std::unique_ptr<DecodedFunction> decodeFunction(Function *F);
+
   void *getPointerToFunction(Function *F) override { return (void*)F; }
 
   void initializeExecutionEngine() { }
@@ -227,6 +297,8 @@ private:  // Helper functions
   GenericValue executeCastOperation(Instruction::CastOps opcode, Value *SrcVal, 
                                     Type *Ty, ExecutionContext &SF);
   void popStackAndReturnValueToCaller(Type *RetTy, GenericValue Result);
+  void executeCallOp(const DecodedOp &Op, ExecutionContext &SF);
+  void executeRetOp(const DecodedOp &Op, ExecutionContext &SF);
 
 };
 
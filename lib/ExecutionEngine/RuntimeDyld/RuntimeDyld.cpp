@@ -19,9 +19,12 @@
 #include "RuntimeDyldMachO.h"
 #include "llvm/Object/COFF.h"
 #include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 
 using namespace llvm;
 using namespace llvm::object;
@@ -117,6 +120,14 @@ static void dumpSectionMemory(const SectionEntry &S, StringRef State) {
 }
 #endif
 
+// Resolving section relocations concurrently only pays off when every thread
+// gets at least this many of them.
+static cl::opt<unsigned> ConcurrentRelocationsPerThread(
+    "rtdyld-concurrent-relocations-per-thread",
+    cl::desc("Minimum number of relocations per thread when resolving "
+             "section relocations concurrently"),
+    cl::init(16384), cl::Hidden);
+
 // Resolve the relocations for all symbols we currently know about.
 void RuntimeDyldImpl::resolveRelocations() {
   MutexGuard locked(lock);
@@ -133,18 +144,24 @@ void RuntimeDyldImpl::resolveRelocations() {
     ErrorStr = toString(std::move(Err));
   }
 
-  // Iterate over all outstanding relocations
-  for (auto it = Relocations.begin(), e = Relocations.end(); it != e; ++it) {
-    // The Section here (Sections[i]) refers to the section in which the
-    // symbol for the relocation is located.  The SectionID in the relocation
-    // entry provides the section to which the relocation will be applied.
-    int Idx = it->first;
-    uint64_t Addr = Sections[Idx].getLoadAddress();
-    DEBUG(dbgs() << "Resolving relocations Section #" << Idx << "\t"
-                 << format("%p", (uintptr_t)Addr) << "\n");
-    resolveRelocationList(it->second, Addr);
+  // Iterate over all outstanding relocations. Each list only writes to the
+  // memory of its own section, so large objects resolve the lists
+  // concurrently unless the target's relocations reach into other sections.
+  unsigned PerThread = std::max(1u, unsigned(ConcurrentRelocationsPerThread));
+  unsigned NumThreads = std::min<size_t>(heavyweight_hardware_concurrency(),
+                                         NumSectionRelocations / PerThread);
+  if (NumThreads > 1 && canResolveSectionsConcurrently() && !DebugFlag) {
+    ThreadPool Pool(NumThreads);
+    for (const auto &Relocs : Relocations)
+      if (!Relocs.empty())
+        Pool.async([this, &Relocs]() { resolveSectionRelocations(Relocs); });
+    Pool.wait();
+  } else {
+    for (const auto &Relocs : Relocations)
+      resolveSectionRelocations(Relocs);
   }
   Relocations.clear();
+  NumSectionRelocations = 0;
 
   // Print out sections after relocation.
   DEBUG(
@@ -839,7 +856,10 @@ RuntimeDyldImpl::findOrEmitSection(const ObjectFile &Obj,
 
 void RuntimeDyldImpl::addRelocationForSection(const RelocationEntry &RE,
                                               unsigned SectionID) {
-  Relocations[SectionID].push_back(RE);
+  if (RE.SectionID >= Relocations.size())
+    Relocations.resize(std::max<size_t>(RE.SectionID + 1, Sections.size()));
+  Relocations[RE.SectionID].push_back({RE, SectionID});
+  ++NumSectionRelocations;
 }
 
 void RuntimeDyldImpl::addRelocationForSymbol(const RelocationEntry &RE,
@@ -855,7 +875,7 @@ void RuntimeDyldImpl::addRelocationForSymbol(const RelocationEntry &RE,
     RelocationEntry RECopy = RE;
     const auto &SymInfo = Loc->second;
     RECopy.Addend += SymInfo.getOffset();
-    Relocations[SymInfo.getSectionID()].push_back(RECopy);
+    addRelocationForSection(RECopy, SymInfo.getSectionID());
   }
 }
 
@@ -996,85 +1016,113 @@ void RuntimeDyldImpl::resolveRelocationList(const RelocationList &Relocs,
   }
 }
 
+void RuntimeDyldImpl::resolveSectionRelocations(
+    const SectionRelocationList &Relocs) {
+  if (Relocs.empty())
+    return;
+  // Ignore relocations for sections that were not loaded
+  if (Sections[Relocs.front().RE.SectionID].getAddress() == nullptr)
+    return;
+  DEBUG(dbgs() << "Resolving relocations to Section #"
+               << Relocs.front().RE.SectionID << "\n");
+  for (const auto &R : Relocs) {
+    // The value is the load address of the section holding the relocation's
+    // symbol; the offset of the symbol is already part of the addend.
+    uint64_t Value = 0;
+    if (R.ValueSectionID != AbsoluteSymbolSection)
+      Value = Sections[R.ValueSectionID].getLoadAddress();
+    resolveRelocation(R.RE, Value);
+  }
+}
+
 Error RuntimeDyldImpl::resolveExternalSymbols() {
+  // Resolving a symbol may load additional modules, which may add new entries
+  // to the ExternalSymbolRelocations map, so take the pending relocations in
+  // batches until no more arrive. Walking each batch once rather than
+  // repeatedly erasing the first entry of the map keeps this linear in the
+  // number of symbols.
   while (!ExternalSymbolRelocations.empty()) {
-    StringMap<RelocationList>::iterator i = ExternalSymbolRelocations.begin();
-
-    StringRef Name = i->first();
-    if (Name.size() == 0) {
-      // This is an absolute symbol, use an address of zero.
-      DEBUG(dbgs() << "Resolving absolute relocations."
-                   << "\n");
-      RelocationList &Relocs = i->second;
-      resolveRelocationList(Relocs, 0);
-    } else {
-      uint64_t Addr = 0;
-      JITSymbolFlags Flags;
-      RTDyldSymbolTable::const_iterator Loc = GlobalSymbolTable.find(Name);
-      if (Loc == GlobalSymbolTable.end()) {
-        // This is an external symbol, try to get its address from the symbol
-        // resolver.
-        // First search for the symbol in this logical dylib.
-        if (auto Sym = Resolver.findSymbolInLogicalDylib(Name.data())) {
-          if (auto AddrOrErr = Sym.getAddress()) {
-            Addr = *AddrOrErr;
-            Flags = Sym.getFlags();
-          } else
-            return AddrOrErr.takeError();
-        } else if (auto Err = Sym.takeError())
-          return Err;
-
-        // If that fails, try searching for an external symbol.
-        if (!Addr) {
-          if (auto Sym = Resolver.findSymbol(Name.data())) {
-            if (auto AddrOrErr = Sym.getAddress()) {
-              Addr = *AddrOrErr;
-              Flags = Sym.getFlags();
-            } else
-              return AddrOrErr.takeError();
-          } else if (auto Err = Sym.takeError())
-            return Err;
+    StringMap<RelocationList> Batch = std::move(ExternalSymbolRelocations);
+    for (auto I = Batch.begin(), E = Batch.end(); I != E; ++I)
+      if (auto Err = resolveExternalSymbol(I->first(), I->second)) {
+        // Keep the unresolved relocations for a later attempt.
+        for (; I != E; ++I) {
+          RelocationList &Relocs = ExternalSymbolRelocations[I->first()];
+          Relocs.append(I->second.begin(), I->second.end());
         }
-        // The call to getSymbolAddress may have caused additional modules to
-        // be loaded, which may have added new entries to the
-        // ExternalSymbolRelocations map.  Consquently, we need to update our
-        // iterator.  This is also why retrieval of the relocation list
-        // associated with this symbol is deferred until below this point.
-        // New entries may have been added to the relocation list.
-        i = ExternalSymbolRelocations.find(Name);
-      } else {
-        // We found the symbol in our global table.  It was probably in a
-        // Module that we loaded previously.
-        const auto &SymInfo = Loc->second;
-        Addr = getSectionLoadAddress(SymInfo.getSectionID()) +
-               SymInfo.getOffset();
-        Flags = SymInfo.getFlags();
+        return Err;
       }
+  }
 
-      // FIXME: Implement error handling that doesn't kill the host program!
-      if (!Addr)
-        report_fatal_error("Program used external function '" + Name +
-                           "' which could not be resolved!");
-
-      // If Resolver returned UINT64_MAX, the client wants to handle this symbol
-      // manually and we shouldn't resolve its relocations.
-      if (Addr != UINT64_MAX) {
-
-        // Tweak the address based on the symbol flags if necessary.
-        // For example, this is used by RuntimeDyldMachOARM to toggle the low bit
-        // if the target symbol is Thumb.
-        Addr = modifyAddressBasedOnFlags(Addr, Flags);
-
-        DEBUG(dbgs() << "Resolving relocations Name: " << Name << "\t"
-                     << format("0x%lx", Addr) << "\n");
-        // This list may have been updated when we called getSymbolAddress, so
-        // don't change this code to get the list earlier.
-        RelocationList &Relocs = i->second;
-        resolveRelocationList(Relocs, Addr);
-      }
+  return Error::success();
+}
+
+Error RuntimeDyldImpl::resolveExternalSymbol(StringRef Name,
+                                             const RelocationList &Relocs) {
+  if (Name.size() == 0) {
+    // This is an absolute symbol, use an address of zero.
+    DEBUG(dbgs() << "Resolving absolute relocations."
+                 << "\n");
+    resolveRelocationList(Relocs, 0);
+    return Error::success();
+  }
+
+  uint64_t Addr = 0;
+  JITSymbolFlags Flags;
+  RTDyldSymbolTable::const_iterator Loc = GlobalSymbolTable.find(Name);
+  if (Loc == GlobalSymbolTable.end()) {
+    // This is an external symbol, try to get its address from the symbol
+    // resolver.
+    // First search for the symbol in this logical dylib.
+    if (auto Sym = Resolver.findSymbolInLogicalDylib(Name.data())) {
+      if (auto AddrOrErr = Sym.getAddress()) {
+        Addr = *AddrOrErr;
+        Flags = Sym.getFlags();
+      } else
+        return AddrOrErr.takeError();
+    } else if (auto Err = Sym.takeError())
+      return Err;
+
+    // If that fails, try searching for an external symbol.
+    if (!Addr) {
+      if (auto Sym = Resolver.findSymbol(Name.data())) {
+        if (auto AddrOrErr = Sym.getAddress()) {
+          Addr = *AddrOrErr;
+          Flags = Sym.getFlags();
+        } else
+          return AddrOrErr.takeError();
+      } else if (auto Err = Sym.takeError())
+        return Err;
     }
+    // The call to getSymbolAddress may have caused additional modules to be
+    // loaded. Relocations they added against this symbol went to the
+    // ExternalSymbolRelocations map and are resolved with the next batch.
+  } else {
+    // We found the symbol in our global table.  It was probably in a
+    // Module that we loaded previously.
+    const auto &SymInfo = Loc->second;
+    Addr = getSectionLoadAddress(SymInfo.getSectionID()) +
+           SymInfo.getOffset();
+    Flags = SymInfo.getFlags();
+  }
+
+  // FIXME: Implement error handling that doesn't kill the host program!
+  if (!Addr)
+    report_fatal_error("Program used external function '" + Name +
+                       "' which could not be resolved!");
+
+  // If Resolver returned UINT64_MAX, the client wants to handle this symbol
+  // manually and we shouldn't resolve its relocations.
+  if (Addr != UINT64_MAX) {
+
+    // Tweak the address based on the symbol flags if necessary.
+    // For example, this is used by RuntimeDyldMachOARM to toggle the low bit
+    // if the target symbol is Thumb.
+    Addr = modifyAddressBasedOnFlags(Addr, Flags);
 
-    ExternalSymbolRelocations.erase(i);
+    DEBUG(dbgs() << "Resolving relocations Name: " << Name << "\t"
+                 << format("0x%lx", Addr) << "\n");
+    resolveRelocationList(Relocs, Addr);
   }
 
   return Error::success();
@@ -29,7 +29,7 @@
 #include "llvm/Support/SwapByteOrder.h"
 #include <map>
 #include <system_error>
-#include <unordered_map>
+#include <vector>
 
 using namespace llvm;
 using namespace llvm::object;
@@ -278,10 +278,18 @@ protected:
   // The symbol (or section) the relocation is sourced from is the Key
   // in the relocation list where it's stored.
   typedef SmallVector<RelocationEntry, 64> RelocationList;
-  // Relocations to sections already loaded. Indexed by SectionID which is the
-  // source of the address. The target where the address will be written is
-  // SectionID/Offset in the relocation itself.
-  std::unordered_map<unsigned, RelocationList> Relocations;
+
+  // A relocation whose value is the load address of a section.
+  struct SectionRelocation {
+    RelocationEntry RE;
+    unsigned ValueSectionID;
+  };
+  typedef std::vector<SectionRelocation> SectionRelocationList;
+  // Relocations to sections already loaded. Indexed by the SectionID in the
+  // relocation itself, i.e. the section the address will be written to, so
+  // that every list touches the memory of a single section.
+  std::vector<SectionRelocationList> Relocations;
+  size_t NumSectionRelocations = 0;
 
   // Relocations to external symbols that are not yet resolved.  Symbols are
   // external when they aren't found in the global symbol table of all loaded
@@ -418,6 +426,9 @@ protected:
   /// \brief Resolves relocations from Relocs list with address from Value.
   void resolveRelocationList(const RelocationList &Relocs, uint64_t Value);
 
+  /// \brief Resolves the relocations of one section to other sections.
+  void resolveSectionRelocations(const SectionRelocationList &Relocs);
+
   /// \brief A object file specific relocation resolver
   /// \param RE The relocation to be resolved
   /// \param Value Target symbol address to apply the relocation action
@@ -435,6 +446,10 @@ protected:
   /// \brief Resolve relocations to external symbols.
   Error resolveExternalSymbols();
 
+  /// \brief Look up the address of the external symbol Name once and resolve
+  ///        its relocations.
+  Error resolveExternalSymbol(StringRef Name, const RelocationList &Relocs);
+
   // \brief Compute an upper bound of the memory that is required to load all
   // sections
   Error computeTotalAllocSize(const ObjectFile &Obj,
@@ -465,6 +480,11 @@ protected:
     return true;    // Conservative answer
   }
 
+  // \brief Return true if resolveRelocation only writes to the section the
+  // relocation is applied to, so that the relocations of different sections
+  // can be resolved concurrently.
+  virtual bool canResolveSectionsConcurrently() const { return true; }
+
 public:
   RuntimeDyldImpl(RuntimeDyld::MemoryManager &MemMgr,
                   JITSymbolResolver &Resolver)
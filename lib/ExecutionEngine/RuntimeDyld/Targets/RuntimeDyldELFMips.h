@@ -28,6 +28,9 @@ public:
 
   void resolveRelocation(const RelocationEntry &RE, uint64_t Value) override;
 
+  // GOT relocations read and write the GOT of their section.
+  bool canResolveSectionsConcurrently() const override { return false; }
+
 protected:
   void resolveMIPSO32Relocation(const SectionEntry &Section, uint64_t Offset,
                                 uint32_t Value, uint32_t Type, int32_t Addend);
@@ -22,6 +22,7 @@
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Remarks/BinaryRemarks.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
@@ -167,6 +168,20 @@ void LLVMContext::setDiagnosticsOutputFile(std::unique_ptr<yaml::Output> F) {
   pImpl->DiagnosticsOutputFile = std::move(F);
 }
 
+remarks::BinaryRemarkSerializer *
+LLVMContext::getDiagnosticsBinaryOutputFile() {
+  return pImpl->DiagnosticsBinaryOutputFile.get();
+}
+
+void LLVMContext::setDiagnosticsBinaryOutputFile(
+    std::unique_ptr<remarks::BinaryRemarkSerializer> F) {
+  pImpl->DiagnosticsBinaryOutputFile = std::move(F);
+}
+
+bool LLVMContext::hasDiagnosticsOutputFile() const {
+  return pImpl->DiagnosticsOutputFile || pImpl->DiagnosticsBinaryOutputFile;
+}
+
 DiagnosticHandler::DiagnosticHandlerTy
 LLVMContext::getDiagnosticHandlerCallBack() const {
   return pImpl->DiagHandler->DiagHandlerCallback;
@@ -226,6 +241,58 @@ LLVMContext::getDiagnosticMessagePrefix(DiagnosticSeverity Severity) {
   llvm_unreachable("Unknown DiagnosticSeverity");
 }
 
+static remarks::Type getRemarkType(int Kind) {
+  switch (Kind) {
+  case DK_OptimizationRemark:
+  case DK_MachineOptimizationRemark:
+    return remarks::Type::Passed;
+  case DK_OptimizationRemarkMissed:
+  case DK_MachineOptimizationRemarkMissed:
+    return remarks::Type::Missed;
+  case DK_OptimizationRemarkAnalysis:
+  case DK_MachineOptimizationRemarkAnalysis:
+    return remarks::Type::Analysis;
+  case DK_OptimizationRemarkAnalysisFPCommute:
+    return remarks::Type::AnalysisFPCommute;
+  case DK_OptimizationRemarkAnalysisAliasing:
+    return remarks::Type::AnalysisAliasing;
+  case DK_OptimizationFailure:
+    return remarks::Type::Failure;
+  default:
+    llvm_unreachable("Unknown remark type");
+  }
+}
+
+static remarks::RemarkLocation getRemarkLocation(const DiagnosticLocation &DL) {
+  remarks::RemarkLocation Loc;
+  if (DL.isValid()) {
+    Loc.File = DL.getFilename();
+    Loc.Line = DL.getLine();
+    Loc.Column = DL.getColumn();
+  }
+  return Loc;
+}
+
+/// Writes \p OptDiag to a binary remark file, with the same contents as the
+/// YAML mapping of DiagnosticInfoOptimizationBase.
+static void emitBinaryRemark(const DiagnosticInfoOptimizationBase &OptDiag,
+                             remarks::BinaryRemarkSerializer &Binary) {
+  SmallVector<remarks::Argument, 8> Args;
+  for (const DiagnosticInfoOptimizationBase::Argument &Arg : OptDiag.getArgs())
+    Args.push_back({Arg.Key, Arg.Val, getRemarkLocation(Arg.Loc)});
+
+  remarks::Remark R;
+  R.RemarkType = getRemarkType(OptDiag.getKind());
+  R.PassName = OptDiag.getPassName();
+  R.RemarkName = OptDiag.getRemarkName();
+  R.FunctionName =
+      GlobalValue::dropLLVMManglingEscape(OptDiag.getFunction().getName());
+  R.Loc = getRemarkLocation(OptDiag.getLocation());
+  R.Hotness = OptDiag.getHotness();
+  R.Args = Args;
+  Binary.emit(R);
+}
+
 void LLVMContext::diagnose(const DiagnosticInfo &DI) {
   if (auto *OptDiagBase = dyn_cast<DiagnosticInfoOptimizationBase>(&DI)) {
     yaml::Output *Out = getDiagnosticsOutputFile();
@@ -234,6 +301,9 @@ void LLVMContext::diagnose(const DiagnosticInfo &DI) {
       auto *P = const_cast<DiagnosticInfoOptimizationBase *>(OptDiagBase);
       *Out << P;
     }
+    if (remarks::BinaryRemarkSerializer *Binary =
+            getDiagnosticsBinaryOutputFile())
+      emitBinaryRemark(*OptDiagBase, *Binary);
   }
   // If there is a report handler, use it.
   if (pImpl->DiagHandler &&
@@ -37,6 +37,7 @@
 #include "llvm/Support/LEB128.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
@@ -68,6 +69,8 @@ STATISTIC(FragmentLayouts, "Number of fragment layouts");
 STATISTIC(ObjectBytes, "Number of emitted object file bytes");
 STATISTIC(RelaxationSteps, "Number of assembler layout and relaxation steps");
 STATISTIC(RelaxedInstructions, "Number of relaxed instructions");
+STATISTIC(SkippedRelaxationChecks,
+          "Number of relaxation checks skipped because no fixup target moved");
 STATISTIC(PaddingFragmentsRelaxations,
           "Number of Padding Fragments relaxations");
 STATISTIC(PaddingFragmentsBytes,
@@ -83,6 +86,184 @@ STATISTIC(PaddingFragmentsBytes,
 
 /* *** */
 
+/// Remembers, for every relaxable fragment that was last found not to need
+/// relaxation, the range of fragments (in layout order) whose sizes decide the
+/// values of its fixups. Every fragment whose size may have changed is stamped
+/// with the relaxation pass in which that happened, and a segment tree over
+/// those stamps tells in logarithmic time whether anything in such a range
+/// changed since the fragment was last checked. This lets layoutSectionOnce
+/// skip fragments whose fixup targets cannot have moved.
+class MCAssembler::RelaxationCache {
+  struct CheckedFragment {
+    /// The pass in which the fragment was last found not to need relaxation,
+    /// or 0 if it has to be checked again.
+    unsigned Pass = 0;
+    /// The half-open range of fragments the fixup values depend on.
+    unsigned Begin = 0;
+    unsigned End = 0;
+  };
+
+  struct SectionState {
+    /// The current relaxation pass over the section, counting from 1.
+    unsigned Pass = 0;
+    unsigned NumFragments = 0;
+    /// Segment tree holding the last pass in which each fragment may have
+    /// changed size. The leaves start at index NumFragments.
+    std::vector<unsigned> Changed;
+    std::vector<CheckedFragment> Checked;
+  };
+
+  std::vector<SectionState> Sections;
+
+  SectionState &getState(const MCFragment &F) {
+    return Sections[F.getParent()->getLayoutOrder()];
+  }
+
+public:
+  explicit RelaxationCache(const MCAsmLayout &Layout)
+      : Sections(Layout.getSectionOrder().size()) {
+    for (const MCSection *Sec : Layout.getSectionOrder()) {
+      SectionState &S = Sections[Sec->getLayoutOrder()];
+      S.NumFragments = Sec->getFragmentList().back().getLayoutOrder() + 1;
+      S.Changed.assign(2 * S.NumFragments, 0);
+      S.Checked.resize(S.NumFragments);
+    }
+  }
+
+  void beginPass(const MCSection &Sec) {
+    ++Sections[Sec.getLayoutOrder()].Pass;
+  }
+
+  /// Record that the size of \p F may have changed in the current pass.
+  void markChanged(const MCFragment &F) {
+    SectionState &S = getState(F);
+    for (unsigned I = S.NumFragments + F.getLayoutOrder(); I; I >>= 1)
+      S.Changed[I] = S.Pass;
+  }
+
+  /// Record that \p F did not need relaxation in the current pass, and that
+  /// this will not change until a fragment in [Begin, End) changes size.
+  void markStable(const MCFragment &F, unsigned Begin, unsigned End) {
+    SectionState &S = getState(F);
+    CheckedFragment &C = S.Checked[F.getLayoutOrder()];
+    C.Pass = S.Pass;
+    C.Begin = Begin;
+    C.End = End;
+  }
+
+  void forget(const MCFragment &F) {
+    getState(F).Checked[F.getLayoutOrder()].Pass = 0;
+  }
+
+  /// Check whether \p F was found not to need relaxation in an earlier pass
+  /// and none of the fragments its fixups depend on changed size since.
+  bool isStable(const MCFragment &F) {
+    SectionState &S = getState(F);
+    const CheckedFragment &C = S.Checked[F.getLayoutOrder()];
+    if (!C.Pass)
+      return false;
+
+    unsigned LastChange = 0;
+    for (unsigned Lo = S.NumFragments + C.Begin, Hi = S.NumFragments + C.End;
+         Lo < Hi; Lo >>= 1, Hi >>= 1) {
+      if (Lo & 1)
+        LastChange = std::max(LastChange, S.Changed[Lo++]);
+      if (Hi & 1)
+        LastChange = std::max(LastChange, S.Changed[--Hi]);
+    }
+    return LastChange < C.Pass;
+  }
+};
+
+/// Collect the layout order of the fragments defining the symbols referenced
+/// by \p Expr. Returns false if the value of \p Expr may depend on anything
+/// but the layout of \p Sec.
+static bool collectFixupFragments(const MCExpr &Expr, const MCSection &Sec,
+                                  SmallVectorImpl<unsigned> &Orders) {
+  switch (Expr.getKind()) {
+  case MCExpr::Constant:
+    return true;
+  case MCExpr::SymbolRef: {
+    const MCSymbol &Sym = cast<MCSymbolRefExpr>(Expr).getSymbol();
+    if (Sym.isVariable() || !Sym.isInSection(false) ||
+        &Sym.getSection(false) != &Sec)
+      return false;
+    Orders.push_back(Sym.getFragment(false)->getLayoutOrder());
+    return true;
+  }
+  case MCExpr::Unary:
+    return collectFixupFragments(*cast<MCUnaryExpr>(Expr).getSubExpr(), Sec,
+                                 Orders);
+  case MCExpr::Binary: {
+    const MCBinaryExpr &BE = cast<MCBinaryExpr>(Expr);
+    return collectFixupFragments(*BE.getLHS(), Sec, Orders) &&
+           collectFixupFragments(*BE.getRHS(), Sec, Orders);
+  }
+  case MCExpr::Target:
+    return false;
+  }
+  llvm_unreachable("Invalid assembly expression kind!");
+}
+
+/// Compute the half-open range of fragments whose sizes decide whether \p F
+/// needs relaxation. Returns false if that cannot be determined from the
+/// layout of the section of \p F alone.
+static bool getRelaxationDependencies(const MCAsmBackend &Backend,
+                                      const MCRelaxableFragment &F,
+                                      unsigned &Begin, unsigned &End) {
+  Begin = End = 0;
+  if (!Backend.mayNeedRelaxation(F.getInst()))
+    return true;
+
+  bool First = true;
+  for (const MCFixup &Fixup : F.getFixups()) {
+    SmallVector<unsigned, 4> Orders;
+    if (!collectFixupFragments(*Fixup.getValue(), *F.getParent(), Orders))
+      return false;
+
+    const MCFixupKindInfo &Info = Backend.getFixupKindInfo(Fixup.getKind());
+    bool IsPCRel = Info.Flags & MCFixupKindInfo::FKF_IsPCRel;
+    if (IsPCRel)
+      Orders.push_back(F.getLayoutOrder());
+    if (Orders.empty())
+      continue;
+
+    // A PC-relative reference to a single symbol only depends on the distance
+    // between the fixup and the symbol. Anything else may depend on offsets
+    // from the start of the section.
+    const MCExpr *Ref = Fixup.getValue();
+    if (const auto *BE = dyn_cast<MCBinaryExpr>(Ref))
+      if ((BE->getOpcode() == MCBinaryExpr::Add ||
+           BE->getOpcode() == MCBinaryExpr::Sub) &&
+          isa<MCConstantExpr>(BE->getRHS()))
+        Ref = BE->getLHS();
+    bool IsDistance = IsPCRel && isa<MCSymbolRefExpr>(Ref) &&
+                      !(Info.Flags & MCFixupKindInfo::FKF_IsAlignedDownTo32Bits);
+
+    auto MinMax = std::minmax_element(Orders.begin(), Orders.end());
+    unsigned FixupBegin = IsDistance ? *MinMax.first : 0;
+    unsigned FixupEnd = *MinMax.second;
+    Begin = First ? FixupBegin : std::min(Begin, FixupBegin);
+    End = First ? FixupEnd : std::max(End, FixupEnd);
+    First = false;
+  }
+  return true;
+}
+
+/// Check whether the size of \p F depends on its offset, and so may change
+/// whenever an earlier fragment is relaxed.
+static bool hasOffsetDependentSize(const MCFragment &F) {
+  switch (F.getKind()) {
+  case MCFragment::FT_Align:
+  case MCFragment::FT_Fill:
+  case MCFragment::FT_Org:
+  case MCFragment::FT_Padding:
+    return true;
+  default:
+    return false;
+  }
+}
+
 MCAssembler::MCAssembler(MCContext &Context, MCAsmBackend &Backend,
                          MCCodeEmitter &Emitter, MCObjectWriter &Writer)
     : Context(Context), Backend(Backend), Emitter(Emitter), Writer(Writer),
@@ -713,10 +894,18 @@ void MCAssembler::layout(MCAsmLayout &Layout) {
       Frag.setLayoutOrder(FragmentIndex++);
   }
 
-  // Layout until everything fits.
+  // Layout until everything fits. Bundle padding makes the offset of every
+  // fragment with instructions depend on the layout before it, so only track
+  // which fragments may skip their relaxation checks without bundling.
+  if (!isBundlingEnabled())
+    RelaxCache = llvm::make_unique<RelaxationCache>(Layout);
+  bool HadError = false;
   while (layoutOnce(Layout))
-    if (getContext().hadError())
-      return;
+    if ((HadError = getContext().hadError()))
+      break;
+  RelaxCache.reset();
+  if (HadError)
+    return;
 
   DEBUG_WITH_TYPE("mc-dump", {
       errs() << "assembler backend - post-relaxation\n--\n";
@@ -816,8 +1005,21 @@ bool MCAssembler::fragmentNeedsRelaxation(const MCRelaxableFragment *F,
 
 bool MCAssembler::relaxInstruction(MCAsmLayout &Layout,
                                    MCRelaxableFragment &F) {
-  if (!fragmentNeedsRelaxation(&F, Layout))
+  if (RelaxCache && RelaxCache->isStable(F)) {
+    ++stats::SkippedRelaxationChecks;
     return false;
+  }
+
+  if (!fragmentNeedsRelaxation(&F, Layout)) {
+    unsigned Begin, End;
+    if (RelaxCache && getRelaxationDependencies(getBackend(), F, Begin, End))
+      RelaxCache->markStable(F, Begin, End);
+    else if (RelaxCache)
+      RelaxCache->forget(F);
+    return false;
+  }
+  if (RelaxCache)
+    RelaxCache->forget(F);
 
   ++stats::RelaxedInstructions;
 
@@ -929,6 +1131,9 @@ bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec) {
   // invalidated because their offset is going to change.
   MCFragment *FirstRelaxedFragment = nullptr;
 
+  if (RelaxCache)
+    RelaxCache->beginPass(Sec);
+
   // Attempt to relax all the fragments in the section.
   for (MCSection::iterator I = Sec.begin(), IE = Sec.end(); I != IE; ++I) {
     // Check if this is a fragment that needs relaxation.
@@ -966,6 +1171,12 @@ bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec) {
     }
     if (RelaxedFrag && !FirstRelaxedFragment)
       FirstRelaxedFragment = &*I;
+
+    // Besides the relaxed fragments themselves, every fragment whose size
+    // depends on its offset may change size once an earlier one was relaxed.
+    if (RelaxCache && (RelaxedFrag || (FirstRelaxedFragment &&
+                                       hasOffsetDependentSize(*I))))
+      RelaxCache->markChanged(*I);
   }
   if (FirstRelaxedFragment) {
     Layout.invalidateFragmentsFrom(FirstRelaxedFragment);
@@ -14,6 +14,7 @@
 #include "llvm/BinaryFormat/COFF.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cstddef>
@@ -62,10 +63,12 @@ using StringPair = std::pair<CachedHashStringRef, size_t>;
 
 void StringTableBuilder::write(uint8_t *Buf) const {
   assert(isFinalized());
-  for (const StringPair &P : StringIndexMap) {
-    StringRef Data = P.first.val();
-    if (!Data.empty())
-      memcpy(Buf + P.second, Data.data(), Data.size());
+  for (const StringIndexMapTy &Shard : StringIndexMap) {
+    for (const StringPair &P : Shard) {
+      StringRef Data = P.first.val();
+      if (!Data.empty())
+        memcpy(Buf + P.second, Data.data(), Data.size());
+    }
   }
   if (K != WinCOFF)
     return;
@@ -115,24 +118,85 @@ tailcall:
   }
 }
 
+template <class FuncTy> static void parallelForEachN(size_t End, FuncTy Fn) {
+#if LLVM_ENABLE_THREADS
+  parallel::for_each_n(parallel::par, size_t(0), End, Fn);
+#else
+  parallel::for_each_n(parallel::seq, size_t(0), End, Fn);
+#endif
+}
+
+// Sorts the same way as multikeySort(Vec, 0). The strings are first
+// distributed into buckets by their last two characters with a counting sort,
+// and the buckets are then sorted independently on multiple threads. Since the
+// strings are unique, the order is fully determined by their contents.
+static void parallelMultikeySort(MutableArrayRef<StringPair *> Vec) {
+  // Characters range from -1 to 255, so two of them form a key in
+  // [0, 257 * 257). Keys are ordered the way multikeySort orders the strings.
+  const size_t NumKeys = 257 * 257;
+  auto GetKey = [](StringPair *P) {
+    return (charTailAt(P, 0) + 1) * 257 + (charTailAt(P, 1) + 1);
+  };
+
+  // Bucket I starts at Starts[I]; larger keys come first.
+  std::vector<size_t> Starts(NumKeys);
+  for (StringPair *P : Vec)
+    ++Starts[GetKey(P)];
+  size_t Pos = 0;
+  for (size_t I = NumKeys; I-- != 0;) {
+    size_t Count = Starts[I];
+    Starts[I] = Pos;
+    Pos += Count;
+  }
+
+  std::vector<StringPair *> Sorted(Vec.size());
+  std::vector<size_t> Next(Starts);
+  for (StringPair *P : Vec)
+    Sorted[Next[GetKey(P)]++] = P;
+
+  // Only buckets of strings with at least two characters can hold more than
+  // one string, and those still need to be sorted by the remaining ones.
+  std::vector<MutableArrayRef<StringPair *>> Buckets;
+  for (size_t I = 0; I != NumKeys; ++I) {
+    size_t Size = Next[I] - Starts[I];
+    if (Size > 1)
+      Buckets.push_back(makeMutableArrayRef(&Sorted[Starts[I]], Size));
+  }
+  parallelForEachN(Buckets.size(),
+                   [&](size_t I) { multikeySort(Buckets[I], 2); });
+
+  std::copy(Sorted.begin(), Sorted.end(), Vec.begin());
+}
+
 void StringTableBuilder::finalize() {
-  finalizeStringTable(/*Optimize=*/true);
+  finalizeStringTable(/*Optimize=*/true, /*Parallel=*/false);
+}
+
+void StringTableBuilder::finalizeParallel() {
+  finalizeStringTable(/*Optimize=*/true, /*Parallel=*/true);
 }
 
 void StringTableBuilder::finalizeInOrder() {
-  finalizeStringTable(/*Optimize=*/false);
+  finalizeStringTable(/*Optimize=*/false, /*Parallel=*/false);
 }
 
-void StringTableBuilder::finalizeStringTable(bool Optimize) {
+void StringTableBuilder::finalizeStringTable(bool Optimize, bool Parallel) {
   Finalized = true;
 
   if (Optimize) {
     std::vector<StringPair *> Strings;
-    Strings.reserve(StringIndexMap.size());
-    for (StringPair &P : StringIndexMap)
-      Strings.push_back(&P);
+    size_t NumStrings = 0;
+    for (StringIndexMapTy &Shard : StringIndexMap)
+      NumStrings += Shard.size();
+    Strings.reserve(NumStrings);
+    for (StringIndexMapTy &Shard : StringIndexMap)
+      for (StringPair &P : Shard)
+        Strings.push_back(&P);
 
-    multikeySort(Strings, 0);
+    if (Parallel)
+      parallelMultikeySort(Strings);
+    else
+      multikeySort(Strings, 0);
     initSize();
 
     StringRef Previous;
@@ -162,13 +226,15 @@ void StringTableBuilder::finalizeStringTable(bool Optimize) {
 
 void StringTableBuilder::clear() {
   Finalized = false;
-  StringIndexMap.clear();
+  for (StringIndexMapTy &Shard : StringIndexMap)
+    Shard.clear();
 }
 
 size_t StringTableBuilder::getOffset(CachedHashStringRef S) const {
   assert(isFinalized());
-  auto I = StringIndexMap.find(S);
-  assert(I != StringIndexMap.end() && "String is not in table!");
+  const StringIndexMapTy &Shard = StringIndexMap[getShard(S)];
+  auto I = Shard.find(S);
+  assert(I != Shard.end() && "String is not in table!");
   return I->second;
 }
 
@@ -177,7 +243,7 @@ size_t StringTableBuilder::add(CachedHashStringRef S) {
     assert(S.size() > COFF::NameSize && "Short string in COFF string table!");
 
   assert(!isFinalized());
-  auto P = StringIndexMap.insert(std::make_pair(S, 0));
+  auto P = StringIndexMap[getShard(S)].insert(std::make_pair(S, 0));
   if (P.second) {
     size_t Start = alignTo(Size, Alignment);
     P.first->second = Start;
@@ -185,3 +251,40 @@ size_t StringTableBuilder::add(CachedHashStringRef S) {
   }
   return P.first->second;
 }
+
+void StringTableBuilder::addParallel(ArrayRef<CachedHashStringRef> Strings) {
+  assert(!isFinalized());
+
+  // Distribute the strings over the shards, keeping their relative order.
+  std::array<std::vector<size_t>, NumShards> ShardStrings;
+  for (size_t I = 0, E = Strings.size(); I != E; ++I) {
+    if (K == WinCOFF)
+      assert(Strings[I].size() > COFF::NameSize &&
+             "Short string in COFF string table!");
+    ShardStrings[getShard(Strings[I])].push_back(I);
+  }
+
+  // Deduplicate every shard on its own, remembering which strings were not in
+  // the table yet.
+  std::vector<uint8_t> IsNew(Strings.size());
+  parallelForEachN(NumShards, [&](size_t Shard) {
+    StringIndexMapTy &Map = StringIndexMap[Shard];
+    for (size_t I : ShardStrings[Shard])
+      IsNew[I] = Map.insert(std::make_pair(Strings[I], 0)).second;
+  });
+
+  // Assign offsets in the order add would have, then store them.
+  std::vector<size_t> Offsets(Strings.size());
+  for (size_t I = 0, E = Strings.size(); I != E; ++I) {
+    if (!IsNew[I])
+      continue;
+    Offsets[I] = alignTo(Size, Alignment);
+    Size = Offsets[I] + Strings[I].size() + (K != RAW);
+  }
+  parallelForEachN(NumShards, [&](size_t Shard) {
+    StringIndexMapTy &Map = StringIndexMap[Shard];
+    for (size_t I : ShardStrings[Shard])
+      if (IsNew[I])
+        Map[Strings[I]] = Offsets[I];
+  });
+}
@@ -0,0 +1,490 @@
+//===- ArchiveSymbolCache.cpp - Persistent archive symbol index -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An index file holds, in little endian:
+//
+//   Header
+//   Member[NumMembers]    Header offset, data offset and size, name and path
+//                         of each member.
+//   Symbol[NumSymbols]    The archive's symbol table, in order.
+//   Strings               The names and paths the above refer to.
+//   Hash table            An OnDiskChainedHashTable from the symbol names to
+//                         the index of the first member defining them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Object/ArchiveSymbolCache.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Object/Archive.h"
+#include "llvm/Object/Error.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/OnDiskHashTable.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+using namespace object;
+using namespace llvm::support;
+
+namespace {
+
+const char IndexMagic[8] = {'L', 'L', 'V', 'M', 'A', 'S', 'Y', 'M'};
+const uint32_t IndexVersion = 2;
+
+struct IndexHeader {
+  char Magic[8];
+  ulittle32_t Version;
+  ulittle32_t Thin;
+  ulittle64_t ArchiveSize;
+  little64_t ModTime;
+  ulittle32_t NumMembers;
+  ulittle32_t NumSymbols;
+  ulittle32_t StringsOffset;
+  ulittle32_t StringsSize;
+  ulittle32_t TableOffset;
+  ulittle32_t Reserved;
+};
+
+struct IndexMember {
+  ulittle64_t HeaderOffset;
+  ulittle64_t Offset;
+  ulittle64_t Size;
+  ulittle32_t NameOffset;
+  ulittle32_t NameSize;
+  ulittle32_t PathOffset;
+  ulittle32_t PathSize;
+};
+
+// The layout of an archive member header.
+struct MemberHeader {
+  char Name[16];
+  char LastModified[12];
+  char UID[6];
+  char GID[6];
+  char AccessMode[8];
+  char Size[10];
+  char Terminator[2];
+};
+
+struct IndexSymbol {
+  ulittle32_t NameOffset;
+  ulittle32_t NameSize;
+  ulittle32_t Member;
+};
+
+class SymbolTableInfo {
+public:
+  using key_type = StringRef;
+  using key_type_ref = StringRef;
+  using internal_key_type = StringRef;
+  using external_key_type = StringRef;
+  using data_type = uint32_t;
+  using data_type_ref = uint32_t;
+  using hash_value_type = uint32_t;
+  using offset_type = uint32_t;
+
+  static hash_value_type ComputeHash(StringRef Key) { return xxHash64(Key); }
+  static bool EqualKey(StringRef LHS, StringRef RHS) { return LHS == RHS; }
+  static StringRef GetInternalKey(StringRef Key) { return Key; }
+
+  static std::pair<offset_type, offset_type>
+  EmitKeyDataLength(raw_ostream &Out, StringRef Key, uint32_t) {
+    endian::Writer<little>(Out).write<offset_type>(Key.size());
+    return std::make_pair(Key.size(), sizeof(uint32_t));
+  }
+
+  static void EmitKey(raw_ostream &Out, StringRef Key, offset_type) {
+    Out << Key;
+  }
+
+  static void EmitData(raw_ostream &Out, StringRef, uint32_t Member,
+                       offset_type) {
+    endian::Writer<little>(Out).write<uint32_t>(Member);
+  }
+
+  static std::pair<offset_type, offset_type>
+  ReadKeyDataLength(const unsigned char *&Data) {
+    offset_type KeySize = endian::readNext<offset_type, little, unaligned>(Data);
+    return std::make_pair(KeySize, sizeof(uint32_t));
+  }
+
+  static StringRef ReadKey(const unsigned char *Data, offset_type Size) {
+    return StringRef(reinterpret_cast<const char *>(Data), Size);
+  }
+
+  static uint32_t ReadData(StringRef, const unsigned char *Data, offset_type) {
+    return endian::read<uint32_t, little, unaligned>(Data);
+  }
+};
+
+// Appends S to Strings and returns its offset.
+uint32_t addString(std::string &Strings, StringRef S) {
+  uint32_t Offset = Strings.size();
+  Strings += S;
+  return Offset;
+}
+
+template <class T> void writeStruct(raw_ostream &OS, const T &Struct) {
+  OS.write(reinterpret_cast<const char *>(&Struct), sizeof(T));
+}
+
+// Writes the index of Members and Symbols, which are not backed by an index
+// file yet.
+void writeIndex(raw_ostream &OS, bool Thin, uint64_t ArchiveSize,
+                int64_t ModTime, ArrayRef<ArchiveSymbolIndex::Member> Members,
+                ArrayRef<ArchiveSymbolIndex::Symbol> Symbols) {
+  std::string Strings;
+  std::vector<IndexMember> OutMembers;
+  for (const ArchiveSymbolIndex::Member &M : Members) {
+    IndexMember Out;
+    Out.HeaderOffset = M.HeaderOffset;
+    Out.Offset = M.Offset;
+    Out.Size = M.Size;
+    Out.NameOffset = addString(Strings, M.Name);
+    Out.NameSize = M.Name.size();
+    Out.PathOffset = addString(Strings, M.Path);
+    Out.PathSize = M.Path.size();
+    OutMembers.push_back(Out);
+  }
+
+  // Only the first member defining a symbol is in the hash table, which is
+  // the one a linker picks.
+  OnDiskChainedHashTableGenerator<SymbolTableInfo> Generator;
+  StringSet<> Seen;
+  std::vector<IndexSymbol> OutSymbols;
+  for (const ArchiveSymbolIndex::Symbol &S : Symbols) {
+    IndexSymbol Out;
+    Out.NameOffset = addString(Strings, S.Name);
+    Out.NameSize = S.Name.size();
+    Out.Member = S.Member;
+    OutSymbols.push_back(Out);
+    if (Seen.insert(S.Name).second)
+      Generator.insert(S.Name, S.Member);
+  }
+
+  IndexHeader Header;
+  std::copy(std::begin(IndexMagic), std::end(IndexMagic), Header.Magic);
+  Header.Version = IndexVersion;
+  Header.Thin = Thin;
+  Header.ArchiveSize = ArchiveSize;
+  Header.ModTime = ModTime;
+  Header.NumMembers = Members.size();
+  Header.NumSymbols = Symbols.size();
+  Header.StringsOffset = sizeof(IndexHeader) +
+                         Members.size() * sizeof(IndexMember) +
+                         Symbols.size() * sizeof(IndexSymbol);
+  Header.StringsSize = Strings.size();
+  Header.TableOffset = 0;
+  Header.Reserved = 0;
+
+  // The offsets in the hash table are relative to the start of the file, so
+  // it is emitted into a stream that holds everything before it.
+  SmallString<0> Buf;
+  raw_svector_ostream Out(Buf);
+  writeStruct(Out, Header);
+  for (const IndexMember &M : OutMembers)
+    writeStruct(Out, M);
+  for (const IndexSymbol &S : OutSymbols)
+    writeStruct(Out, S);
+  Out << Strings;
+  uint32_t TableOffset = Generator.Emit(Out);
+  reinterpret_cast<IndexHeader *>(Buf.data())->TableOffset = TableOffset;
+  OS << Buf;
+}
+
+Error malformedIndex(StringRef Name) {
+  return make_error<GenericBinaryError>("malformed archive symbol index " +
+                                            Name,
+                                        object_error::parse_failed);
+}
+
+} // end anonymous namespace
+
+class ArchiveSymbolIndex::HashTable
+    : public OnDiskChainedHashTable<SymbolTableInfo> {
+public:
+  using OnDiskChainedHashTable::OnDiskChainedHashTable;
+};
+
+ArchiveSymbolIndex::~ArchiveSymbolIndex() = default;
+
+Expected<std::unique_ptr<ArchiveSymbolIndex>>
+ArchiveSymbolIndex::create(const Archive &A, uint64_t ArchiveSize,
+                           int64_t ModTime) {
+  StringRef Data = A.getData();
+  std::vector<Member> Members;
+  std::vector<Symbol> Symbols;
+  // Thin archive member paths are computed, so they are kept here until the
+  // index is written.
+  std::vector<std::string> Paths;
+  DenseMap<uint64_t, uint32_t> MemberIndex;
+
+  for (const Archive::Symbol &S : A.symbols()) {
+    Expected<Archive::Child> C = S.getMember();
+    if (!C)
+      return C.takeError();
+    auto Inserted = MemberIndex.insert({C->getChildOffset(), Members.size()});
+    if (Inserted.second) {
+      Member M;
+      Expected<StringRef> NameOrErr = C->getName();
+      if (!NameOrErr)
+        return NameOrErr.takeError();
+      M.Name = *NameOrErr;
+      Expected<uint64_t> SizeOrErr = C->getSize();
+      if (!SizeOrErr)
+        return SizeOrErr.takeError();
+      M.Size = *SizeOrErr;
+      M.HeaderOffset = C->getChildOffset();
+      M.Offset = 0;
+      if (A.isThin()) {
+        Expected<std::string> PathOrErr = C->getFullName();
+        if (!PathOrErr)
+          return PathOrErr.takeError();
+        Paths.push_back(std::move(*PathOrErr));
+      } else {
+        Expected<StringRef> BufOrErr = C->getBuffer();
+        if (!BufOrErr)
+          return BufOrErr.takeError();
+        M.Offset = BufOrErr->data() - Data.data();
+        Paths.emplace_back();
+      }
+      Members.push_back(M);
+    }
+    Symbols.push_back({S.getName(), Inserted.first->second});
+  }
+  for (size_t I = 0, E = Members.size(); I != E; ++I)
+    Members[I].Path = Paths[I];
+
+  SmallString<0> Buf;
+  raw_svector_ostream OS(Buf);
+  writeIndex(OS, A.isThin(), ArchiveSize, ModTime, Members, Symbols);
+  return read(MemoryBuffer::getMemBufferCopy(Buf, A.getFileName()));
+}
+
+Expected<std::unique_ptr<ArchiveSymbolIndex>>
+ArchiveSymbolIndex::read(std::unique_ptr<MemoryBuffer> Buf) {
+  StringRef Data = Buf->getBuffer();
+  StringRef Name = Buf->getBufferIdentifier();
+  if (Data.size() < sizeof(IndexHeader) ||
+      !Data.startswith(StringRef(IndexMagic, sizeof(IndexMagic))))
+    return malformedIndex(Name);
+  const auto *Header = reinterpret_cast<const IndexHeader *>(Data.data());
+  if (Header->Version != IndexVersion)
+    return malformedIndex(Name);
+
+  uint64_t NumMembers = Header->NumMembers;
+  uint64_t NumSymbols = Header->NumSymbols;
+  uint64_t StringsOffset = Header->StringsOffset;
+  uint64_t StringsEnd = StringsOffset + Header->StringsSize;
+  uint64_t TableOffset = Header->TableOffset;
+  if (StringsOffset != sizeof(IndexHeader) + NumMembers * sizeof(IndexMember) +
+                           NumSymbols * sizeof(IndexSymbol) ||
+      StringsEnd > TableOffset || TableOffset % alignof(uint32_t) ||
+      TableOffset + 2 * sizeof(uint32_t) > Data.size() ||
+      reinterpret_cast<uintptr_t>(Data.data()) % alignof(uint32_t))
+    return malformedIndex(Name);
+  StringRef Strings = Data.slice(StringsOffset, StringsEnd);
+  auto GetString = [&](uint32_t Offset, uint32_t Size) -> Optional<StringRef> {
+    if (uint64_t(Offset) + Size > Strings.size())
+      return None;
+    return Strings.substr(Offset, Size);
+  };
+
+  std::unique_ptr<ArchiveSymbolIndex> Index(new ArchiveSymbolIndex());
+  Index->Thin = Header->Thin;
+  Index->ArchiveSize = Header->ArchiveSize;
+  Index->ModTime = Header->ModTime;
+
+  const auto *InMembers =
+      reinterpret_cast<const IndexMember *>(Data.data() + sizeof(IndexHeader));
+  Index->Members.reserve(NumMembers);
+  for (const IndexMember &In : makeArrayRef(InMembers, NumMembers)) {
+    Optional<StringRef> MemberName = GetString(In.NameOffset, In.NameSize);
+    Optional<StringRef> Path = GetString(In.PathOffset, In.PathSize);
+    if (!MemberName || !Path)
+      return malformedIndex(Name);
+    Index->Members.push_back(
+        {*MemberName, *Path, In.HeaderOffset, In.Offset, In.Size});
+  }
+
+  const auto *InSymbols =
+      reinterpret_cast<const IndexSymbol *>(InMembers + NumMembers);
+  Index->Symbols.reserve(NumSymbols);
+  for (const IndexSymbol &In : makeArrayRef(InSymbols, NumSymbols)) {
+    Optional<StringRef> SymName = GetString(In.NameOffset, In.NameSize);
+    if (!SymName || In.Member >= NumMembers)
+      return malformedIndex(Name);
+    Index->Symbols.push_back({*SymName, In.Member});
+  }
+
+  const auto *Base = reinterpret_cast<const unsigned char *>(Data.data());
+  const unsigned char *Buckets = Base + TableOffset;
+  auto NumBucketsAndEntries = HashTable::readNumBucketsAndEntries(Buckets);
+  uint32_t NumBuckets = NumBucketsAndEntries.first;
+  if (!isPowerOf2_32(NumBuckets) ||
+      TableOffset + (2 + uint64_t(NumBuckets)) * sizeof(uint32_t) >
+          Data.size())
+    return malformedIndex(Name);
+
+  // The chains are checked too, as lookup() reads them without bounds checks
+  // and returns the member indexes they hold.
+  const unsigned char *End = Base + Data.size();
+  for (uint32_t I = 0; I != NumBuckets; ++I) {
+    uint32_t Offset = endian::read<uint32_t, little, aligned>(
+        Buckets + I * sizeof(uint32_t));
+    if (Offset == 0)
+      continue;
+    if (Offset > Data.size() - sizeof(uint16_t))
+      return malformedIndex(Name);
+    const unsigned char *Items = Base + Offset;
+    unsigned NumItems = endian::readNext<uint16_t, little, unaligned>(Items);
+    for (unsigned J = 0; J != NumItems; ++J) {
+      // The hash and the key size.
+      if (uint64_t(End - Items) < 2 * sizeof(uint32_t))
+        return malformedIndex(Name);
+      Items += sizeof(uint32_t);
+      uint32_t KeySize = SymbolTableInfo::ReadKeyDataLength(Items).first;
+      if (uint64_t(End - Items) < uint64_t(KeySize) + sizeof(uint32_t) ||
+          SymbolTableInfo::ReadData(StringRef(), Items + KeySize,
+                                    sizeof(uint32_t)) >= NumMembers)
+        return malformedIndex(Name);
+      Items += KeySize + sizeof(uint32_t);
+    }
+  }
+
+  Index->Table = llvm::make_unique<HashTable>(
+      NumBuckets, NumBucketsAndEntries.second, Buckets, Base);
+  Index->Buf = std::move(Buf);
+  return std::move(Index);
+}
+
+void ArchiveSymbolIndex::write(raw_ostream &OS) const {
+  OS << Buf->getBuffer();
+}
+
+Optional<uint32_t> ArchiveSymbolIndex::lookup(StringRef Name) const {
+  auto I = Table->find(Name);
+  if (I == Table->end())
+    return None;
+  return *I;
+}
+
+Expected<StringRef>
+ArchiveSymbolIndex::getMemberData(StringRef ArchiveData, uint32_t I) const {
+  assert(!Thin && "Thin archive members are not in the archive");
+  const Member &M = Members[I];
+  auto MemberMoved = [&] {
+    return make_error<GenericBinaryError>(
+        "member " + M.Name + " is not where the symbol index has it",
+        object_error::parse_failed);
+  };
+
+  if (M.HeaderOffset > ArchiveData.size() ||
+      ArchiveData.size() - M.HeaderOffset < sizeof(MemberHeader))
+    return MemberMoved();
+  const auto *Header = reinterpret_cast<const MemberHeader *>(
+      ArchiveData.data() + M.HeaderOffset);
+  uint64_t RawSize;
+  if (StringRef(Header->Terminator, sizeof(Header->Terminator)) != "`\n" ||
+      StringRef(Header->Size, sizeof(Header->Size))
+          .rtrim(' ')
+          .getAsInteger(10, RawSize))
+    return MemberMoved();
+
+  // BSD archives put long names between the header and the data, and count
+  // them in the member size.
+  uint64_t NameSize = 0;
+  StringRef RawName(Header->Name, sizeof(Header->Name));
+  if (RawName.startswith("#1/") &&
+      RawName.substr(3).rtrim(' ').getAsInteger(10, NameSize))
+    return MemberMoved();
+  if (M.HeaderOffset + sizeof(MemberHeader) + NameSize != M.Offset ||
+      RawSize < NameSize || RawSize - NameSize != M.Size ||
+      M.Offset > ArchiveData.size() || ArchiveData.size() - M.Offset < M.Size)
+    return MemberMoved();
+  return ArchiveData.substr(M.Offset, M.Size);
+}
+
+Expected<std::unique_ptr<ArchiveSymbolIndex>>
+ArchiveSymbolCache::getIndex(StringRef Path) {
+  SmallString<128> AbsPath(Path);
+  if (std::error_code EC = sys::fs::make_absolute(AbsPath))
+    return errorCodeToError(EC);
+  sys::fs::file_status Status;
+  if (std::error_code EC = sys::fs::status(AbsPath, Status))
+    return errorCodeToError(EC);
+  uint64_t Size = Status.getSize();
+  // The full resolution of the timestamp is kept, so that an archive
+  // rewritten within the same second with the same size is not mistaken for
+  // the one indexed.
+  int64_t ModTime = Status.getLastModificationTime().time_since_epoch().count();
+
+  // The key covers what identifies the archive contents, so a changed archive
+  // gets a new entry rather than overwriting the index of the old one.
+  SmallString<64> EntryPath;
+  std::string Key;
+  raw_string_ostream(Key) << AbsPath << '\0' << Size << '\0' << ModTime;
+  sys::path::append(EntryPath, Dir,
+                    "llvmarsym-" + utohexstr(xxHash64(Key)) + ".idx");
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> CachedOrErr =
+      MemoryBuffer::getFile(EntryPath, /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
+  if (CachedOrErr) {
+    Expected<std::unique_ptr<ArchiveSymbolIndex>> IndexOrErr =
+        ArchiveSymbolIndex::read(std::move(*CachedOrErr));
+    if (IndexOrErr && (*IndexOrErr)->getArchiveSize() == Size &&
+        (*IndexOrErr)->getModTime() == ModTime)
+      return IndexOrErr;
+    // A stale or unreadable entry is rebuilt.
+    if (!IndexOrErr)
+      consumeError(IndexOrErr.takeError());
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> ArchiveBufOrErr =
+      MemoryBuffer::getFile(AbsPath, /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
+  if (!ArchiveBufOrErr)
+    return errorCodeToError(ArchiveBufOrErr.getError());
+  Error Err = Error::success();
+  Archive A((*ArchiveBufOrErr)->getMemBufferRef(), Err);
+  if (Err)
+    return std::move(Err);
+  Expected<std::unique_ptr<ArchiveSymbolIndex>> IndexOrErr =
+      ArchiveSymbolIndex::create(A, Size, ModTime);
+  if (!IndexOrErr)
+    return IndexOrErr.takeError();
+
+  // Write to a temporary to avoid racing with other processes.
+  if (sys::fs::create_directories(Dir))
+    return IndexOrErr;
+  Expected<sys::fs::TempFile> Temp =
+      sys::fs::TempFile::create(EntryPath + "-%%%%%%.tmp");
+  if (!Temp) {
+    consumeError(Temp.takeError());
+    return IndexOrErr;
+  }
+  {
+    raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+    (*IndexOrErr)->write(OS);
+  }
+  if (Error E = Temp->keep(EntryPath)) {
+    consumeError(std::move(E));
+    consumeError(Temp->discard());
+  }
+  return IndexOrErr;
+}
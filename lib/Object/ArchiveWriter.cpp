@@ -13,6 +13,7 @@
 
 #include "llvm/Object/ArchiveWriter.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/BinaryFormat/Magic.h"
 #include "llvm/IR/LLVMContext.h"
@@ -22,10 +23,14 @@
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
 #include <unistd.h>
@@ -381,10 +386,21 @@ static void writeSymbolTable(raw_ostream &Out, object::Archive::Kind Kind,
     Out.write(uint8_t(0));
 }
 
-static Expected<std::vector<unsigned>>
-getSymbols(MemoryBufferRef Buf, raw_ostream &SymNames, bool &HasObject) {
-  std::vector<unsigned> Ret;
+namespace {
+// The archive symbols of one member. Offsets are relative to the start of
+// Names until the member's names are appended to the symbol name table.
+struct MemberSymbols {
+  std::vector<unsigned> Offsets;
+  std::string Names;
+  bool HasObject = false;
+  // Set if reading the symbols failed.
+  Optional<Error> Err;
+};
+} // namespace
+
+static Error getSymbols(MemoryBufferRef Buf, MemberSymbols &Syms) {
   LLVMContext Context;
+  raw_string_ostream SymNames(Syms.Names);
 
   Expected<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
       object::SymbolicFile::createSymbolicFile(Buf, llvm::file_magic::unknown,
@@ -392,19 +408,46 @@ getSymbols(MemoryBufferRef Buf, raw_ostream &SymNames, bool &HasObject) {
   if (!ObjOrErr) {
     // FIXME: check only for "not an object file" errors.
     consumeError(ObjOrErr.takeError());
-    return Ret;
+    return Error::success();
   }
 
-  HasObject = true;
+  Syms.HasObject = true;
   object::SymbolicFile &Obj = *ObjOrErr.get();
   for (const object::BasicSymbolRef &S : Obj.symbols()) {
     if (!isArchiveSymbol(S))
       continue;
-    Ret.push_back(SymNames.tell());
+    Syms.Offsets.push_back(SymNames.tell());
     if (auto EC = S.printName(SymNames))
       return errorCodeToError(EC);
     SymNames << '\0';
   }
+  return Error::success();
+}
+
+// Reads the symbols of all members. Opening a member as a SymbolicFile
+// dominates the time it takes to write an archive of bitcode files, so each
+// member is read on a thread pool with its own LLVMContext. The results are
+// kept per member, which keeps the symbol table independent of the order in
+// which the members are read.
+static std::vector<MemberSymbols>
+computeSymbols(ArrayRef<NewArchiveMember> NewMembers) {
+  std::vector<MemberSymbols> Ret(NewMembers.size());
+  unsigned Threads =
+      std::min<size_t>(heavyweight_hardware_concurrency(), NewMembers.size());
+  if (Threads <= 1) {
+    for (size_t I = 0, E = NewMembers.size(); I != E; ++I)
+      if (Error Err = getSymbols(NewMembers[I].Buf->getMemBufferRef(), Ret[I]))
+        Ret[I].Err = std::move(Err);
+    return Ret;
+  }
+
+  ThreadPool Pool(Threads);
+  for (size_t I = 0, E = NewMembers.size(); I != E; ++I)
+    Pool.async([&, I] {
+      if (Error Err = getSymbols(NewMembers[I].Buf->getMemBufferRef(), Ret[I]))
+        Ret[I].Err = std::move(Err);
+    });
+  Pool.wait();
   return Ret;
 }
 
@@ -418,9 +461,22 @@ computeMemberData(raw_ostream &StringTable, raw_ostream &SymNames,
   // symbol table is aligned to be a multiple of 8 bytes
   uint64_t Pos = 0;
 
+  std::vector<MemberSymbols> Symbols = computeSymbols(NewMembers);
+  // Report the error of the first failing member, as reading the members in
+  // order would.
+  for (MemberSymbols &Syms : Symbols)
+    if (Syms.Err) {
+      Error Err = std::move(*Syms.Err);
+      for (MemberSymbols &Other : Symbols)
+        if (Other.Err)
+          consumeError(std::move(*Other.Err));
+      return std::move(Err);
+    }
+
   std::vector<MemberData> Ret;
   bool HasObject = false;
-  for (const NewArchiveMember &M : NewMembers) {
+  for (size_t I = 0, E = NewMembers.size(); I != E; ++I) {
+    const NewArchiveMember &M = NewMembers[I];
     std::string Header;
     raw_string_ostream Out(Header);
 
@@ -441,13 +497,15 @@ computeMemberData(raw_ostream &StringTable, raw_ostream &SymNames,
                       Buf.getBufferSize() + MemberPadding);
     Out.flush();
 
-    Expected<std::vector<unsigned>> Symbols =
-        getSymbols(Buf, SymNames, HasObject);
-    if (auto E = Symbols.takeError())
-      return std::move(E);
+    MemberSymbols &Syms = Symbols[I];
+    HasObject |= Syms.HasObject;
+    unsigned Base = SymNames.tell();
+    for (unsigned &Offset : Syms.Offsets)
+      Offset += Base;
+    SymNames << Syms.Names;
 
     Pos += Header.size() + Data.size() + Padding.size();
-    Ret.push_back({std::move(*Symbols), std::move(Header), Data, Padding});
+    Ret.push_back({std::move(Syms.Offsets), std::move(Header), Data, Padding});
   }
   // If there are no symbols, emit an empty symbol table, to satisfy Solaris
   // tools, older versions of which expect a symbol table in a non-empty
@@ -497,24 +555,39 @@ Error llvm::writeArchive(StringRef ArcName,
       Kind = object::Archive::K_GNU64;
   }
 
-  Expected<sys::fs::TempFile> Temp =
-      sys::fs::TempFile::create(ArcName + ".temp-archive-%%%%%%%.a");
-  if (!Temp)
-    return Temp.takeError();
-
-  raw_fd_ostream Out(Temp->FD, false);
+  // Everything up to the first member is small and rendered in memory. The
+  // members are then copied straight into the output file's buffer.
+  SmallString<0> HeadBuf;
+  raw_svector_ostream Head(HeadBuf);
   if (Thin)
-    Out << "!<thin>\n";
+    Head << "!<thin>\n";
   else
-    Out << "!<arch>\n";
+    Head << "!<arch>\n";
 
   if (WriteSymtab)
-    writeSymbolTable(Out, Kind, Deterministic, Data, SymNamesBuf);
+    writeSymbolTable(Head, Kind, Deterministic, Data, SymNamesBuf);
 
+  uint64_t Size = HeadBuf.size();
   for (const MemberData &M : Data)
-    Out << M.Header << M.Data << M.Padding;
-
-  Out.flush();
+    Size += M.Header.size() + M.Data.size() + M.Padding.size();
+
+  Expected<std::unique_ptr<FileOutputBuffer>> OutOrErr =
+      FileOutputBuffer::create(ArcName, Size);
+  if (!OutOrErr)
+    return OutOrErr.takeError();
+  std::unique_ptr<FileOutputBuffer> &Out = *OutOrErr;
+
+  uint8_t *Buf = Out->getBufferStart();
+  auto Write = [&](StringRef Part) {
+    Buf = std::copy(Part.bytes_begin(), Part.bytes_end(), Buf);
+  };
+  Write(HeadBuf);
+  for (const MemberData &M : Data) {
+    Write(M.Header);
+    Write(M.Data);
+    Write(M.Padding);
+  }
+  assert(Buf == Out->getBufferEnd() && "Archive size mismatch");
 
   // At this point, we no longer need whatever backing memory
   // was used to generate the NewMembers. On Windows, this buffer
@@ -528,5 +601,5 @@ Error llvm::writeArchive(StringRef ArcName,
   // closed before we attempt to rename.
   OldArchiveBuf.reset();
 
-  return Temp->keep(ArcName);
+  return Out->commit();
 }
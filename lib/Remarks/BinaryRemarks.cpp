@@ -0,0 +1,237 @@
+//===- BinaryRemarks.cpp - Binary optimization remark files ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Implements the serializer and the parser of the binary remark format.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Remarks/BinaryRemarks.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::remarks;
+using namespace llvm::support;
+
+namespace {
+enum RecordTag : uint8_t { StringRecord = 1, RemarkRecord = 2 };
+enum RemarkFlags : uint8_t { HasLocation = 1, HasHotness = 2 };
+} // end anonymous namespace
+
+// Buffered records are written out once they reach this size.
+static const size_t FlushThreshold = 64 * 1024;
+
+BinaryRemarkSerializer::BinaryRemarkSerializer(raw_ostream &OS) : OS(OS) {
+  Buffer.append(BinaryRemarkMagic.begin(), BinaryRemarkMagic.end());
+  write<uint32_t>(BinaryRemarkVersion);
+}
+
+BinaryRemarkSerializer::~BinaryRemarkSerializer() { flush(); }
+
+void BinaryRemarkSerializer::flush() {
+  OS.write(Buffer.data(), Buffer.size());
+  Buffer.clear();
+}
+
+template <typename T> void BinaryRemarkSerializer::write(T Value) {
+  size_t Size = Buffer.size();
+  Buffer.resize(Size + sizeof(T));
+  endian::write<T, little>(Buffer.data() + Size, Value);
+}
+
+uint32_t BinaryRemarkSerializer::getStringIndex(StringRef S) {
+  auto Inserted = StringIndices.insert({S, StringIndices.size()});
+  if (Inserted.second) {
+    write<uint8_t>(StringRecord);
+    write<uint32_t>(S.size());
+    Buffer.append(S.begin(), S.end());
+    Buffer.push_back('\0');
+  }
+  return Inserted.first->second;
+}
+
+void BinaryRemarkSerializer::writeLocation(const RemarkLocation &Loc) {
+  write<uint32_t>(StringIndices.find(Loc.File)->second);
+  write<uint32_t>(Loc.Line);
+  write<uint32_t>(Loc.Column);
+}
+
+void BinaryRemarkSerializer::emit(const Remark &R) {
+  // Define the strings this remark refers to ahead of its record.
+  uint32_t PassName = getStringIndex(R.PassName);
+  uint32_t RemarkName = getStringIndex(R.RemarkName);
+  uint32_t FunctionName = getStringIndex(R.FunctionName);
+  if (R.Loc.isValid())
+    getStringIndex(R.Loc.File);
+  for (const Argument &Arg : R.Args) {
+    getStringIndex(Arg.Key);
+    getStringIndex(Arg.Val);
+    if (Arg.Loc.isValid())
+      getStringIndex(Arg.Loc.File);
+  }
+
+  uint8_t Flags = (R.Loc.isValid() ? HasLocation : 0) |
+                  (R.Hotness ? HasHotness : 0);
+  write<uint8_t>(RemarkRecord);
+  write<uint8_t>(static_cast<uint8_t>(R.RemarkType));
+  write<uint8_t>(Flags);
+  write<uint8_t>(0);
+  write<uint32_t>(PassName);
+  write<uint32_t>(RemarkName);
+  write<uint32_t>(FunctionName);
+  write<uint32_t>(R.Args.size());
+  if (R.Loc.isValid())
+    writeLocation(R.Loc);
+  if (R.Hotness)
+    write<uint64_t>(*R.Hotness);
+  for (const Argument &Arg : R.Args) {
+    write<uint32_t>(StringIndices.find(Arg.Key)->second);
+    write<uint32_t>(StringIndices.find(Arg.Val)->second);
+    write<uint32_t>(Arg.Loc.isValid() ? HasLocation : 0);
+    if (Arg.Loc.isValid())
+      writeLocation(Arg.Loc);
+  }
+
+  if (Buffer.size() >= FlushThreshold)
+    flush();
+}
+
+static Error makeParseError(const Twine &Message, size_t Offset) {
+  return make_error<StringError>("invalid binary remark file at offset " +
+                                     Twine(Offset) + ": " + Message,
+                                 inconvertibleErrorCode());
+}
+
+Expected<std::unique_ptr<BinaryRemarkParser>>
+BinaryRemarkParser::create(StringRef Buffer) {
+  if (!isBinaryRemarkFile(Buffer))
+    return makeParseError("missing magic", 0);
+  std::unique_ptr<BinaryRemarkParser> Parser(new BinaryRemarkParser(Buffer));
+  Parser->Offset = BinaryRemarkMagic.size();
+  uint32_t Version;
+  if (Error E = Parser->read(Version))
+    return std::move(E);
+  if (Version != BinaryRemarkVersion)
+    return makeParseError("unsupported version " + Twine(Version), 4);
+  return std::move(Parser);
+}
+
+template <typename T> Error BinaryRemarkParser::read(T &Value) {
+  if (Buffer.size() - Offset < sizeof(T))
+    return makeParseError("unexpected end of file", Offset);
+  Value = endian::read<T, little>(Buffer.data() + Offset);
+  Offset += sizeof(T);
+  return Error::success();
+}
+
+Error BinaryRemarkParser::readString(StringRef &S) {
+  size_t IndexOffset = Offset;
+  uint32_t Index;
+  if (Error E = read(Index))
+    return E;
+  if (Index >= Strings.size())
+    return makeParseError("undefined string " + Twine(Index), IndexOffset);
+  S = Strings[Index];
+  return Error::success();
+}
+
+Error BinaryRemarkParser::readLocation(RemarkLocation &Loc) {
+  if (Error E = readString(Loc.File))
+    return E;
+  if (Error E = read(Loc.Line))
+    return E;
+  return read(Loc.Column);
+}
+
+Error BinaryRemarkParser::parseString() {
+  uint32_t Size;
+  if (Error E = read(Size))
+    return E;
+  // The string is followed by a NUL, so that it can be used as a C string.
+  if (Buffer.size() - Offset <= Size || Buffer[Offset + Size] != '\0')
+    return makeParseError("unterminated string", Offset);
+  Strings.push_back(Buffer.substr(Offset, Size));
+  Offset += Size + 1;
+  return Error::success();
+}
+
+Error BinaryRemarkParser::parseRemark() {
+  size_t RecordOffset = Offset - 1;
+  uint8_t RemarkType, Flags, Reserved;
+  uint32_t NumArgs;
+  if (Error E = read(RemarkType))
+    return E;
+  if (RemarkType > static_cast<uint8_t>(Type::Last))
+    return makeParseError(
+        "unknown remark type " + Twine(unsigned(RemarkType)), RecordOffset);
+  if (Error E = read(Flags))
+    return E;
+  if (Error E = read(Reserved))
+    return E;
+
+  Current = Remark();
+  Current.RemarkType = static_cast<Type>(RemarkType);
+  if (Error E = readString(Current.PassName))
+    return E;
+  if (Error E = readString(Current.RemarkName))
+    return E;
+  if (Error E = readString(Current.FunctionName))
+    return E;
+  if (Error E = read(NumArgs))
+    return E;
+  if (Flags & HasLocation)
+    if (Error E = readLocation(Current.Loc))
+      return E;
+  if (Flags & HasHotness) {
+    uint64_t Hotness;
+    if (Error E = read(Hotness))
+      return E;
+    Current.Hotness = Hotness;
+  }
+
+  Args.clear();
+  for (uint32_t I = 0; I != NumArgs; ++I) {
+    Argument Arg;
+    uint32_t ArgFlags;
+    if (Error E = readString(Arg.Key))
+      return E;
+    if (Error E = readString(Arg.Val))
+      return E;
+    if (Error E = read(ArgFlags))
+      return E;
+    if (ArgFlags & HasLocation)
+      if (Error E = readLocation(Arg.Loc))
+        return E;
+    Args.push_back(Arg);
+  }
+  Current.Args = Args;
+  return Error::success();
+}
+
+Expected<const Remark *> BinaryRemarkParser::next() {
+  while (Offset != Buffer.size()) {
+    uint8_t Tag;
+    if (Error E = read(Tag))
+      return std::move(E);
+    switch (Tag) {
+    case StringRecord:
+      if (Error E = parseString())
+        return std::move(E);
+      break;
+    case RemarkRecord:
+      if (Error E = parseRemark())
+        return std::move(E);
+      return &Current;
+    default:
+      return makeParseError("unknown record " + Twine(unsigned(Tag)),
+                            Offset - 1);
+    }
+  }
+  return nullptr;
+}
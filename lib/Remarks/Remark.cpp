@@ -0,0 +1,48 @@
+//===- Remark.cpp - Optimization remarks ----------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Remarks/Remark.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/ErrorHandling.h"
+
+using namespace llvm;
+using namespace llvm::remarks;
+
+StringRef remarks::getTypeTag(Type T) {
+  switch (T) {
+  case Type::Passed:
+    return "!Passed";
+  case Type::Missed:
+    return "!Missed";
+  case Type::Analysis:
+    return "!Analysis";
+  case Type::AnalysisFPCommute:
+    return "!AnalysisFPCommute";
+  case Type::AnalysisAliasing:
+    return "!AnalysisAliasing";
+  case Type::Failure:
+    return "!Failure";
+  }
+  llvm_unreachable("Unknown remark type");
+}
+
+bool remarks::getTypeForTag(StringRef Tag, Type &T) {
+  int Result = StringSwitch<int>(Tag)
+                   .Case("!Passed", int(Type::Passed))
+                   .Case("!Missed", int(Type::Missed))
+                   .Case("!Analysis", int(Type::Analysis))
+                   .Case("!AnalysisFPCommute", int(Type::AnalysisFPCommute))
+                   .Case("!AnalysisAliasing", int(Type::AnalysisAliasing))
+                   .Case("!Failure", int(Type::Failure))
+                   .Default(-1);
+  if (Result < 0)
+    return false;
+  T = static_cast<Type>(Result);
+  return true;
+}
@@ -0,0 +1,245 @@
+//===- YAMLRemarks.cpp - YAML optimization remark files -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Implements the serializer and the parser of YAML remark files. The layout
+// matches the one the optimization remark diagnostics are written with.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Remarks/YAMLRemarks.h"
+#include "llvm/ADT/SmallString.h"
+
+using namespace llvm;
+using namespace llvm::remarks;
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<RemarkLocation> {
+  static void mapping(IO &io, RemarkLocation &Loc) {
+    assert(io.outputting() && "input not yet implemented");
+    io.mapRequired("File", Loc.File);
+    io.mapRequired("Line", Loc.Line);
+    io.mapRequired("Column", Loc.Column);
+  }
+
+  static const bool flow = true;
+};
+
+// Implement this as a mapping to get proper quotation for the value.
+template <> struct MappingTraits<Argument> {
+  static void mapping(IO &io, Argument &A) {
+    assert(io.outputting() && "input not yet implemented");
+    // The key has to be NUL terminated.
+    std::string Key = A.Key;
+    io.mapRequired(Key.c_str(), A.Val);
+    if (A.Loc.isValid())
+      io.mapOptional("DebugLoc", A.Loc);
+  }
+};
+
+} // end namespace yaml
+} // end namespace llvm
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(Argument)
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<Remark *> {
+  static void mapping(IO &io, Remark *&R) {
+    assert(io.outputting() && "input not yet implemented");
+    io.mapTag(getTypeTag(R->RemarkType), true);
+    io.mapRequired("Pass", R->PassName);
+    io.mapRequired("Name", R->RemarkName);
+    if (R->Loc.isValid())
+      io.mapOptional("DebugLoc", R->Loc);
+    io.mapRequired("Function", R->FunctionName);
+    io.mapOptional("Hotness", R->Hotness);
+    std::vector<Argument> Args(R->Args.begin(), R->Args.end());
+    io.mapOptional("Args", Args);
+  }
+};
+
+} // end namespace yaml
+} // end namespace llvm
+
+YAMLRemarkSerializer::YAMLRemarkSerializer(raw_ostream &OS) : Out(OS) {}
+
+void YAMLRemarkSerializer::emit(const Remark &R) {
+  Remark Copy = R;
+  Remark *P = &Copy;
+  Out << P;
+}
+
+static void handleDiagnostic(const SMDiagnostic &Diag, void *Ctx) {
+  std::string &LastError = *static_cast<std::string *>(Ctx);
+  raw_string_ostream OS(LastError);
+  Diag.print(/*ProgName=*/nullptr, OS, /*ShowColors=*/false,
+             /*ShowKindLabel=*/false);
+}
+
+YAMLRemarkParser::YAMLRemarkParser(StringRef Buffer) {
+  SM.setDiagHandler(handleDiagnostic, &LastError);
+  Stream.reset(new yaml::Stream(Buffer, SM));
+  Doc = Stream->begin();
+}
+
+Error YAMLRemarkParser::error(const Twine &Message, yaml::Node &Node) {
+  LastError.clear();
+  Stream->printError(&Node, Message);
+  return make_error<StringError>(StringRef(LastError).rtrim(),
+                                 inconvertibleErrorCode());
+}
+
+Expected<StringRef> YAMLRemarkParser::parseStr(yaml::Node &Node) {
+  auto *Scalar = dyn_cast<yaml::ScalarNode>(&Node);
+  if (!Scalar)
+    return error("expected a value of scalar type", Node);
+  SmallString<32> Storage;
+  StringRef Value = Scalar->getValue(Storage);
+  // Values that contain escape sequences are unescaped into Storage, all
+  // others point into the buffer.
+  if (Value.data() == Storage.data())
+    Value = Saver.save(Value);
+  return Value;
+}
+
+Expected<unsigned> YAMLRemarkParser::parseUnsigned(yaml::Node &Node) {
+  Expected<StringRef> Str = parseStr(Node);
+  if (!Str)
+    return Str.takeError();
+  unsigned Value;
+  if (Str->getAsInteger(10, Value))
+    return error("expected a value of integer type", Node);
+  return Value;
+}
+
+Error YAMLRemarkParser::parseLocation(yaml::Node &Node, RemarkLocation &Loc) {
+  auto *Map = dyn_cast<yaml::MappingNode>(&Node);
+  if (!Map)
+    return error("expected a value of mapping type", Node);
+  for (yaml::KeyValueNode &KV : *Map) {
+    Expected<StringRef> Key = parseStr(*KV.getKey());
+    if (!Key)
+      return Key.takeError();
+    if (*Key == "File") {
+      Expected<StringRef> File = parseStr(*KV.getValue());
+      if (!File)
+        return File.takeError();
+      Loc.File = *File;
+    } else if (*Key == "Line" || *Key == "Column") {
+      Expected<unsigned> Value = parseUnsigned(*KV.getValue());
+      if (!Value)
+        return Value.takeError();
+      (*Key == "Line" ? Loc.Line : Loc.Column) = *Value;
+    }
+  }
+  return Error::success();
+}
+
+Error YAMLRemarkParser::parseArgument(yaml::Node &Node) {
+  auto *Map = dyn_cast<yaml::MappingNode>(&Node);
+  if (!Map)
+    return error("expected a value of mapping type", Node);
+  Argument Arg;
+  bool HasKey = false;
+  for (yaml::KeyValueNode &KV : *Map) {
+    Expected<StringRef> Key = parseStr(*KV.getKey());
+    if (!Key)
+      return Key.takeError();
+    if (*Key == "DebugLoc") {
+      if (Error E = parseLocation(*KV.getValue(), Arg.Loc))
+        return E;
+      continue;
+    }
+    if (HasKey)
+      return error("more than one key in argument", *KV.getKey());
+    Expected<StringRef> Val = parseStr(*KV.getValue());
+    if (!Val)
+      return Val.takeError();
+    Arg.Key = *Key;
+    Arg.Val = *Val;
+    HasKey = true;
+  }
+  if (!HasKey)
+    return error("argument without a key", Node);
+  Args.push_back(Arg);
+  return Error::success();
+}
+
+Error YAMLRemarkParser::parseRemark(yaml::MappingNode &Root) {
+  Current = Remark();
+  Args.clear();
+  if (!getTypeForTag(Root.getRawTag(), Current.RemarkType))
+    return error("expected a remark tag", Root);
+
+  for (yaml::KeyValueNode &KV : Root) {
+    Expected<StringRef> Key = parseStr(*KV.getKey());
+    if (!Key)
+      return Key.takeError();
+    yaml::Node &Value = *KV.getValue();
+    if (*Key == "Pass" || *Key == "Name" || *Key == "Function") {
+      Expected<StringRef> Str = parseStr(Value);
+      if (!Str)
+        return Str.takeError();
+      (*Key == "Pass"   ? Current.PassName
+       : *Key == "Name" ? Current.RemarkName
+                        : Current.FunctionName) = *Str;
+    } else if (*Key == "DebugLoc") {
+      if (Error E = parseLocation(Value, Current.Loc))
+        return E;
+    } else if (*Key == "Hotness") {
+      Expected<StringRef> Str = parseStr(Value);
+      if (!Str)
+        return Str.takeError();
+      uint64_t Hotness;
+      if (Str->getAsInteger(10, Hotness))
+        return error("expected a value of integer type", Value);
+      Current.Hotness = Hotness;
+    } else if (*Key == "Args") {
+      auto *Seq = dyn_cast<yaml::SequenceNode>(&Value);
+      if (!Seq)
+        return error("expected a value of sequence type", Value);
+      for (yaml::Node &Arg : *Seq)
+        if (Error E = parseArgument(Arg))
+          return E;
+    }
+  }
+
+  if (Current.PassName.empty() || Current.RemarkName.empty())
+    return error("remark without a pass or a name", Root);
+  Current.Args = Args;
+  return Error::success();
+}
+
+Expected<const Remark *> YAMLRemarkParser::next() {
+  for (; Doc != Stream->end(); ++Doc) {
+    auto *Root = dyn_cast_or_null<yaml::MappingNode>(Doc->getRoot());
+    if (!Root) {
+      if (Stream->failed())
+        return make_error<StringError>(StringRef(LastError).rtrim(),
+                                       inconvertibleErrorCode());
+      continue;
+    }
+    if (Error E = parseRemark(*Root)) {
+      // A document cannot be skipped halfway, so stop parsing altogether.
+      Doc = yaml::document_iterator();
+      return std::move(E);
+    }
+    // Move past the document before returning, so that the next call starts
+    // at the following one.
+    ++Doc;
+    if (Stream->failed())
+      return make_error<StringError>(StringRef(LastError).rtrim(),
+                                     inconvertibleErrorCode());
+    return &Current;
+  }
+  return nullptr;
+}
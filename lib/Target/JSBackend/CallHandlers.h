@@ -104,7 +104,7 @@ DEF_CALL_HANDLER(__default__, {
       ensureFunctionTable(FT);
       if (!Invoke) {
         Sig = getFunctionSignature(FT);
-        if (!EmulatedFunctionPointers) {
+        if (!usesEmulatedFunctionPointerCall(FT)) {
           Name = std::string("FUNCTION_TABLE_") + Sig + '[' + Name + " & #FM_" + Sig + "#]";
           NeedCasts = false; // function table call, so stays in asm module
         } else {
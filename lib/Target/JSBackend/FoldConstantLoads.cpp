@@ -0,0 +1,154 @@
+//===-- FoldConstantLoads.cpp - Fold loads from constant data ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===-----------------------------------------------------------------------===//
+//
+// Replaces loads from constant globals (vtables, lookup tables, string
+// literals) with the values they read. FlattenGlobals turns initializers into
+// byte arrays and relocations, after which the backend can only emit these as
+// heap reads, so this must run while the initializers are still typed.
+//
+// A load whose address is itself loaded from memory is folded too when the
+// address was stored earlier in the same block, which is how a vtable slot
+// is read from an object whose vtable pointer was just set. When the folded
+// value is a function, calls through it become direct calls.
+//
+//===-----------------------------------------------------------------------===//
+
+#include "OptPasses.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/Loads.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#define DEBUG_TYPE "emscripten-fold-constant-loads"
+
+namespace llvm {
+
+STATISTIC(NumFoldedLoads, "Number of loads from constant data folded");
+STATISTIC(NumDevirtualizedCalls, "Number of indirect calls made direct");
+
+struct FoldConstantLoads : public FunctionPass {
+  static char ID; // Pass identification, replacement for typeid
+  FoldConstantLoads() : FunctionPass(ID) {}
+    // XXX initialize..(*PassRegistry::getPassRegistry()); }
+
+  bool runOnFunction(Function &Func) override;
+
+  StringRef getPassName() const override { return "FoldConstantLoads"; }
+};
+
+char FoldConstantLoads::ID = 0;
+
+// Returns the address V computes as a constant, looking through bitcasts and
+// constant-index GEPs that ExpandConstantExpr or the optimizer left as
+// instructions.
+static Constant *getConstantAddress(Value *V, unsigned Depth = 0) {
+  if (Constant *C = dyn_cast<Constant>(V))
+    return C;
+  if (Depth > 8)
+    return nullptr;
+  if (BitCastInst *BC = dyn_cast<BitCastInst>(V)) {
+    Constant *Op = getConstantAddress(BC->getOperand(0), Depth + 1);
+    return Op ? ConstantExpr::getBitCast(Op, BC->getType()) : nullptr;
+  }
+  if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(V)) {
+    Constant *Base = getConstantAddress(GEP->getPointerOperand(), Depth + 1);
+    if (!Base)
+      return nullptr;
+    SmallVector<Constant*, 4> Indices;
+    for (auto I = GEP->idx_begin(), E = GEP->idx_end(); I != E; ++I) {
+      Constant *Index = dyn_cast<Constant>(*I);
+      if (!Index)
+        return nullptr;
+      Indices.push_back(Index);
+    }
+    return ConstantExpr::getGetElementPtr(GEP->getSourceElementType(), Base,
+                                          Indices, GEP->isInBounds());
+  }
+  return nullptr;
+}
+
+// Returns the value Load reads if it is known at compile time.
+static Constant *foldLoad(LoadInst *Load, const DataLayout &DL) {
+  if (!Load->isSimple())
+    return nullptr;
+
+  if (Constant *Addr = getConstantAddress(Load->getPointerOperand())) {
+    // Only read from globals whose contents can't change; in particular,
+    // never turn a load from a null or constant integer address into a value.
+    GlobalVariable *GV =
+        dyn_cast<GlobalVariable>(GetUnderlyingObject(Addr, DL));
+    if (!GV || !GV->isConstant() || !GV->hasDefinitiveInitializer())
+      return nullptr;
+    return ConstantFoldLoadFromConstPtr(Addr, Load->getType(), DL);
+  }
+
+  // The value may have been stored to the same address earlier in the block,
+  // e.g. the vtable pointer of an object that was just constructed.
+  BasicBlock::iterator ScanFrom = Load->getIterator();
+  Value *Available =
+      FindAvailableLoadedValue(Load, Load->getParent(), ScanFrom);
+  Constant *C = dyn_cast_or_null<Constant>(Available);
+  if (!C)
+    return nullptr;
+  if (C->getType() == Load->getType())
+    return C;
+  if (C->getType()->isPointerTy() && Load->getType()->isPointerTy())
+    return ConstantExpr::getBitCast(C, Load->getType());
+  return nullptr;
+}
+
+bool FoldConstantLoads::runOnFunction(Function &Func) {
+  bool Changed = false;
+  const DataLayout &DL = Func.getParent()->getDataLayout();
+  for (BasicBlock &BB : Func) {
+    // Instructions are visited in order, so a folded vtable pointer makes the
+    // address of the slot load that follows it constant.
+    for (BasicBlock::iterator BI = BB.begin(), BE = BB.end(); BI != BE; ) {
+      LoadInst *Load = dyn_cast<LoadInst>(&*BI++);
+      if (!Load)
+        continue;
+      Constant *C = foldLoad(Load, DL);
+      if (!C)
+        continue;
+      if (isa<Function>(C->stripPointerCasts())) {
+        for (Use &U : Load->uses()) {
+          ImmutableCallSite CS(U.getUser());
+          if (CS && CS.isCallee(&U))
+            NumDevirtualizedCalls++;
+        }
+      }
+      Value *Ptr = Load->getPointerOperand();
+      Load->replaceAllUsesWith(C);
+      // Only the address computation, which precedes the load, can become
+      // dead, so BI stays valid.
+      Load->eraseFromParent();
+      RecursivelyDeleteTriviallyDeadInstructions(Ptr);
+      NumFoldedLoads++;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+//
+
+extern FunctionPass *createEmscriptenFoldConstantLoadsPass() {
+  return new FoldConstantLoads();
+}
+
+} // End llvm namespace
@@ -18,10 +18,12 @@
 #include "MCTargetDesc/JSBackendMCTargetDesc.h"
 #include "AllocaManager.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Config/config.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -36,10 +38,13 @@
 #include "llvm/IR/CallSite.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ScopedPrinter.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/NaCl.h"
@@ -48,12 +53,15 @@
 #include <cstdio>
 #include <map>
 #include <set> // TODO: unordered_set?
-#include <sstream>
 using namespace llvm;
 
 #include <OptPasses.h>
 #include <Relooper.h>
 
+#define DEBUG_TYPE "js-backend"
+
+STATISTIC(NumRelooperSplitBytes, "Number of bytes of code duplicated by relooper node splitting");
+
 #if !defined(NDEBUG) || defined(LLVM_ENABLE_DUMP)
 #define DUMP(I) ((I)->dump())
 #else
@@ -103,6 +111,11 @@ EmulateFunctionPointerCasts("emscripten-emulate-function-pointer-casts",
                          cl::desc("Emulate function pointers casts, handling extra or ignored parameters (see emscripten EMULATE_FUNCTION_POINTER_CASTS option)"),
                          cl::init(false));
 
+static cl::opt<bool>
+SelectiveFunctionPointerCasts("emscripten-selective-function-pointer-casts",
+                         cl::desc("With emulated function pointer casts, only emulate indirect calls whose signature a cast function pointer can be called with, and call through the typed function tables otherwise"),
+                         cl::init(false));
+
 static cl::opt<int>
 EmscriptenAssertions("emscripten-assertions",
                      cl::desc("Additional JS-specific assertions (see emscripten ASSERTIONS)"),
@@ -159,12 +172,22 @@ NoExitRuntime("emscripten-no-exit-runtime",
               cl::desc("Generate code which assumes the runtime is never exited (so atexit etc. is unneeded; see emscripten NO_EXIT_RUNTIME setting)"),
               cl::init(false));
 
+static cl::opt<bool>
+ScalarizeSmallStructs("emscripten-scalarize-small-structs",
+                      cl::desc("Pass small structs to and from internal functions as scalars rather than through memory (ignored with pthreads)"),
+                      cl::init(false));
+
 static cl::opt<bool>
 
 EnableCyberDWARF("enable-cyberdwarf",
                  cl::desc("Include CyberDWARF debug information"),
                  cl::init(false));
 
+static cl::opt<std::string>
+CyberDWARFFile("emscripten-cyberdwarf-file",
+               cl::desc("Write CyberDWARF debug information to this file instead of the metadata"),
+               cl::init(""));
+
 static cl::opt<bool>
 EnableCyberDWARFIntrinsics("enable-debug-intrinsics",
                            cl::desc("Include debug intrinsics in generated output"),
@@ -192,6 +215,10 @@ OnlyWebAssembly("emscripten-only-wasm",
                 cl::desc("Generate code that will only ever be used as WebAssembly, and is not valid JS or asm.js"),
                 cl::init(false));
 
+static cl::opt<int>
+RelooperSplitLimit("emscripten-relooper-split-limit",
+                   cl::desc("Maximum number of bytes of code per function the relooper may duplicate to make multiple-entry loops reducible (0 disables it, -1 uses a fifth of the function's code)"),
+                   cl::init(-1));
 
 extern "C" void LLVMInitializeJSBackendTarget() {
   // Register the target.
@@ -258,6 +285,7 @@ namespace {
     NameIntMap NamedGlobals; // globals that we export as metadata to JS, so it can access them by name
     std::map<std::string, unsigned> IndexedFunctions; // name -> index
     FunctionTableMap FunctionTables; // sig => list of functions
+    std::set<std::string> FunctionPointerCastSigs; // sigs at which a function of another sig can be called indirectly
     std::set<std::string> InvokeFuncNames; // Names of actually used invoke wrappers ('invoke_v', 'invoke_vii' etc)
     std::vector<std::string> GlobalInitializers;
     std::vector<std::string> Exports; // additional exports
@@ -269,14 +297,65 @@ namespace {
     std::vector<std::string> ExtraFunctions;
     std::set<const Function*> DeclaresNeedingTypeDeclarations; // list of declared funcs whose type we must declare asm.js-style with a usage, as they may not have another usage
 
+    // One object in the CyberDWARF data, written a record at a time.
+    struct CyberDWARFSection {
+      raw_ostream *OS = nullptr;
+      std::unique_ptr<raw_ostream> Owned;
+      std::string Buffer; // the records, when kept in memory
+      SmallString<128> TempPath; // the records, when written to a temp file
+      bool Empty = true;
+
+      void openBuffer() {
+        Owned.reset(new raw_string_ostream(Buffer));
+        OS = Owned.get();
+      }
+
+      void openTempFile() {
+        int FD;
+        if (std::error_code EC = sys::fs::createTemporaryFile("cyberdwarf", "json", FD, TempPath))
+          report_fatal_error("cannot create temporary file for CyberDWARF data: " + EC.message());
+        Owned.reset(new raw_fd_ostream(FD, /*shouldClose=*/true));
+        OS = Owned.get();
+      }
+
+      void add(std::string Record) {
+        // On Windows, paths can have \ separators
+        std::replace(Record.begin(), Record.end(), '\\', '/');
+        if (!Empty)
+          *OS << ",";
+        *OS << Record;
+        Empty = false;
+      }
+
+      // Writes out the records, and releases what holds them.
+      void close(raw_ostream &Out) {
+        Owned.reset();
+        if (TempPath.empty()) {
+          Out << Buffer;
+          std::string().swap(Buffer);
+          return;
+        }
+        auto BufOrErr = MemoryBuffer::getFile(TempPath);
+        if (!BufOrErr)
+          report_fatal_error("cannot read temporary file for CyberDWARF data: " + BufOrErr.getError().message());
+        Out << (*BufOrErr)->getBuffer();
+        sys::fs::remove(TempPath);
+      }
+    };
+
+    // Records are written as soon as the functions and types they describe
+    // are first reached. With -emscripten-cyberdwarf-file, the types go
+    // straight to that file and the other sections to temporary files which
+    // are appended to it at the end; otherwise all are kept for the metadata.
     struct {
       // 0 is reserved for void type
       unsigned MetadataNum = 1;
-      std::map<Metadata *, unsigned> IndexedMetadata;
+      DenseMap<const Metadata *, unsigned> IndexedMetadata;
       std::map<unsigned, std::string> VtableOffsets;
-      std::ostringstream TypeDebugData;
-      std::ostringstream TypeNameMap;
-      std::ostringstream FunctionMembers;
+      std::unique_ptr<raw_fd_ostream> File;
+      CyberDWARFSection Types;
+      CyberDWARFSection TypeNames;
+      CyberDWARFSection Functions;
     } cyberDWARFData;
 
     std::string CantValidate;
@@ -496,6 +575,16 @@ namespace {
       while (Table.size() < MinSize) Table.push_back("0");
       return Table;
     }
+    bool emulatesFunctionPointerCastsSelectively() {
+      return EmulatedFunctionPointers && EmulateFunctionPointerCasts && SelectiveFunctionPointerCasts && !Relocatable;
+    }
+    // Whether an indirect call of this type goes through the emulated function pointer
+    // path (ftCall_*) rather than the typed function table
+    bool usesEmulatedFunctionPointerCall(const FunctionType *FT) {
+      if (!EmulatedFunctionPointers) return false;
+      if (!emulatesFunctionPointerCastsSelectively()) return true;
+      return FunctionPointerCastSigs.count(getFunctionSignature(FT));
+    }
     bool usesFloat32(FunctionType* F) {
       if (F->getReturnType()->isFloatTy()) return true;
       for (FunctionType::param_iterator AI = F->param_begin(),
@@ -586,6 +675,13 @@ namespace {
       } else {
         Table.push_back(Name);
       }
+      if (WebAssembly && emulatesFunctionPointerCastsSelectively()) {
+        // calls that are not emulated use the typed tables, so the function must be at
+        // the same index there as in the single table
+        FunctionTable &TypedTable = FunctionTables[getFunctionSignature(F->getFunctionType())];
+        while (TypedTable.size() < Index) TypedTable.push_back("0");
+        TypedTable.push_back(Table[Index]);
+      }
       IndexedFunctions[Name] = Index;
       if (NoAliasingFunctionPointers) {
         NextFunctionIndex = Index+1;
@@ -650,13 +746,6 @@ namespace {
       return Relocatable ? "(gb + (" + G + ") | 0)" : G;
     }
 
-    unsigned getIDForMetadata(Metadata *MD) {
-      if (cyberDWARFData.IndexedMetadata.find(MD) == cyberDWARFData.IndexedMetadata.end()) {
-        cyberDWARFData.IndexedMetadata[MD] = cyberDWARFData.MetadataNum++;
-      }
-      return cyberDWARFData.IndexedMetadata[MD];
-    }
-
     // Return a constant we are about to write into a global as a numeric offset. If the
     // value is not known at compile time, emit a postSet to that location.
     unsigned getConstAsOffset(const Value *V, unsigned AbsoluteTarget) {
@@ -957,8 +1046,11 @@ namespace {
     void generateExpression(const User *I, raw_string_ostream& Code);
 
     // debug information
+    unsigned getIDForMetadata(Metadata *MD);
     std::string generateDebugRecordForVar(Metadata *MD);
-    void buildCyberDWARFData();
+    void startCyberDWARFData();
+    void addCyberDWARFFunction(const Function *F);
+    void finishCyberDWARFData();
 
     std::string getOpName(const Value*);
 
@@ -974,6 +1066,7 @@ namespace {
     // special analyses
 
     bool canReloop(const Function *F);
+    void findFunctionPointerCasts();
 
     // main entry point
 
@@ -3363,6 +3456,7 @@ void JSWriter::printFunctionBody(const Function *F) {
       F->getAttributes().hasAttribute(AttributeList::FunctionIndex, Attribute::OptimizeForSize)) {
     R.SetMinSize(true);
   }
+  R.SetSplitLimit(RelooperSplitLimit);
   R.SetAsmJSMode(1);
   Block *Entry = NULL;
   LLVMToRelooperMap LLVMToRelooper;
@@ -3467,9 +3561,15 @@ void JSWriter::printFunctionBody(const Function *F) {
     }
   }
 
-  // Calculate relooping and print
-  R.Calculate(Entry);
-  R.Render();
+  // Calculate relooping and print. This is timed separately from the rest of
+  // the writer under -time-passes.
+  {
+    NamedRegionTimer T("relooper", "Relooper", "js-backend", "JS backend",
+                       TimePassesIsEnabled);
+    R.Calculate(Entry);
+    NumRelooperSplitBytes += R.GetSplitBytes();
+    R.Render();
+  }
 
   // Emit local variables
   UsedVars["sp"] = i32;
@@ -3700,6 +3800,9 @@ void JSWriter::printFunction(const Function *F) {
   // Do alloca coloring at -O1 and higher.
   Allocas.analyze(*F, *DL, OptLevel != CodeGenOpt::None);
 
+  if (EnableCyberDWARF)
+    addCyberDWARFFunction(F);
+
   // Emit the function
 
   std::string Name = F->getName();
@@ -3982,7 +4085,7 @@ void JSWriter::printModuleBody() {
   for (FunctionTableMap::iterator I = FunctionTables.begin(), E = FunctionTables.end(); I != E; ++I) {
     Out << "  \"" << I->first << "\": \"var FUNCTION_TABLE_" << I->first << " = [";
     // wasm emulated function pointers use just one table
-    if (!(WebAssembly && EmulatedFunctionPointers && I->first != "X")) {
+    if (!(WebAssembly && EmulatedFunctionPointers && I->first != "X") || emulatesFunctionPointerCastsSelectively()) {
       FunctionTable &Table = I->second;
       // ensure power of two
       unsigned Size = 1;
@@ -4165,33 +4268,8 @@ void JSWriter::printModuleBody() {
     Out << "}";
   }
 
-  if (EnableCyberDWARF) {
-    Out << ",\"cyberdwarf_data\": {\n";
-    Out << "\"types\": {";
-
-    // Remove trailing comma
-    std::string TDD = cyberDWARFData.TypeDebugData.str().substr(0, cyberDWARFData.TypeDebugData.str().length() - 1);
-    // One Windows, paths can have \ separators
-    std::replace(TDD.begin(), TDD.end(), '\\', '/');
-    Out << TDD << "}, \"type_name_map\": {";
-
-    std::string TNM = cyberDWARFData.TypeNameMap.str().substr(0, cyberDWARFData.TypeNameMap.str().length() - 1);
-    std::replace(TNM.begin(), TNM.end(), '\\', '/');
-    Out << TNM << "}, \"functions\": {";
-
-    std::string FM = cyberDWARFData.FunctionMembers.str().substr(0, cyberDWARFData.FunctionMembers.str().length() - 1);
-    std::replace(FM.begin(), FM.end(), '\\', '/');
-    Out << FM << "}, \"vtable_offsets\": {";
-    bool first_elem = true;
-    for (auto VTO: cyberDWARFData.VtableOffsets) {
-      if (!first_elem) {
-        Out << ",";
-      }
-      Out << "\"" << VTO.first << "\":\"" << VTO.second << "\"";
-      first_elem = false;
-    }
-    Out << "}\n}";
-  }
+  if (EnableCyberDWARF)
+    finishCyberDWARFData();
 
   // for wasm shared emulated function pointers, we need to know a function pointer for each function name
   if (WebAssembly && Relocatable && EmulatedFunctionPointers) {
@@ -4445,103 +4523,91 @@ void JSWriter::parseConstant(const std::string& name, const Constant* CV, int Al
   }
 }
 
-std::string JSWriter::generateDebugRecordForVar(Metadata *MD) {
+unsigned JSWriter::getIDForMetadata(Metadata *MD) {
   // void shows up as nullptr for Metadata
-  if (!MD) {
-    cyberDWARFData.IndexedMetadata[0] = 0;
-    return "\"0\"";
-  }
-  if (cyberDWARFData.IndexedMetadata.find(MD) == cyberDWARFData.IndexedMetadata.end()) {
-    cyberDWARFData.IndexedMetadata[MD] = cyberDWARFData.MetadataNum++;
-  }
-  else {
-    return "\"" + utostr(cyberDWARFData.IndexedMetadata[MD]) + "\"";
-  }
-
-  std::string VarIDForJSON = "\"" + utostr(cyberDWARFData.IndexedMetadata[MD]) + "\"";
+  if (!MD)
+    return 0;
+  auto Inserted = cyberDWARFData.IndexedMetadata.insert(
+      std::make_pair(MD, cyberDWARFData.MetadataNum));
+  if (!Inserted.second)
+    return Inserted.first->second;
+  unsigned ID = cyberDWARFData.MetadataNum++;
+
+  // Records this one refers to are written before it, as they are reached.
+  std::string Record;
+  raw_string_ostream OS(Record);
+  OS << "\"" << ID << "\":";
 
   if (DIBasicType *BT = dyn_cast<DIBasicType>(MD)) {
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-    << "[0,\""
-    << BT->getName().str()
+    OS << "[0,\""
+    << BT->getName()
     << "\","
     << BT->getEncoding()
     << ","
     << BT->getOffsetInBits()
     << ","
     << BT->getSizeInBits()
-    << "],";
+    << "]";
   }
   else if (MDString *MDS = dyn_cast<MDString>(MD)) {
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-    << "[10,\"" << MDS->getString().str() << "\"],";
+    OS << "[10,\"" << MDS->getString() << "\"]";
   }
   else if (DIDerivedType *DT = dyn_cast<DIDerivedType>(MD)) {
     if (DT->getRawBaseType() && isa<MDString>(DT->getRawBaseType())) {
       auto MDS = cast<MDString>(DT->getRawBaseType());
-      cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-      << "[1, \""
-      << DT->getName().str()
+      OS << "[1, \""
+      << DT->getName()
       << "\","
       << DT->getTag()
       << ",\""
-      << MDS->getString().str()
+      << MDS->getString()
       << "\","
       << DT->getOffsetInBits()
       << ","
-      << DT->getSizeInBits() << "],";
+      << DT->getSizeInBits() << "]";
     }
     else {
-      if (cyberDWARFData.IndexedMetadata.find(DT->getRawBaseType()) == cyberDWARFData.IndexedMetadata.end()) {
-        generateDebugRecordForVar(DT->getRawBaseType());
-      }
-
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-        << "[1, \""
-        << DT->getName().str()
-        << "\","
-        << DT->getTag()
-        << ","
-        << cyberDWARFData.IndexedMetadata[DT->getRawBaseType()]
-        << ","
-        << DT->getOffsetInBits()
-        << ","
-        << DT->getSizeInBits() << "],";
+      unsigned BaseID = getIDForMetadata(DT->getRawBaseType());
+      OS << "[1, \""
+      << DT->getName()
+      << "\","
+      << DT->getTag()
+      << ","
+      << BaseID
+      << ","
+      << DT->getOffsetInBits()
+      << ","
+      << DT->getSizeInBits() << "]";
     }
   }
   else if (DICompositeType *CT = dyn_cast<DICompositeType>(MD)) {
 
-    if (CT->getIdentifier().str() != "") {
-      if (CT->isForwardDecl()) {
-        cyberDWARFData.TypeNameMap << "\"" << "fd_" << CT->getIdentifier().str() << "\":" << VarIDForJSON << ",";
-      } else {
-        cyberDWARFData.TypeNameMap << "\"" << CT->getIdentifier().str() << "\":" << VarIDForJSON << ",";
-      }
+    if (CT->getIdentifier() != "") {
+      std::string Prefix = CT->isForwardDecl() ? "fd_" : "";
+      cyberDWARFData.TypeNames.add("\"" + Prefix + CT->getIdentifier().str() +
+                                   "\":\"" + utostr(ID) + "\"");
     }
 
     // Pull in debug info for any used elements before emitting ours
     for (auto e : CT->getElements()) {
-      generateDebugRecordForVar(e);
+      getIDForMetadata(e);
     }
 
     // Build our base type, if we have one (arrays)
-    if (cyberDWARFData.IndexedMetadata.find(CT->getRawBaseType()) == cyberDWARFData.IndexedMetadata.end()) {
-      generateDebugRecordForVar(CT->getRawBaseType());
-    }
+    unsigned BaseID = getIDForMetadata(CT->getRawBaseType());
 
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-      << "[2, \""
-      << CT->getName().str()
+    OS << "[2, \""
+      << CT->getName()
       << "\","
       << CT->getTag()
       << ","
-      << cyberDWARFData.IndexedMetadata[CT->getRawBaseType()]
+      << BaseID
       << ","
       << CT->getOffsetInBits()
       << ","
       << CT->getSizeInBits()
       << ",\""
-      << CT->getIdentifier().str()
+      << CT->getIdentifier()
       << "\",[";
 
     bool first_elem = true;
@@ -4550,72 +4616,120 @@ std::string JSWriter::generateDebugRecordForVar(Metadata *MD) {
       if ((vx && vx->isStaticMember()) || isa<DISubroutineType>(e))
         continue;
       if (!first_elem) {
-        cyberDWARFData.TypeDebugData << ",";
+        OS << ",";
       }
       first_elem = false;
-      cyberDWARFData.TypeDebugData << generateDebugRecordForVar(e);
+      OS << generateDebugRecordForVar(e);
     }
 
-    cyberDWARFData.TypeDebugData << "]],";
+    OS << "]]";
 
   }
   else if (DISubroutineType *ST = dyn_cast<DISubroutineType>(MD)) {
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-    << "[3," << ST->getTag() << "],";
+    OS << "[3," << ST->getTag() << "]";
   }
   else if (DISubrange *SR = dyn_cast<DISubrange>(MD)) {
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-    << "[4," << SR->getCount() << "],";
+    OS << "[4," << SR->getCount() << "]";
   }
   else if (DISubprogram *SP = dyn_cast<DISubprogram>(MD)) {
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-    << "[5,\"" << SP->getName().str() << "\"],";
+    OS << "[5,\"" << SP->getName() << "\"]";
   }
   else if (DIEnumerator *E = dyn_cast<DIEnumerator>(MD)) {
-    cyberDWARFData.TypeDebugData << VarIDForJSON << ":"
-    << "[6,\"" << E->getName().str() << "\"," << E->getValue() << "],";
+    OS << "[6,\"" << E->getName() << "\"," << E->getValue() << "]";
   }
   else {
-    //MD->dump();
+    // Nothing to record, e.g. for a DIExpression
+    return ID;
   }
 
-  return VarIDForJSON;
+  cyberDWARFData.Types.add(OS.str());
+  return ID;
 }
 
-void JSWriter::buildCyberDWARFData() {
-  for (auto &F : TheModule->functions()) {
-    auto MD = F.getMetadata("dbg");
-    if (MD) {
-      auto *SP = cast<DISubprogram>(MD);
+std::string JSWriter::generateDebugRecordForVar(Metadata *MD) {
+  return "\"" + utostr(getIDForMetadata(MD)) + "\"";
+}
 
-      if (SP->getLinkageName() != "") {
-        cyberDWARFData.FunctionMembers << "\"" << SP->getLinkageName().str() << "\":{";
-      }
-      else {
-        cyberDWARFData.FunctionMembers << "\"" << SP->getName().str() << "\":{";
-      }
-      bool first_elem = true;
-      for (auto V : SP->getVariables()) {
-        auto RT = V->getRawType();
-        if (!first_elem) {
-          cyberDWARFData.FunctionMembers << ",";
-        }
-        first_elem = false;
-        cyberDWARFData.FunctionMembers << "\"" << V->getName().str() << "\":" << generateDebugRecordForVar(RT);
-      }
-      cyberDWARFData.FunctionMembers << "},";
+void JSWriter::startCyberDWARFData() {
+  if (CyberDWARFFile.empty()) {
+    cyberDWARFData.Types.openBuffer();
+    cyberDWARFData.TypeNames.openBuffer();
+    cyberDWARFData.Functions.openBuffer();
+    return;
+  }
+  std::error_code EC;
+  cyberDWARFData.File.reset(new raw_fd_ostream(CyberDWARFFile, EC, sys::fs::F_Text));
+  if (EC)
+    report_fatal_error("cannot open CyberDWARF file '" + CyberDWARFFile + "': " + EC.message());
+  *cyberDWARFData.File << "{\n\"types\": {";
+  cyberDWARFData.Types.OS = cyberDWARFData.File.get();
+  cyberDWARFData.TypeNames.openTempFile();
+  cyberDWARFData.Functions.openTempFile();
+}
+
+void JSWriter::addCyberDWARFFunction(const Function *F) {
+  auto *SP = cast_or_null<DISubprogram>(F->getMetadata("dbg"));
+  if (!SP)
+    return;
+
+  std::string Record;
+  raw_string_ostream OS(Record);
+  if (SP->getLinkageName() != "") {
+    OS << "\"" << SP->getLinkageName() << "\":{";
+  }
+  else {
+    OS << "\"" << SP->getName() << "\":{";
+  }
+  bool first_elem = true;
+  for (auto V : SP->getVariables()) {
+    if (!first_elem) {
+      OS << ",";
     }
+    first_elem = false;
+    OS << "\"" << V->getName() << "\":" << generateDebugRecordForVar(V->getRawType());
   }
+  OS << "}";
+  cyberDWARFData.Functions.add(OS.str());
+}
 
+void JSWriter::finishCyberDWARFData() {
   // Need to dump any types under each compilation unit's retained types
-  auto CUs = TheModule->getNamedMetadata("llvm.dbg.cu");
+  if (auto CUs = TheModule->getNamedMetadata("llvm.dbg.cu")) {
+    for (auto CUi : CUs->operands()) {
+      auto CU = cast<DICompileUnit>(CUi);
+      for (auto RTi : CU->getRetainedTypes()) {
+        getIDForMetadata(RTi);
+      }
+    }
+  }
 
-  for (auto CUi : CUs->operands()) {
-    auto CU = cast<DICompileUnit>(CUi);
-    auto RT = CU->getRetainedTypes();
-    for (auto RTi : RT) {
-      generateDebugRecordForVar(RTi);
+  raw_ostream &OS = cyberDWARFData.File ? *cyberDWARFData.File : Out;
+  if (!cyberDWARFData.File) {
+    OS << ",\"cyberdwarf_data\": {\n";
+    OS << "\"types\": {";
+    cyberDWARFData.Types.close(OS);
+  }
+  OS << "}, \"type_name_map\": {";
+  cyberDWARFData.TypeNames.close(OS);
+  OS << "}, \"functions\": {";
+  cyberDWARFData.Functions.close(OS);
+  OS << "}, \"vtable_offsets\": {";
+  bool first_elem = true;
+  for (auto VTO: cyberDWARFData.VtableOffsets) {
+    if (!first_elem) {
+      OS << ",";
     }
+    OS << "\"" << VTO.first << "\":\"" << VTO.second << "\"";
+    first_elem = false;
+  }
+  OS << "}\n}";
+
+  if (cyberDWARFData.File) {
+    OS << "\n";
+    cyberDWARFData.File->close();
+    if (cyberDWARFData.File->has_error())
+      report_fatal_error("cannot write CyberDWARF file '" + CyberDWARFFile + "'");
+    cyberDWARFData.File.reset();
   }
 }
 
@@ -4657,6 +4771,126 @@ bool JSWriter::canReloop(const Function *F) {
   return true;
 }
 
+static FunctionType *getPointeeFunctionType(Type *T) {
+  if (PointerType *PT = dyn_cast<PointerType>(T)) {
+    return dyn_cast<FunctionType>(PT->getElementType());
+  }
+  return nullptr;
+}
+
+// A cast of a function whose only uses are as the callee of calls is not a function
+// pointer, as those calls are emitted as direct calls
+static bool isOnlyDirectlyCalled(const Value *V) {
+  if (!isa<Function>(V->stripPointerCasts())) return false;
+  for (const Use &U : V->uses()) {
+    ImmutableCallSite CS(U.getUser());
+    if (!CS || !CS.isCallee(&U)) return false;
+  }
+  return true;
+}
+
+// Finds the signatures at which an indirect call can reach a function of another
+// signature, which are the only calls that need function pointer cast emulation. A
+// function pointer changes signature when it is cast to another function pointer type,
+// or when it is cast to data (an integer or other pointer) and data is cast back to a
+// function pointer of a different signature. Memory is treated like data: storing a
+// function pointer (or placing one in an initializer) casts it to data, and loading
+// one casts data back, since it may have been stored through another pointer type.
+// A call through a cast of a function, including a direct call, also passes its
+// arguments and result across the cast, so a function pointer argument or result
+// can change signature there without being cast itself.
+void JSWriter::findFunctionPointerCasts() {
+  std::set<std::string> ToDataSigs, FromDataSigs;
+  // Notes that a value of type SrcTy is used as a value of type DstTy.
+  auto NoteFlow = [&](Type *SrcTy, Type *DstTy) {
+    FunctionType *Src = getPointeeFunctionType(SrcTy);
+    FunctionType *Dst = getPointeeFunctionType(DstTy);
+    if (Src && Dst) {
+      std::string SrcSig = getFunctionSignature(Src), DstSig = getFunctionSignature(Dst);
+      if (SrcSig != DstSig) {
+        FunctionPointerCastSigs.insert(SrcSig);
+        FunctionPointerCastSigs.insert(DstSig);
+      }
+    } else if (Src) {
+      ToDataSigs.insert(getFunctionSignature(Src));
+    } else if (Dst) {
+      FromDataSigs.insert(getFunctionSignature(Dst));
+    }
+  };
+  std::set<const Value*> Seen;
+  std::vector<const Value*> Worklist;
+  for (Module::const_global_iterator I = TheModule->global_begin(), E = TheModule->global_end(); I != E; ++I) {
+    if (I->hasInitializer()) Worklist.push_back(I->getInitializer());
+  }
+  for (const Function &F : *TheModule) {
+    for (const BasicBlock &BB : F) {
+      for (const Instruction &I : BB) {
+        Worklist.push_back(&I);
+        for (const Value *Op : I.operands()) {
+          if (isa<Constant>(Op) && !isa<GlobalValue>(Op)) Worklist.push_back(Op);
+        }
+      }
+    }
+  }
+  while (!Worklist.empty()) {
+    const Value *V = Worklist.back();
+    Worklist.pop_back();
+    if (isa<Constant>(V)) {
+      if (!Seen.insert(V).second) continue;
+      for (const Value *Op : cast<Constant>(V)->operands()) {
+        if (isa<ConstantAggregate>(V)) {
+          if (FunctionType *FT = getPointeeFunctionType(Op->getType())) {
+            ToDataSigs.insert(getFunctionSignature(FT));
+          }
+        }
+        if (!isa<GlobalValue>(Op)) Worklist.push_back(Op);
+      }
+    }
+    if (const StoreInst *SI = dyn_cast<StoreInst>(V)) {
+      if (FunctionType *FT = getPointeeFunctionType(SI->getValueOperand()->getType())) {
+        ToDataSigs.insert(getFunctionSignature(FT));
+      }
+      continue;
+    }
+    if (const LoadInst *LI = dyn_cast<LoadInst>(V)) {
+      if (FunctionType *FT = getPointeeFunctionType(LI->getType())) {
+        FromDataSigs.insert(getFunctionSignature(FT));
+      }
+      continue;
+    }
+    const Operator *Op = dyn_cast<Operator>(V);
+    if (!Op) continue;
+    unsigned Opcode = Op->getOpcode();
+    if (Opcode != Instruction::BitCast && Opcode != Instruction::IntToPtr &&
+        Opcode != Instruction::PtrToInt && Opcode != Instruction::AddrSpaceCast) continue;
+    FunctionType *From = getPointeeFunctionType(Op->getOperand(0)->getType());
+    FunctionType *To = getPointeeFunctionType(Op->getType());
+    if (!From && !To) continue;
+    if (From && To) {
+      // Calls through the cast pass To's parameters to From's, and return From's
+      // result as To's.
+      for (unsigned i = 0, e = std::min(From->getNumParams(), To->getNumParams()); i < e; i++) {
+        NoteFlow(To->getParamType(i), From->getParamType(i));
+      }
+      NoteFlow(From->getReturnType(), To->getReturnType());
+    }
+    if (isOnlyDirectlyCalled(Op)) continue;
+    if (From && To) {
+      std::string ToSig = getFunctionSignature(To);
+      if (getFunctionSignature(From) != ToSig) FunctionPointerCastSigs.insert(ToSig);
+    } else if (From) {
+      ToDataSigs.insert(getFunctionSignature(From));
+    } else {
+      FromDataSigs.insert(getFunctionSignature(To));
+    }
+  }
+  for (const std::string &Sig : FromDataSigs) {
+    if (ToDataSigs.size() > 1 || (ToDataSigs.size() == 1 && *ToDataSigs.begin() != Sig)) {
+      FunctionPointerCastSigs.insert(Sig);
+    }
+  }
+}
+
 // main entry
 
 void JSWriter::printCommaSeparated(const HeapData data) {
@@ -4688,12 +4922,14 @@ bool JSWriter::runOnModule(Module &M) {
   assert(Relocatable ? GlobalBase == 0 : true);
   assert(Relocatable ? EmulatedFunctionPointers : true);
 
-  // Build debug data first, so that inline metadata can reuse the indicies
   if (EnableCyberDWARF)
-    buildCyberDWARFData();
+    startCyberDWARFData();
 
   setupCallHandlers();
 
+  if (emulatesFunctionPointerCastsSelectively())
+    findFunctionPointerCasts();
+
   printProgram("", "");
 
   return false;
@@ -4794,10 +5030,16 @@ bool JSTargetMachine::addPassesToEmitFile(PassManagerBase &PM, raw_pwrite_stream
     // in "byval" during optimization also allows some dead stores to be
     // eliminated, because "byval" is a stronger constraint than what
     // ExpandByVal expands it to.
-    PM.add(createExpandByValPass());
+    // Small struct results are returned in globals, which threads would share.
+    PM.add(createExpandByValPass(ScalarizeSmallStructs && !EnablePthreads));
 
     PM.add(createPromoteI1OpsPass());
 
+    // Fold loads from constant data while global initializers still have
+    // their types; FlattenGlobals turns them into bytes and relocations.
+    if (getOptLevel() != CodeGenOpt::None)
+      PM.add(createEmscriptenFoldConstantLoadsPass());
+
     // We should not place arbitrary passes after ExpandConstantExpr
     // because they might reintroduce ConstantExprs.
     PM.add(createExpandConstantExprPass());
@@ -4823,7 +5065,10 @@ bool JSTargetMachine::addPassesToEmitFile(PassManagerBase &PM, raw_pwrite_stream
 
     // The type legalization passes (ExpandLargeIntegers and PromoteIntegers) do
     // not handle constexprs and create GEPs, so they go between those passes.
+    // Both work one function at a time; PromoteIntegerSignatures rewrites the
+    // signatures PromoteIntegers relies on beforehand.
     PM.add(createExpandLargeIntegersPass());
+    PM.add(createPromoteIntegerSignaturesPass());
     PM.add(createPromoteIntegersPass());
     // Rewrite atomic and volatile instructions with intrinsic calls.
     PM.add(createRewriteAtomicsPass());
@@ -34,30 +34,58 @@
 //
 // This is because PNaCl Clang generates the latter and not the former.
 //
+// Optionally, internal functions that are only called directly can instead
+// take small structs (up to four scalar fields) as separate scalar arguments,
+// and return them as a scalar return value for the first field plus one
+// global per other field, like tempRet0. Neither side then needs a stack copy
+// of the struct, as the remaining struct allocas are split into scalars.
+//
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Attributes.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/Transforms/NaCl.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include <map>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "expand-byval"
+
+STATISTIC(NumScalarizedFunctions,
+          "Number of functions passing small structs as scalars");
+
 namespace {
   // This is a ModulePass so that it can strip attributes from
   // declared functions as well as defined functions.
   class ExpandByVal : public ModulePass {
   public:
     static char ID; // Pass identification, replacement for typeid
-    ExpandByVal() : ModulePass(ID) {
+    explicit ExpandByVal(bool ScalarizeSmallStructs = false)
+        : ModulePass(ID), ScalarizeSmallStructs(ScalarizeSmallStructs) {
       initializeExpandByValPass(*PassRegistry::getPassRegistry());
     }
 
     virtual bool runOnModule(Module &M);
+
+  private:
+    bool ScalarizeSmallStructs;
+    // The globals that return the fields after the first of a small struct,
+    // by field index and type.
+    std::map<std::pair<unsigned, Type *>, GlobalVariable *> StructRetGlobals;
+
+    GlobalVariable *getStructRetGlobal(Module &M, unsigned Field, Type *Ty);
+    bool scalarizeSmallStructs(Function *Func,
+                               SetVector<AllocaInst *> &Allocas);
   };
 }
 
@@ -176,10 +204,369 @@ static bool ExpandCall(DataLayout *DL, InstType *Call) {
   return Modify;
 }
 
+static const unsigned MaxScalarizedFields = 4;
+
+// Returns Ty if it is a struct that can be passed as scalars. Packed structs,
+// and structs with fields at offsets their types are not aligned to, are
+// left alone.
+static StructType *getSmallStructType(const DataLayout &DL, Type *Ty) {
+  auto *STy = dyn_cast<StructType>(Ty);
+  if (!STy || STy->isOpaque() || STy->isPacked() ||
+      STy->getNumElements() == 0 ||
+      STy->getNumElements() > MaxScalarizedFields)
+    return nullptr;
+  for (Type *ElemTy : STy->elements())
+    if (!ElemTy->isFloatTy() && !ElemTy->isDoubleTy() &&
+        !ElemTy->isPointerTy() &&
+        !(ElemTy->isIntegerTy() && ElemTy->getIntegerBitWidth() <= 32))
+      return nullptr;
+  const StructLayout *Layout = DL.getStructLayout(STy);
+  for (unsigned I = 0, E = STy->getNumElements(); I != E; ++I)
+    if (Layout->getElementOffset(I) %
+            DL.getABITypeAlignment(STy->getElementType(I)) !=
+        0)
+      return nullptr;
+  return STy;
+}
+
+static StructType *getSmallStructArgType(Function *Func, unsigned ArgNo) {
+  Type *Ty = Func->getFunctionType()->getParamType(ArgNo);
+  return Ty->isPointerTy()
+             ? getSmallStructType(Func->getParent()->getDataLayout(),
+                                  Ty->getPointerElementType())
+             : nullptr;
+}
+
+// Returns whether the address Ptr may be kept beyond its uses here: the sret
+// buffer is replaced by a local, which must not outlive the callee.
+static bool addressEscapes(Value *Ptr) {
+  for (User *U : Ptr->users()) {
+    if (isa<LoadInst>(U) || isa<MemIntrinsic>(U))
+      continue;
+    if (auto *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->getValueOperand() == Ptr)
+        return true;
+      continue;
+    }
+    if (auto *II = dyn_cast<IntrinsicInst>(U))
+      if (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+          II->getIntrinsicID() == Intrinsic::lifetime_end)
+        continue;
+    if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+      if (addressEscapes(U))
+        return true;
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
+
+static bool isLifetimeMarkerCast(User *U) {
+  if (!isa<BitCastInst>(U))
+    return false;
+  for (User *CU : U->users()) {
+    auto *II = dyn_cast<IntrinsicInst>(CU);
+    if (!II || (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+                II->getIntrinsicID() != Intrinsic::lifetime_end))
+      return false;
+  }
+  return true;
+}
+
+// Splits an alloca of a small struct into one alloca per field, if it is only
+// accessed by loads and stores of whole fields. The new allocas are added to
+// Promotable.
+static void splitSmallStructAlloca(AllocaInst *AI,
+                                   std::vector<AllocaInst *> &Promotable) {
+  StructType *STy = getSmallStructType(AI->getModule()->getDataLayout(),
+                                       AI->getAllocatedType());
+  if (!STy || AI->isArrayAllocation())
+    return;
+  SmallVector<GetElementPtrInst *, 8> GEPs;
+  SmallVector<Instruction *, 4> Markers;
+  for (User *U : AI->users()) {
+    if (isLifetimeMarkerCast(U)) {
+      Markers.push_back(cast<Instruction>(U));
+      continue;
+    }
+    auto *GEP = dyn_cast<GetElementPtrInst>(U);
+    if (!GEP || GEP->getPointerOperand() != AI || GEP->getNumIndices() != 2 ||
+        !GEP->hasAllConstantIndices() ||
+        !cast<ConstantInt>(GEP->getOperand(1))->isZero())
+      return;
+    Type *FieldTy = GEP->getResultElementType();
+    for (User *GU : GEP->users()) {
+      if (auto *LI = dyn_cast<LoadInst>(GU)) {
+        if (LI->isVolatile() || LI->getType() != FieldTy)
+          return;
+      } else if (auto *SI = dyn_cast<StoreInst>(GU)) {
+        if (SI->isVolatile() || SI->getValueOperand() == GEP ||
+            SI->getValueOperand()->getType() != FieldTy)
+          return;
+      } else {
+        return;
+      }
+    }
+    GEPs.push_back(GEP);
+  }
+
+  SmallVector<AllocaInst *, MaxScalarizedFields> Fields;
+  for (unsigned I = 0, E = STy->getNumElements(); I != E; ++I) {
+    Fields.push_back(new AllocaInst(STy->getElementType(I),
+                                    AI->getType()->getAddressSpace(),
+                                    AI->getName() + "." + Twine(I), AI));
+    Promotable.push_back(Fields.back());
+  }
+  for (GetElementPtrInst *GEP : GEPs) {
+    unsigned Field = cast<ConstantInt>(GEP->getOperand(2))->getZExtValue();
+    GEP->replaceAllUsesWith(Fields[Field]);
+    GEP->eraseFromParent();
+  }
+  for (Instruction *Marker : Markers) {
+    while (!Marker->use_empty())
+      cast<Instruction>(Marker->user_back())->eraseFromParent();
+    Marker->eraseFromParent();
+  }
+  AI->eraseFromParent();
+}
+
+static Value *createFieldPtr(IRBuilder<> &IRB, Value *Ptr, unsigned Field) {
+  return IRB.CreateConstInBoundsGEP2_32(
+      Ptr->getType()->getPointerElementType(), Ptr, 0, Field,
+      Ptr->getName() + ".field" + Twine(Field));
+}
+
+// Returns the alignment of field Field of a struct at an address aligned to
+// Align, or to the ABI alignment of the struct if Align is 0.
+static unsigned getFieldAlign(const DataLayout &DL, StructType *STy,
+                              unsigned Align, unsigned Field) {
+  if (!Align)
+    Align = DL.getABITypeAlignment(STy);
+  return MinAlign(Align, DL.getStructLayout(STy)->getElementOffset(Field));
+}
+
+static LoadInst *loadField(IRBuilder<> &IRB, const DataLayout &DL,
+                           StructType *STy, Value *Ptr, unsigned Align,
+                           unsigned Field) {
+  return IRB.CreateAlignedLoad(createFieldPtr(IRB, Ptr, Field),
+                               getFieldAlign(DL, STy, Align, Field));
+}
+
+static StoreInst *storeField(IRBuilder<> &IRB, const DataLayout &DL,
+                             StructType *STy, Value *Val, Value *Ptr,
+                             unsigned Align, unsigned Field) {
+  return IRB.CreateAlignedStore(Val, createFieldPtr(IRB, Ptr, Field),
+                                getFieldAlign(DL, STy, Align, Field));
+}
+
+GlobalVariable *ExpandByVal::getStructRetGlobal(Module &M, unsigned Field,
+                                                Type *Ty) {
+  GlobalVariable *&GV = StructRetGlobals[std::make_pair(Field, Ty)];
+  if (!GV)
+    GV = new GlobalVariable(M, Ty, /*isConstant=*/false,
+                            GlobalValue::InternalLinkage,
+                            Constant::getNullValue(Ty),
+                            "struct_ret" + Twine(Field));
+  return GV;
+}
+
+// Rewrites Func to take its small byval structs as scalars and to return its
+// small sret struct in its return value and the struct_ret globals. Func must
+// be internal and only called directly, so all calls can be updated. Struct
+// allocas that may now be split are added to Allocas.
+bool ExpandByVal::scalarizeSmallStructs(Function *Func,
+                                        SetVector<AllocaInst *> &Allocas) {
+  if (!Func->hasLocalLinkage() || Func->isDeclaration() || Func->isVarArg())
+    return false;
+  SmallVector<CallInst *, 8> Calls;
+  for (Use &U : Func->uses()) {
+    auto *Call = dyn_cast<CallInst>(U.getUser());
+    if (!Call || Call->getCalledValue() != Func || Call->isMustTailCall())
+      return false;
+    Calls.push_back(Call);
+  }
+
+  FunctionType *FTy = Func->getFunctionType();
+  AttributeList Attrs = Func->getAttributes();
+  SmallVector<StructType *, 8> ByValTypes;
+  StructType *SRetType = nullptr;
+  unsigned SRetArgNo = 0;
+  bool Changed = false;
+  for (unsigned ArgNo = 0, E = FTy->getNumParams(); ArgNo != E; ++ArgNo) {
+    StructType *STy = getSmallStructArgType(Func, ArgNo);
+    if (STy && Attrs.hasParamAttribute(ArgNo, Attribute::ByVal)) {
+      ByValTypes.push_back(STy);
+      Changed = true;
+      continue;
+    }
+    ByValTypes.push_back(nullptr);
+    if (STy && !SRetType && FTy->getReturnType()->isVoidTy() &&
+        Attrs.hasParamAttribute(ArgNo, Attribute::StructRet) &&
+        Attrs.hasParamAttribute(ArgNo, Attribute::NoAlias) &&
+        !addressEscapes(Func->arg_begin() + ArgNo)) {
+      SRetType = STy;
+      SRetArgNo = ArgNo;
+      Changed = true;
+    }
+  }
+  if (!Changed)
+    return false;
+
+  // Build the new signature. The attributes of the scalars are left empty,
+  // and the return attributes are dropped if the return type changes.
+  LLVMContext &Ctx = Func->getContext();
+  SmallVector<Type *, 8> Params;
+  SmallVector<AttributeSet, 8> ParamAttrs;
+  for (unsigned ArgNo = 0, E = FTy->getNumParams(); ArgNo != E; ++ArgNo) {
+    if (SRetType && ArgNo == SRetArgNo)
+      continue;
+    if (StructType *STy = ByValTypes[ArgNo]) {
+      for (Type *ElemTy : STy->elements()) {
+        Params.push_back(ElemTy);
+        ParamAttrs.push_back(AttributeSet());
+      }
+      continue;
+    }
+    Params.push_back(FTy->getParamType(ArgNo));
+    ParamAttrs.push_back(Attrs.getParamAttributes(ArgNo));
+  }
+  Type *RetTy = SRetType ? SRetType->getElementType(0) : FTy->getReturnType();
+  AttributeSet RetAttrs = SRetType ? AttributeSet() : Attrs.getRetAttributes();
+  FunctionType *NFTy = FunctionType::get(RetTy, Params, /*isVarArg=*/false);
+  Function *NewFunc = RecreateFunction(Func, NFTy);
+  NewFunc->setAttributes(
+      AttributeList::get(Ctx, Attrs.getFnAttributes(), RetAttrs, ParamAttrs));
+  NewFunc->setSubprogram(Func->getSubprogram());
+
+  // Move the arguments across. Small structs get a local copy, built from
+  // the scalars, which is split up later.
+  Module *M = Func->getParent();
+  const DataLayout &DL = M->getDataLayout();
+  IRBuilder<> IRB(&*NewFunc->getEntryBlock().getFirstInsertionPt());
+  AllocaInst *SRetBuf = nullptr;
+  auto NewArg = NewFunc->arg_begin();
+  for (Argument &Arg : Func->args()) {
+    unsigned ArgNo = Arg.getArgNo();
+    if (SRetType && ArgNo == SRetArgNo) {
+      SRetBuf = IRB.CreateAlloca(SRetType, nullptr, Arg.getName());
+      Arg.replaceAllUsesWith(SRetBuf);
+      Allocas.insert(SRetBuf);
+    } else if (StructType *STy = ByValTypes[ArgNo]) {
+      AllocaInst *Copy = IRB.CreateAlloca(STy, nullptr, Arg.getName());
+      for (unsigned I = 0, E = STy->getNumElements(); I != E; ++I) {
+        NewArg->setName(Arg.getName() + "." + Twine(I));
+        storeField(IRB, DL, STy, &*NewArg++, Copy, Copy->getAlignment(), I);
+      }
+      Arg.replaceAllUsesWith(Copy);
+      Allocas.insert(Copy);
+    } else {
+      Arg.replaceAllUsesWith(&*NewArg);
+      NewArg->takeName(&Arg);
+      ++NewArg;
+    }
+  }
+
+  // Return the first field, and pass the others in globals.
+  if (SRetType) {
+    for (BasicBlock &BB : *NewFunc) {
+      auto *Ret = dyn_cast<ReturnInst>(BB.getTerminator());
+      if (!Ret)
+        continue;
+      IRB.SetInsertPoint(Ret);
+      unsigned Align = SRetBuf->getAlignment();
+      for (unsigned I = 1, E = SRetType->getNumElements(); I != E; ++I)
+        IRB.CreateStore(loadField(IRB, DL, SRetType, SRetBuf, Align, I),
+                        getStructRetGlobal(*M, I, SRetType->getElementType(I)));
+      IRB.CreateRet(loadField(IRB, DL, SRetType, SRetBuf, Align, 0));
+      Ret->eraseFromParent();
+    }
+  }
+
+  for (CallInst *Call : Calls) {
+    IRB.SetInsertPoint(Call);
+    SmallVector<Value *, 8> Args;
+    SmallVector<AttributeSet, 8> CallParamAttrs;
+    AttributeList CallAttrs = Call->getAttributes();
+    Value *SRetPtr = nullptr;
+    unsigned SRetAlign = 0;
+    for (unsigned ArgNo = 0, E = FTy->getNumParams(); ArgNo != E; ++ArgNo) {
+      Value *ArgVal = Call->getArgOperand(ArgNo);
+      // The pointer is as aligned as the call or the callee promise.
+      unsigned Align = std::max(CallAttrs.getParamAlignment(ArgNo),
+                                Attrs.getParamAlignment(ArgNo));
+      if (SRetType && ArgNo == SRetArgNo) {
+        SRetPtr = ArgVal;
+        SRetAlign = Align;
+        continue;
+      }
+      if (StructType *STy = ByValTypes[ArgNo]) {
+        for (unsigned I = 0, E = STy->getNumElements(); I != E; ++I) {
+          Args.push_back(loadField(IRB, DL, STy, ArgVal, Align, I));
+          CallParamAttrs.push_back(AttributeSet());
+        }
+        if (auto *AI = dyn_cast<AllocaInst>(ArgVal))
+          Allocas.insert(AI);
+        continue;
+      }
+      Args.push_back(ArgVal);
+      CallParamAttrs.push_back(CallAttrs.getParamAttributes(ArgNo));
+    }
+    CallInst *NewCall = IRB.CreateCall(NewFunc, Args);
+    NewCall->setAttributes(AttributeList::get(
+        Ctx, CallAttrs.getFnAttributes(),
+        SRetType ? AttributeSet() : CallAttrs.getRetAttributes(),
+        CallParamAttrs));
+    NewCall->setCallingConv(Call->getCallingConv());
+    NewCall->setDebugLoc(Call->getDebugLoc());
+    if (SRetType) {
+      storeField(IRB, DL, SRetType, NewCall, SRetPtr, SRetAlign, 0);
+      for (unsigned I = 1, E = SRetType->getNumElements(); I != E; ++I)
+        storeField(IRB, DL, SRetType,
+                   IRB.CreateLoad(
+                       getStructRetGlobal(*M, I, SRetType->getElementType(I))),
+                   SRetPtr, SRetAlign, I);
+      if (auto *AI = dyn_cast<AllocaInst>(SRetPtr))
+        Allocas.insert(AI);
+    } else {
+      NewCall->takeName(Call);
+      Call->replaceAllUsesWith(NewCall);
+    }
+    Call->eraseFromParent();
+  }
+
+  Func->eraseFromParent();
+  NewFunc->removeDeadConstantUsers();
+  ++NumScalarizedFunctions;
+  return true;
+}
+
 bool ExpandByVal::runOnModule(Module &M) {
   bool Modified = false;
   DataLayout DL(&M);
 
+  if (ScalarizeSmallStructs) {
+    SetVector<AllocaInst *> Allocas;
+    for (Module::iterator I = M.begin(), E = M.end(); I != E;) {
+      Function *Func = &*I++;
+      Modified |= scalarizeSmallStructs(Func, Allocas);
+    }
+    // Split up the struct copies that are left, and promote the fields.
+    std::map<Function *, std::vector<AllocaInst *>> Promotable;
+    for (AllocaInst *AI : Allocas)
+      splitSmallStructAlloca(AI, Promotable[AI->getFunction()]);
+    for (auto &FuncAllocas : Promotable) {
+      std::vector<AllocaInst *> ToPromote;
+      for (AllocaInst *AI : FuncAllocas.second)
+        if (isAllocaPromotable(AI))
+          ToPromote.push_back(AI);
+      if (ToPromote.empty())
+        continue;
+      DominatorTree DT(*FuncAllocas.first);
+      PromoteMemToReg(ToPromote, DT);
+    }
+  }
+
   for (Module::iterator Func = M.begin(), E = M.end(); Func != E; ++Func) {
     AttributeList NewAttrs = RemoveAttrs(Func->getContext(),
                                         Func->getAttributes());
@@ -202,6 +589,6 @@ bool ExpandByVal::runOnModule(Module &M) {
   return Modified;
 }
 
-ModulePass *llvm::createExpandByValPass() {
-  return new ExpandByVal();
+ModulePass *llvm::createExpandByValPass(bool ScalarizeSmallStructs) {
+  return new ExpandByVal(ScalarizeSmallStructs);
 }
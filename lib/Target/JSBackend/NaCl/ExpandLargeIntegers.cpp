@@ -645,7 +645,7 @@ bool ExpandLargeIntegers::runOnFunction(Function &F) {
   // TODO(jfb) This should loop to handle nested forward PHIs.
 
   ConversionState State;
-  DataLayout DL(F.getParent());
+  const DataLayout &DL = F.getParent()->getDataLayout();
   bool Modified = false;
   ReversePostOrderTraversal<Function *> RPOT(&F);
   for (ReversePostOrderTraversal<Function *>::rpo_iterator FI = RPOT.begin(),
@@ -14,22 +14,47 @@
 // The callee explicitly allocates space for the variable arguments on
 // the stack using "alloca".
 //
+// Optionally, internal varargs functions whose va_lists do not escape are
+// first cloned into versions that take the variable arguments of a direct
+// call as ordinary parameters, so those calls need no buffer at all.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/NaCl.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include <map>
+#include <vector>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "expand-varargs"
+
+STATISTIC(NumSpecializedCalls,
+          "Number of varargs calls redirected to a fixed-arity clone");
+STATISTIC(NumSpecializations, "Number of fixed-arity clones created");
+
+static cl::opt<unsigned> SpecializeMaxArgs(
+    "expand-varargs-specialize-max-args",
+    cl::desc("Clone internal varargs functions into fixed-arity versions for "
+             "direct calls passing at most this many variable arguments"),
+    cl::init(0));
+
 namespace {
 class ExpandVarArgs : public ModulePass {
 public:
@@ -286,10 +311,239 @@ static bool ExpandVarArgCall(Module *M, InstType *Call, DataLayout *DL) {
   return true;
 }
 
+// Finds the va_lists of Func, and checks that their only uses are va_start,
+// va_arg, va_end and lifetime markers, so the variable arguments are only
+// ever read in order by va_arg in Func itself. Returns false otherwise.
+static bool FindLocalVALists(Function *Func,
+                             SmallVectorImpl<AllocaInst *> &VALists) {
+  for (BasicBlock &BB : *Func) {
+    for (Instruction &I : BB) {
+      Value *ArgList;
+      if (auto *VAS = dyn_cast<VAStartInst>(&I))
+        ArgList = VAS->getArgList();
+      else if (auto *VI = dyn_cast<VAArgInst>(&I))
+        ArgList = VI->getPointerOperand();
+      else if (isa<VACopyInst>(&I))
+        return false;
+      else
+        continue;
+      auto *AI = dyn_cast<AllocaInst>(ArgList->stripPointerCasts());
+      if (!AI)
+        return false;
+      if (!is_contained(VALists, AI))
+        VALists.push_back(AI);
+    }
+  }
+
+  SmallVector<Value *, 4> Worklist(VALists.begin(), VALists.end());
+  while (!Worklist.empty()) {
+    Value *V = Worklist.pop_back_val();
+    for (User *U : V->users()) {
+      if (isa<BitCastInst>(U)) {
+        Worklist.push_back(U);
+        continue;
+      }
+      if (isa<VAStartInst>(U) || isa<VAEndInst>(U) || isa<VAArgInst>(U))
+        continue;
+      if (auto *II = dyn_cast<IntrinsicInst>(U))
+        if (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+            II->getIntrinsicID() == Intrinsic::lifetime_end)
+          continue;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Replaces a va_list of a fixed-arity clone by the index of the next argument
+// to read, and each va_arg by a select of that argument. Returns the alloca
+// of the index, which can be promoted to a register.
+static AllocaInst *ReplaceVAList(Function *NewFunc, AllocaInst *VAList,
+                                 ArrayRef<Argument *> VarArgs) {
+  LLVMContext &Ctx = NewFunc->getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  IRBuilder<> IRB(&*NewFunc->getEntryBlock().getFirstInsertionPt());
+  AllocaInst *Index = IRB.CreateAlloca(I32, nullptr, "vararg_index");
+
+  SmallVector<Instruction *, 8> Uses;
+  SmallVector<Instruction *, 4> Casts;
+  SmallVector<Value *, 4> Worklist(1, VAList);
+  while (!Worklist.empty()) {
+    Value *V = Worklist.pop_back_val();
+    for (User *U : V->users()) {
+      if (isa<BitCastInst>(U)) {
+        Casts.push_back(cast<Instruction>(U));
+        Worklist.push_back(U);
+      } else {
+        Uses.push_back(cast<Instruction>(U));
+      }
+    }
+  }
+
+  for (Instruction *I : Uses) {
+    if (auto *VI = dyn_cast<VAArgInst>(I)) {
+      IRB.SetInsertPoint(VI);
+      Value *Current = IRB.CreateLoad(Index, "vararg_current");
+      Type *Ty = VI->getType();
+      // Reading an argument as a type it was not passed as is undefined, so
+      // only arguments of the right type are candidates.
+      Value *Result = UndefValue::get(Ty);
+      for (unsigned I = VarArgs.size(); I-- > 0;) {
+        Value *Arg = VarArgs[I];
+        if (Arg->getType() != Ty) {
+          if (!Arg->getType()->isPointerTy() || !Ty->isPointerTy())
+            continue;
+          Arg = IRB.CreateBitCast(Arg, Ty);
+        }
+        Result = IRB.CreateSelect(
+            IRB.CreateICmpEQ(Current, ConstantInt::get(I32, I)), Arg, Result);
+      }
+      IRB.CreateStore(IRB.CreateAdd(Current, ConstantInt::get(I32, 1)), Index);
+      Result->takeName(VI);
+      VI->replaceAllUsesWith(Result);
+    } else if (isa<VAStartInst>(I)) {
+      new StoreInst(ConstantInt::get(I32, 0), Index, I);
+    }
+    I->eraseFromParent();
+  }
+  for (auto It = Casts.rbegin(), E = Casts.rend(); It != E; ++It)
+    (*It)->eraseFromParent();
+  VAList->eraseFromParent();
+  return Index;
+}
+
+// Clones Func into a function that takes VarArgTypes as ordinary parameters
+// after its fixed ones.
+static Function *CreateSpecialization(Function *Func,
+                                      ArrayRef<Type *> VarArgTypes,
+                                      ArrayRef<AllocaInst *> VALists) {
+  FunctionType *FTy = Func->getFunctionType();
+  SmallVector<Type *, 8> Params(FTy->param_begin(), FTy->param_end());
+  Params.append(VarArgTypes.begin(), VarArgTypes.end());
+  FunctionType *NFTy =
+      FunctionType::get(FTy->getReturnType(), Params, /*isVarArg=*/false);
+  Function *NewFunc = Function::Create(NFTy, Func->getLinkage(),
+                                       Func->getName() + ".varargs");
+  Func->getParent()->getFunctionList().insert(Func->getIterator(), NewFunc);
+
+  ValueToValueMapTy VMap;
+  auto NewArg = NewFunc->arg_begin();
+  for (Argument &Arg : Func->args()) {
+    NewArg->setName(Arg.getName());
+    VMap[&Arg] = &*NewArg++;
+  }
+  SmallVector<Argument *, 4> VarArgs;
+  for (auto E = NewFunc->arg_end(); NewArg != E; ++NewArg) {
+    NewArg->setName("vararg");
+    VarArgs.push_back(&*NewArg);
+  }
+  SmallVector<ReturnInst *, 4> Returns;
+  // As in CloneFunction, the clone gets its own copy of the subprogram, since
+  // a subprogram may only be attached to one function.
+  CloneFunctionInto(NewFunc, Func, VMap,
+                    /*ModuleLevelChanges=*/Func->getSubprogram() != nullptr,
+                    Returns);
+
+  // This runs after the optimizer, so promote the indexes and fold the
+  // selects of constant indexes here.
+  std::vector<AllocaInst *> Indexes;
+  for (AllocaInst *VAList : VALists)
+    Indexes.push_back(
+        ReplaceVAList(NewFunc, cast<AllocaInst>(VMap[VAList]), VarArgs));
+  if (!Indexes.empty()) {
+    DominatorTree DT(*NewFunc);
+    PromoteMemToReg(Indexes, DT);
+    for (BasicBlock &BB : *NewFunc)
+      SimplifyInstructionsInBlock(&BB);
+  }
+  ++NumSpecializations;
+  return NewFunc;
+}
+
+// Redirects the direct calls to Func that pass few enough, scalar, variable
+// arguments to fixed-arity clones of it. Func is removed if no uses remain.
+static bool SpecializeVarArgFunc(Function *Func) {
+  if (Func->isDeclaration() || !Func->hasLocalLinkage())
+    return false;
+  SmallVector<AllocaInst *, 2> VALists;
+  if (!FindLocalVALists(Func, VALists))
+    return false;
+
+  unsigned NumParams = Func->getFunctionType()->getNumParams();
+  SmallVector<Instruction *, 8> Calls;
+  for (Use &U : Func->uses()) {
+    CallSite CS(U.getUser());
+    if (!CS || !CS.isCallee(&U) || CS.isMustTailCall())
+      continue;
+    if (CS.arg_size() - NumParams > SpecializeMaxArgs)
+      continue;
+    bool Scalar = true;
+    for (unsigned I = NumParams, E = CS.arg_size(); I < E; ++I)
+      if (CS.getArgument(I)->getType()->isAggregateType() ||
+          CS.isByValArgument(I))
+        Scalar = false;
+    if (Scalar)
+      Calls.push_back(CS.getInstruction());
+  }
+  if (Calls.empty())
+    return false;
+
+  LLVMContext &Ctx = Func->getContext();
+  std::map<std::vector<Type *>, Function *> Specializations;
+  for (Instruction *Call : Calls) {
+    CallSite CS(Call);
+    std::vector<Type *> VarArgTypes;
+    for (unsigned I = NumParams, E = CS.arg_size(); I < E; ++I)
+      VarArgTypes.push_back(CS.getArgument(I)->getType());
+    Function *&NewFunc = Specializations[VarArgTypes];
+    if (!NewFunc)
+      NewFunc = CreateSpecialization(Func, VarArgTypes, VALists);
+
+    SmallVector<Value *, 8> Args(CS.arg_begin(), CS.arg_end());
+    SmallVector<AttributeSet, 8> ArgAttrs;
+    for (unsigned I = 0, E = CS.arg_size(); I < E; ++I)
+      ArgAttrs.push_back(CS.getAttributes().getParamAttributes(I));
+    AttributeList Attrs =
+        AttributeList::get(Ctx, CS.getAttributes().getFnAttributes(),
+                           CS.getAttributes().getRetAttributes(), ArgAttrs);
+    IRBuilder<> IRB(Call);
+    Instruction *NewCall;
+    if (auto *C = dyn_cast<CallInst>(Call)) {
+      auto *N = IRB.CreateCall(NewFunc, Args);
+      N->setTailCallKind(C->getTailCallKind());
+      NewCall = N;
+    } else {
+      auto *II = cast<InvokeInst>(Call);
+      NewCall = IRB.CreateInvoke(NewFunc, II->getNormalDest(),
+                                 II->getUnwindDest(), Args);
+    }
+    CallSite NewCS(NewCall);
+    NewCS.setAttributes(Attrs);
+    NewCS.setCallingConv(CS.getCallingConv());
+    NewCall->setDebugLoc(Call->getDebugLoc());
+    NewCall->takeName(Call);
+    Call->replaceAllUsesWith(NewCall);
+    Call->eraseFromParent();
+    ++NumSpecializedCalls;
+  }
+
+  if (Func->use_empty())
+    Func->eraseFromParent();
+  return true;
+}
+
 bool ExpandVarArgs::runOnModule(Module &M) {
   bool Changed = false;
   DataLayout DL(&M);
 
+  if (SpecializeMaxArgs) {
+    for (auto MI = M.begin(), ME = M.end(); MI != ME;) {
+      Function *F = &*MI++;
+      if (F->isVarArg())
+        Changed |= SpecializeVarArgFunc(F);
+    }
+  }
+
   for (auto MI = M.begin(), ME = M.end(); MI != ME;) {
     Function *F = &*MI++;
     for (BasicBlock &BB : *F) {
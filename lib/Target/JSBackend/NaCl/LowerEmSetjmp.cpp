@@ -11,13 +11,15 @@
 // is that each block with a setjmp is broken up into the part right after
 // the setjmp, and a new basic block is added which is either reached from
 // the setjmp, or later from a longjmp. To handle the longjmp, all calls that
-// might longjmp are checked immediately afterwards.
+// might longjmp are checked immediately afterwards. Calls to functions that
+// provably cannot longjmp are left alone.
 //
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Instructions.h"
@@ -40,6 +42,11 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "loweremsetjmp"
+
+STATISTIC(NumCallsNotInstrumented,
+          "Number of calls in setjmp-calling functions that cannot longjmp");
+
 // Utilities for mem/reg: based on Reg2Mem and MemToReg
 
 bool valueEscapes(const Instruction *Inst) {
@@ -130,6 +137,84 @@ void doMemToReg(Function &F) {
   }
 }
 
+// Longjmp analysis
+
+// Library functions that never call back into user code, so they cannot
+// longjmp. Anything else we only see a declaration of might.
+static const char *const KnownLeaves[] = {
+  "acos", "acosf", "asin", "asinf", "atan", "atan2", "atan2f", "atanf",
+  "calloc", "ceil", "ceilf", "cos", "cosf", "emscripten_memcpy_big", "exp",
+  "expf", "fabs", "fabsf", "floor", "floorf", "fmod", "fmodf", "free", "log",
+  "logf", "malloc", "memchr", "memcmp", "memcpy", "memmove", "memset", "pow",
+  "powf", "realloc", "sin", "sinf", "sqrt", "sqrtf", "strcat", "strchr",
+  "strcmp", "strcpy", "strlen", "strncat", "strncmp", "strncpy", "strrchr",
+  "strstr", "tan", "tanf",
+};
+
+static bool isKnownLeaf(StringRef Name) {
+  for (const char *Leaf : KnownLeaves)
+    if (Name == Leaf)
+      return true;
+  return false;
+}
+
+static bool hasIndirectCalls(Function &F) {
+  for (BasicBlock &BB : F)
+    for (Instruction &I : BB) {
+      CallSite CS(&I);
+      if (CS && !isa<Function>(CS.getCalledValue()->stripPointerCasts()))
+        return true;
+    }
+  return false;
+}
+
+// Adds the functions that call V, directly or through a cast or an alias, to
+// Worklist.
+static void addCallers(Value *V, std::set<Function*> &MayLongjmp,
+                       std::vector<Function*> &Worklist) {
+  for (Use &U : V->uses()) {
+    if (GlobalAlias *GA = dyn_cast<GlobalAlias>(U.getUser())) {
+      addCallers(GA, MayLongjmp, Worklist);
+      continue;
+    }
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(U.getUser())) {
+      if (CE->isCast())
+        addCallers(CE, MayLongjmp, Worklist);
+      continue;
+    }
+    CallSite CS(U.getUser());
+    if (!CS || !CS.isCallee(&U))
+      continue;
+    Function *Caller = CS.getInstruction()->getParent()->getParent();
+    if (MayLongjmp.insert(Caller).second)
+      Worklist.push_back(Caller);
+  }
+}
+
+// Finds the functions that may longjmp: functions we cannot see into (other
+// than known leaves), those that may be replaced at link time, those with
+// indirect calls, and everything that calls one of them. Anything else only
+// calls functions that provably return normally, so it cannot longjmp either.
+static void findMayLongjmp(Module &M, const std::set<Function*> &Helpers,
+                           std::set<Function*> &MayLongjmp) {
+  std::vector<Function*> Worklist;
+  for (Function &F : M) {
+    if (Helpers.count(&F) || F.isIntrinsic())
+      continue;
+    bool May = F.isDeclaration() ? !isKnownLeaf(F.getName())
+                                 : F.isInterposable() || hasIndirectCalls(F);
+    if (May) {
+      MayLongjmp.insert(&F);
+      Worklist.push_back(&F);
+    }
+  }
+  while (!Worklist.empty()) {
+    Function *F = Worklist.back();
+    Worklist.pop_back();
+    addCallers(F, MayLongjmp, Worklist);
+  }
+}
+
 // LowerEmSetjmp
 
 namespace {
@@ -235,6 +320,14 @@ bool LowerEmSetjmp::runOnModule(Module &M) {
 
   if (Longjmp) Longjmp->replaceAllUsesWith(EmLongjmp);
 
+  // Find what can longjmp, so we only check after calls that might
+
+  std::set<Function*> MayLongjmp;
+  if (!SetjmpOutputPhis.empty()) {
+    std::set<Function*> Helpers = { Setjmp, EmSetjmp, CheckLongjmp, GetLongjmpResult, PrepSetjmp, CleanupSetjmp, PreInvoke, PostInvoke };
+    findMayLongjmp(M, Helpers, MayLongjmp);
+  }
+
   // Update all setjmping functions
 
   unsigned InvokeId = 0;
@@ -254,9 +347,14 @@ bool LowerEmSetjmp::runOnModule(Module &M) {
         CallInst *CI;
         if ((CI = dyn_cast<CallInst>(I))) {
           Value *V = CI->getCalledValue();
-          if (V == PrepSetjmp || V == EmSetjmp || V == CheckLongjmp || V == GetLongjmpResult || V == PreInvoke || V == PostInvoke) continue;
+          if (V == Setjmp || V == PrepSetjmp || V == EmSetjmp || V == CheckLongjmp || V == GetLongjmpResult || V == PreInvoke || V == PostInvoke) continue;
           if (Function *CF = dyn_cast<Function>(V)) if (CF->isIntrinsic()) continue;
-          // TODO: proper analysis of what can actually longjmp. Currently we assume anything but setjmp can.
+          if (Function *CF = dyn_cast<Function>(V->stripPointerCasts())) {
+            if (!MayLongjmp.count(CF)) {
+              NumCallsNotInstrumented++;
+              continue;
+            }
+          }
           // This may longjmp, so we need to check if it did. Split at that point, and
           // envelop the call in pre/post invoke, if we need to
           CallInst *After;
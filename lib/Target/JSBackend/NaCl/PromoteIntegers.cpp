@@ -17,8 +17,12 @@
 // value of these bits (e.g. cmp, select, lshr), the upper bits of the operands
 // are cleared.
 //
+// Function signatures are promoted up front by PromoteIntegerSignatures, a
+// module pass, so that promoting the bodies is a function pass that only
+// touches the function it runs on.
+//
 // Limitations:
-// 1) It can't change function signatures or global variables
+// 1) It can't change global variables
 // 2) Doesn't handle arrays or structs with illegal types
 // 3) Doesn't handle constant expressions (it also doesn't produce them, so it
 //    can run after ExpandConstantExpr)
@@ -76,24 +80,41 @@ private:
   }
 };
 
-class PromoteIntegers : public ModulePass {
+class PromoteIntegerSignatures : public ModulePass {
 public:
   static char ID;
 
-  PromoteIntegers() : ModulePass(ID) {
-    initializePromoteIntegersPass(*PassRegistry::getPassRegistry());
+  PromoteIntegerSignatures() : ModulePass(ID) {
+    initializePromoteIntegerSignaturesPass(*PassRegistry::getPassRegistry());
   }
 
   bool runOnModule(Module &M) override;
 
 private:
-  typedef DenseMap<const llvm::Function *, DISubprogram *> DebugMap;
   TypeMap TypeMapper;
 
   bool ensureCompliantSignature(LLVMContext &Ctx, Function *OldFct, Module &M);
 };
+
+class PromoteIntegers : public FunctionPass {
+public:
+  static char ID;
+
+  PromoteIntegers() : FunctionPass(ID) {
+    initializePromoteIntegersPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnFunction(Function &F) override;
+};
 } // anonymous namespace
 
+char PromoteIntegerSignatures::ID = 0;
+
+INITIALIZE_PASS(PromoteIntegerSignatures, "nacl-promote-int-signatures",
+                "Promote integer types in function signatures which are "
+                "illegal in PNaCl",
+                false, false)
+
 char PromoteIntegers::ID = 0;
 
 INITIALIZE_PASS(PromoteIntegers, "nacl-promote-ints",
@@ -231,8 +252,9 @@ static Value *CreateBitCast(IRBuilder<> *IRB, Value *From, Type *ToTy,
 //
 // \param BaseAlign Alignment of the base load.
 // \param Offset    Offset from the base load.
-static Value *splitLoad(DataLayout *DL, LoadInst *Inst, ConversionState &State,
-                        unsigned BaseAlign, unsigned Offset) {
+static Value *splitLoad(const DataLayout *DL, LoadInst *Inst,
+                        ConversionState &State, unsigned BaseAlign,
+                        unsigned Offset) {
   if (Inst->isVolatile() || Inst->isAtomic())
     report_fatal_error("Can't split volatile/atomic loads");
   if (DL->getTypeSizeInBits(Inst->getType()) % 8 != 0)
@@ -276,7 +298,7 @@ static Value *splitLoad(DataLayout *DL, LoadInst *Inst, ConversionState &State,
   return Result;
 }
 
-static Value *splitStore(DataLayout *DL, StoreInst *Inst,
+static Value *splitStore(const DataLayout *DL, StoreInst *Inst,
                          ConversionState &State, unsigned BaseAlign,
                          unsigned Offset) {
   if (Inst->isVolatile() || Inst->isAtomic())
@@ -380,7 +402,7 @@ static Value *getSignExtend(Value *Operand, Value *OrigOperand,
                    Shl);
 }
 
-static void convertInstruction(DataLayout *DL, Instruction *Inst,
+static void convertInstruction(const DataLayout *DL, Instruction *Inst,
                                ConversionState &State) {
   if (SExtInst *Sext = dyn_cast<SExtInst>(Inst)) {
     Value *Op = Sext->getOperand(0);
@@ -632,7 +654,18 @@ static void convertInstruction(DataLayout *DL, Instruction *Inst,
   }
 }
 
-static bool processFunction(Function &F, DataLayout &DL) {
+bool PromoteIntegers::runOnFunction(Function &F) {
+  // Arguments and return values are promoted by PromoteIntegerSignatures.
+  for (Argument &Arg : F.args())
+    if (shouldConvert(&Arg))
+      report_fatal_error("Function " + F.getName() +
+                         " has illegal integer argument");
+  if (auto *RetTy = dyn_cast<IntegerType>(F.getReturnType()))
+    if (!isLegalSize(RetTy->getBitWidth()))
+      report_fatal_error("Function " + F.getName() +
+                         " has illegal integer return type");
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
   ConversionState State;
   bool Modified = false; // XXX Emscripten: Fixed use of an uninitialized variable.
   for (auto FI = F.begin(), FE = F.end(); FI != FE; ++FI) {
@@ -659,7 +692,7 @@ static bool processFunction(Function &F, DataLayout &DL) {
   return Modified;
 }
 
-bool PromoteIntegers::ensureCompliantSignature(
+bool PromoteIntegerSignatures::ensureCompliantSignature(
     LLVMContext &Ctx, Function *OldFct, Module &M) {
 
   auto *NewFctType = cast<FunctionType>(
@@ -714,12 +747,10 @@ bool PromoteIntegers::ensureCompliantSignature(
   return true;
 }
 
-bool PromoteIntegers::runOnModule(Module &M) {
-  DataLayout DL(&M);
+bool PromoteIntegerSignatures::runOnModule(Module &M) {
   LLVMContext &Ctx = M.getContext();
   bool Modified = false;
 
-  // Change function signatures first.
   for (auto I = M.begin(), E = M.end(); I != E;) {
     Function *F = &*I++;
     bool Changed = ensureCompliantSignature(Ctx, F, M);
@@ -728,10 +759,11 @@ bool PromoteIntegers::runOnModule(Module &M) {
     Modified |= Changed;
   }
 
-  for (auto &F : M.getFunctionList())
-    Modified |= processFunction(F, DL);
-
   return Modified;
 }
 
-ModulePass *llvm::createPromoteIntegersPass() { return new PromoteIntegers(); }
+ModulePass *llvm::createPromoteIntegerSignaturesPass() {
+  return new PromoteIntegerSignatures();
+}
+
+FunctionPass *llvm::createPromoteIntegersPass() { return new PromoteIntegers(); }
@@ -2,9 +2,11 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <list>
 #include <stack>
 #include <string>
+#include <vector>
 
 // uncomment these out to get LLVM errs() debugging support
 //#include <llvm/Support/raw_ostream.h>
@@ -425,7 +427,7 @@ void EmulatedShape::Render(bool InLoop) {
 
 // Relooper
 
-Relooper::Relooper() : Root(NULL), Emulate(false), MinSize(false), BlockIdCounter(1), ShapeIdCounter(0) { // block ID 0 is reserved for clearings
+Relooper::Relooper() : Root(NULL), Emulate(false), MinSize(false), SplitLimit(-1), SplitBytes(0), BlockIdCounter(1), ShapeIdCounter(0) { // block ID 0 is reserved for clearings
 }
 
 Relooper::~Relooper() {
@@ -517,6 +519,192 @@ void Relooper::Calculate(Block *Entry) {
       }
       //DebugDump(Live, "after");
     }
+
+    // Finds the strongly connected components of the live blocks that contain
+    // more than one block, that is, the loops, in an iterative version of
+    // Tarjan's algorithm.
+    void FindLoops(std::vector<BlockSet> &Loops) {
+      std::map<Block*, int> Index;
+      std::map<Block*, int> LowLink;
+      std::vector<Block*> Stack;
+      BlockSet OnStack;
+      std::vector<std::pair<Block*, BlockBranchMap::iterator> > Work;
+      int Counter = 0;
+      for (BlockSet::iterator iter = Live.begin(); iter != Live.end(); iter++) {
+        if (contains(Index, *iter)) continue;
+        Block *Next = *iter;
+        while (true) {
+          if (Next) {
+            Index[Next] = LowLink[Next] = Counter++;
+            Stack.push_back(Next);
+            OnStack.insert(Next);
+            Work.push_back(std::make_pair(Next, Next->BranchesOut.begin()));
+            Next = NULL;
+          }
+          if (Work.size() == 0) break;
+          Block *Curr = Work.back().first;
+          BlockBranchMap::iterator &Out = Work.back().second;
+          if (Out != Curr->BranchesOut.end()) {
+            Block *Target = Out->first;
+            Out++;
+            if (!contains(Index, Target)) {
+              Next = Target;
+            } else if (contains(OnStack, Target)) {
+              LowLink[Curr] = std::min(LowLink[Curr], Index[Target]);
+            }
+            continue;
+          }
+          Work.pop_back();
+          if (Work.size() > 0) {
+            Block *Prior = Work.back().first;
+            LowLink[Prior] = std::min(LowLink[Prior], LowLink[Curr]);
+          }
+          if (LowLink[Curr] != Index[Curr]) continue;
+          BlockSet Loop;
+          Block *Member;
+          do {
+            Member = Stack.back();
+            Stack.pop_back();
+            OnStack.erase(Member);
+            Loop.insert(Member);
+          } while (Member != Curr);
+          if (Loop.size() > 1) Loops.push_back(Loop);
+        }
+      }
+    }
+
+    // Finds the blocks of Loop that can be reached from Start without going through Header
+    void FindRegion(BlockSet &Loop, Block *Header, Block *Start, BlockSet &Region) {
+      BlockList ToInvestigate;
+      ToInvestigate.push_back(Start);
+      while (ToInvestigate.size() > 0) {
+        Block *Curr = ToInvestigate.front();
+        ToInvestigate.pop_front();
+        if (Curr == Header || !contains(Loop, Curr) || contains(Region, Curr)) continue;
+        Region.insert(Curr);
+        for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
+          ToInvestigate.push_back(iter->first);
+        }
+      }
+    }
+
+    unsigned GetCodeSize(BlockSet &Blocks) {
+      unsigned Size = 0;
+      for (BlockSet::iterator iter = Blocks.begin(); iter != Blocks.end(); iter++) {
+        Size += strlen((*iter)->Code);
+      }
+      return Size;
+    }
+
+    // Copies the blocks of Loop that Start reaches without going through Header, and
+    // redirects the branches into Start from outside the loop to the copy. The copies
+    // branch to each other where the originals did, and back to the original Header,
+    // so afterwards the only way into the original loop from outside is through Header.
+    void SplitRegion(BlockSet &Loop, Block *Header, Block *Start) {
+      BlockSet Region;
+      FindRegion(Loop, Header, Start, Region);
+      PrintDebug("Splitting %d blocks entered at %d out of the loop headed by %d\n", Region.size(), Start->Id, Header->Id);
+      std::map<Block*, Block*> Copies;
+      for (BlockSet::iterator iter = Region.begin(); iter != Region.end(); iter++) {
+        Block *Original = *iter;
+        Block *Copy = new Block(Original->Code, Original->BranchVar);
+        // Unlike dead end splits, a copy may branch elsewhere than the original, so it
+        // is a different logical block and gets its own Id
+        Parent->AddBlock(Copy);
+        Copies[Original] = Copy;
+        Live.insert(Copy);
+        Parent->SplitBytes += strlen(Original->Code);
+      }
+      for (BlockSet::iterator iter = Region.begin(); iter != Region.end(); iter++) {
+        Block *Original = *iter;
+        Block *Copy = Copies[Original];
+        for (BlockBranchMap::iterator iter = Original->BranchesOut.begin(); iter != Original->BranchesOut.end(); iter++) {
+          Block *Post = contains(Copies, iter->first) ? Copies[iter->first] : iter->first;
+          Branch *Details = iter->second;
+          Copy->BranchesOut[Post] = new Branch(Details->Condition, Details->Code);
+          Post->BranchesIn.insert(Copy);
+        }
+      }
+      Block *StartCopy = Copies[Start];
+      BlockList Outside;
+      for (BlockSet::iterator iter = Start->BranchesIn.begin(); iter != Start->BranchesIn.end(); iter++) {
+        if (!contains(Loop, *iter)) Outside.push_back(*iter);
+      }
+      for (BlockList::iterator iter = Outside.begin(); iter != Outside.end(); iter++) {
+        Block *Prior = *iter;
+        Branch *Details = Prior->BranchesOut[Start];
+        Prior->BranchesOut[StartCopy] = new Branch(Details->Condition, Details->Code);
+        delete Details;
+        Prior->BranchesOut.erase(Start);
+        Start->BranchesIn.erase(Prior);
+        StartCopy->BranchesIn.insert(Prior);
+      }
+    }
+
+    // Loops with more than one entry from outside cannot be reduced to a LoopShape
+    // directly, and end up inside Multiples that dispatch on the label variable on
+    // every iteration. If the blocks reachable from the extra entries are small, it is
+    // better to duplicate them (controlled node splitting), so that the original loop
+    // has a single entry and the copies, which rejoin it at that entry, are acyclic or
+    // are smaller loops of their own. Splitting a loop can leave its copies with
+    // multiple-entry loops of their own, so this is repeated a few times, for as long
+    // as the total amount of duplicated code stays within the limit.
+    void SplitIrreducible(Block *Entry) {
+      unsigned Limit;
+      if (Parent->SplitLimit >= 0) {
+        Limit = Parent->SplitLimit;
+      } else {
+        Limit = GetCodeSize(Live)/5;
+      }
+      for (int Round = 0; Round < 4; Round++) {
+        std::vector<BlockSet> Loops;
+        FindLoops(Loops);
+        bool Changed = false;
+        for (unsigned i = 0; i < Loops.size(); i++) {
+          BlockSet &Loop = Loops[i];
+          BlockSet Entries;
+          for (BlockSet::iterator iter = Loop.begin(); iter != Loop.end(); iter++) {
+            Block *Curr = *iter;
+            if (Curr == Entry) {
+              Entries.insert(Curr);
+              continue;
+            }
+            for (BlockSet::iterator iter = Curr->BranchesIn.begin(); iter != Curr->BranchesIn.end(); iter++) {
+              if (!contains(Loop, *iter)) {
+                Entries.insert(Curr);
+                break;
+              }
+            }
+          }
+          if (Entries.size() <= 1) continue;
+          // Keep the entry that makes us copy the least code as the loop header. The
+          // function entry has no branches in that could be redirected, so it must stay.
+          Block *Header = NULL;
+          unsigned HeaderCost = 0;
+          for (BlockSet::iterator iter = Entries.begin(); iter != Entries.end(); iter++) {
+            Block *Candidate = *iter;
+            if (contains(Entries, Entry) && Candidate != Entry) continue;
+            unsigned Cost = 0;
+            for (BlockSet::iterator iter = Entries.begin(); iter != Entries.end(); iter++) {
+              if (*iter == Candidate) continue;
+              BlockSet Region;
+              FindRegion(Loop, Candidate, *iter, Region);
+              Cost += GetCodeSize(Region);
+            }
+            if (!Header || Cost < HeaderCost) {
+              Header = Candidate;
+              HeaderCost = Cost;
+            }
+          }
+          if (Parent->SplitBytes + HeaderCost > Limit) continue;
+          for (BlockSet::iterator iter = Entries.begin(); iter != Entries.end(); iter++) {
+            if (*iter != Header) SplitRegion(Loop, Header, *iter);
+          }
+          Changed = true;
+        }
+        if (!Changed) break;
+      }
+    }
   };
   PreOptimizer Pre(this);
   Pre.FindLive(Entry);
@@ -530,7 +718,11 @@ void Relooper::Calculate(Block *Entry) {
     }
   }
 
-  if (!Emulate && !MinSize) Pre.SplitDeadEnds();
+  SplitBytes = 0;
+  if (!Emulate && !MinSize) {
+    Pre.SplitDeadEnds();
+    if (SplitLimit != 0) Pre.SplitIrreducible(Entry);
+  }
 
   // Recursively process the graph
 
@@ -1344,6 +1536,7 @@ static void PrintDebug(const char *Format, ...) {
 
 typedef std::map<void*, int> VoidIntMap;
 VoidIntMap __blockDebugMap__; // maps block pointers in currently running code to block ids, for generated debug output
+int __blockDebugCounter__ = 0;
 
 extern "C" {
 
@@ -1368,23 +1561,24 @@ void rl_set_asm_js_mode(int on) {
 void *rl_new_block(const char *text, const char *branch_var) {
   Block *ret = new Block(text, branch_var);
 #if DEBUG
-  printf("  void *b%d = rl_new_block(\"// code %d\");\n", ret->Id, ret->Id);
-  __blockDebugMap__[ret] = ret->Id;
-  printf("  block_map[%d] = b%d;\n", ret->Id, ret->Id);
+  int id = ++__blockDebugCounter__; // blocks only get their ids when added to a relooper
+  __blockDebugMap__[ret] = id;
+  printf("  void *b%d = rl_new_block(\"// code %d\", %s%s%s);\n", id, id, branch_var ? "\"" : "", branch_var ? branch_var : "NULL", branch_var ? "\"" : "");
+  printf("  block_map[%d] = b%d;\n", id, id);
 #endif
   return ret;
 }
 
 void rl_delete_block(void *block) {
 #if DEBUG
-  printf("  rl_delete_block(block_map[%d]);\n", ((Block*)block)->Id);
+  printf("  rl_delete_block(block_map[%d]);\n", __blockDebugMap__[block]);
 #endif
   delete (Block*)block;
 }
 
 void rl_block_add_branch_to(void *from, void *to, const char *condition, const char *code) {
 #if DEBUG
-  printf("  rl_block_add_branch_to(block_map[%d], block_map[%d], %s%s%s, %s%s%s);\n", ((Block*)from)->Id, ((Block*)to)->Id, condition ? "\"" : "", condition ? condition : "NULL", condition ? "\"" : "", code ? "\"" : "", code ? code : "NULL", code ? "\"" : "");
+  printf("  rl_block_add_branch_to(block_map[%d], block_map[%d], %s%s%s, %s%s%s);\n", __blockDebugMap__[from], __blockDebugMap__[to], condition ? "\"" : "", condition ? condition : "NULL", condition ? "\"" : "", code ? "\"" : "", code ? code : "NULL", code ? "\"" : "");
 #endif
   ((Block*)from)->AddBranchTo((Block*)to, condition, code);
 }
@@ -1403,14 +1597,14 @@ void rl_delete_relooper(void *relooper) {
 
 void rl_relooper_add_block(void *relooper, void *block) {
 #if DEBUG
-  printf("  rl_relooper_add_block(rl, block_map[%d]);\n", ((Block*)block)->Id);
+  printf("  rl_relooper_add_block(rl, block_map[%d]);\n", __blockDebugMap__[block]);
 #endif
   ((Relooper*)relooper)->AddBlock((Block*)block);
 }
 
 void rl_relooper_calculate(void *relooper, void *entry) {
 #if DEBUG
-  printf("  rl_relooper_calculate(rl, block_map[%d]);\n", ((Block*)entry)->Id);
+  printf("  rl_relooper_calculate(rl, block_map[%d]);\n", __blockDebugMap__[entry]);
   printf("  rl_relooper_render(rl);\n");
   printf("  rl_delete_relooper(rl);\n");
   printf("  puts(buffer);\n");
@@ -296,6 +296,8 @@ struct Relooper {
   Shape *Root;
   bool Emulate;
   bool MinSize;
+  int SplitLimit; // Maximum number of bytes of code node splitting may duplicate; -1 means a fifth of the code
+  unsigned SplitBytes; // Number of bytes of code duplicated by node splitting in the last Calculate()
   int BlockIdCounter;
   int ShapeIdCounter;
 
@@ -329,6 +331,13 @@ struct Relooper {
 
   // Sets us to try to minimize size
   void SetMinSize(bool MinSize_) { MinSize = MinSize_; }
+
+  // Sets the maximum number of bytes of code node splitting may duplicate to
+  // make multiple-entry loops reducible. 0 disables it, -1 uses the default
+  void SetSplitLimit(int Limit) { SplitLimit = Limit; }
+
+  // Returns the number of bytes of code duplicated by node splitting
+  unsigned GetSplitBytes() { return SplitBytes; }
 };
 
 typedef InsertOrderedMap<Block*, BlockSet> BlockBlockSetMap;
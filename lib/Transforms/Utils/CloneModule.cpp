@@ -12,8 +12,15 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constant.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
@@ -191,6 +198,459 @@ std::unique_ptr<Module> llvm::CloneModule(
   return New;
 }
 
+namespace {
+
+/// Rebuilds types of the source module's context in the destination context.
+class ContextTypeRemapper : public ValueMapTypeRemapper {
+  LLVMContext &Ctx;
+  DenseMap<Type *, Type *> MappedTypes;
+
+public:
+  explicit ContextTypeRemapper(LLVMContext &Ctx) : Ctx(Ctx) {}
+
+  Type *remapType(Type *SrcTy) override;
+};
+
+/// Clones a module into another LLVMContext.  Everything that is uniqued per
+/// context (types, leaf constants, attributes, metadata, metadata kinds and
+/// sync scopes) is rebuilt explicitly; the ValueMapper then takes care of
+/// constant expressions, aggregates and instruction operands.
+class ContextCloner : public ValueMaterializer {
+  const Module &SrcM;
+  LLVMContext &Ctx;
+  ValueToValueMapTy VMap;
+  ContextTypeRemapper TypeMapper;
+  SmallVector<unsigned, 32> MDKindMap;
+  SmallVector<SyncScope::ID, 4> SSIDMap;
+  SmallPtrSet<const MDNode *, 8> UniquedInProgress;
+  bool Failed = false;
+
+  /// Attachments of the cloned instructions, keyed by destination kind and
+  /// still pointing at source metadata until everything has been mapped.
+  SmallVector<std::pair<Instruction *,
+                        SmallVector<std::pair<unsigned, MDNode *>, 2>>, 0>
+      PendingAttachments;
+
+  Constant *mapConstant(const Constant *C) {
+    return MapValue(C, VMap, RF_None, &TypeMapper, this);
+  }
+  Metadata *mapMetadata(const Metadata *MD);
+  Constant *mapDataSequential(const ConstantDataSequential *CDS);
+  AttributeList mapAttributes(AttributeList Attrs);
+  void mapGlobalObjectMetadata(GlobalObject &Dst, const GlobalObject &Src);
+  void cloneFunctionBody(Function &Dst, const Function &Src);
+
+public:
+  ContextCloner(const Module &SrcM, LLVMContext &Ctx)
+      : SrcM(SrcM), Ctx(Ctx), TypeMapper(Ctx) {}
+
+  Value *materialize(Value *V) override;
+  std::unique_ptr<Module> clone();
+};
+
+} // end anonymous namespace
+
+Type *ContextTypeRemapper::remapType(Type *SrcTy) {
+  if (&SrcTy->getContext() == &Ctx)
+    return SrcTy;
+  auto I = MappedTypes.find(SrcTy);
+  if (I != MappedTypes.end())
+    return I->second;
+
+  Type *DstTy;
+  switch (SrcTy->getTypeID()) {
+  case Type::IntegerTyID:
+    DstTy = IntegerType::get(Ctx, cast<IntegerType>(SrcTy)->getBitWidth());
+    break;
+  case Type::PointerTyID:
+    DstTy = PointerType::get(remapType(SrcTy->getPointerElementType()),
+                             SrcTy->getPointerAddressSpace());
+    break;
+  case Type::ArrayTyID:
+    DstTy = ArrayType::get(remapType(SrcTy->getArrayElementType()),
+                           SrcTy->getArrayNumElements());
+    break;
+  case Type::VectorTyID:
+    DstTy = VectorType::get(remapType(SrcTy->getVectorElementType()),
+                            SrcTy->getVectorNumElements());
+    break;
+  case Type::FunctionTyID: {
+    auto *FTy = cast<FunctionType>(SrcTy);
+    SmallVector<Type *, 8> Params;
+    for (Type *Param : FTy->params())
+      Params.push_back(remapType(Param));
+    DstTy = FunctionType::get(remapType(FTy->getReturnType()), Params,
+                              FTy->isVarArg());
+    break;
+  }
+  case Type::StructTyID: {
+    auto *STy = cast<StructType>(SrcTy);
+    SmallVector<Type *, 8> Elts;
+    if (STy->isLiteral()) {
+      for (Type *Elt : STy->elements())
+        Elts.push_back(remapType(Elt));
+      DstTy = StructType::get(Ctx, Elts, STy->isPacked());
+      break;
+    }
+    // Identified structs may be recursive, so record the mapping before
+    // mapping the body.
+    StructType *DstSTy = StructType::create(Ctx, STy->getName());
+    MappedTypes[SrcTy] = DstSTy;
+    if (!STy->isOpaque()) {
+      for (Type *Elt : STy->elements())
+        Elts.push_back(remapType(Elt));
+      DstSTy->setBody(Elts, STy->isPacked());
+    }
+    return DstSTy;
+  }
+  default:
+    DstTy = Type::getPrimitiveType(Ctx, SrcTy->getTypeID());
+    break;
+  }
+  return MappedTypes[SrcTy] = DstTy;
+}
+
+template <typename T, typename ConstantDataT>
+static Constant *getDataSequential(LLVMContext &Ctx, ArrayRef<uint64_t> Elts,
+                                   bool IsFP) {
+  SmallVector<T, 16> Data(Elts.begin(), Elts.end());
+  return IsFP ? ConstantDataT::getFP(Ctx, Data) : ConstantDataT::get(Ctx, Data);
+}
+
+template <typename ConstantDataT>
+static Constant *getDataSequential(LLVMContext &Ctx, ArrayRef<uint64_t> Elts,
+                                   unsigned EltBits, bool IsFP) {
+  switch (EltBits) {
+  case 8: {
+    SmallVector<uint8_t, 16> Data(Elts.begin(), Elts.end());
+    return ConstantDataT::get(Ctx, Data);
+  }
+  case 16:
+    return getDataSequential<uint16_t, ConstantDataT>(Ctx, Elts, IsFP);
+  case 32:
+    return getDataSequential<uint32_t, ConstantDataT>(Ctx, Elts, IsFP);
+  case 64:
+    return getDataSequential<uint64_t, ConstantDataT>(Ctx, Elts, IsFP);
+  default:
+    llvm_unreachable("unexpected ConstantDataSequential element type");
+  }
+}
+
+Constant *
+ContextCloner::mapDataSequential(const ConstantDataSequential *CDS) {
+  Type *EltTy = CDS->getElementType();
+  bool IsFP = EltTy->isFloatingPointTy();
+  SmallVector<uint64_t, 16> Elts;
+  for (unsigned I = 0, E = CDS->getNumElements(); I != E; ++I)
+    Elts.push_back(IsFP ? CDS->getElementAsAPFloat(I)
+                              .bitcastToAPInt()
+                              .getZExtValue()
+                        : CDS->getElementAsInteger(I));
+  unsigned EltBits = EltTy->getPrimitiveSizeInBits();
+  if (isa<ConstantDataArray>(CDS))
+    return getDataSequential<ConstantDataArray>(Ctx, Elts, EltBits, IsFP);
+  return getDataSequential<ConstantDataVector>(Ctx, Elts, EltBits, IsFP);
+}
+
+Value *ContextCloner::materialize(Value *V) {
+  // Global values and locals are seeded into the map; everything the
+  // ValueMapper cannot rebuild from operands and a remapped type is handled
+  // here.
+  if (auto *CI = dyn_cast<ConstantInt>(V))
+    return ConstantInt::get(Ctx, CI->getValue());
+  if (auto *CFP = dyn_cast<ConstantFP>(V))
+    return ConstantFP::get(Ctx, CFP->getValueAPF());
+  if (auto *CDS = dyn_cast<ConstantDataSequential>(V))
+    return mapDataSequential(CDS);
+  if (isa<ConstantTokenNone>(V))
+    return ConstantTokenNone::get(Ctx);
+  if (auto *MDV = dyn_cast<MetadataAsValue>(V))
+    if (Metadata *MD = mapMetadata(MDV->getMetadata()))
+      return MetadataAsValue::get(Ctx, MD);
+  return nullptr;
+}
+
+Metadata *ContextCloner::mapMetadata(const Metadata *MD) {
+  if (!MD)
+    return nullptr;
+  if (Optional<Metadata *> Mapped = VMap.getMappedMD(MD))
+    return *Mapped;
+
+  if (auto *S = dyn_cast<MDString>(MD))
+    return MDString::get(Ctx, S->getString());
+  if (auto *CMD = dyn_cast<ConstantAsMetadata>(MD))
+    return ConstantAsMetadata::get(mapConstant(CMD->getValue()));
+  if (auto *LMD = dyn_cast<LocalAsMetadata>(MD)) {
+    Value *Local = VMap.lookup(LMD->getValue());
+    assert(Local && "local referenced before its function was cloned");
+    return LocalAsMetadata::get(Local);
+  }
+
+  // Only generic tuples can be rebuilt without knowing the layout of the
+  // node; specialized nodes (debug info) are left to the bitcode path.
+  auto *N = dyn_cast<MDTuple>(MD);
+  if (!N || N->isTemporary()) {
+    Failed = true;
+    return nullptr;
+  }
+
+  if (N->isDistinct()) {
+    // Distinct nodes may be part of a cycle, so map the node itself before
+    // its operands.
+    SmallVector<Metadata *, 8> Placeholders(N->getNumOperands(), nullptr);
+    MDTuple *NewN = MDTuple::getDistinct(Ctx, Placeholders);
+    VMap.MD()[MD].reset(NewN);
+    for (unsigned I = 0, E = N->getNumOperands(); I != E; ++I)
+      NewN->replaceOperandWith(I, mapMetadata(N->getOperand(I)));
+    return NewN;
+  }
+
+  if (!UniquedInProgress.insert(N).second) {
+    Failed = true;
+    return nullptr;
+  }
+  SmallVector<Metadata *, 8> Ops;
+  for (const MDOperand &Op : N->operands())
+    Ops.push_back(mapMetadata(Op));
+  UniquedInProgress.erase(N);
+  MDTuple *NewN = MDTuple::get(Ctx, Ops);
+  VMap.MD()[MD].reset(NewN);
+  return NewN;
+}
+
+AttributeList ContextCloner::mapAttributes(AttributeList Attrs) {
+  AttributeList NewAttrs;
+  for (unsigned I = Attrs.index_begin(), E = Attrs.index_end(); I != E; ++I) {
+    AttrBuilder B(Attrs.getAttributes(I));
+    if (B.hasAttributes())
+      NewAttrs = NewAttrs.addAttributes(Ctx, I, B);
+  }
+  return NewAttrs;
+}
+
+void ContextCloner::mapGlobalObjectMetadata(GlobalObject &Dst,
+                                            const GlobalObject &Src) {
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  Src.getAllMetadata(MDs);
+  for (const auto &MD : MDs)
+    if (auto *NewMD = cast_or_null<MDNode>(mapMetadata(MD.second)))
+      Dst.addMetadata(MDKindMap[MD.first], *NewMD);
+}
+
+void ContextCloner::cloneFunctionBody(Function &Dst, const Function &Src) {
+  auto DestArg = Dst.arg_begin();
+  for (const Argument &A : Src.args()) {
+    DestArg->setName(A.getName());
+    VMap[&A] = &*DestArg++;
+  }
+
+  // Create all blocks up front so that branches and block addresses can be
+  // remapped in a single pass afterwards.
+  for (const BasicBlock &BB : Src)
+    VMap[&BB] = BasicBlock::Create(Ctx, BB.getName(), &Dst);
+
+  for (const BasicBlock &BB : Src) {
+    auto *NewBB = cast<BasicBlock>(VMap[&BB]);
+    for (const Instruction &I : BB) {
+      if (auto CS = ImmutableCallSite(&I))
+        if (CS.hasOperandBundles()) {
+          Failed = true;
+          return;
+        }
+
+      Instruction *NewI = I.clone();
+
+      // Metadata kinds are numbered per context; strip the attachments now
+      // and re-add them under the destination kind once mapped.
+      SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+      I.getAllMetadata(MDs);
+      if (!MDs.empty()) {
+        PendingAttachments.emplace_back();
+        PendingAttachments.back().first = NewI;
+        for (const auto &MD : MDs) {
+          NewI->setMetadata(MD.first, nullptr);
+          PendingAttachments.back().second.push_back(
+              {MDKindMap[MD.first], MD.second});
+        }
+      }
+
+      // Side tables such as value handles and names are keyed by the context
+      // of the value's type, so move the clone over before anything refers
+      // to it.  The remaining types are remapped with the operands.
+      if (auto *GEP = dyn_cast<GetElementPtrInst>(NewI)) {
+        GEP->setSourceElementType(
+            TypeMapper.remapType(GEP->getSourceElementType()));
+        GEP->setResultElementType(
+            TypeMapper.remapType(GEP->getResultElementType()));
+      }
+      NewI->mutateType(TypeMapper.remapType(I.getType()));
+      NewBB->getInstList().push_back(NewI);
+      if (I.hasName())
+        NewI->setName(I.getName());
+      VMap[&I] = NewI;
+    }
+  }
+}
+
+std::unique_ptr<Module> ContextCloner::clone() {
+  auto New = llvm::make_unique<Module>(SrcM.getModuleIdentifier(), Ctx);
+  New->setSourceFileName(SrcM.getSourceFileName());
+  New->setDataLayout(SrcM.getDataLayout());
+  New->setTargetTriple(SrcM.getTargetTriple());
+  New->setModuleInlineAsm(SrcM.getModuleInlineAsm());
+
+  SmallVector<StringRef, 16> Names;
+  SrcM.getContext().getMDKindNames(Names);
+  for (StringRef Name : Names)
+    MDKindMap.push_back(Ctx.getMDKindID(Name));
+  Names.clear();
+  SrcM.getContext().getSyncScopeNames(Names);
+  for (StringRef Name : Names)
+    SSIDMap.push_back(Ctx.getOrInsertSyncScopeID(Name));
+
+  // Create every global value first so that initializers and bodies can
+  // refer to any of them.
+  for (const GlobalVariable &GV : SrcM.globals()) {
+    auto *NewGV = new GlobalVariable(
+        *New, TypeMapper.remapType(GV.getValueType()), GV.isConstant(),
+        GV.getLinkage(), nullptr, GV.getName(), nullptr,
+        GV.getThreadLocalMode(), GV.getType()->getAddressSpace(),
+        GV.isExternallyInitialized());
+    NewGV->setVisibility(GV.getVisibility());
+    NewGV->setUnnamedAddr(GV.getUnnamedAddr());
+    NewGV->setDLLStorageClass(GV.getDLLStorageClass());
+    NewGV->setDSOLocal(GV.isDSOLocal());
+    NewGV->setAlignment(GV.getAlignment());
+    NewGV->setSection(GV.getSection());
+    if (GV.hasAttributes())
+      NewGV->setAttributes(
+          AttributeSet::get(Ctx, AttrBuilder(GV.getAttributes())));
+    copyComdat(NewGV, &GV);
+    VMap[&GV] = NewGV;
+  }
+
+  for (const Function &F : SrcM) {
+    auto *NewF = Function::Create(
+        cast<FunctionType>(TypeMapper.remapType(F.getFunctionType())),
+        F.getLinkage(), F.getName(), New.get());
+    NewF->setVisibility(F.getVisibility());
+    NewF->setUnnamedAddr(F.getUnnamedAddr());
+    NewF->setDLLStorageClass(F.getDLLStorageClass());
+    NewF->setDSOLocal(F.isDSOLocal());
+    NewF->setAlignment(F.getAlignment());
+    NewF->setSection(F.getSection());
+    NewF->setCallingConv(F.getCallingConv());
+    NewF->setAttributes(mapAttributes(F.getAttributes()));
+    if (F.hasGC())
+      NewF->setGC(F.getGC());
+    copyComdat(NewF, &F);
+    VMap[&F] = NewF;
+  }
+
+  for (const GlobalAlias &GA : SrcM.aliases()) {
+    auto *NewGA = GlobalAlias::create(
+        TypeMapper.remapType(GA.getValueType()),
+        GA.getType()->getPointerAddressSpace(), GA.getLinkage(), GA.getName(),
+        New.get());
+    NewGA->copyAttributesFrom(&GA);
+    NewGA->setThreadLocalMode(GA.getThreadLocalMode());
+    VMap[&GA] = NewGA;
+  }
+
+  for (const GlobalIFunc &GI : SrcM.ifuncs()) {
+    auto *NewGI = GlobalIFunc::create(
+        TypeMapper.remapType(GI.getValueType()),
+        GI.getType()->getPointerAddressSpace(), GI.getLinkage(), GI.getName(),
+        nullptr, New.get());
+    NewGI->copyAttributesFrom(&GI);
+    VMap[&GI] = NewGI;
+  }
+
+  // Clone the instructions.  Their operands still refer to the source context
+  // until they are remapped below.
+  for (const Function &F : SrcM) {
+    if (!F.isDeclaration())
+      cloneFunctionBody(*cast<Function>(VMap[&F]), F);
+    if (Failed)
+      return nullptr;
+  }
+
+  // Map all metadata before handing anything to the ValueMapper, which would
+  // otherwise rebuild unmapped nodes in the source context.
+  for (const NamedMDNode &NMD : SrcM.named_metadata()) {
+    NamedMDNode *NewNMD = New->getOrInsertNamedMetadata(NMD.getName());
+    for (const MDNode *Op : NMD.operands())
+      if (auto *NewOp = cast_or_null<MDNode>(mapMetadata(Op)))
+        NewNMD->addOperand(NewOp);
+  }
+  for (const GlobalVariable &GV : SrcM.globals())
+    mapGlobalObjectMetadata(*cast<GlobalVariable>(VMap[&GV]), GV);
+  for (const Function &F : SrcM)
+    mapGlobalObjectMetadata(*cast<Function>(VMap[&F]), F);
+  for (auto &Pending : PendingAttachments)
+    for (auto &MD : Pending.second)
+      MD.second = cast_or_null<MDNode>(mapMetadata(MD.second));
+  for (const Function &F : SrcM)
+    for (const BasicBlock &BB : F)
+      for (const Instruction &I : BB)
+        for (const Use &Op : I.operands())
+          if (auto *MDV = dyn_cast<MetadataAsValue>(Op))
+            if (!isa<LocalAsMetadata>(MDV->getMetadata()))
+              mapMetadata(MDV->getMetadata());
+  if (Failed)
+    return nullptr;
+
+  for (const GlobalVariable &GV : SrcM.globals())
+    if (GV.hasInitializer())
+      cast<GlobalVariable>(VMap[&GV])
+          ->setInitializer(mapConstant(GV.getInitializer()));
+
+  for (const Function &F : SrcM) {
+    auto *NewF = cast<Function>(VMap[&F]);
+    if (F.hasPersonalityFn())
+      NewF->setPersonalityFn(mapConstant(F.getPersonalityFn()));
+    if (F.hasPrefixData())
+      NewF->setPrefixData(mapConstant(F.getPrefixData()));
+    if (F.hasPrologueData())
+      NewF->setPrologueData(mapConstant(F.getPrologueData()));
+
+    for (const BasicBlock &BB : F)
+      for (const Instruction &SrcI : BB) {
+        auto *I = cast<Instruction>(VMap[&SrcI]);
+        RemapInstruction(I, VMap, RF_None, &TypeMapper, this);
+        if (auto CS = CallSite(I))
+          CS.setAttributes(mapAttributes(CS.getAttributes()));
+        if (auto *LI = dyn_cast<LoadInst>(I))
+          LI->setSyncScopeID(SSIDMap[LI->getSyncScopeID()]);
+        else if (auto *SI = dyn_cast<StoreInst>(I))
+          SI->setSyncScopeID(SSIDMap[SI->getSyncScopeID()]);
+        else if (auto *FI = dyn_cast<FenceInst>(I))
+          FI->setSyncScopeID(SSIDMap[FI->getSyncScopeID()]);
+        else if (auto *CXI = dyn_cast<AtomicCmpXchgInst>(I))
+          CXI->setSyncScopeID(SSIDMap[CXI->getSyncScopeID()]);
+        else if (auto *RMWI = dyn_cast<AtomicRMWInst>(I))
+          RMWI->setSyncScopeID(SSIDMap[RMWI->getSyncScopeID()]);
+      }
+  }
+  for (const auto &Pending : PendingAttachments)
+    for (const auto &MD : Pending.second)
+      Pending.first->setMetadata(MD.first, MD.second);
+
+  for (const GlobalAlias &GA : SrcM.aliases())
+    if (const Constant *C = GA.getAliasee())
+      cast<GlobalAlias>(VMap[&GA])->setAliasee(mapConstant(C));
+  for (const GlobalIFunc &GI : SrcM.ifuncs())
+    if (const Constant *C = GI.getResolver())
+      cast<GlobalIFunc>(VMap[&GI])->setResolver(mapConstant(C));
+
+  return New;
+}
+
+std::unique_ptr<Module> llvm::CloneModuleIntoContext(const Module &M,
+                                                     LLVMContext &Ctx) {
+  return ContextCloner(M, Ctx).clone();
+}
+
 extern "C" {
 
 LLVMModuleRef LLVMCloneModule(LLVMModuleRef M) {
@@ -11,10 +11,12 @@
 //
 //===----------------------------------------------------------------------===//
 #include "llvm/XRay/Trace.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/DataExtractor.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
 #include "llvm/XRay/YAMLXRayRecord.h"
 
 using namespace llvm;
@@ -55,88 +57,13 @@ Error readBinaryFormatHeader(StringRef Data, XRayFileHeader &FileHeader) {
   return Error::success();
 }
 
-Error loadNaiveFormatLog(StringRef Data, XRayFileHeader &FileHeader,
-                         std::vector<XRayRecord> &Records) {
-  if (Data.size() < 32)
-    return make_error<StringError>(
-        "Not enough bytes for an XRay log.",
-        std::make_error_code(std::errc::invalid_argument));
-
-  if (Data.size() - 32 == 0 || Data.size() % 32 != 0)
-    return make_error<StringError>(
-        "Invalid-sized XRay data.",
-        std::make_error_code(std::errc::invalid_argument));
-
-  if (auto E = readBinaryFormatHeader(Data, FileHeader))
-    return E;
-
-  // Each record after the header will be 32 bytes, in the following format:
-  //
-  //   (2)   uint16 : record type
-  //   (1)   uint8  : cpu id
-  //   (1)   uint8  : type
-  //   (4)   sint32 : function id
-  //   (8)   uint64 : tsc
-  //   (4)   uint32 : thread id
-  //   (12)  -      : padding
-  for (auto S = Data.drop_front(32); !S.empty(); S = S.drop_front(32)) {
-    DataExtractor RecordExtractor(S, true, 8);
-    uint32_t OffsetPtr = 0;
-    switch (auto RecordType = RecordExtractor.getU16(&OffsetPtr)) {
-    case 0: { // Normal records.
-      Records.emplace_back();
-      auto &Record = Records.back();
-      Record.RecordType = RecordType;
-      Record.CPU = RecordExtractor.getU8(&OffsetPtr);
-      auto Type = RecordExtractor.getU8(&OffsetPtr);
-      switch (Type) {
-      case 0:
-        Record.Type = RecordTypes::ENTER;
-        break;
-      case 1:
-        Record.Type = RecordTypes::EXIT;
-        break;
-      case 2:
-        Record.Type = RecordTypes::TAIL_EXIT;
-        break;
-      case 3:
-        Record.Type = RecordTypes::ENTER_ARG;
-        break;
-      default:
-        return make_error<StringError>(
-            Twine("Unknown record type '") + Twine(int{Type}) + "'",
-            std::make_error_code(std::errc::executable_format_error));
-      }
-      Record.FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
-      Record.TSC = RecordExtractor.getU64(&OffsetPtr);
-      Record.TId = RecordExtractor.getU32(&OffsetPtr);
-      break;
-    }
-    case 1: { // Arg payload record.
-      auto &Record = Records.back();
-      // Advance two bytes to avoid padding.
-      OffsetPtr += 2;
-      int32_t FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
-      auto TId = RecordExtractor.getU32(&OffsetPtr);
-      if (Record.FuncId != FuncId || Record.TId != TId)
-        return make_error<StringError>(
-            Twine("Corrupted log, found payload following non-matching "
-                  "function + thread record. Record for ") +
-                Twine(Record.FuncId) + " != " + Twine(FuncId),
-            std::make_error_code(std::errc::executable_format_error));
-      // Advance another four bytes to avoid padding.
-      OffsetPtr += 4;
-      auto Arg = RecordExtractor.getU64(&OffsetPtr);
-      Record.CallArgs.push_back(Arg);
-      break;
-    }
-    default:
-      return make_error<StringError>(
-          Twine("Unknown record type == ") + Twine(RecordType),
-          std::make_error_code(std::errc::executable_format_error));
-    }
-  }
-  return Error::success();
+// FDR mode logs keep the size of their thread buffers in the free form data of
+// the header.
+uint64_t getFDRBufferSize(const XRayFileHeader &FileHeader) {
+  StringRef ExtraDataRef(FileHeader.FreeFormData, 16);
+  DataExtractor ExtraDataExtractor(ExtraDataRef, true, 8);
+  uint32_t ExtraDataOffset = 0;
+  return ExtraDataExtractor.getU64(&ExtraDataOffset);
 }
 
 /// When reading from a Flight Data Recorder mode log, metadata records are
@@ -302,16 +229,14 @@ Error processBufferExtents(FDRState &State, uint8_t RecordFirstByte,
 /// State transition when a CallArgumentRecord is encountered.
 Error processFDRCallArgumentRecord(FDRState &State, uint8_t RecordFirstByte,
                                    DataExtractor &RecordExtractor,
-                                   std::vector<XRayRecord> &Records) {
+                                   XRayRecord *Enter) {
   uint32_t OffsetPtr = 1; // Read starting after the first byte.
-  auto &Enter = Records.back();
-
-  if (Enter.Type != RecordTypes::ENTER)
+  if (!Enter || Enter->Type != RecordTypes::ENTER)
     return make_error<StringError>(
         "CallArgument needs to be right after a function entry",
         std::make_error_code(std::errc::executable_format_error));
-  Enter.Type = RecordTypes::ENTER_ARG;
-  Enter.CallArgs.emplace_back(RecordExtractor.getU64(&OffsetPtr));
+  Enter->Type = RecordTypes::ENTER_ARG;
+  Enter->CallArgs.emplace_back(RecordExtractor.getU64(&OffsetPtr));
   return Error::success();
 }
 
@@ -324,10 +249,12 @@ Error processFDRCallArgumentRecord(FDRState &State, uint8_t RecordFirstByte,
 /// Beginning with Version 2 of the FDR log, we do not depend on the size of the
 /// buffer, but rather use the extents to determine how far to read in the log
 /// for this particular buffer.
+///
+/// LastRecord is the function record that immediately precedes this one, if
+/// any, which receives the arguments of CallArgument records.
 Error processFDRMetadataRecord(FDRState &State, uint8_t RecordFirstByte,
                                DataExtractor &RecordExtractor,
-                               size_t &RecordSize,
-                               std::vector<XRayRecord> &Records,
+                               size_t &RecordSize, XRayRecord *LastRecord,
                                uint16_t Version) {
   // The remaining 7 bits are the RecordKind enum.
   uint8_t RecordKind = RecordFirstByte >> 1;
@@ -368,7 +295,7 @@ Error processFDRMetadataRecord(FDRState &State, uint8_t RecordFirstByte,
     break;
   case 6: // CallArgument
     if (auto E = processFDRCallArgumentRecord(State, RecordFirstByte,
-                                              RecordExtractor, Records))
+                                              RecordExtractor, LastRecord))
       return E;
     break;
   case 7: // BufferExtents
@@ -385,16 +312,15 @@ Error processFDRMetadataRecord(FDRState &State, uint8_t RecordFirstByte,
   return Error::success();
 }
 
-/// Reads a function record from an FDR format log, appending a new XRayRecord
-/// to the vector being populated and updating the State with a new value
-/// reference value to interpret TSC deltas.
+/// Reads a function record from an FDR format log into Record, updating the
+/// State with a new value reference value to interpret TSC deltas.
 ///
 /// The XRayRecord constructed includes information from the function record
 /// processed here as well as Thread ID and CPU ID formerly extracted into
 /// State.
 Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
                                DataExtractor &RecordExtractor,
-                               std::vector<XRayRecord> &Records) {
+                               XRayRecord &Record) {
   switch (State.Expects) {
   case FDRState::Token::NEW_BUFFER_RECORD_OR_EOF:
     return make_error<StringError>(
@@ -409,9 +335,8 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
         "Malformed log. Received Function Record before first CPU record.",
         std::make_error_code(std::errc::executable_format_error));
   default:
-    Records.emplace_back();
-    auto &Record = Records.back();
     Record.RecordType = 0; // Record is type NORMAL.
+    Record.CallArgs.clear();
     // Strip off record type bit and use the next three bits.
     uint8_t RecordType = (RecordFirstByte >> 1) & 0x07;
     switch (RecordType) {
@@ -453,7 +378,79 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
   return Error::success();
 }
 
-/// Reads a log in FDR mode for version 1 of this binary format. FDR mode is
+Error loadYAMLLog(StringRef Data, XRayFileHeader &FileHeader,
+                  std::vector<XRayRecord> &Records) {
+  YAMLXRayTrace Trace;
+  Input In(Data);
+  In >> Trace;
+  if (In.error())
+    return make_error<StringError>("Failed loading YAML Data.", In.error());
+
+  FileHeader.Version = Trace.Header.Version;
+  FileHeader.Type = Trace.Header.Type;
+  FileHeader.ConstantTSC = Trace.Header.ConstantTSC;
+  FileHeader.NonstopTSC = Trace.Header.NonstopTSC;
+  FileHeader.CycleFrequency = Trace.Header.CycleFrequency;
+
+  if (FileHeader.Version != 1)
+    return make_error<StringError>(
+        Twine("Unsupported XRay file version: ") + Twine(FileHeader.Version),
+        std::make_error_code(std::errc::invalid_argument));
+
+  Records.clear();
+  std::transform(Trace.Records.begin(), Trace.Records.end(),
+                 std::back_inserter(Records), [&](const YAMLXRayRecord &R) {
+                   return XRayRecord{R.RecordType, R.CPU, R.Type,    R.FuncId,
+                                     R.TSC,        R.TId, R.CallArgs};
+                 });
+  return Error::success();
+}
+} // namespace
+
+
+struct TraceRecordReader::FDRState : public ::FDRState {};
+
+Error TraceFile::indexNaiveLog() {
+  if (Data.size() < 32)
+    return make_error<StringError>(
+        "Not enough bytes for an XRay log.",
+        std::make_error_code(std::errc::invalid_argument));
+
+  if (Data.size() - 32 == 0 || Data.size() % 32 != 0)
+    return make_error<StringError>(
+        "Invalid-sized XRay data.",
+        std::make_error_code(std::errc::invalid_argument));
+
+  if (auto E = readBinaryFormatHeader(Data, FileHeader))
+    return E;
+
+  // Only the thread id of each record is read here; see decodeNaiveRecord for
+  // the layout of the records. Argument payload records carry the thread id
+  // of the function record they belong to, so they stay in its buffer.
+  for (uint64_t Offset = 32; Offset != Data.size(); Offset += 32) {
+    DataExtractor RecordExtractor(Data.substr(Offset, 32), true, 8);
+    uint32_t OffsetPtr = 0;
+    uint32_t TId;
+    switch (RecordExtractor.getU16(&OffsetPtr)) {
+    case 0: // Normal records.
+      OffsetPtr = 16;
+      TId = RecordExtractor.getU32(&OffsetPtr);
+      break;
+    case 1: // Arg payload record.
+      OffsetPtr = 8;
+      TId = RecordExtractor.getU32(&OffsetPtr);
+      break;
+    default:
+      // Leave unknown records to the decoder to diagnose.
+      TId = Buffers.empty() ? 0 : Buffers.back().TId;
+      break;
+    }
+    addBuffer(Offset, 32, TId);
+  }
+  return Error::success();
+}
+
+/// Indexes a log in FDR mode for version 1 of this binary format. FDR mode is
 /// defined as part of the compiler-rt project in xray_fdr_logging.h, and such
 /// a log consists of the familiar 32 bit XRayHeader, followed by sequences of
 /// of interspersed 16 byte Metadata Records and 8 byte Function Records.
@@ -490,8 +487,12 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
 ///                in the buffer. This is measured from the start of the buffer
 ///                and must always be at least 48 (bytes).
 /// EOB: *deprecated*
-Error loadFDRLog(StringRef Data, XRayFileHeader &FileHeader,
-                 std::vector<XRayRecord> &Records) {
+///
+/// Indexing only follows the BufferSize (Version 1) or the BufferExtents
+/// records (Version 2) from one thread buffer to the next, and reads the
+/// thread id from their NewBuffer records. The thread buffers are validated
+/// as they are decoded.
+Error TraceFile::indexFDRLog() {
   if (Data.size() < 32)
     return make_error<StringError>(
         "Not enough bytes for an XRay log.",
@@ -508,126 +509,113 @@ Error loadFDRLog(StringRef Data, XRayFileHeader &FileHeader,
   if (auto E = readBinaryFormatHeader(Data, FileHeader))
     return E;
 
-  uint64_t BufferSize = 0;
-  {
-    StringRef ExtraDataRef(FileHeader.FreeFormData, 16);
-    DataExtractor ExtraDataExtractor(ExtraDataRef, true, 8);
-    uint32_t ExtraDataOffset = 0;
-    BufferSize = ExtraDataExtractor.getU64(&ExtraDataOffset);
-  }
-
-  FDRState::Token InitialExpectation;
-  switch (FileHeader.Version) {
-  case 1:
-    InitialExpectation = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
-    break;
-  case 2:
-    InitialExpectation = FDRState::Token::BUFFER_EXTENTS;
-    break;
-  default:
+  uint64_t BufferSize = getFDRBufferSize(FileHeader);
+  if (FileHeader.Version == 1 && BufferSize == 0)
     return make_error<StringError>(
-        Twine("Unsupported version '") + Twine(FileHeader.Version) + "'",
+        "Malformed log. The thread buffer size is zero.",
         std::make_error_code(std::errc::executable_format_error));
-  }
-  FDRState State{0, 0, 0, InitialExpectation, BufferSize, 0};
 
-  // RecordSize will tell the loop how far to seek ahead based on the record
-  // type that we have just read.
-  size_t RecordSize = 0;
-  for (auto S = Data.drop_front(32); !S.empty(); S = S.drop_front(RecordSize)) {
-    DataExtractor RecordExtractor(S, true, 8);
-    uint32_t OffsetPtr = 0;
-    if (State.Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF) {
-      RecordSize = State.CurrentBufferSize - State.CurrentBufferConsumed;
-      if (S.size() < RecordSize) {
+  for (uint64_t Offset = 32; Offset != Data.size();) {
+    StringRef Rest = Data.drop_front(Offset);
+    uint64_t Size;
+    StringRef NewBuffer;
+    if (FileHeader.Version == 1) {
+      Size = BufferSize;
+      NewBuffer = Rest;
+    } else {
+      DataExtractor ExtentsExtractor(Rest, true, 8);
+      uint32_t OffsetPtr = 0;
+      uint8_t BitField = ExtentsExtractor.getU8(&OffsetPtr);
+      if (Rest.size() < 16 || BitField != ((7 << 1) | 0x01))
         return make_error<StringError>(
-            Twine("Incomplete thread buffer. Expected at least ") +
-                Twine(RecordSize) + " bytes but found " + Twine(S.size()),
-            make_error_code(std::errc::invalid_argument));
-      }
-      State.CurrentBufferConsumed = 0;
-      State.Expects = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
-      continue;
-    }
-    uint8_t BitField = RecordExtractor.getU8(&OffsetPtr);
-    bool isMetadataRecord = BitField & 0x01uL;
-    bool isBufferExtents =
-        (BitField >> 1) == 7; // BufferExtents record kind == 7
-    if (isMetadataRecord) {
-      RecordSize = 16;
-      if (auto E =
-              processFDRMetadataRecord(State, BitField, RecordExtractor,
-                                       RecordSize, Records, FileHeader.Version))
-        return E;
-    } else { // Process Function Record
-      RecordSize = 8;
-      if (auto E = processFDRFunctionRecord(State, BitField, RecordExtractor,
-                                            Records))
-        return E;
+            Twine("Malformed log. Expected a Buffer Extents record at offset ") +
+                Twine(Offset),
+            std::make_error_code(std::errc::executable_format_error));
+      // The BufferExtents record is not counted in the size of the buffer.
+      Size = 16 + ExtentsExtractor.getU64(&OffsetPtr);
+      NewBuffer = Rest.drop_front(16);
     }
+    if (Rest.size() < Size)
+      return make_error<StringError>(
+          Twine("Incomplete thread buffer. Expected at least ") + Twine(Size) +
+              " bytes but found " + Twine(Rest.size()),
+          make_error_code(std::errc::invalid_argument));
+
+    // A buffer that does not start with a NewBuffer record is diagnosed when
+    // it is decoded.
+    uint32_t TId = 0;
+    DataExtractor NewBufferExtractor(NewBuffer, true, 8);
+    uint32_t OffsetPtr = 0;
+    if (NewBuffer.size() >= 16 && NewBufferExtractor.getU8(&OffsetPtr) == 0x01)
+      TId = NewBufferExtractor.getU16(&OffsetPtr);
 
-    // The BufferExtents record is technically not part of the buffer, so we
-    // don't count the size of that record against the buffer's actual size.
-    if (!isBufferExtents)
-      State.CurrentBufferConsumed += RecordSize;
-    assert(State.CurrentBufferConsumed <= State.CurrentBufferSize);
-    if (FileHeader.Version == 2 &&
-        State.CurrentBufferSize == State.CurrentBufferConsumed) {
-      // In Version 2 of the log, we don't need to scan to the end of the thread
-      // buffer if we've already consumed all the bytes we need to.
-      State.Expects = FDRState::Token::BUFFER_EXTENTS;
-      State.CurrentBufferSize = BufferSize;
-      State.CurrentBufferConsumed = 0;
-    }
+    // Version 2 buffers that only hold their extents have no records.
+    if (FileHeader.Version == 1 || Size > 16)
+      Buffers.push_back({Offset, Size, TId});
+    Offset += Size;
   }
+  return Error::success();
+}
 
-  // Having iterated over everything we've been given, we've either consumed
-  // everything and ended up in the end state, or were told to skip the rest.
-  bool Finished = State.Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF &&
-                  State.CurrentBufferSize == State.CurrentBufferConsumed;
-  if ((State.Expects != FDRState::Token::NEW_BUFFER_RECORD_OR_EOF &&
-       State.Expects != FDRState::Token::BUFFER_EXTENTS) &&
-      !Finished)
-    return make_error<StringError>(
-        Twine("Encountered EOF with unexpected state expectation ") +
-            fdrStateToTwine(State.Expects) +
-            ". Remaining expected bytes in thread buffer total " +
-            Twine(State.CurrentBufferSize - State.CurrentBufferConsumed),
-        std::make_error_code(std::errc::executable_format_error));
-
+Error TraceFile::indexYAMLLog() {
+  if (auto E = loadYAMLLog(Data, FileHeader, YAMLRecords))
+    return E;
+  for (uint64_t I = 0, E = YAMLRecords.size(); I != E; ++I)
+    addBuffer(I, 1, YAMLRecords[I].TId);
   return Error::success();
 }
 
-Error loadYAMLLog(StringRef Data, XRayFileHeader &FileHeader,
-                  std::vector<XRayRecord> &Records) {
-  YAMLXRayTrace Trace;
-  Input In(Data);
-  In >> Trace;
-  if (In.error())
-    return make_error<StringError>("Failed loading YAML Data.", In.error());
+void TraceFile::addBuffer(uint64_t Offset, uint64_t Size, uint32_t TId) {
+  if (!Buffers.empty() && Buffers.back().TId == TId &&
+      Buffers.back().Offset + Buffers.back().Size == Offset) {
+    Buffers.back().Size += Size;
+    return;
+  }
+  Buffers.push_back({Offset, Size, TId});
+}
 
-  FileHeader.Version = Trace.Header.Version;
-  FileHeader.Type = Trace.Header.Type;
-  FileHeader.ConstantTSC = Trace.Header.ConstantTSC;
-  FileHeader.NonstopTSC = Trace.Header.NonstopTSC;
-  FileHeader.CycleFrequency = Trace.Header.CycleFrequency;
+void TraceFile::groupBuffersByThread() {
+  DenseMap<uint32_t, unsigned> ThreadIndex;
+  std::vector<size_t> Counts;
+  for (const auto &Buffer : Buffers) {
+    auto Inserted = ThreadIndex.insert({Buffer.TId, ThreadIds.size()});
+    if (Inserted.second) {
+      ThreadIds.push_back(Buffer.TId);
+      Counts.push_back(0);
+    }
+    ++Counts[Inserted.first->second];
+  }
 
-  if (FileHeader.Version != 1)
-    return make_error<StringError>(
-        Twine("Unsupported XRay file version: ") + Twine(FileHeader.Version),
-        std::make_error_code(std::errc::invalid_argument));
+  size_t Begin = 0;
+  for (size_t Count : Counts) {
+    ThreadRanges.emplace_back(Begin, Count);
+    Begin += Count;
+  }
 
-  Records.clear();
-  std::transform(Trace.Records.begin(), Trace.Records.end(),
-                 std::back_inserter(Records), [&](const YAMLXRayRecord &R) {
-                   return XRayRecord{R.RecordType, R.CPU, R.Type,    R.FuncId,
-                                     R.TSC,        R.TId, R.CallArgs};
-                 });
-  return Error::success();
+  // A stable counting sort of the buffers by thread.
+  std::vector<size_t> Next;
+  for (const auto &Range : ThreadRanges)
+    Next.push_back(Range.first);
+  BuffersByThread.resize(Buffers.size());
+  for (const auto &Buffer : Buffers)
+    BuffersByThread[Next[ThreadIndex[Buffer.TId]]++] = Buffer;
 }
-} // namespace
 
-Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
+TraceRecordReader TraceFile::records() const {
+  return TraceRecordReader(*this, Buffers);
+}
+
+TraceRecordReader TraceFile::records(uint32_t TId) const {
+  auto It = llvm::find(ThreadIds, TId);
+  if (It == ThreadIds.end())
+    return TraceRecordReader(*this, None);
+  const auto &Range = ThreadRanges[It - ThreadIds.begin()];
+  return TraceRecordReader(
+      *this, makeArrayRef(BuffersByThread).slice(Range.first, Range.second));
+}
+
+Expected<std::unique_ptr<TraceFile>>
+llvm::xray::openTraceFile(StringRef Filename) {
   int Fd;
   if (auto EC = sys::fs::openFileForRead(Filename, Fd)) {
     return make_error<StringError>(
@@ -636,24 +624,28 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
 
   uint64_t FileSize;
   if (auto EC = sys::fs::file_size(Filename, FileSize)) {
+    sys::Process::SafelyCloseFileDescriptor(Fd);
     return make_error<StringError>(
         Twine("Cannot read log from '") + Filename + "'", EC);
   }
   if (FileSize < 4) {
+    sys::Process::SafelyCloseFileDescriptor(Fd);
     return make_error<StringError>(
         Twine("File '") + Filename + "' too small for XRay.",
         std::make_error_code(std::errc::executable_format_error));
   }
 
   // Map the opened file into memory and use a StringRef to access it later.
+  // The mapping stays valid once the file is closed.
   std::error_code EC;
-  sys::fs::mapped_file_region MappedFile(
+  auto MappedFile = llvm::make_unique<sys::fs::mapped_file_region>(
       Fd, sys::fs::mapped_file_region::mapmode::readonly, FileSize, 0, EC);
+  sys::Process::SafelyCloseFileDescriptor(Fd);
   if (EC) {
     return make_error<StringError>(
         Twine("Cannot read log from '") + Filename + "'", EC);
   }
-  auto Data = StringRef(MappedFile.data(), MappedFile.size());
+  std::unique_ptr<TraceFile> File(new TraceFile(std::move(MappedFile)));
 
   // Attempt to detect the file type using file magic. We have a slight bias
   // towards the binary format, and we do this by making sure that the first 4
@@ -669,19 +661,18 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
   //
   // Only if we can't load either the binary or the YAML format will we yield an
   // error.
-  StringRef Magic(MappedFile.data(), 4);
-  DataExtractor HeaderExtractor(Magic, true, 8);
+  DataExtractor HeaderExtractor(File->Data.take_front(4), true, 8);
   uint32_t OffsetPtr = 0;
   uint16_t Version = HeaderExtractor.getU16(&OffsetPtr);
   uint16_t Type = HeaderExtractor.getU16(&OffsetPtr);
 
   enum BinaryFormatType { NAIVE_FORMAT = 0, FLIGHT_DATA_RECORDER_FORMAT = 1 };
 
-  Trace T;
   switch (Type) {
   case NAIVE_FORMAT:
     if (Version == 1 || Version == 2) {
-      if (auto E = loadNaiveFormatLog(Data, T.FileHeader, T.Records))
+      File->Kind = TraceFile::LogKind::Naive;
+      if (auto E = File->indexNaiveLog())
         return std::move(E);
     } else {
       return make_error<StringError>(
@@ -692,7 +683,8 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
     break;
   case FLIGHT_DATA_RECORDER_FORMAT:
     if (Version == 1 || Version == 2) {
-      if (auto E = loadFDRLog(Data, T.FileHeader, T.Records))
+      File->Kind = TraceFile::LogKind::FDR;
+      if (auto E = File->indexFDRLog())
         return std::move(E);
     } else {
       return make_error<StringError>(
@@ -701,10 +693,247 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
     }
     break;
   default:
-    if (auto E = loadYAMLLog(Data, T.FileHeader, T.Records))
+    File->Kind = TraceFile::LogKind::YAML;
+    if (auto E = File->indexYAMLLog())
       return std::move(E);
   }
 
+  File->groupBuffersByThread();
+  return std::move(File);
+}
+
+TraceRecordReader::TraceRecordReader(const TraceFile &File,
+                                     ArrayRef<TraceFile::ThreadBuffer> Buffers)
+    : File(File), Buffers(Buffers),
+      State(llvm::make_unique<FDRState>()) {}
+
+TraceRecordReader::TraceRecordReader(TraceRecordReader &&) = default;
+
+TraceRecordReader::~TraceRecordReader() = default;
+
+void TraceRecordReader::startBuffer(const TraceFile::ThreadBuffer &Buffer) {
+  switch (File.Kind) {
+  case TraceFile::LogKind::YAML:
+    YAMLIndex = Buffer.Offset;
+    YAMLEnd = Buffer.Offset + Buffer.Size;
+    return;
+  case TraceFile::LogKind::FDR:
+    // Every thread buffer starts from a fresh state.
+    *State = FDRState();
+    State->Expects = File.FileHeader.Version == 1
+                         ? FDRState::Token::NEW_BUFFER_RECORD_OR_EOF
+                         : FDRState::Token::BUFFER_EXTENTS;
+    State->CurrentBufferSize = getFDRBufferSize(File.FileHeader);
+    LLVM_FALLTHROUGH;
+  case TraceFile::LogKind::Naive:
+    Remaining = File.Data.substr(Buffer.Offset, Buffer.Size);
+    return;
+  }
+}
+
+Expected<const XRayRecord *> TraceRecordReader::next() {
+  while (true) {
+    if (File.Kind == TraceFile::LogKind::YAML) {
+      if (YAMLIndex != YAMLEnd)
+        return &File.YAMLRecords[YAMLIndex++];
+    } else {
+      auto Decoded = File.Kind == TraceFile::LogKind::Naive
+                         ? decodeNaiveRecord()
+                         : decodeFDRRecord();
+      if (!Decoded)
+        return Decoded.takeError();
+      if (*Decoded)
+        return &Current;
+    }
+    if (Buffers.empty())
+      return nullptr;
+    startBuffer(Buffers.front());
+    Buffers = Buffers.drop_front();
+  }
+}
+
+Expected<bool> TraceRecordReader::decodeNaiveRecord() {
+  if (Remaining.empty())
+    return false;
+
+  // Each record after the header will be 32 bytes, in the following format:
+  //
+  //   (2)   uint16 : record type
+  //   (1)   uint8  : cpu id
+  //   (1)   uint8  : type
+  //   (4)   sint32 : function id
+  //   (8)   uint64 : tsc
+  //   (4)   uint32 : thread id
+  //   (12)  -      : padding
+  //
+  // A normal record may be followed by argument payload records, which we read
+  // along with it.
+  DataExtractor RecordExtractor(Remaining.take_front(32), true, 8);
+  uint32_t OffsetPtr = 0;
+  switch (auto RecordType = RecordExtractor.getU16(&OffsetPtr)) {
+  case 0: { // Normal records.
+    Current.RecordType = RecordType;
+    Current.CPU = RecordExtractor.getU8(&OffsetPtr);
+    auto Type = RecordExtractor.getU8(&OffsetPtr);
+    switch (Type) {
+    case 0:
+      Current.Type = RecordTypes::ENTER;
+      break;
+    case 1:
+      Current.Type = RecordTypes::EXIT;
+      break;
+    case 2:
+      Current.Type = RecordTypes::TAIL_EXIT;
+      break;
+    case 3:
+      Current.Type = RecordTypes::ENTER_ARG;
+      break;
+    default:
+      return make_error<StringError>(
+          Twine("Unknown record type '") + Twine(int{Type}) + "'",
+          std::make_error_code(std::errc::executable_format_error));
+    }
+    Current.FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
+    Current.TSC = RecordExtractor.getU64(&OffsetPtr);
+    Current.TId = RecordExtractor.getU32(&OffsetPtr);
+    Current.CallArgs.clear();
+    break;
+  }
+  case 1: // Arg payload record.
+    return make_error<StringError>(
+        "Corrupted log, found payload without a preceding function record of "
+        "the same thread.",
+        std::make_error_code(std::errc::executable_format_error));
+  default:
+    return make_error<StringError>(
+        Twine("Unknown record type == ") + Twine(RecordType),
+        std::make_error_code(std::errc::executable_format_error));
+  }
+
+  for (Remaining = Remaining.drop_front(32); !Remaining.empty();
+       Remaining = Remaining.drop_front(32)) {
+    DataExtractor PayloadExtractor(Remaining.take_front(32), true, 8);
+    OffsetPtr = 0;
+    if (PayloadExtractor.getU16(&OffsetPtr) != 1)
+      break;
+    // Advance two bytes to avoid padding.
+    OffsetPtr += 2;
+    int32_t FuncId = PayloadExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
+    auto TId = PayloadExtractor.getU32(&OffsetPtr);
+    if (Current.FuncId != FuncId || Current.TId != TId)
+      return make_error<StringError>(
+          Twine("Corrupted log, found payload following non-matching "
+                "function + thread record. Record for ") +
+              Twine(Current.FuncId) + " != " + Twine(FuncId),
+          std::make_error_code(std::errc::executable_format_error));
+    // Advance another four bytes to avoid padding.
+    OffsetPtr += 4;
+    Current.CallArgs.push_back(PayloadExtractor.getU64(&OffsetPtr));
+  }
+  return true;
+}
+
+Expected<bool> TraceRecordReader::decodeFDRRecord() {
+  uint16_t Version = File.FileHeader.Version;
+  bool HaveRecord = false;
+  while (!Remaining.empty()) {
+    // The rest of a Version 1 buffer after its EOB record is garbage.
+    if (State->Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF) {
+      Remaining = StringRef();
+      State->CurrentBufferConsumed = 0;
+      State->Expects = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
+      break;
+    }
+
+    DataExtractor RecordExtractor(Remaining, true, 8);
+    uint32_t OffsetPtr = 0;
+    uint8_t BitField = RecordExtractor.getU8(&OffsetPtr);
+    bool isMetadataRecord = BitField & 0x01uL;
+    bool isBufferExtents =
+        (BitField >> 1) == 7; // BufferExtents record kind == 7
+    bool isCallArgument = isMetadataRecord && (BitField >> 1) == 6;
+
+    // A function record is complete once the CallArgument records that follow
+    // it have been read.
+    if (HaveRecord && !isCallArgument)
+      return true;
+
+    size_t RecordSize;
+    if (isMetadataRecord) {
+      RecordSize = 16;
+      if (auto E = processFDRMetadataRecord(*State, BitField, RecordExtractor,
+                                            RecordSize,
+                                            HaveRecord ? &Current : nullptr,
+                                            Version))
+        return std::move(E);
+    } else { // Process Function Record
+      RecordSize = 8;
+      if (auto E = processFDRFunctionRecord(*State, BitField, RecordExtractor,
+                                            Current))
+        return std::move(E);
+      HaveRecord = true;
+    }
+    if (Remaining.size() < RecordSize)
+      return make_error<StringError>(
+          Twine("Malformed log. Record of ") + Twine(RecordSize) +
+              " bytes crosses the end of the thread buffer.",
+          std::make_error_code(std::errc::executable_format_error));
+    Remaining = Remaining.drop_front(RecordSize);
+
+    // The BufferExtents record is technically not part of the buffer, so we
+    // don't count the size of that record against the buffer's actual size.
+    if (!isBufferExtents)
+      State->CurrentBufferConsumed += RecordSize;
+    if (State->CurrentBufferConsumed > State->CurrentBufferSize)
+      return make_error<StringError>(
+          Twine("Malformed log. Read ") + Twine(State->CurrentBufferConsumed) +
+              " bytes from a thread buffer of " +
+              Twine(State->CurrentBufferSize) + " bytes.",
+          std::make_error_code(std::errc::executable_format_error));
+    if (Version == 2 &&
+        State->CurrentBufferSize == State->CurrentBufferConsumed) {
+      // In Version 2 of the log, we don't need to scan to the end of the thread
+      // buffer if we've already consumed all the bytes we need to.
+      State->Expects = FDRState::Token::BUFFER_EXTENTS;
+      State->CurrentBufferConsumed = 0;
+      Remaining = StringRef();
+    }
+  }
+  if (HaveRecord)
+    return true;
+
+  // Having decoded the whole buffer, we've either consumed everything and
+  // ended up in the end state, or were told to skip the rest.
+  if (State->Expects != FDRState::Token::NEW_BUFFER_RECORD_OR_EOF &&
+      State->Expects != FDRState::Token::BUFFER_EXTENTS &&
+      State->Expects != FDRState::Token::SCAN_TO_END_OF_THREAD_BUF)
+    return make_error<StringError>(
+        Twine("Encountered end of thread buffer with unexpected state "
+              "expectation ") +
+            fdrStateToTwine(State->Expects) +
+            ". Remaining expected bytes in thread buffer total " +
+            Twine(State->CurrentBufferSize - State->CurrentBufferConsumed),
+        std::make_error_code(std::errc::executable_format_error));
+  return false;
+}
+
+Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
+  auto FileOrErr = openTraceFile(Filename);
+  if (!FileOrErr)
+    return FileOrErr.takeError();
+
+  Trace T;
+  T.FileHeader = (*FileOrErr)->getFileHeader();
+  TraceRecordReader Reader = (*FileOrErr)->records();
+  while (true) {
+    auto RecordOrErr = Reader.next();
+    if (!RecordOrErr)
+      return RecordOrErr.takeError();
+    if (!*RecordOrErr)
+      break;
+    T.Records.push_back(**RecordOrErr);
+  }
+
   if (Sort)
     std::stable_sort(T.Records.begin(), T.Records.end(),
               [&](const XRayRecord &L, const XRayRecord &R) {
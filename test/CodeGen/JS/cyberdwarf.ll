@@ -0,0 +1,64 @@
+; RUN: llc < %s -enable-cyberdwarf | FileCheck %s
+; RUN: llc < %s -enable-cyberdwarf -emscripten-cyberdwarf-file=%t | FileCheck %s -check-prefix=NODATA
+; RUN: FileCheck %s -check-prefix=FILE < %t
+
+; Types are recorded once, when first referenced by a function or by the
+; retained types at the end, and can be written to a separate file.
+
+; CHECK: "cyberdwarf_data": {
+; CHECK-NEXT: "types": {"4":[0,"int",5,0,32],"3":[1, "value",13,4,0,32],"5":[1, "next",13,1,32,32],"2":[2, "node",19,0,0,64,"",["3","5"]],"1":[1, "",15,2,0,32],"7":[6,"RED",0],"8":[6,"BLUE",1],"6":[2, "color",4,0,0,32,"_ZTS5color",["7","8"]]}, "type_name_map": {"_ZTS5color":"6"}, "functions": {"length":{"list":"1"},"_Z5counti":{"c":"4"}}, "vtable_offsets": {}
+
+; NODATA-NOT: cyberdwarf_data
+
+; FILE: {
+; FILE-NEXT: "types": {"4":[0,"int",5,0,32],"3":[1, "value",13,4,0,32],"5":[1, "next",13,1,32,32],"2":[2, "node",19,0,0,64,"",["3","5"]],"1":[1, "",15,2,0,32],"7":[6,"RED",0],"8":[6,"BLUE",1],"6":[2, "color",4,0,0,32,"_ZTS5color",["7","8"]]}, "type_name_map": {"_ZTS5color":"6"}, "functions": {"length":{"list":"1"},"_Z5counti":{"c":"4"}}, "vtable_offsets": {}
+; FILE-NEXT: }
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+%struct.node = type { i32, %struct.node* }
+
+@table = global [4 x i32] zeroinitializer, align 4
+
+define i32 @length(%struct.node* %list) !dbg !10 {
+entry:
+  ret i32 0, !dbg !23
+}
+
+define i32 @count(i32 %c) !dbg !30 {
+entry:
+  ret i32 %c, !dbg !33
+}
+
+declare void @llvm.dbg.value(metadata, metadata, metadata)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2, retainedTypes: !5)
+!1 = !DIFile(filename: "list.c", directory: "/src")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = !{!6}
+!6 = !DICompositeType(tag: DW_TAG_enumeration_type, name: "color", file: !1, line: 1, size: 32, elements: !7, identifier: "_ZTS5color")
+!7 = !{!8, !9}
+!8 = !DIEnumerator(name: "RED", value: 0)
+!9 = !DIEnumerator(name: "BLUE", value: 1)
+!10 = distinct !DISubprogram(name: "length", scope: !1, file: !1, line: 3, type: !11, isLocal: false, isDefinition: true, scopeLine: 3, flags: DIFlagPrototyped, isOptimized: false, unit: !0, variables: !19)
+!11 = !DISubroutineType(types: !12)
+!12 = !{!13, !14}
+!13 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!14 = !DIDerivedType(tag: DW_TAG_pointer_type, baseType: !15, size: 32)
+!15 = distinct !DICompositeType(tag: DW_TAG_structure_type, name: "node", file: !1, line: 2, size: 64, elements: !16)
+!16 = !{!17, !18}
+!17 = !DIDerivedType(tag: DW_TAG_member, name: "value", scope: !15, file: !1, line: 2, baseType: !13, size: 32)
+!18 = !DIDerivedType(tag: DW_TAG_member, name: "next", scope: !15, file: !1, line: 2, baseType: !14, size: 32, offset: 32)
+!19 = !{!20}
+!20 = !DILocalVariable(name: "list", arg: 1, scope: !10, file: !1, line: 3, type: !14)
+!23 = !DILocation(line: 3, scope: !10)
+!30 = distinct !DISubprogram(name: "count", linkageName: "_Z5counti", scope: !1, file: !1, line: 5, type: !11, isLocal: false, isDefinition: true, scopeLine: 5, flags: DIFlagPrototyped, isOptimized: false, unit: !0, variables: !31)
+!31 = !{!32}
+!32 = !DILocalVariable(name: "c", arg: 1, scope: !30, file: !1, line: 5, type: !13)
+!33 = !DILocation(line: 5, scope: !30)
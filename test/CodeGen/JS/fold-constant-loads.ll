@@ -0,0 +1,94 @@
+; RUN: llc < %s | FileCheck %s
+; RUN: llc -O0 < %s | FileCheck %s -check-prefix=NOFOLD
+
+; Loads from constant globals are folded into the values they read, and
+; calls through vtable slots read that way become direct calls.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+%struct.Obj = type { i32 (%struct.Obj*)** }
+
+@table = internal constant [4 x i32] [i32 10, i32 20, i32 30, i32 40], align 4
+@scale = internal constant double 2.500000e+00, align 8
+@mutable = internal global [2 x i32] [i32 1, i32 2], align 4
+@vtable = internal constant [2 x i32 (%struct.Obj*)*] [i32 (%struct.Obj*)* @first, i32 (%struct.Obj*)* @second], align 4
+@static_obj = internal constant %struct.Obj { i32 (%struct.Obj*)** getelementptr inbounds ([2 x i32 (%struct.Obj*)*], [2 x i32 (%struct.Obj*)*]* @vtable, i32 0, i32 0) }, align 4
+
+define internal i32 @first(%struct.Obj* %this) {
+  ret i32 1
+}
+
+define internal i32 @second(%struct.Obj* %this) {
+  ret i32 2
+}
+
+; CHECK: function _lookup() {
+; CHECK: return 30;
+; NOFOLD: function _lookup() {
+; NOFOLD: HEAP32[
+define i32 @lookup() {
+  %p = getelementptr inbounds [4 x i32], [4 x i32]* @table, i32 0, i32 2
+  %v = load i32, i32* %p, align 4
+  ret i32 %v
+}
+
+; CHECK: function _scaled($x) {
+; CHECK-NOT: HEAPF64
+; CHECK: 2.5
+; CHECK: }
+define double @scaled(double %x) {
+  %s = load double, double* @scale, align 8
+  %r = fmul double %x, %s
+  ret double %r
+}
+
+; Globals that may be written are left alone.
+; CHECK: function _not_constant() {
+; CHECK: HEAP32[
+define i32 @not_constant() {
+  %p = getelementptr inbounds [2 x i32], [2 x i32]* @mutable, i32 0, i32 1
+  %v = load i32, i32* %p, align 4
+  ret i32 %v
+}
+
+; CHECK: function _call_static() {
+; CHECK-NOT: FUNCTION_TABLE
+; CHECK: _second(
+; CHECK: }
+define i32 @call_static() {
+  %vtable = load i32 (%struct.Obj*)**, i32 (%struct.Obj*)*** getelementptr inbounds (%struct.Obj, %struct.Obj* @static_obj, i32 0, i32 0), align 4
+  %slot = getelementptr inbounds i32 (%struct.Obj*)*, i32 (%struct.Obj*)** %vtable, i32 1
+  %fn = load i32 (%struct.Obj*)*, i32 (%struct.Obj*)** %slot, align 4
+  %r = call i32 %fn(%struct.Obj* @static_obj)
+  ret i32 %r
+}
+
+; The vtable pointer stored into a fresh object is forwarded to the load.
+; CHECK: function _call_constructed($o) {
+; CHECK-NOT: FUNCTION_TABLE
+; CHECK: _first(
+; CHECK: }
+define i32 @call_constructed(%struct.Obj* %o) {
+  %vptr = getelementptr inbounds %struct.Obj, %struct.Obj* %o, i32 0, i32 0
+  store i32 (%struct.Obj*)** getelementptr inbounds ([2 x i32 (%struct.Obj*)*], [2 x i32 (%struct.Obj*)*]* @vtable, i32 0, i32 0), i32 (%struct.Obj*)*** %vptr, align 4
+  %vtable = load i32 (%struct.Obj*)**, i32 (%struct.Obj*)*** %vptr, align 4
+  %fn = load i32 (%struct.Obj*)*, i32 (%struct.Obj*)** %vtable, align 4
+  %r = call i32 %fn(%struct.Obj* %o)
+  ret i32 %r
+}
+
+; A call in between may change the vtable pointer.
+; CHECK: function _call_after_clobber($o) {
+; CHECK: FUNCTION_TABLE
+define i32 @call_after_clobber(%struct.Obj* %o) {
+  %vptr = getelementptr inbounds %struct.Obj, %struct.Obj* %o, i32 0, i32 0
+  store i32 (%struct.Obj*)** getelementptr inbounds ([2 x i32 (%struct.Obj*)*], [2 x i32 (%struct.Obj*)*]* @vtable, i32 0, i32 0), i32 (%struct.Obj*)*** %vptr, align 4
+  call void @clobber(%struct.Obj* %o)
+  %vtable = load i32 (%struct.Obj*)**, i32 (%struct.Obj*)*** %vptr, align 4
+  %fn = load i32 (%struct.Obj*)*, i32 (%struct.Obj*)** %vtable, align 4
+  %r = call i32 %fn(%struct.Obj* %o)
+  ret i32 %r
+}
+
+declare void @clobber(%struct.Obj*)
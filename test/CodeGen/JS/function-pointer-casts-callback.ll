@@ -0,0 +1,27 @@
+; RUN: llc < %s -emscripten-emulated-function-pointers -emscripten-emulate-function-pointer-casts -emscripten-selective-function-pointer-casts | FileCheck %s
+
+; A direct call through a cast of the callee can pass a callback of another
+; signature than the one the callee calls it with.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK-LABEL: function _g($cb) {
+; CHECK-NOT: FUNCTION_TABLE_vi[
+; CHECK: ftCall_vi(
+; CHECK: }
+define void @g(void (i32)* %cb) {
+  call void %cb(i32 7)
+  ret void
+}
+
+define void @two(i32 %a, i32 %b) {
+  ret void
+}
+
+; CHECK-LABEL: function _main() {
+; CHECK: _g(
+define i32 @main() {
+  call void bitcast (void (void (i32)*)* @g to void (void (i32, i32)*)*)(void (i32, i32)* @two)
+  ret i32 0
+}
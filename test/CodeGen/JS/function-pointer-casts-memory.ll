@@ -0,0 +1,45 @@
+; RUN: llc < %s -emscripten-emulated-function-pointers -emscripten-emulate-function-pointer-casts -emscripten-selective-function-pointer-casts | FileCheck %s
+
+; A function pointer stored to memory through one type and loaded back through
+; another changes signature without any cast of a function pointer value.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+define void @one(i32 %a) {
+  ret void
+}
+
+define void @two(i32 %a, i32 %b) {
+  ret void
+}
+
+define void @install(void (i32)** %slot) {
+  store void (i32)* @one, void (i32)** %slot
+  ret void
+}
+
+; CHECK-LABEL: function _reload(
+; CHECK: ftCall_vii(
+define void @reload(void (i32)** %slot) {
+  %cast = bitcast void (i32)** %slot to void (i32, i32)**
+  %f = load void (i32, i32)*, void (i32, i32)** %cast
+  call void %f(i32 1, i32 2)
+  ret void
+}
+
+; A load at the only stored signature can't observe a cast.
+; CHECK-LABEL: function _same_type(
+; CHECK: FUNCTION_TABLE_vi[
+define void @same_type(void (i32)** %slot) {
+  %f = load void (i32)*, void (i32)** %slot
+  call void %f(i32 3)
+  ret void
+}
+
+; CHECK-LABEL: function _unrelated(
+; CHECK: FUNCTION_TABLE_ii[
+define i32 @unrelated(i32 (i32)* %f) {
+  %r = call i32 %f(i32 4)
+  ret i32 %r
+}
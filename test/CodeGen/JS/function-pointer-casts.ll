@@ -0,0 +1,53 @@
+; RUN: llc < %s -emscripten-emulated-function-pointers -emscripten-emulate-function-pointer-casts | FileCheck %s -check-prefix=ALL
+; RUN: llc < %s -emscripten-emulated-function-pointers -emscripten-emulate-function-pointer-casts -emscripten-selective-function-pointer-casts | FileCheck %s
+; RUN: llc < %s -emscripten-emulated-function-pointers -emscripten-emulate-function-pointer-casts -emscripten-selective-function-pointer-casts -emscripten-wasm | FileCheck %s -check-prefix=WASM
+
+; With selective function pointer cast emulation, only indirect calls with a
+; signature that a cast function pointer can be called with are emulated.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; @one is called as a vii through @handlers, and @three escapes as data, so
+; data cast to a vi may be @three.
+@handlers = global [2 x void (i32, i32)*] [void (i32, i32)* bitcast (void (i32)* @one to void (i32, i32)*), void (i32, i32)* @two]
+@data = global i8* bitcast (i32 (i32)* @three to i8*)
+
+define void @one(i32 %a) {
+  ret void
+}
+
+define void @two(i32 %a, i32 %b) {
+  ret void
+}
+
+define i32 @three(i32 %a) {
+  ret i32 %a
+}
+
+; ALL-LABEL: function _callers(
+; ALL: ftCall_vii($h|0,1,2);
+; ALL: ftCall_ii($u|0,3)
+; ALL: ftCall_vi(
+; CHECK-LABEL: function _callers(
+; CHECK: ftCall_vii($h|0,1,2);
+; CHECK: FUNCTION_TABLE_ii[$u & #FM_ii#](3)
+; CHECK: _one(4);
+; CHECK: ftCall_vi(
+; WASM-LABEL: function _callers(
+; WASM: ftCall_vii($h|0,1,2);
+; WASM: FUNCTION_TABLE_ii[$u & #FM_ii#](3)
+define void @callers(void (i32, i32)* %h, i32 (i32)* %u, i8* %p) {
+  call void %h(i32 1, i32 2)
+  %r = call i32 %u(i32 3)
+  call void bitcast (void (i32)* @one to void (i32, i32)*)(i32 4, i32 5)
+  %f = bitcast i8* %p to void (i32)*
+  call void %f(i32 6)
+  ret void
+}
+
+; The typed tables hold each function at its index in the single wasm table.
+; WASM: "X": "var FUNCTION_TABLE_X = [0,_one,_two,_three];",
+; WASM: "ii": "var FUNCTION_TABLE_ii = [0,0,0,_three];",
+; WASM: "vi": "var FUNCTION_TABLE_vi = [0,_one];",
+; WASM: "vii": "var FUNCTION_TABLE_vii = [0,0,_two,0];"
@@ -0,0 +1,51 @@
+; RUN: llc < %s -emscripten-relooper-split-limit=1000 | FileCheck %s
+; RUN: llc < %s -emscripten-relooper-split-limit=0 | FileCheck %s -check-prefix=NOSPLIT
+
+; A loop that is entered both at %left and at %right can only be emitted as a
+; label-dispatch loop, unless the relooper duplicates %right for the branch
+; from %entry so that the loop has a single entry.
+
+target datalayout = "e-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-p:32:32:32-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK: function _irreducible
+; CHECK: } else {
+; CHECK-NEXT: _b();
+; CHECK: while(1) {
+; CHECK-NEXT: label = 0;
+; CHECK-NEXT: _a();
+; CHECK: _b();
+; CHECK: }
+; CHECK-NOT: (label|0) == 3
+
+; NOSPLIT: function _irreducible
+; NOSPLIT: while(1) {
+; NOSPLIT: if ((label|0) == 2) {
+; NOSPLIT: else if ((label|0) == 3) {
+
+declare void @a()
+declare void @b()
+declare void @big()
+
+define void @irreducible(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %left, label %right
+
+left:
+  call void @a()
+  %l = icmp slt i32 %x, 10
+  br i1 %l, label %right, label %exit
+
+right:
+  call void @b()
+  %r = icmp sgt i32 %x, 5
+  br i1 %r, label %left, label %exit
+
+exit:
+  call void @big()
+  call void @big()
+  call void @big()
+  call void @big()
+  ret void
+}
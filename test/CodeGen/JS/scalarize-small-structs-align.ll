@@ -0,0 +1,53 @@
+; RUN: llc < %s -emscripten-scalarize-small-structs | FileCheck %s
+
+; Packed structs are not scalarized, and the fields of structs that are
+; scalarized are read and written at the alignment of the struct pointer.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK-LABEL: function _packed($p) {
+; CHECK-LABEL: function _unaligned($s$0,$s$1) {
+; CHECK-LABEL: function _test($q,$s,$out) {
+; CHECK: $q$byval_copy = sp;
+; CHECK: _packed($q$byval_copy)
+; CHECK: $s$field1 = ((($s)) + 4|0);
+; CHECK-NEXT: = HEAPU8[$s$field1>>0]|(HEAPU8[$s$field1+1>>0]<<8)|(HEAPU8[$s$field1+2>>0]<<16)|(HEAPU8[$s$field1+3>>0]<<24);
+; CHECK: _make(
+; CHECK: $out$field1 = ((($out)) + 4|0);
+; CHECK-NEXT: HEAP16[$out$field1>>1]={{.*}};HEAP16[$out$field1+2>>1]=
+
+%struct.P = type <{ i8, i32 }>
+%struct.S = type { i8, i32 }
+
+define internal i32 @packed(%struct.P* byval align 1 %p) {
+entry:
+  %f = getelementptr inbounds %struct.P, %struct.P* %p, i32 0, i32 1
+  %v = load i32, i32* %f, align 1
+  ret i32 %v
+}
+
+define internal i32 @unaligned(%struct.S* byval align 1 %s) {
+entry:
+  %f = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 1
+  %v = load i32, i32* %f, align 1
+  ret i32 %v
+}
+
+define internal void @make(%struct.S* noalias sret %r, i32 %x) {
+entry:
+  %f0 = getelementptr inbounds %struct.S, %struct.S* %r, i32 0, i32 0
+  store i8 1, i8* %f0, align 1
+  %f1 = getelementptr inbounds %struct.S, %struct.S* %r, i32 0, i32 1
+  store i32 %x, i32* %f1, align 4
+  ret void
+}
+
+define i32 @test(%struct.P* %q, %struct.S* %s, %struct.S* %out) {
+entry:
+  %a = call i32 @packed(%struct.P* byval align 1 %q)
+  %b = call i32 @unaligned(%struct.S* byval align 1 %s)
+  call void @make(%struct.S* sret align 2 %out, i32 %a)
+  %r = add i32 %a, %b
+  ret i32 %r
+}
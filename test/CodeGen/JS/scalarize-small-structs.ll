@@ -0,0 +1,85 @@
+; RUN: llc < %s -emscripten-scalarize-small-structs | FileCheck %s
+; RUN: llc < %s | FileCheck %s -check-prefix=DEFAULT
+
+; Small structs are passed to internal functions as scalars, and returned in
+; the return value and a global, so no stack copies are made.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+%struct.vec2 = type { float, float }
+%struct.big = type { i32, i32, i32, i32, i32 }
+
+@g = global %struct.vec2 zeroinitializer, align 4
+
+define internal void @add(%struct.vec2* noalias sret %agg.result, %struct.vec2* byval align 4 %a, %struct.vec2* byval align 4 %b) {
+entry:
+  %ax = getelementptr inbounds %struct.vec2, %struct.vec2* %a, i32 0, i32 0
+  %0 = load float, float* %ax, align 4
+  %bx = getelementptr inbounds %struct.vec2, %struct.vec2* %b, i32 0, i32 0
+  %1 = load float, float* %bx, align 4
+  %add = fadd float %0, %1
+  %rx = getelementptr inbounds %struct.vec2, %struct.vec2* %agg.result, i32 0, i32 0
+  store float %add, float* %rx, align 4
+  %ay = getelementptr inbounds %struct.vec2, %struct.vec2* %a, i32 0, i32 1
+  %2 = load float, float* %ay, align 4
+  %by = getelementptr inbounds %struct.vec2, %struct.vec2* %b, i32 0, i32 1
+  %3 = load float, float* %by, align 4
+  %add3 = fadd float %2, %3
+  %ry = getelementptr inbounds %struct.vec2, %struct.vec2* %agg.result, i32 0, i32 1
+  store float %add3, float* %ry, align 4
+  ret void
+}
+
+define internal i32 @sum(%struct.big* byval align 4 %b) {
+entry:
+  %p = getelementptr inbounds %struct.big, %struct.big* %b, i32 0, i32 4
+  %v = load i32, i32* %p, align 4
+  ret i32 %v
+}
+
+define float @test(float %x, float %y, %struct.big* %bp) {
+entry:
+  %v = alloca %struct.vec2, align 4
+  %r = alloca %struct.vec2, align 4
+  %0 = bitcast %struct.vec2* %v to i8*
+  call void @llvm.lifetime.start.p0i8(i64 8, i8* %0)
+  %vx = getelementptr inbounds %struct.vec2, %struct.vec2* %v, i32 0, i32 0
+  store float %x, float* %vx, align 4
+  %vy = getelementptr inbounds %struct.vec2, %struct.vec2* %v, i32 0, i32 1
+  store float %y, float* %vy, align 4
+  call void @add(%struct.vec2* sret %r, %struct.vec2* byval align 4 %v, %struct.vec2* byval align 4 @g)
+  call void @llvm.lifetime.end.p0i8(i64 8, i8* %0)
+  %rx = getelementptr inbounds %struct.vec2, %struct.vec2* %r, i32 0, i32 0
+  %1 = load float, float* %rx, align 4
+  %ry = getelementptr inbounds %struct.vec2, %struct.vec2* %r, i32 0, i32 1
+  %2 = load float, float* %ry, align 4
+  %s = fadd float %1, %2
+  %n = call i32 @sum(%struct.big* byval align 4 %bp)
+  %nf = sitofp i32 %n to float
+  %t = fadd float %s, %nf
+  ret float %t
+}
+
+; CHECK-LABEL: function _add($a$0,$a$1,$b$0,$b$1) {
+; CHECK-NOT: STACKTOP = STACKTOP
+; CHECK: $add = $a$0 + $b$0;
+; CHECK-NEXT: $add3 = $a$1 + $b$1;
+; CHECK-NEXT: HEAPF32[4] = $add3;
+; CHECK-NEXT: return (+$add);
+
+; CHECK-LABEL: function _sum($b) {
+; CHECK-LABEL: function _test($x,$y,$bp) {
+; CHECK: STACKTOP = STACKTOP + 32|0;
+; CHECK-NOT: $v
+; CHECK: $2 = (+_add($x,$y,$0,$1));
+; CHECK-NEXT: $3 = +HEAPF32[4];
+; CHECK-NEXT: $s = $2 + $3;
+; CHECK: $n = (_sum($bp$byval_copy)|0);
+
+; DEFAULT-LABEL: function _add($agg$result,$a,$b) {
+; DEFAULT-LABEL: function _test($x,$y,$bp) {
+; DEFAULT: _add($r,$v$byval_copy,$bp$byval_copy);
+
+declare void @llvm.lifetime.start.p0i8(i64, i8* nocapture)
+declare void @llvm.lifetime.end.p0i8(i64, i8* nocapture)
@@ -0,0 +1,94 @@
+; RUN: llc < %s | FileCheck %s
+
+; Only calls to functions that may reach longjmp are checked for a longjmp
+; back into a setjmp-calling function.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+%struct.__jmp_buf_tag = type { [6 x i32], i32, [32 x i32] }
+
+@buf = global [1 x %struct.__jmp_buf_tag] zeroinitializer, align 16
+@fp = global void ()* null, align 4
+
+define internal i32 @leaf(i32 %x) {
+entry:
+  %r = mul i32 %x, %x
+  ret i32 %r
+}
+
+define internal i32 @calls_leaf(i8* %s) {
+entry:
+  %l = call i32 @strlen(i8* %s)
+  %r = call i32 @leaf(i32 %l)
+  ret i32 %r
+}
+
+define internal void @jumps() {
+entry:
+  call void @longjmp(%struct.__jmp_buf_tag* getelementptr inbounds ([1 x %struct.__jmp_buf_tag], [1 x %struct.__jmp_buf_tag]* @buf, i32 0, i32 0), i32 1)
+  unreachable
+}
+
+define internal void @calls_jumps() {
+entry:
+  call void @jumps()
+  ret void
+}
+
+@jumps_alias = internal alias void (), void ()* @jumps
+
+; Reaches @jumps only through an alias.
+define internal void @calls_alias() {
+entry:
+  call void @jumps_alias()
+  ret void
+}
+
+define internal void @indirect() {
+entry:
+  %f = load void ()*, void ()** @fp, align 4
+  call void %f()
+  ret void
+}
+
+; CHECK-LABEL: function _main(
+; CHECK: _saveSetjmp(
+; CHECK-NOT: invoke_
+; CHECK: _calls_leaf($s)
+; CHECK-NOT: invoke_
+; CHECK: _strlen(
+; CHECK: invoke_v(1);
+; CHECK: _testSetjmp(
+; CHECK: invoke_v(2);
+; CHECK: _testSetjmp(
+; CHECK: invoke_v(3);
+; CHECK: _testSetjmp(
+; CHECK: invoke_v(4);
+; CHECK: _testSetjmp(
+; CHECK-NOT: invoke_
+; CHECK: }
+; CHECK: var FUNCTION_TABLE_v = [0,_calls_jumps,_indirect,_external,_calls_alias,
+define i32 @main(i8* %s) {
+entry:
+  %call = call i32 @setjmp(%struct.__jmp_buf_tag* getelementptr inbounds ([1 x %struct.__jmp_buf_tag], [1 x %struct.__jmp_buf_tag]* @buf, i32 0, i32 0))
+  %tobool = icmp eq i32 %call, 0
+  br i1 %tobool, label %if.then, label %if.end
+
+if.then:
+  %a = call i32 @calls_leaf(i8* %s)
+  %b = call i32 @strlen(i8* %s)
+  call void @calls_jumps()
+  call void @indirect()
+  call void @external()
+  call void @calls_alias()
+  br label %if.end
+
+if.end:
+  ret i32 0
+}
+
+declare i32 @setjmp(%struct.__jmp_buf_tag*) returns_twice
+declare void @longjmp(%struct.__jmp_buf_tag*, i32) noreturn
+declare i32 @strlen(i8*)
+declare void @external()
@@ -0,0 +1,50 @@
+; RUN: llc < %s -expand-varargs-specialize-max-args=3 | FileCheck %s
+
+; A specialized function with debug info gets its own copy of the
+; subprogram, and keeps its line numbers.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK-LABEL: function _first_varargs($n,$vararg) {
+; CHECK: //@line 2 "varargs.c"
+; CHECK-LABEL: function _first($n,$varargs) {
+; CHECK: //@line 2 "varargs.c"
+; CHECK-LABEL: function _main() {
+; CHECK: _first_varargs(1,10)
+; CHECK: _first(4,$vararg_buffer
+
+define internal i32 @first(i32 %n, ...) !dbg !6 {
+entry:
+  %ap = alloca i8*, align 4
+  %ap1 = bitcast i8** %ap to i8*
+  call void @llvm.va_start(i8* %ap1), !dbg !7
+  %v = va_arg i8** %ap, i32, !dbg !7
+  call void @llvm.va_end(i8* %ap1), !dbg !7
+  ret i32 %v, !dbg !7
+}
+
+define i32 @main() !dbg !8 {
+entry:
+  %a = call i32 (i32, ...) @first(i32 1, i32 10), !dbg !9
+  %b = call i32 (i32, ...) @first(i32 4, i32 1, i32 2, i32 3, i32 4), !dbg !9
+  %r = add i32 %a, %b, !dbg !9
+  ret i32 %r, !dbg !9
+}
+
+declare void @llvm.va_start(i8*)
+declare void @llvm.va_end(i8*)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "varargs.c", directory: "/tmp")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = !DISubroutineType(types: !2)
+!6 = distinct !DISubprogram(name: "first", scope: !1, file: !1, line: 1, type: !5, isLocal: true, isDefinition: true, scopeLine: 1, flags: DIFlagPrototyped, isOptimized: false, unit: !0, variables: !2)
+!7 = !DILocation(line: 2, column: 3, scope: !6)
+!8 = distinct !DISubprogram(name: "main", scope: !1, file: !1, line: 5, type: !5, isLocal: false, isDefinition: true, scopeLine: 5, flags: DIFlagPrototyped, isOptimized: false, unit: !0, variables: !2)
+!9 = !DILocation(line: 6, column: 3, scope: !8)
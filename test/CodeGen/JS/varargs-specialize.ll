@@ -0,0 +1,97 @@
+; RUN: llc < %s | FileCheck %s -check-prefix=NOSPEC
+; RUN: llc < %s -expand-varargs-specialize-max-args=3 | FileCheck %s
+
+; Calls with few variable arguments to an internal varargs function whose
+; va_list does not escape go to a clone that takes them as parameters.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK-LABEL: function _sum_varargs($n,$vararg,$vararg1) {
+; CHECK-NOT: HEAP
+; CHECK: $v = $0 ? $vararg : $vararg1;
+; CHECK-NOT: HEAP
+; CHECK: }
+; CHECK-LABEL: function _sum_varargs_1($n,$vararg) {
+; CHECK-LABEL: function _sum($n,$varargs) {
+; CHECK-LABEL: function _mixed_varargs($n,$vararg,$vararg1) {
+; CHECK-NEXT: $n = $n|0;
+; CHECK-NEXT: $vararg = $vararg|0;
+; CHECK-NEXT: $vararg1 = +$vararg1;
+; CHECK-NEXT: var
+; CHECK-NEXT: sp = STACKTOP;
+; CHECK-NEXT: $c = (+($vararg|0));
+; CHECK-NEXT: $r = $vararg1 + $c;
+; CHECK-NOT: function _mixed(
+; CHECK-LABEL: function _escapes($fmt,$varargs) {
+; CHECK-LABEL: function _main() {
+; CHECK: _sum_varargs_1(1,10)
+; CHECK: _sum_varargs(2,20,30)
+; CHECK: _mixed_varargs(2,3,+4)
+; CHECK: _escapes(0,$vararg_buffer)
+; CHECK: _sum(4,$vararg_buffer
+
+; NOSPEC-NOT: _varargs(
+; NOSPEC-LABEL: function _main() {
+; NOSPEC: _sum(1,$vararg_buffer)
+; NOSPEC-NOT: _varargs(
+
+define internal i32 @sum(i32 %n, ...) {
+entry:
+  %ap = alloca i8*, align 4
+  %ap1 = bitcast i8** %ap to i8*
+  call void @llvm.va_start(i8* %ap1)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %v = va_arg i8** %ap, i32
+  %acc.next = add i32 %acc, %v
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  call void @llvm.va_end(i8* %ap1)
+  ret i32 %acc.next
+}
+
+define internal double @mixed(i32 %n, ...) {
+entry:
+  %ap = alloca i8*, align 4
+  %ap1 = bitcast i8** %ap to i8*
+  call void @llvm.va_start(i8* %ap1)
+  %a = va_arg i8** %ap, i32
+  %b = va_arg i8** %ap, double
+  call void @llvm.va_end(i8* %ap1)
+  %c = sitofp i32 %a to double
+  %r = fadd double %b, %c
+  ret double %r
+}
+
+define internal void @escapes(i8* %fmt, ...) {
+entry:
+  %ap = alloca i8*, align 4
+  %ap1 = bitcast i8** %ap to i8*
+  call void @llvm.va_start(i8* %ap1)
+  call void @vlog(i8* %fmt, i8* %ap1)
+  call void @llvm.va_end(i8* %ap1)
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 (i32, ...) @sum(i32 1, i32 10)
+  %b = call i32 (i32, ...) @sum(i32 2, i32 20, i32 30)
+  %c = call double (i32, ...) @mixed(i32 2, i32 3, double 4.0)
+  call void (i8*, ...) @escapes(i8* null, i32 5)
+  %d = call i32 (i32, ...) @sum(i32 4, i32 1, i32 2, i32 3, i32 4)
+  %r1 = add i32 %a, %b
+  %r = add i32 %r1, %d
+  ret i32 %r
+}
+
+declare void @vlog(i8*, i8*)
+declare void @llvm.va_start(i8*)
+declare void @llvm.va_end(i8*)
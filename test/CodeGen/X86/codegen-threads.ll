@@ -0,0 +1,37 @@
+; RUN: rm -f %t.0 %t.1
+; RUN: llc -mtriple=x86_64-unknown-linux-gnu -codegen-threads=2 -o %t %s
+; RUN: cat %t.0 %t.1 | FileCheck %s
+; RUN: llc -mtriple=x86_64-unknown-linux-gnu -codegen-threads=2 \
+; RUN:   -filetype=obj -o %t %s
+; RUN: llvm-nm %t.0 %t.1 | FileCheck --check-prefix=NM %s
+; RUN: not llc -mtriple=x86_64-unknown-linux-gnu -codegen-threads=2 -o - %s \
+; RUN:   2>&1 | FileCheck --check-prefix=STDOUT %s
+
+; Each function is code generated in exactly one of the partitions.
+; CHECK-DAG: {{^}}foo:
+; CHECK-DAG: {{^}}bar:
+; CHECK-DAG: {{^}}baz:
+
+; NM-DAG: T foo
+; NM-DAG: T bar
+; NM-DAG: T baz
+
+; STDOUT: cannot write multiple outputs to stdout
+
+@g = global i32 0
+
+define i32 @foo(i32 %x) {
+  %v = load i32, i32* @g
+  %r = add i32 %v, %x
+  ret i32 %r
+}
+
+define i32 @bar(i32 %x) {
+  %r = call i32 @foo(i32 %x)
+  ret i32 %r
+}
+
+define void @baz(i32 %x) {
+  store i32 %x, i32* @g
+  ret void
+}
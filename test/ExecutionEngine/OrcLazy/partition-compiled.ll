@@ -0,0 +1,34 @@
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-inline-stubs=false \
+; RUN:   -orc-lazy-partition-with-callees -orc-lazy-debug=funcs-to-stdout %s \
+; RUN:   | FileCheck %s
+;
+; @b is compiled with its callee @a in one partition, but @a was already
+; compiled along with @main, so only @b may be emitted the second time.
+;
+; CHECK: [ a c main ]
+; CHECK-NEXT: [ b ]
+
+define i32 @a() {
+entry:
+  ret i32 1
+}
+
+define i32 @b() {
+entry:
+  %r = call i32 @a()
+  ret i32 %r
+}
+
+define i32 @c() {
+entry:
+  %r = call i32 @b()
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** nocapture readnone %argv) {
+entry:
+  %x = call i32 @a()
+  %y = call i32 @c()
+  %r = sub i32 %x, %y
+  ret i32 %r
+}
@@ -0,0 +1,34 @@
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-speculate-threads=2 -orc-lazy-stats %s \
+; RUN:   2> %t.stats | FileCheck %s
+; RUN: FileCheck --check-prefix=STATS %s < %t.stats
+;
+; Functions reachable from main are compiled in the background; the program
+; runs the same either way.
+;
+; CHECK: result: 42
+; STATS: orc-lazy: {{[0-9]+}} synchronous compiles, {{[0-9]+}} speculative compiles
+; STATS: orc-lazy: stalled
+
+@fmt = private unnamed_addr constant [12 x i8] c"result: %d\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @leaf(i32 %x) {
+entry:
+  %r = add i32 %x, 2
+  ret i32 %r
+}
+
+define i32 @middle(i32 %x) {
+entry:
+  %a = call i32 @leaf(i32 %x)
+  %b = mul i32 %a, 2
+  ret i32 %b
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %v = call i32 @middle(i32 19)
+  %c = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([12 x i8], [12 x i8]* @fmt, i64 0, i64 0), i32 %v)
+  ret i32 0
+}
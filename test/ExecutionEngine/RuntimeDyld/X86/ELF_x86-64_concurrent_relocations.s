@@ -0,0 +1,54 @@
+# RUN: rm -rf %t && mkdir -p %t
+# RUN: llvm-mc -triple=x86_64-unknown-linux -filetype=obj -o %t/concurrent.o %s
+# RUN: llvm-rtdyld -triple=x86_64-unknown-linux -verify -check=%s %t/concurrent.o
+# RUN: llvm-rtdyld -triple=x86_64-unknown-linux -verify -check=%s \
+# RUN:   -rtdyld-concurrent-relocations-per-thread=1 %t/concurrent.o
+
+# The relocations of every section are resolved the same way whether the
+# sections are resolved one after another or concurrently.
+
+	.section .text.first,"ax",@progbits
+	.globl	first
+	.align	16, 0x90
+first:
+# rtdyld-check: decode_operand(first_call, 0) = second - next_pc(first_call)
+first_call:
+	callq	second
+# rtdyld-check: decode_operand(first_load, 4) = second_data - next_pc(first_load)
+first_load:
+	movq	second_data(%rip), %rax
+	retq
+
+	.section .text.second,"ax",@progbits
+	.globl	second
+	.align	16, 0x90
+second:
+# rtdyld-check: decode_operand(second_call, 0) = first - next_pc(second_call)
+second_call:
+	callq	first
+# rtdyld-check: decode_operand(second_load, 4) = first_data - next_pc(second_load)
+second_load:
+	movq	first_data(%rip), %rax
+	retq
+
+	.section .data.first,"aw",@progbits
+	.globl	first_data
+	.align	8
+# rtdyld-check: *{8}first_data = first
+first_data:
+	.quad	first
+# rtdyld-check: *{8}(first_data + 8) = second_data
+	.quad	second_data
+# rtdyld-check: *{4}(first_data + 16) = (second - first_data - 16)[31:0]
+	.long	second - .
+
+	.section .data.second,"aw",@progbits
+	.globl	second_data
+	.align	8
+# rtdyld-check: *{8}second_data = second
+second_data:
+	.quad	second
+# rtdyld-check: *{8}(second_data + 8) = first_data
+	.quad	first_data
+# rtdyld-check: *{4}(second_data + 16) = (first - second_data - 16)[31:0]
+	.long	first - .
@@ -0,0 +1,6 @@
+@counter = global i32 0
+
+define i32 @bar() {
+  %v = load i32, i32* @counter
+  ret i32 %v
+}
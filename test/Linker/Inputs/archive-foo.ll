@@ -0,0 +1,6 @@
+declare i32 @bar()
+
+define i32 @foo() {
+  %r = call i32 @bar()
+  ret i32 %r
+}
@@ -0,0 +1,3 @@
+define i32 @unused() {
+  ret i32 1
+}
@@ -0,0 +1,60 @@
+; RUN: rm -rf %t.dir %t.cache
+; RUN: mkdir %t.dir
+; RUN: llvm-as %s -o %t.dir/main.bc
+; RUN: llvm-as %S/Inputs/archive-unused.ll -o %t.dir/unused.bc
+; RUN: llvm-as %S/Inputs/archive-bar.ll -o %t.dir/bar.bc
+; RUN: llvm-as %S/Inputs/archive-foo.ll -o %t.dir/foo.bc
+; RUN: llvm-ar rcs %t.dir/lib.a %t.dir/unused.bc %t.dir/bar.bc %t.dir/foo.bc
+; RUN: llvm-ar rcsT %t.dir/thin.a %t.dir/unused.bc %t.dir/bar.bc %t.dir/foo.bc
+
+; Only the members defining undefined symbols are linked, including those
+; needed by other members.
+; RUN: llvm-link -S %t.dir/main.bc %t.dir/lib.a | FileCheck %s
+; RUN: llvm-link -S %t.dir/main.bc %t.dir/thin.a | FileCheck %s
+; RUN: llvm-link -S -disable-lazy-loading %t.dir/main.bc %t.dir/lib.a \
+; RUN:   | FileCheck %s
+
+; The second run with a cache reads the index from it.
+; RUN: llvm-link -S -archive-cache=%t.cache %t.dir/main.bc %t.dir/lib.a \
+; RUN:   | FileCheck %s
+; RUN: ls %t.cache | count 1
+; RUN: llvm-link -S -archive-cache=%t.cache %t.dir/main.bc %t.dir/lib.a \
+; RUN:   | FileCheck %s
+; RUN: llvm-link -S -archive-cache=%t.cache %t.dir/main.bc %t.dir/thin.a \
+; RUN:   | FileCheck %s
+; RUN: ls %t.cache | count 2
+
+; An archive rewritten with the same size and modification time is found by
+; the index of the old one, whose member offsets are checked before use.
+; RUN: llvm-ar rcs %t.dir/moved.a %t.dir/unused.bc %t.dir/bar.bc %t.dir/foo.bc
+; RUN: llvm-link -S -archive-cache=%t.cache %t.dir/main.bc %t.dir/moved.a \
+; RUN:   | FileCheck %s
+; RUN: cp %t.dir/moved.a %t.dir/stamp
+; RUN: rm %t.dir/moved.a
+; RUN: llvm-ar rcs %t.dir/moved.a %t.dir/foo.bc %t.dir/bar.bc %t.dir/unused.bc
+; RUN: touch -r %t.dir/stamp %t.dir/moved.a
+; RUN: not llvm-link -S -archive-cache=%t.cache %t.dir/main.bc %t.dir/moved.a \
+; RUN:   2>&1 | FileCheck %s --check-prefix=MOVED
+; MOVED: error loading archive '{{.*}}moved.a': member foo.bc is not where the symbol index has it
+
+; RUN: llvm-nm -M -archive-cache=%t.cache %t.dir/lib.a | FileCheck %s --check-prefix=NM
+; RUN: llvm-nm -M %t.dir/lib.a | FileCheck %s --check-prefix=NM
+
+; CHECK-DAG: @counter = global i32 0
+; CHECK-DAG: define i32 @main()
+; CHECK-DAG: define i32 @foo()
+; CHECK-DAG: define i32 @bar()
+; CHECK-NOT: @unused
+
+; NM:      Archive map
+; NM-NEXT: unused in unused.bc
+; NM-NEXT: bar in bar.bc
+; NM-NEXT: counter in bar.bc
+; NM-NEXT: foo in foo.bc
+
+declare i32 @foo()
+
+define i32 @main() {
+  %r = call i32 @foo()
+  ret i32 %r
+}
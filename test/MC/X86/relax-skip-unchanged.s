@@ -0,0 +1,27 @@
+# RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-unknown %s -o %t
+# RUN: llvm-objdump -d %t | FileCheck %s
+# RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-unknown -stats %s \
+# RUN:   -o /dev/null 2>&1 | FileCheck --check-prefix=STATS %s
+# REQUIRES: asserts
+
+# The first jump only goes out of range once the second one has been relaxed,
+# so it has to be checked again in the next pass. The last jump does not span
+# any relaxed instruction and is not checked again after the first pass.
+
+back:
+	.fill 130, 1, 0x90
+	jmp end
+	.fill 120, 1, 0x90
+	jmp back
+	.fill 4, 1, 0x90
+end:
+	retq
+	jmp end
+
+# CHECK:      82: e9 81 00 00 00 jmp 129
+# CHECK:      ff: e9 fc fe ff ff jmp -260
+# CHECK:     108: c3 retq
+# CHECK-NEXT: 109: eb fd jmp -3
+
+# STATS: 2 assembler - Number of relaxed instructions
+# STATS: 6 assembler - Number of relaxation checks skipped because no fixup target moved
@@ -0,0 +1,11 @@
+; RUN: not opt < %s -nacl-promote-ints -S 2>&1 | FileCheck %s
+; Test that the pass rejects functions whose arguments were not promoted by
+; -nacl-promote-int-signatures.
+
+target datalayout = "e-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-p:32:32:32-v128:32:32"
+
+; CHECK: Function arg24 has illegal integer argument
+define i32 @arg24(i24 %a) {
+  %b = zext i24 %a to i32
+  ret i32 %b
+}
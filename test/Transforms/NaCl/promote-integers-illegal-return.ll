@@ -0,0 +1,11 @@
+; RUN: not opt < %s -nacl-promote-ints -S 2>&1 | FileCheck %s
+; Test that the pass rejects functions whose return types were not promoted
+; by -nacl-promote-int-signatures.
+
+target datalayout = "e-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-p:32:32:32-v128:32:32"
+
+; CHECK: Function ret24 has illegal integer return type
+define i24 @ret24(i32 %a) {
+  %b = trunc i32 %a to i24
+  ret i24 %b
+}
@@ -1,4 +1,4 @@
-; RUN: opt < %s -nacl-promote-ints -S | FileCheck %s
+; RUN: opt < %s -nacl-promote-int-signatures -nacl-promote-ints -S | FileCheck %s
 
 target datalayout = "e-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-p:32:32:32-v128:32:32"
 
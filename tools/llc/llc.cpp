@@ -14,6 +14,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/CodeGen/CommandFlags.def"
@@ -22,6 +23,7 @@
 #include "llvm/CodeGen/MIRParser/MIRParser.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/CodeGen/TargetPassConfig.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/IR/DataLayout.h"
@@ -35,6 +37,7 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Pass.h"
+#include "llvm/Remarks/BinaryRemarks.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
@@ -71,6 +74,11 @@ TimeCompilations("time-compilations", cl::Hidden, cl::init(1u),
                  cl::value_desc("N"),
                  cl::desc("Repeat compilation N times for timing"));
 
+static cl::opt<unsigned> CodeGenThreads(
+    "codegen-threads", cl::init(1u), cl::value_desc("N"),
+    cl::desc("Split the module into N partitions and generate code for them "
+             "on N threads, writing partition I to <output>.I"));
+
 static cl::opt<bool>
 NoIntegratedAssembler("no-integrated-as", cl::Hidden,
                       cl::desc("Disable integrated assembler"));
@@ -139,9 +147,17 @@ static cl::opt<unsigned> PassRemarksHotnessThreshold(
 
 static cl::opt<std::string>
     RemarksFilename("pass-remarks-output",
-                    cl::desc("YAML output filename for pass remarks"),
+                    cl::desc("Output filename for pass remarks"),
                     cl::value_desc("filename"));
 
+enum RemarkFileFormat { RFF_YAML, RFF_Binary };
+static cl::opt<RemarkFileFormat> RemarksFormat(
+    "pass-remarks-format", cl::desc("The format of the pass remarks file"),
+    cl::init(RFF_YAML),
+    cl::values(clEnumValN(RFF_YAML, "yaml", "YAML documents"),
+               clEnumValN(RFF_Binary, "binary",
+                          "Binary remarks, see llvm-remarkutil")));
+
 namespace {
 static ManagedStatic<std::vector<std::string>> RunPassNames;
 
@@ -166,9 +182,9 @@ static cl::opt<RunPassOption, true, cl::parser<std::string>> RunPass(
 
 static int compileModule(char **, LLVMContext &);
 
-static std::unique_ptr<ToolOutputFile> GetOutputStream(const char *TargetName,
-                                                       Triple::OSType OS,
-                                                       const char *ProgName) {
+static std::unique_ptr<ToolOutputFile>
+GetOutputStream(const char *TargetName, Triple::OSType OS,
+                const char *ProgName, const Twine &Suffix = "") {
   // If we don't yet have an output filename, make one.
   if (OutputFilename.empty()) {
     if (InputFilename == "-")
@@ -219,12 +235,18 @@ static std::unique_ptr<ToolOutputFile> GetOutputStream(const char *TargetName,
     break;
   }
 
+  if (OutputFilename == "-" && !Suffix.isTriviallyEmpty()) {
+    errs() << ProgName << ": cannot write multiple outputs to stdout\n";
+    return nullptr;
+  }
+
   // Open the file.
   std::error_code EC;
   sys::fs::OpenFlags OpenFlags = sys::fs::F_None;
   if (!Binary)
     OpenFlags |= sys::fs::F_Text;
-  auto FDOut = llvm::make_unique<ToolOutputFile>(OutputFilename, EC, OpenFlags);
+  auto FDOut = llvm::make_unique<ToolOutputFile>(
+      (OutputFilename + Suffix).str(), EC, OpenFlags);
   if (EC) {
     errs() << EC.message() << '\n';
     return nullptr;
@@ -330,9 +352,16 @@ int main(int argc, char **argv) {
       errs() << EC.message() << '\n';
       return 1;
     }
-    Context.setDiagnosticsOutputFile(
-        llvm::make_unique<yaml::Output>(YamlFile->os()));
+    if (RemarksFormat == RFF_Binary)
+      Context.setDiagnosticsBinaryOutputFile(
+          llvm::make_unique<remarks::BinaryRemarkSerializer>(YamlFile->os()));
+    else
+      Context.setDiagnosticsOutputFile(
+          llvm::make_unique<yaml::Output>(YamlFile->os()));
   }
+  // Binary remarks are buffered, so write them out before the file closes.
+  auto FlushRemarks = make_scope_exit(
+      [&] { Context.setDiagnosticsBinaryOutputFile(nullptr); });
 
   if (InputLanguage != "" && InputLanguage != "ir" &&
       InputLanguage != "mir") {
@@ -468,11 +497,6 @@ static int compileModule(char **argv, LLVMContext &Context) {
   if (FloatABIForCalls != FloatABI::Default)
     Options.FloatABIType = FloatABIForCalls;
 
-  // Figure out where we are going to send the output.
-  std::unique_ptr<ToolOutputFile> Out =
-      GetOutputStream(TheTarget->getName(), TheTriple.getOS(), argv[0]);
-  if (!Out) return 1;
-
   // Build up all of the passes that we want to do to the module.
   legacy::PassManager PM;
 
@@ -496,6 +520,42 @@ static int compileModule(char **argv, LLVMContext &Context) {
     errs() << argv[0]
              << ": warning: ignoring -mc-relax-all because filetype != obj";
 
+  // Generate code for partitions of the module on separate threads. Each
+  // partition is cloned into its own context and runs the whole codegen
+  // pipeline with its own TargetMachine and MCContext.
+  if (CodeGenThreads > 1) {
+    if (MIR || !RunPassNames->empty() || CompileTwice) {
+      errs() << argv[0] << ": -codegen-threads cannot be used with MIR input, "
+             << "-run-pass or -compile-twice\n";
+      return 1;
+    }
+
+    std::vector<std::unique_ptr<ToolOutputFile>> Outs;
+    SmallVector<raw_pwrite_stream *, 8> OSs;
+    for (unsigned I = 0; I != CodeGenThreads; ++I) {
+      Outs.push_back(GetOutputStream(TheTarget->getName(), TheTriple.getOS(),
+                                     argv[0], "." + Twine(I)));
+      if (!Outs.back())
+        return 1;
+      OSs.push_back(&Outs.back()->os());
+    }
+
+    splitCodeGen(std::move(M), OSs, {}, [&]() {
+      return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(
+          TheTriple.getTriple(), CPUStr, FeaturesStr, Options, getRelocModel(),
+          getCodeModel(), OLvl));
+    }, FileType);
+
+    for (auto &Out : Outs)
+      Out->keep();
+    return 0;
+  }
+
+  // Figure out where we are going to send the output.
+  std::unique_ptr<ToolOutputFile> Out =
+      GetOutputStream(TheTarget->getName(), TheTriple.getOS(), argv[0]);
+  if (!Out) return 1;
+
   {
     raw_pwrite_stream *OS = &Out->os();
 
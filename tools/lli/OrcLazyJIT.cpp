@@ -15,6 +15,9 @@
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -51,6 +54,22 @@ static cl::opt<bool> OrcInlineStubs("orc-lazy-inline-stubs",
                                     cl::desc("Try to inline stubs"),
                                     cl::init(true), cl::Hidden);
 
+static cl::opt<unsigned> OrcSpeculateThreads(
+    "orc-lazy-speculate-threads",
+    cl::desc("Compile functions reachable from main on this many background "
+             "threads before they are called (0 = compile on first call only)"),
+    cl::init(0), cl::Hidden);
+
+static cl::opt<bool> OrcPartitionWithCallees(
+    "orc-lazy-partition-with-callees",
+    cl::desc("Compile the functions a function calls directly along with it"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> OrcPrintStats(
+    "orc-lazy-stats",
+    cl::desc("Print compile counts and stub stall times to stderr"),
+    cl::init(false), cl::Hidden);
+
 OrcLazyJIT::TransformFtor OrcLazyJIT::createDebugDumper() {
   switch (OrcDumpKind) {
   case DumpKind::NoDump:
@@ -108,6 +127,16 @@ static PtrTy fromTargetAddress(JITTargetAddress Addr) {
   return reinterpret_cast<PtrTy>(static_cast<uintptr_t>(Addr));
 }
 
+static void printCompileStats(const OrcLazyJIT::CODLayerT::CompileStats &S) {
+  using MS = std::chrono::duration<double, std::milli>;
+  errs() << "orc-lazy: " << S.SynchronousCompiles << " synchronous compiles, "
+         << S.SpeculativeCompiles << " speculative compiles, "
+         << S.CompiledBeforeCall
+         << " stub calls found their function compiled\n"
+         << format("orc-lazy: stalled %.3f ms in total, %.3f ms at most\n",
+                   MS(S.TotalStallTime).count(), MS(S.MaxStallTime).count());
+}
+
 int llvm::runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
                         const std::vector<std::string> &Args) {
   // Add the program's symbols into the JIT's search space.
@@ -144,7 +173,9 @@ int llvm::runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
   // Everything looks good. Build the JIT.
   OrcLazyJIT J(std::move(TM), std::move(CompileCallbackMgr),
                std::move(IndirectStubsMgrBuilder),
-               OrcInlineStubs);
+               OrcInlineStubs, OrcPartitionWithCallees);
+  if (OrcSpeculateThreads)
+    J.enableSpeculation(OrcSpeculateThreads);
 
   // Add the module, look up main and run it.
   for (auto &M : Ms)
@@ -156,7 +187,10 @@ int llvm::runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
     for (auto &Arg : Args)
       ArgV.push_back(Arg.c_str());
     auto Main = fromTargetAddress<MainFnPtr>(cantFail(MainSym.getAddress()));
-    return Main(ArgV.size(), (const char**)ArgV.data());
+    int Result = Main(ArgV.size(), (const char**)ArgV.data());
+    if (OrcPrintStats)
+      printCompileStats(J.getCompileStats());
+    return Result;
   } else if (auto Err = MainSym.takeError())
     logAllUnhandledErrors(std::move(Err), llvm::errs(), "");
   else
@@ -29,8 +29,10 @@
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_ostream.h"
@@ -60,13 +62,16 @@ public:
   OrcLazyJIT(std::unique_ptr<TargetMachine> TM,
              std::unique_ptr<CompileCallbackMgr> CCMgr,
              IndirectStubsManagerBuilder IndirectStubsMgrBuilder,
-             bool InlineStubs)
+             bool InlineStubs, bool PartitionWithCallees = false)
       : TM(std::move(TM)), DL(this->TM->createDataLayout()),
         CCMgr(std::move(CCMgr)),
         ObjectLayer([]() { return std::make_shared<SectionMemoryManager>(); }),
         CompileLayer(ObjectLayer, orc::SimpleCompiler(*this->TM)),
         IRDumpLayer(CompileLayer, createDebugDumper()),
-        CODLayer(IRDumpLayer, extractSingleFunction, *this->CCMgr,
+        CODLayer(IRDumpLayer,
+                 PartitionWithCallees ? extractFunctionAndCallees
+                                      : extractSingleFunction,
+                 *this->CCMgr,
                  std::move(IndirectStubsMgrBuilder), InlineStubs),
         CXXRuntimeOverrides(
             [this](const std::string &S) { return mangle(S); }) {}
@@ -160,6 +165,16 @@ public:
     return CODLayer.findSymbolIn(H, mangle(Name), true);
   }
 
+  /// Compile the functions reachable from main on a background thread pool
+  /// before they are first called. Must be called before adding modules.
+  void enableSpeculation(unsigned NumThreads) {
+    CODLayer.enableSpeculation(NumThreads, "main");
+  }
+
+  CODLayerT::CompileStats getCompileStats() const {
+    return CODLayer.getCompileStats();
+  }
+
 private:
   std::string mangle(const std::string &Name) {
     std::string MangledName;
@@ -176,6 +191,17 @@ private:
     return Partition;
   }
 
+  static std::set<Function*> extractFunctionAndCallees(Function &F) {
+    std::set<Function*> Partition;
+    Partition.insert(&F);
+    for (auto &I : instructions(F))
+      if (auto CS = CallSite(&I))
+        if (auto *Callee = CS.getCalledFunction())
+          if (!Callee->isDeclaration())
+            Partition.insert(Callee);
+    return Partition;
+  }
+
   static TransformFtor createDebugDumper();
 
   std::unique_ptr<TargetMachine> TM;
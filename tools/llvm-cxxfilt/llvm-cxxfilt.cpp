@@ -54,7 +54,9 @@ static cl::list<std::string>
 Decorated(cl::Positional, cl::desc("<mangled>"), cl::ZeroOrMore);
 
 static void demangle(llvm::raw_ostream &OS, const std::string &Mangled) {
-  int Status;
+  // Reused across calls so that filtering a whole symbol list does not pay
+  // for a fresh node arena and output buffer per name.
+  static ItaniumBatchDemangler Demangler;
 
   const char *Decorated = Mangled.c_str();
   if (StripUnderscore)
@@ -62,22 +64,20 @@ static void demangle(llvm::raw_ostream &OS, const std::string &Mangled) {
       ++Decorated;
   size_t DecoratedLength = strlen(Decorated);
 
-  char *Undecorated = nullptr;
+  const char *Undecorated = nullptr;
 
   if (Types || ((DecoratedLength >= 2 && strncmp(Decorated, "_Z", 2) == 0) ||
                 (DecoratedLength >= 4 && strncmp(Decorated, "___Z", 4) == 0)))
-    Undecorated = itaniumDemangle(Decorated, nullptr, nullptr, &Status);
+    Undecorated = Demangler.demangle(Decorated, DecoratedLength);
 
   if (!Undecorated &&
       (DecoratedLength > 6 && strncmp(Decorated, "__imp_", 6) == 0)) {
     OS << "import thunk for ";
-    Undecorated = itaniumDemangle(Decorated + 6, nullptr, nullptr, &Status);
+    Undecorated = Demangler.demangle(Decorated + 6, DecoratedLength - 6);
   }
 
   OS << (Undecorated ? Undecorated : Mangled) << '\n';
   OS.flush();
-
-  free(Undecorated);
 }
 
 int main(int argc, char **argv) {
@@ -13,17 +13,21 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/BinaryFormat/Magic.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/AutoUpgrade.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/ModuleSummaryIndex.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Object/Archive.h"
+#include "llvm/Object/ArchiveSymbolCache.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
@@ -87,6 +91,12 @@ static cl::opt<bool>
     DisableLazyLoad("disable-lazy-loading",
                     cl::desc("Disable lazy module loading"));
 
+static cl::opt<std::string> ArchiveCache(
+    "archive-cache",
+    cl::desc("Directory in which to keep the symbol indexes of input "
+             "archives between runs"),
+    cl::value_desc("directory"));
+
 static cl::opt<bool>
     OutputAssembly("S", cl::desc("Write output as LLVM assembly"), cl::Hidden);
 
@@ -273,14 +283,155 @@ static bool importFunctions(const char *argv0, Module &DestModule) {
   return true;
 }
 
+// Links M into L. With InternalizeLinkedSymbols, the symbols M defines are
+// internalized unless they are used by the module linked so far.
+static bool linkInModule(Linker &L, std::unique_ptr<Module> M, unsigned Flags,
+                         bool InternalizeLinkedSymbols) {
+  if (InternalizeLinkedSymbols)
+    return L.linkInModule(
+        std::move(M), Flags, [](Module &M, const StringSet<> &GVS) {
+          internalizeModule(M, [&GVS](const GlobalValue &GV) {
+            return !GV.hasName() || (GVS.count(GV.getName()) == 0);
+          });
+        });
+  return L.linkInModule(std::move(M), Flags);
+}
+
+// Returns the index of the symbol table of the archive File, from the
+// -archive-cache directory if one was given.
+static Expected<std::unique_ptr<object::ArchiveSymbolIndex>>
+getArchiveIndex(StringRef File) {
+  if (!ArchiveCache.empty())
+    return object::ArchiveSymbolCache(ArchiveCache).getIndex(File);
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr = MemoryBuffer::getFile(File);
+  if (!BufOrErr)
+    return errorCodeToError(BufOrErr.getError());
+  Error Err = Error::success();
+  object::Archive A((*BufOrErr)->getMemBufferRef(), Err);
+  if (Err)
+    return std::move(Err);
+  return object::ArchiveSymbolIndex::create(A);
+}
+
+// Links in the members of the archive File that define symbols the composite
+// module leaves undefined, until no member defines another one. Members are
+// found and loaded through the index of the archive's symbol table, so only
+// the headers of the members linked in are read, to check the index.
+static bool linkArchive(const char *argv0, LLVMContext &Context, Linker &L,
+                        Module &Composite, const std::string &File,
+                        unsigned Flags, bool InternalizeLinkedSymbols) {
+  Expected<std::unique_ptr<object::ArchiveSymbolIndex>> IndexOrErr =
+      getArchiveIndex(File);
+  if (!IndexOrErr) {
+    errs() << argv0 << ": error loading archive '" << File
+           << "': " << toString(IndexOrErr.takeError()) << "\n";
+    return false;
+  }
+  object::ArchiveSymbolIndex &Index = **IndexOrErr;
+
+  std::unique_ptr<MemoryBuffer> ArchiveBuf;
+  if (!Index.isThin()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+        MemoryBuffer::getFile(File, /*FileSize=*/-1,
+                              /*RequiresNullTerminator=*/false);
+    if (!BufOrErr) {
+      errs() << argv0 << ": error loading archive '" << File
+             << "': " << BufOrErr.getError().message() << "\n";
+      return false;
+    }
+    ArchiveBuf = std::move(*BufOrErr);
+  }
+
+  std::vector<bool> Linked(Index.members().size());
+  Mangler Mang;
+  while (true) {
+    // Find the members defining the undefined symbols, and link them in
+    // archive order.
+    std::vector<uint32_t> Needed;
+    for (const GlobalValue &GV : Composite.global_values()) {
+      if (!GV.isDeclaration() || GV.hasLocalLinkage() || !GV.hasName())
+        continue;
+      if (auto *F = dyn_cast<Function>(&GV))
+        if (F->isIntrinsic())
+          continue;
+      SmallString<64> Name;
+      Mang.getNameWithPrefix(Name, &GV, false);
+      if (Optional<uint32_t> Member = Index.lookup(Name))
+        if (!Linked[*Member]) {
+          Linked[*Member] = true;
+          Needed.push_back(*Member);
+        }
+    }
+    if (Needed.empty())
+      return true;
+    std::sort(Needed.begin(), Needed.end());
+
+    for (uint32_t I : Needed) {
+      const object::ArchiveSymbolIndex::Member &Member = Index.members()[I];
+      std::string MemberName = (File + "(" + Member.Name + ")").str();
+      std::unique_ptr<MemoryBuffer> MemberBuf;
+      if (Index.isThin()) {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+            MemoryBuffer::getFile(Member.Path);
+        if (!BufOrErr) {
+          errs() << argv0 << ": error loading file '" << Member.Path
+                 << "': " << BufOrErr.getError().message() << "\n";
+          return false;
+        }
+        MemberBuf = std::move(*BufOrErr);
+      } else {
+        Expected<StringRef> DataOrErr =
+            Index.getMemberData(ArchiveBuf->getBuffer(), I);
+        if (!DataOrErr) {
+          errs() << argv0 << ": error loading archive '" << File
+                 << "': " << toString(DataOrErr.takeError()) << "\n";
+          return false;
+        }
+        MemberBuf = MemoryBuffer::getMemBuffer(*DataOrErr, MemberName, false);
+      }
+
+      if (Verbose)
+        errs() << "Loading '" << MemberName << "'\n";
+      std::unique_ptr<Module> M;
+      if (DisableLazyLoad) {
+        SMDiagnostic Err;
+        M = parseIR(MemberBuf->getMemBufferRef(), Err, Context);
+        if (!M) {
+          Err.print(argv0, errs());
+          return false;
+        }
+      } else {
+        M = ExitOnErr(getOwningLazyBitcodeModule(std::move(MemberBuf), Context));
+        ExitOnErr(M->materializeMetadata());
+        UpgradeDebugInfo(*M);
+      }
+
+      if (Verbose)
+        errs() << "Linking in '" << MemberName << "'\n";
+      if (linkInModule(L, std::move(M), Flags, InternalizeLinkedSymbols))
+        return false;
+    }
+  }
+}
+
 static bool linkFiles(const char *argv0, LLVMContext &Context, Linker &L,
-                      const cl::list<std::string> &Files,
+                      Module &Composite, const cl::list<std::string> &Files,
                       unsigned Flags) {
   // Filter out flags that don't apply to the first file we load.
   unsigned ApplicableFlags = Flags & Linker::Flags::OverrideFromSrc;
   // Similar to some flags, internalization doesn't apply to the first file.
   bool InternalizeLinkedSymbols = false;
   for (const auto &File : Files) {
+    file_magic Magic;
+    if (!identify_magic(File, Magic) && Magic == file_magic::archive) {
+      if (!linkArchive(argv0, Context, L, Composite, File, ApplicableFlags,
+                       InternalizeLinkedSymbols))
+        return false;
+      InternalizeLinkedSymbols = Internalize;
+      ApplicableFlags = Flags;
+      continue;
+    }
+
     std::unique_ptr<Module> M = loadFile(argv0, File, Context);
     if (!M.get()) {
       errs() << argv0 << ": error loading file '" << File << "'\n";
@@ -319,19 +470,8 @@ static bool linkFiles(const char *argv0, LLVMContext &Context, Linker &L,
     if (Verbose)
       errs() << "Linking in '" << File << "'\n";
 
-    bool Err = false;
-    if (InternalizeLinkedSymbols) {
-      Err = L.linkInModule(
-          std::move(M), ApplicableFlags, [](Module &M, const StringSet<> &GVS) {
-            internalizeModule(M, [&GVS](const GlobalValue &GV) {
-              return !GV.hasName() || (GVS.count(GV.getName()) == 0);
-            });
-          });
-    } else {
-      Err = L.linkInModule(std::move(M), ApplicableFlags);
-    }
-
-    if (Err)
+    if (linkInModule(L, std::move(M), ApplicableFlags,
+                     InternalizeLinkedSymbols))
       return false;
 
     // Internalization applies to linking of subsequent files.
@@ -368,11 +508,11 @@ int main(int argc, char **argv) {
     Flags |= Linker::Flags::LinkOnlyNeeded;
 
   // First add all the regular input files
-  if (!linkFiles(argv[0], Context, L, InputFilenames, Flags))
+  if (!linkFiles(argv[0], Context, L, *Composite, InputFilenames, Flags))
     return 1;
 
   // Next the -override ones.
-  if (!linkFiles(argv[0], Context, L, OverridingInputs,
+  if (!linkFiles(argv[0], Context, L, *Composite, OverridingInputs,
                  Flags | Linker::Flags::OverrideFromSrc))
     return 1;
 
@@ -22,6 +22,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Object/Archive.h"
+#include "llvm/Object/ArchiveSymbolCache.h"
 #include "llvm/Object/COFF.h"
 #include "llvm/Object/COFFImportFile.h"
 #include "llvm/Object/ELFObjectFile.h"
@@ -141,6 +142,12 @@ cl::opt<bool> ArchiveMap("print-armap", cl::desc("Print the archive map"));
 cl::alias ArchiveMaps("M", cl::desc("Alias for --print-armap"),
                       cl::aliasopt(ArchiveMap), cl::Grouping);
 
+cl::opt<std::string>
+    ArchiveCache("archive-cache",
+                 cl::desc("Print the archive map from the symbol indexes "
+                          "kept in <directory>"),
+                 cl::value_desc("directory"));
+
 enum Radix { d, o, x };
 cl::opt<Radix>
     AddressRadix("radix", cl::desc("Radix (o/d/x) for printing symbol Values"),
@@ -668,15 +675,12 @@ static Optional<std::string> demangle(StringRef Name, bool StripUnderscore) {
   if (!Name.startswith("_Z"))
     return None;
 
-  int Status;
-  char *Undecorated =
-      itaniumDemangle(Name.str().c_str(), nullptr, nullptr, &Status);
-  if (Status != 0)
+  // A symbol table is demangled name by name; reuse the parser's arena.
+  static ItaniumBatchDemangler Demangler;
+  const char *Undecorated = Demangler.demangle(Name.data(), Name.size());
+  if (!Undecorated)
     return None;
-
-  std::string S(Undecorated);
-  free(Undecorated);
-  return S;
+  return std::string(Undecorated);
 }
 
 static bool symbolIsDefined(const NMSymbol &Sym) {
@@ -1630,7 +1634,21 @@ static void dumpSymbolNamesFromFile(std::string &Filename) {
   Binary &Bin = *BinaryOrErr.get();
 
   if (Archive *A = dyn_cast<Archive>(&Bin)) {
-    if (ArchiveMap) {
+    if (ArchiveMap && !ArchiveCache.empty()) {
+      Expected<std::unique_ptr<ArchiveSymbolIndex>> IndexOrErr =
+          ArchiveSymbolCache(ArchiveCache).getIndex(Filename);
+      if (!IndexOrErr) {
+        error(IndexOrErr.takeError(), Filename);
+        return;
+      }
+      ArchiveSymbolIndex &Index = **IndexOrErr;
+      if (!Index.symbols().empty()) {
+        outs() << "Archive map\n";
+        for (const ArchiveSymbolIndex::Symbol &S : Index.symbols())
+          outs() << S.Name << " in " << Index.members()[S.Member].Name << "\n";
+        outs() << "\n";
+      }
+    } else if (ArchiveMap) {
       Archive::symbol_iterator I = A->symbol_begin();
       Archive::symbol_iterator E = A->symbol_end();
       if (I != E) {
@@ -83,7 +83,7 @@ void Section::writeSection(FileOutputBuffer &Out) const {
 
 void OwnedDataSection::writeSection(FileOutputBuffer &Out) const {
   uint8_t *Buf = Out.getBufferStart() + Offset;
-  std::copy(std::begin(Data), std::end(Data), Buf);
+  std::copy(Data->getBufferStart(), Data->getBufferEnd(), Buf);
 }
 
 void StringTableSection::addString(StringRef Name) {
@@ -578,6 +578,7 @@ template <class ELFT> Object<ELFT>::Object(const ELFObjectFile<ELFT> &Obj) {
   Version = Ehdr.e_version;
   Entry = Ehdr.e_entry;
   Flags = Ehdr.e_flags;
+  OriginalPHOffset = Ehdr.e_phoff;
 
   SectionTableRef SecTable = readSectionHeaders(ElfFile);
   readProgramHeaders(ElfFile);
@@ -644,9 +645,11 @@ void Object<ELFT>::writeSectionHeaders(FileOutputBuffer &Out) const {
 }
 
 template <class ELFT>
-void Object<ELFT>::writeSectionData(FileOutputBuffer &Out) const {
+void Object<ELFT>::writeSectionData(FileOutputBuffer &Out,
+                                    uint64_t From) const {
   for (auto &Section : Sections)
-    Section->writeSection(Out);
+    if (Section->Offset + Section->Size > From)
+      Section->writeSection(Out);
 }
 
 template <class ELFT>
@@ -675,6 +678,9 @@ void Object<ELFT>::removeSections(
   // be removed. Sometimes it is impossible to remove a reference so we emit
   // an error here instead.
   for (auto &RemoveSec : make_range(Iter, std::end(Sections))) {
+    if (RemoveSec->Type != SHT_NOBITS)
+      FirstRemovedOffset =
+          std::min(FirstRemovedOffset, RemoveSec->OriginalOffset);
     for (auto &Segment : Segments)
       Segment->removeSection(RemoveSec.get());
     for (auto &KeepSec : make_range(std::begin(Sections), Iter))
@@ -685,8 +691,9 @@ void Object<ELFT>::removeSections(
 }
 
 template <class ELFT>
-void Object<ELFT>::addSection(StringRef SecName, ArrayRef<uint8_t> Data) {
-  auto Sec = llvm::make_unique<OwnedDataSection>(SecName, Data);
+void Object<ELFT>::addSection(StringRef SecName,
+                              std::unique_ptr<MemoryBuffer> Data) {
+  auto Sec = llvm::make_unique<OwnedDataSection>(SecName, std::move(Data));
   Sec->OriginalOffset = ~0ULL;
   Sections.push_back(std::move(Sec));
 }
@@ -816,13 +823,40 @@ template <class ELFT> size_t ELFObject<ELFT>::totalSize() const {
 }
 
 template <class ELFT> void ELFObject<ELFT>::write(FileOutputBuffer &Out) const {
+  writeChanges(Out, 0);
+}
+
+template <class ELFT>
+void ELFObject<ELFT>::writeChanges(FileOutputBuffer &Out, uint64_t From) const {
   this->writeHeader(Out);
   this->writeProgramHeaders(Out);
-  this->writeSectionData(Out);
+  this->writeSectionData(Out, From);
   if (this->WriteSectionHeaders)
     this->writeSectionHeaders(Out);
 }
 
+template <class ELFT>
+Optional<uint64_t> ELFObject<ELFT>::getFirstChangedOffset() const {
+  // The program headers are always written right after the ELF header, and
+  // loaded segments keep their contents only if they keep their offsets.
+  if (!this->Segments.empty() && this->OriginalPHOffset != sizeof(Elf_Ehdr))
+    return None;
+  for (auto &Segment : this->Segments)
+    if (Segment->Offset != Segment->OriginalOffset)
+      return None;
+  // Everything up to the first section that was removed, rebuilt, added or
+  // moved is already in place in the input file.
+  uint64_t FirstChanged = std::min(this->SHOffset, this->FirstRemovedOffset);
+  for (auto &Section : this->Sections) {
+    if (Section->Type == SHT_NOBITS)
+      continue;
+    if (!Section->hasOriginalContents() ||
+        Section->Offset != Section->OriginalOffset)
+      FirstChanged = std::min(FirstChanged, Section->Offset);
+  }
+  return FirstChanged;
+}
+
 template <class ELFT> void ELFObject<ELFT>::finalize() {
   // Make sure we add the names of all the sections.
   if (this->SectionNames != nullptr)
@@ -11,11 +11,13 @@
 #define LLVM_TOOLS_OBJCOPY_OBJECT_H
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/MC/StringTableBuilder.h"
 #include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include <cstddef>
 #include <cstdint>
 #include <functional>
@@ -68,6 +70,9 @@ public:
   virtual void initialize(SectionTableRef SecTable);
   virtual void finalize();
   virtual void removeSectionReferences(const SectionBase *Sec);
+  // Returns true if the section's contents are the bytes at OriginalOffset in
+  // the input file.
+  virtual bool hasOriginalContents() const { return false; }
   template <class ELFT> void writeHeader(FileOutputBuffer &Out) const;
   virtual void writeSection(FileOutputBuffer &Out) const = 0;
 };
@@ -123,19 +128,23 @@ private:
 public:
   Section(ArrayRef<uint8_t> Data) : Contents(Data) {}
 
+  bool hasOriginalContents() const override { return true; }
   void writeSection(FileOutputBuffer &Out) const override;
 };
 
+// A section whose contents come from a separate file. The file's buffer is
+// kept alive rather than copied so that large files are only read once, when
+// the section is written.
 class OwnedDataSection : public SectionBase {
 private:
-  std::vector<uint8_t> Data;
+  std::unique_ptr<MemoryBuffer> Data;
 
 public:
-  OwnedDataSection(StringRef SecName, ArrayRef<uint8_t> Data)
-      : Data(std::begin(Data), std::end(Data)) {
+  OwnedDataSection(StringRef SecName, std::unique_ptr<MemoryBuffer> Buf)
+      : Data(std::move(Buf)) {
     Name = SecName;
     Type = ELF::SHT_PROGBITS;
-    Size = Data.size();
+    Size = Data->getBufferSize();
   }
   void writeSection(FileOutputBuffer &Out) const override;
 };
@@ -335,6 +344,7 @@ private:
 public:
   DynamicRelocationSection(ArrayRef<uint8_t> Data) : Contents(Data) {}
 
+  bool hasOriginalContents() const override { return true; }
   void writeSection(FileOutputBuffer &Out) const override;
 
   static bool classof(const SectionBase *S) {
@@ -368,12 +378,15 @@ protected:
 
   void writeHeader(FileOutputBuffer &Out) const;
   void writeProgramHeaders(FileOutputBuffer &Out) const;
-  void writeSectionData(FileOutputBuffer &Out) const;
+  void writeSectionData(FileOutputBuffer &Out, uint64_t From = 0) const;
   void writeSectionHeaders(FileOutputBuffer &Out) const;
 
 public:
   uint8_t Ident[16];
   uint64_t Entry;
+  uint64_t OriginalPHOffset;
+  // The lowest input offset of the contents of a removed section.
+  uint64_t FirstRemovedOffset = ~0ULL;
   uint64_t SHOffset;
   uint32_t Type;
   uint32_t Machine;
@@ -387,7 +400,7 @@ public:
   const SymbolTableSection *getSymTab() const { return SymbolTable; }
   const SectionBase *getSectionHeaderStrTab() const { return SectionNames; }
   void removeSections(std::function<bool(const SectionBase &)> ToRemove);
-  void addSection(StringRef SecName, ArrayRef<uint8_t> Data);
+  void addSection(StringRef SecName, std::unique_ptr<MemoryBuffer> Data);
   virtual size_t totalSize() const = 0;
   virtual void finalize() = 0;
   virtual void write(FileOutputBuffer &Out) const = 0;
@@ -411,6 +424,18 @@ public:
   void finalize() override;
   size_t totalSize() const override;
   void write(FileOutputBuffer &Out) const override;
+
+  // The size of the ELF header and the program headers that follow it.
+  uint64_t headerSize() const {
+    return sizeof(Elf_Ehdr) + this->Segments.size() * sizeof(Elf_Phdr);
+  }
+  // Returns the offset from which the output may differ from the input file,
+  // apart from the headers, or None if a segment or the program headers
+  // moved. Only valid after finalize().
+  Optional<uint64_t> getFirstChangedOffset() const;
+  // Writes the headers and only the section data that ends after From, which
+  // together with the first From bytes of the input file make up the output.
+  void writeChanges(FileOutputBuffer &Out, uint64_t From) const;
 };
 
 template <class ELFT> class BinaryObject : public Object<ELFT> {
@@ -24,8 +24,13 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/FileOutputBuffer.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Memory.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
@@ -117,6 +122,11 @@ static cl::list<std::string> AddSection(
     "add-section",
     cl::desc("Make a section named <section> with the contents of <file>."),
     cl::value_desc("section=file"));
+static cl::opt<bool> InPlace(
+    "in-place",
+    cl::desc("Modify the input file instead of writing an output file. If no "
+             "segment moves, only the headers and the data from the first "
+             "changed section on are written"));
 
 using SectionPred = std::function<bool(const SectionBase &Sec)>;
 
@@ -148,6 +158,100 @@ void WriteObjectFile(const Object<ELFT> &Obj, StringRef File) {
     reportError(File, errorToErrorCode(std::move(E)));
 }
 
+namespace {
+
+// A FileOutputBuffer that updates an existing file in place. The output is
+// staged in anonymous memory, whose pages are only allocated once written.
+// commit() copies the headers and everything from TailOffset on into the
+// file and leaves the bytes in between untouched.
+class InPlaceBuffer : public FileOutputBuffer {
+public:
+  InPlaceBuffer(StringRef Path, sys::MemoryBlock Buf, size_t Size,
+                uint64_t HeaderSize, uint64_t TailOffset)
+      : FileOutputBuffer(Path), Buffer(Buf), Size(Size),
+        HeaderSize(HeaderSize), TailOffset(TailOffset) {}
+
+  uint8_t *getBufferStart() const override { return (uint8_t *)Buffer.base(); }
+
+  uint8_t *getBufferEnd() const override {
+    return (uint8_t *)Buffer.base() + Size;
+  }
+
+  size_t getBufferSize() const override { return Size; }
+
+  Error commit() override {
+    int FD;
+    // F_Append keeps the existing contents. The file is only written through
+    // mappings, which O_APPEND does not affect.
+    if (auto EC = sys::fs::openFileForWrite(FinalPath, FD,
+                                            sys::fs::F_Append | sys::fs::F_RW))
+      return errorCodeToError(EC);
+    std::error_code EC = update(FD);
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    return errorCodeToError(EC);
+  }
+
+private:
+  std::error_code update(int FD) {
+    sys::fs::file_status Stat;
+    if (auto EC = sys::fs::status(FD, Stat))
+      return EC;
+    uint64_t Size = getBufferSize();
+    if (Size > Stat.getSize())
+      if (auto EC = sys::fs::resize_file(FD, Size))
+        return EC;
+    if (auto EC = copyToFile(FD, 0, std::min(HeaderSize, Size)))
+      return EC;
+    if (auto EC = copyToFile(FD, TailOffset, Size - TailOffset))
+      return EC;
+    if (Size < Stat.getSize())
+      return sys::fs::resize_file(FD, Size);
+    return std::error_code();
+  }
+
+  std::error_code copyToFile(int FD, uint64_t Offset, uint64_t Length) {
+    if (Length == 0)
+      return std::error_code();
+    uint64_t Start = alignDown(Offset, sys::fs::mapped_file_region::alignment());
+    std::error_code EC;
+    sys::fs::mapped_file_region Region(
+        FD, sys::fs::mapped_file_region::readwrite, Offset + Length - Start,
+        Start, EC);
+    if (EC)
+      return EC;
+    std::copy(getBufferStart() + Offset, getBufferStart() + Offset + Length,
+              Region.data() + (Offset - Start));
+    return std::error_code();
+  }
+
+  // The mapping is rounded up to whole pages; Size is what the file holds.
+  sys::OwningMemoryBlock Buffer;
+  size_t Size;
+  uint64_t HeaderSize;
+  uint64_t TailOffset;
+};
+
+} // end anonymous namespace
+
+// Updates File, which holds the input of Obj, by writing only what differs
+// from the input from FirstChanged on.
+template <class ELFT>
+void WriteObjectFileInPlace(const ELFObject<ELFT> &Obj, uint64_t FirstChanged,
+                            StringRef File) {
+  std::error_code EC;
+  sys::MemoryBlock Block = sys::Memory::allocateMappedMemory(
+      Obj.totalSize(), nullptr, sys::Memory::MF_READ | sys::Memory::MF_WRITE,
+      EC);
+  if (EC)
+    reportError(File, EC);
+  InPlaceBuffer Buffer(File, Block, Obj.totalSize(), Obj.headerSize(),
+                       FirstChanged);
+
+  Obj.writeChanges(Buffer, FirstChanged);
+  if (auto E = Buffer.commit())
+    reportError(File, errorToErrorCode(std::move(E)));
+}
+
 template <class ELFT>
 void SplitDWOToFile(const ELFObjectFile<ELFT> &ObjFile, StringRef File) {
   // Construct a second output file for the DWO sections.
@@ -169,13 +273,17 @@ void SplitDWOToFile(const ELFObjectFile<ELFT> &ObjFile, StringRef File) {
 // system. The only priority is that keeps/copies overrule removes.
 template <class ELFT> void CopyBinary(const ELFObjectFile<ELFT> &ObjFile) {
   std::unique_ptr<Object<ELFT>> Obj;
+  ELFObject<ELFT> *ELFObj = nullptr;
 
   if (!OutputFormat.empty() && OutputFormat != "binary")
     error("invalid output format '" + OutputFormat + "'");
-  if (!OutputFormat.empty() && OutputFormat == "binary")
+  if (!OutputFormat.empty() && OutputFormat == "binary") {
     Obj = llvm::make_unique<BinaryObject<ELFT>>(ObjFile);
-  else
-    Obj = llvm::make_unique<ELFObject<ELFT>>(ObjFile);
+  } else {
+    auto ELFOut = llvm::make_unique<ELFObject<ELFT>>(ObjFile);
+    ELFObj = ELFOut.get();
+    Obj = std::move(ELFOut);
+  }
 
   if (!SplitDWO.empty())
     SplitDWOToFile<ELFT>(ObjFile, SplitDWO.getValue());
@@ -296,17 +404,21 @@ template <class ELFT> void CopyBinary(const ELFObjectFile<ELFT> &ObjFile) {
       auto SecPair = StringRef(Flag).split("=");
       auto SecName = SecPair.first;
       auto File = SecPair.second;
-      auto BufOrErr = MemoryBuffer::getFile(File);
+      auto BufOrErr =
+          MemoryBuffer::getFile(File, -1, /*RequiresNullTerminator=*/false);
       if (!BufOrErr)
         reportError(File, BufOrErr.getError());
-      auto Buf = std::move(*BufOrErr);
-      auto BufPtr = reinterpret_cast<const uint8_t *>(Buf->getBufferStart());
-      auto BufSize = Buf->getBufferSize();
-      Obj->addSection(SecName, ArrayRef<uint8_t>(BufPtr, BufSize));
+      Obj->addSection(SecName, std::move(*BufOrErr));
     }
   }
 
   Obj->finalize();
+  if (InPlace && ELFObj)
+    if (auto FirstChanged = ELFObj->getFirstChangedOffset()) {
+      WriteObjectFileInPlace(*ELFObj, *FirstChanged,
+                             OutputFilename.getValue());
+      return;
+    }
   WriteObjectFile(*Obj, OutputFilename.getValue());
 }
 
@@ -321,6 +433,11 @@ int main(int argc, char **argv) {
     cl::PrintHelpMessage();
     return 2;
   }
+  if (InPlace) {
+    if (OutputFilename.getNumOccurrences())
+      error("--in-place cannot be used with an output file");
+    OutputFilename = InputFilename.getValue();
+  }
   Expected<OwningBinary<Binary>> BinaryOrErr = createBinary(InputFilename);
   if (!BinaryOrErr)
     reportError(InputFilename, BinaryOrErr.takeError());
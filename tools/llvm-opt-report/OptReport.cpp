@@ -8,14 +8,16 @@
 //===----------------------------------------------------------------------===//
 ///
 /// \file
-/// \brief This file implements a tool that can parse the YAML optimization
-/// records and generate an optimization summary annotated source listing
-/// report.
+/// \brief This file implements a tool that can parse the YAML or binary
+/// optimization records and generate an optimization summary annotated source
+/// listing report.
 ///
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Demangle/Demangle.h"
+#include "llvm/Remarks/BinaryRemarks.h"
+#include "llvm/Remarks/YAMLRemarks.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/FileSystem.h"
@@ -142,148 +144,96 @@ typedef std::map<std::string, std::map<int, std::map<std::string, std::map<int,
           OptReportLocationInfo>>>> LocationInfoTy;
 } // anonymous namespace
 
-static void collectLocationInfo(yaml::Stream &Stream,
+static void collectLocationInfo(const remarks::Remark &Remark,
                                 LocationInfoTy &LocationInfo) {
-  SmallVector<char, 8> Tmp;
-
-  // Note: We're using the YAML parser here directly, instead of using the
-  // YAMLTraits implementation, because the YAMLTraits implementation does not
-  // support a way to handle only a subset of the input keys (it will error out
-  // if there is an input key that you don't map to your class), and
-  // furthermore, it does not provide a way to handle the Args sequence of
-  // key/value pairs, where the order must be captured and the 'String' key
-  // might be repeated.
-  for (auto &Doc : Stream) {
-    auto *Root = dyn_cast<yaml::MappingNode>(Doc.getRoot());
-    if (!Root)
-      continue;
-
-    bool Transformed = Root->getRawTag() == "!Passed";
-    std::string Pass, File, Function;
-    int Line = 0, Column = 1;
-
-    int VectorizationFactor = 1;
-    int InterleaveCount = 1;
-    int UnrollCount = 1;
-
-    for (auto &RootChild : *Root) {
-      auto *Key = dyn_cast<yaml::ScalarNode>(RootChild.getKey());
-      if (!Key)
-        continue;
-      StringRef KeyName = Key->getValue(Tmp);
-      if (KeyName == "Pass") {
-        auto *Value = dyn_cast<yaml::ScalarNode>(RootChild.getValue());
-        if (!Value)
-          continue;
-        Pass = Value->getValue(Tmp);
-      } else if (KeyName == "Function") {
-        auto *Value = dyn_cast<yaml::ScalarNode>(RootChild.getValue());
-        if (!Value)
-          continue;
-        Function = Value->getValue(Tmp);
-      } else if (KeyName == "DebugLoc") {
-        auto *DebugLoc = dyn_cast<yaml::MappingNode>(RootChild.getValue());
-        if (!DebugLoc)
-          continue;
-
-        for (auto &DLChild : *DebugLoc) {
-          auto *DLKey = dyn_cast<yaml::ScalarNode>(DLChild.getKey());
-          if (!DLKey)
-            continue;
-          StringRef DLKeyName = DLKey->getValue(Tmp);
-          if (DLKeyName == "File") {
-            auto *Value = dyn_cast<yaml::ScalarNode>(DLChild.getValue());
-            if (!Value)
-              continue;
-            File = Value->getValue(Tmp);
-          } else if (DLKeyName == "Line") {
-            auto *Value = dyn_cast<yaml::ScalarNode>(DLChild.getValue());
-            if (!Value)
-              continue;
-            Value->getValue(Tmp).getAsInteger(10, Line);
-          } else if (DLKeyName == "Column") {
-            auto *Value = dyn_cast<yaml::ScalarNode>(DLChild.getValue());
-            if (!Value)
-              continue;
-            Value->getValue(Tmp).getAsInteger(10, Column);
-          }
-        }
-      } else if (KeyName == "Args") {
-        auto *Args = dyn_cast<yaml::SequenceNode>(RootChild.getValue());
-        if (!Args)
-          continue;
-        for (auto &ArgChild : *Args) {
-          auto *ArgMap = dyn_cast<yaml::MappingNode>(&ArgChild);
-          if (!ArgMap)
-            continue;
-          for (auto &ArgKV : *ArgMap) {
-            auto *ArgKey = dyn_cast<yaml::ScalarNode>(ArgKV.getKey());
-            if (!ArgKey)
-              continue;
-            StringRef ArgKeyName = ArgKey->getValue(Tmp);
-            if (ArgKeyName == "VectorizationFactor") {
-              auto *Value = dyn_cast<yaml::ScalarNode>(ArgKV.getValue());
-              if (!Value)
-                continue;
-              Value->getValue(Tmp).getAsInteger(10, VectorizationFactor);
-            } else if (ArgKeyName == "InterleaveCount") {
-              auto *Value = dyn_cast<yaml::ScalarNode>(ArgKV.getValue());
-              if (!Value)
-                continue;
-              Value->getValue(Tmp).getAsInteger(10, InterleaveCount);
-            } else if (ArgKeyName == "UnrollCount") {
-              auto *Value = dyn_cast<yaml::ScalarNode>(ArgKV.getValue());
-              if (!Value)
-                continue;
-              Value->getValue(Tmp).getAsInteger(10, UnrollCount);
-            }
-          }
-        }
-      }
-    }
+  bool Transformed = Remark.RemarkType == remarks::Type::Passed;
+  StringRef Pass = Remark.PassName;
+  std::string File = Remark.Loc.File, Function = Remark.FunctionName;
+  int Line = Remark.Loc.Line, Column = Remark.Loc.Column;
 
-    if (Line < 1 || File.empty())
-      continue;
-
-    // We track information on both actual and potential transformations. This
-    // way, if there are multiple possible things on a line that are, or could
-    // have been transformed, we can indicate that explicitly in the output.
-    auto UpdateLLII = [Transformed](OptReportLocationItemInfo &LLII) {
-      LLII.Analyzed = true;
-      if (Transformed)
-        LLII.Transformed = true;
-    };
-
-    if (Pass == "inline") {
-      auto &LI = LocationInfo[File][Line][Function][Column];
-      UpdateLLII(LI.Inlined);
-    } else if (Pass == "loop-unroll") {
-      auto &LI = LocationInfo[File][Line][Function][Column];
-      LI.UnrollCount = UnrollCount;
-      UpdateLLII(LI.Unrolled);
-    } else if (Pass == "loop-vectorize") {
-      auto &LI = LocationInfo[File][Line][Function][Column];
-      LI.VectorizationFactor = VectorizationFactor;
-      LI.InterleaveCount = InterleaveCount;
-      UpdateLLII(LI.Vectorized);
-    }
+  int VectorizationFactor = 1;
+  int InterleaveCount = 1;
+  int UnrollCount = 1;
+
+  for (const remarks::Argument &Arg : Remark.Args) {
+    if (Arg.Key == "VectorizationFactor")
+      Arg.Val.getAsInteger(10, VectorizationFactor);
+    else if (Arg.Key == "InterleaveCount")
+      Arg.Val.getAsInteger(10, InterleaveCount);
+    else if (Arg.Key == "UnrollCount")
+      Arg.Val.getAsInteger(10, UnrollCount);
+  }
+
+  if (Line < 1 || File.empty())
+    return;
+
+  // We track information on both actual and potential transformations. This
+  // way, if there are multiple possible things on a line that are, or could
+  // have been transformed, we can indicate that explicitly in the output.
+  auto UpdateLLII = [Transformed](OptReportLocationItemInfo &LLII) {
+    LLII.Analyzed = true;
+    if (Transformed)
+      LLII.Transformed = true;
+  };
+
+  if (Pass == "inline") {
+    auto &LI = LocationInfo[File][Line][Function][Column];
+    UpdateLLII(LI.Inlined);
+  } else if (Pass == "loop-unroll") {
+    auto &LI = LocationInfo[File][Line][Function][Column];
+    LI.UnrollCount = UnrollCount;
+    UpdateLLII(LI.Unrolled);
+  } else if (Pass == "loop-vectorize") {
+    auto &LI = LocationInfo[File][Line][Function][Column];
+    LI.VectorizationFactor = VectorizationFactor;
+    LI.InterleaveCount = InterleaveCount;
+    UpdateLLII(LI.Vectorized);
+  }
+}
+
+template <typename ParserT>
+static Error collectLocationInfo(ParserT &Parser,
+                                 LocationInfoTy &LocationInfo) {
+  while (true) {
+    Expected<const remarks::Remark *> Remark = Parser.next();
+    if (!Remark)
+      return Remark.takeError();
+    if (!*Remark)
+      return Error::success();
+    collectLocationInfo(**Remark, LocationInfo);
   }
 }
 
+static Error collectLocationInfo(StringRef Buffer,
+                                 LocationInfoTy &LocationInfo) {
+  if (remarks::BinaryRemarkParser::isBinaryRemarkFile(Buffer)) {
+    auto Parser = remarks::BinaryRemarkParser::create(Buffer);
+    if (!Parser)
+      return Parser.takeError();
+    return collectLocationInfo(**Parser, LocationInfo);
+  }
+  remarks::YAMLRemarkParser Parser(Buffer);
+  return collectLocationInfo(Parser, LocationInfo);
+}
+
 static bool readLocationInfo(LocationInfoTy &LocationInfo) {
-  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf =
-      MemoryBuffer::getFileOrSTDIN(InputFileName);
+  // The buffer does not need to be NUL terminated, so large remark files can
+  // be mapped into memory rather than read.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFileOrSTDIN(
+      InputFileName, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
   if (std::error_code EC = Buf.getError()) {
     errs() << "error: Can't open file " << InputFileName << ": " <<
               EC.message() << "\n";
     return false;
   }
 
-  SourceMgr SM;
-  yaml::Stream Stream(Buf.get()->getBuffer(), SM);
-  collectLocationInfo(Stream, LocationInfo);
+  if (Error E = collectLocationInfo(Buf.get()->getBuffer(), LocationInfo)) {
+    errs() << "error: Can't read remarks from " << InputFileName << ": "
+           << toString(std::move(E)) << "\n";
+    return false;
+  }
 
-  return true; 
+  return true;
 }
 
 static bool writeReport(LocationInfoTy &LocationInfo) {
@@ -0,0 +1,103 @@
+//===- RemarkUtil.cpp - Convert between remark file formats ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Converts optimization remark files between the YAML and the binary
+/// format.
+///
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Remarks/BinaryRemarks.h"
+#include "llvm/Remarks/YAMLRemarks.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::SubCommand YAML2Binary("yaml2binary",
+                                  "Convert a YAML remark file to binary");
+static cl::SubCommand Binary2YAML("binary2yaml",
+                                  "Convert a binary remark file to YAML");
+
+static cl::opt<std::string> InputFileName(cl::Positional,
+                                          cl::desc("<input file>"),
+                                          cl::init("-"), cl::sub(YAML2Binary),
+                                          cl::sub(Binary2YAML));
+
+static cl::opt<std::string> OutputFileName("o", cl::desc("Output file"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"), cl::sub(YAML2Binary),
+                                           cl::sub(Binary2YAML));
+
+static const char *ToolName;
+
+static void error(Error E) {
+  errs() << ToolName << ": " << InputFileName << ": " << toString(std::move(E))
+         << "\n";
+  exit(1);
+}
+
+template <typename ParserT, typename SerializerT>
+static void convert(ParserT &Parser, SerializerT &Serializer) {
+  while (true) {
+    Expected<const remarks::Remark *> Remark = Parser.next();
+    if (!Remark)
+      error(Remark.takeError());
+    if (!*Remark)
+      return;
+    Serializer.emit(**Remark);
+  }
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y; // Call llvm_shutdown() on exit.
+  ToolName = argv[0];
+  cl::ParseCommandLineOptions(argc, argv, "Remark file conversion utility\n");
+
+  if (!YAML2Binary && !Binary2YAML) {
+    cl::PrintHelpMessage(false, true);
+    return 1;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFileOrSTDIN(
+      InputFileName, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = Buf.getError())
+    error(errorCodeToError(EC));
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFileName, EC,
+                     YAML2Binary ? sys::fs::F_None : sys::fs::F_Text);
+  if (EC)
+    error(errorCodeToError(EC));
+
+  StringRef Buffer = Buf.get()->getBuffer();
+  if (YAML2Binary) {
+    remarks::YAMLRemarkParser Parser(Buffer);
+    remarks::BinaryRemarkSerializer Serializer(Out.os());
+    convert(Parser, Serializer);
+  } else {
+    auto Parser = remarks::BinaryRemarkParser::create(Buffer);
+    if (!Parser)
+      error(Parser.takeError());
+    remarks::YAMLRemarkSerializer Serializer(Out.os());
+    convert(**Parser, Serializer);
+  }
+
+  Out.keep();
+  return 0;
+}
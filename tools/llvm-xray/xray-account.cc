@@ -21,6 +21,8 @@
 #include "xray-registry.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/XRay/InstrumentationMap.h"
 #include "llvm/XRay/Trace.h"
 
@@ -111,6 +113,15 @@ static cl::opt<int> AccountTop("top", cl::desc("only show the top N results"),
 static cl::alias AccountTop2("p", cl::desc("Alias for -top"),
                              cl::aliasopt(AccountTop), cl::sub(Account));
 
+static cl::opt<unsigned>
+    AccountThreads("threads",
+                   cl::desc("number of threads to account records with "
+                            "(default: autodetect)"),
+                   cl::value_desc("N"), cl::sub(Account), cl::init(0));
+static cl::alias AccountThreads2("j", cl::aliasopt(AccountThreads),
+                                 cl::desc("Alias for -threads"),
+                                 cl::sub(Account));
+
 static cl::opt<std::string>
     AccountInstrMap("instr_map",
                     cl::desc("binary with the instrumentation map, or "
@@ -215,6 +226,29 @@ bool LatencyAccountant::accountRecord(const XRayRecord &Record) {
   return true;
 }
 
+void LatencyAccountant::merge(LatencyAccountant &&Other) {
+  for (auto &FT : Other.FunctionLatencies) {
+    auto &Timings = FunctionLatencies[FT.first];
+    if (Timings.empty())
+      Timings = std::move(FT.second);
+    else
+      Timings.insert(Timings.end(), FT.second.begin(), FT.second.end());
+  }
+  for (const auto &CPUMinMax : Other.PerCPUMinMaxTSC) {
+    auto &MM = PerCPUMinMaxTSC[CPUMinMax.first];
+    setMinMax(MM, CPUMinMax.second.first);
+    setMinMax(MM, CPUMinMax.second.second);
+  }
+  PerThreadMinMaxTSC.insert(Other.PerThreadMinMaxTSC.begin(),
+                            Other.PerThreadMinMaxTSC.end());
+  for (auto &ThreadStack : Other.PerThreadFunctionStack)
+    PerThreadFunctionStack[ThreadStack.first] = std::move(ThreadStack.second);
+  Other.FunctionLatencies.clear();
+  Other.PerCPUMinMaxTSC.clear();
+  Other.PerThreadMinMaxTSC.clear();
+  Other.PerThreadFunctionStack.clear();
+}
+
 namespace {
 
 // We consolidate the data into a struct which we can output in various forms.
@@ -458,50 +492,125 @@ static CommandRegistration Unused(&Account, []() -> Error {
   llvm::xray::FuncIdConversionHelper FuncIdHelper(AccountInstrMap, Symbolizer,
                                                   FunctionAddresses);
   xray::LatencyAccountant FCA(FuncIdHelper, AccountDeduceSiblingCalls);
-  auto TraceOrErr = loadTraceFile(AccountInput);
-  if (!TraceOrErr)
+  // Decode the records one at a time from the mapped file instead of loading
+  // the whole trace, so that the memory we need does not grow with its size.
+  auto LoadError = [&](Error E) {
     return joinErrors(
         make_error<StringError>(
             Twine("Failed loading input file '") + AccountInput + "'",
             std::make_error_code(std::errc::executable_format_error)),
-        TraceOrErr.takeError());
-
-  auto &T = *TraceOrErr;
-  for (const auto &Record : T) {
-    if (FCA.accountRecord(Record))
-      continue;
-    errs()
-        << "Error processing record: "
-        << llvm::formatv(
-               R"({{type: {0}; cpu: {1}; record-type: {2}; function-id: {3}; tsc: {4}; thread-id: {5}}})",
-               Record.RecordType, Record.CPU, Record.Type, Record.FuncId,
-               Record.TId)
-        << '\n';
-    for (const auto &ThreadStack : FCA.getPerThreadFunctionStack()) {
-      errs() << "Thread ID: " << ThreadStack.first << "\n";
-      if (ThreadStack.second.empty()) {
-        errs() << "  (empty stack)\n";
-        continue;
+        std::move(E));
+  };
+  auto TraceFileOrErr = openTraceFile(AccountInput);
+  if (!TraceFileOrErr)
+    return LoadError(TraceFileOrErr.takeError());
+  auto &T = **TraceFileOrErr;
+
+  // No record may precede the first record of the trace.
+  uint64_t FirstTSC = 0;
+  {
+    TraceRecordReader Reader = T.records();
+    auto RecordOrErr = Reader.next();
+    if (!RecordOrErr)
+      return LoadError(RecordOrErr.takeError());
+    if (*RecordOrErr)
+      FirstTSC = (*RecordOrErr)->TSC;
+  }
+
+  // The call stacks of different threads are independent, so we account the
+  // records of each thread on its own and merge the results at the end. The
+  // records that fail are collected with the stack of their thread at that
+  // point, and reported in the order of the threads.
+  struct ThreadAccount {
+    std::unique_ptr<LatencyAccountant> Accountant;
+    std::vector<std::pair<XRayRecord, LatencyAccountant::FunctionStack>>
+        Failures;
+    Error DecodeError = Error::success();
+  };
+  ArrayRef<uint32_t> Threads = T.threads();
+  std::vector<ThreadAccount> Accounts(Threads.size());
+  auto AccountThread = [&](ThreadAccount &A, uint32_t TId) {
+    ErrorAsOutParameter EAO(&A.DecodeError);
+    TraceRecordReader Reader = T.records(TId);
+    while (true) {
+      auto RecordOrErr = Reader.next();
+      if (!RecordOrErr) {
+        A.DecodeError = RecordOrErr.takeError();
+        return;
       }
-      auto Level = ThreadStack.second.size();
-      for (const auto &Entry : llvm::reverse(ThreadStack.second))
-        errs() << "  #" << Level-- << "\t"
-               << FuncIdHelper.SymbolOrNumber(Entry.first) << '\n';
+      if (!*RecordOrErr)
+        return;
+      const auto &Record = **RecordOrErr;
+      if (A.Accountant->accountRecord(Record))
+        continue;
+      const auto *Stack = A.Accountant->getThreadFunctionStack(Record.TId);
+      A.Failures.emplace_back(Record, Stack ? *Stack
+                                            : LatencyAccountant::FunctionStack());
+      if (!AccountKeepGoing)
+        return;
     }
-    if (!AccountKeepGoing)
-      return make_error<StringError>(
-          Twine("Failed accounting function calls in file '") + AccountInput +
-              "'.",
-          std::make_error_code(std::errc::executable_format_error));
+  };
+
+  unsigned NumThreads = AccountThreads;
+  if (NumThreads == 0)
+    NumThreads = std::max(1U, std::min(heavyweight_hardware_concurrency(),
+                                       unsigned(Threads.size())));
+  {
+    ThreadPool Pool(NumThreads);
+    for (size_t I = 0, E = Threads.size(); I != E; ++I) {
+      Accounts[I].Accountant = llvm::make_unique<LatencyAccountant>(
+          FuncIdHelper, AccountDeduceSiblingCalls);
+      Accounts[I].Accountant->setCurrentMaxTSC(FirstTSC);
+      Pool.async(AccountThread, std::ref(Accounts[I]), Threads[I]);
     }
-    switch (AccountOutputFormat) {
-    case AccountOutputFormats::TEXT:
-      FCA.exportStatsAsText(OS, T.getFileHeader());
-      break;
-    case AccountOutputFormats::CSV:
-      FCA.exportStatsAsCSV(OS, T.getFileHeader());
-      break;
+    Pool.wait();
+  }
+
+  Error DecodeErrors = Error::success();
+  for (auto &A : Accounts)
+    DecodeErrors = joinErrors(std::move(DecodeErrors), std::move(A.DecodeError));
+  if (DecodeErrors)
+    return LoadError(std::move(DecodeErrors));
+
+  for (const auto &A : Accounts) {
+    for (const auto &Failure : A.Failures) {
+      const auto &Record = Failure.first;
+      const auto &ThreadStack = Failure.second;
+      errs()
+          << "Error processing record: "
+          << llvm::formatv(
+                 R"({{type: {0}; cpu: {1}; record-type: {2}; function-id: {3}; tsc: {4}; thread-id: {5}}})",
+                 Record.RecordType, Record.CPU, Record.Type, Record.FuncId,
+                 Record.TId)
+          << '\n';
+      errs() << "Thread ID: " << Record.TId << "\n";
+      if (ThreadStack.empty()) {
+        errs() << "  (empty stack)\n";
+      } else {
+        auto Level = ThreadStack.size();
+        for (const auto &Entry : llvm::reverse(ThreadStack))
+          errs() << "  #" << Level-- << "\t"
+                 << FuncIdHelper.SymbolOrNumber(Entry.first) << '\n';
+      }
+      if (!AccountKeepGoing)
+        return make_error<StringError>(
+            Twine("Failed accounting function calls in file '") +
+                AccountInput + "'.",
+            std::make_error_code(std::errc::executable_format_error));
     }
+  }
+
+  for (auto &A : Accounts)
+    FCA.merge(std::move(*A.Accountant));
+
+  switch (AccountOutputFormat) {
+  case AccountOutputFormats::TEXT:
+    FCA.exportStatsAsText(OS, T.getFileHeader());
+    break;
+  case AccountOutputFormats::CSV:
+    FCA.exportStatsAsCSV(OS, T.getFileHeader());
+    break;
+  }
 
   return Error::success();
 });
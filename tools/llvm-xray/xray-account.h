@@ -68,6 +68,15 @@ public:
     return PerCPUMinMaxTSC;
   }
 
+  /// Sets the TSC that records may not precede, which is otherwise the TSC of
+  /// the first record accounted. Accountants that each see the records of some
+  /// of the threads of a trace use this to agree on the first TSC of the trace.
+  void setCurrentMaxTSC(uint64_t TSC) { CurrentMaxTSC = TSC; }
+
+  /// Moves everything accounted by Other into this accountant. The two must
+  /// have accounted the records of different threads.
+  void merge(LatencyAccountant &&Other);
+
   /// Returns false in case we fail to account the provided record. This happens
   /// in the following cases:
   ///
@@ -27,6 +27,8 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormatAdapters.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/XRay/Graph.h"
 #include "llvm/XRay/InstrumentationMap.h"
 #include "llvm/XRay/Trace.h"
@@ -46,6 +48,15 @@ static cl::alias StackKeepGoing2("k", cl::aliasopt(StackKeepGoing),
                                  cl::desc("Alias for -keep-going"),
                                  cl::sub(Stack));
 
+static cl::opt<unsigned>
+    StackThreads("threads",
+                 cl::desc("number of threads to account records with "
+                          "(default: autodetect)"),
+                 cl::value_desc("N"), cl::sub(Stack), cl::init(0));
+static cl::alias StackThreads2("j", cl::aliasopt(StackThreads),
+                               cl::desc("Alias for -threads"),
+                               cl::sub(Stack));
+
 // TODO: Does there need to be an option to deduce tail or sibling calls?
 
 static cl::opt<std::string> StacksInstrMap(
@@ -445,6 +456,20 @@ public:
 
   bool isEmpty() const { return Roots.empty(); }
 
+  /// Moves the tries of Other into this one. The two must have accounted the
+  /// records of different threads.
+  void merge(StackTrie &&Other) {
+    for (auto &R : Other.Roots) {
+      assert(!Roots.count(R.first) && "Merging tries of the same thread");
+      Roots[R.first] = std::move(R.second);
+    }
+    for (auto &TS : Other.ThreadStackMap)
+      ThreadStackMap[TS.first] = std::move(TS.second);
+    NodeStore.splice_after(NodeStore.before_begin(), Other.NodeStore);
+    Other.Roots.clear();
+    Other.ThreadStackMap.clear();
+  }
+
   void printStack(raw_ostream &OS, const StackTrieNode *Top,
                   FuncIdConversionHelper &FN) {
     // Traverse the pointers up to the parent, noting the sums, then print
@@ -723,34 +748,104 @@ static CommandRegistration Unused(&Stack, []() -> Error {
   symbolize::LLVMSymbolizer Symbolizer(Opts);
   FuncIdConversionHelper FuncIdHelper(StacksInstrMap, Symbolizer,
                                       Map.getFunctionAddresses());
+  // The call stacks of different threads are independent, so the records of
+  // each thread are accounted into a trie of its own on a thread pool, and the
+  // tries are merged once all files were read. The records of a thread in
+  // later files continue its trie.
+  DenseMap<uint32_t, std::unique_ptr<StackTrie>> ThreadTries;
+  std::vector<uint32_t> ThreadOrder;
+  unsigned NumThreads = StackThreads;
+  if (NumThreads == 0)
+    NumThreads = std::max(1U, heavyweight_hardware_concurrency());
+  ThreadPool Pool(NumThreads);
+
   // TODO: Someday, support output to files instead of just directly to
   // standard output.
   for (const auto &Filename : StackInputs) {
-    auto TraceOrErr = loadTraceFile(Filename);
-    if (!TraceOrErr) {
+    // Records are decoded one at a time from the mapped file, so a decoding
+    // error may come after some of the records of a file were accounted.
+    auto LoadError = [&](Error E) -> Error {
       if (!StackKeepGoing)
         return joinErrors(
             make_error<StringError>(
                 Twine("Failed loading input file '") + Filename + "'",
                 std::make_error_code(std::errc::invalid_argument)),
-            TraceOrErr.takeError());
-      logAllUnhandledErrors(TraceOrErr.takeError(), errs(), "");
+            std::move(E));
+      logAllUnhandledErrors(std::move(E), errs(), "");
+      return Error::success();
+    };
+    auto TraceFileOrErr = openTraceFile(Filename);
+    if (!TraceFileOrErr) {
+      if (auto E = LoadError(TraceFileOrErr.takeError()))
+        return E;
       continue;
     }
-    auto &T = *TraceOrErr;
-    StackTrie::AccountRecordState AccountRecordState =
-        StackTrie::AccountRecordState::CreateInitialState();
-    for (const auto &Record : T) {
-      auto error = ST.accountRecord(Record, &AccountRecordState);
-      if (error != StackTrie::AccountRecordStatus::OK) {
-        if (!StackKeepGoing)
+    auto &T = **TraceFileOrErr;
+
+    // The records that fail to account are reported in the order of the
+    // threads once the whole file was accounted.
+    struct ThreadAccount {
+      std::vector<std::pair<StackTrie::AccountRecordStatus, XRayRecord>>
+          Failures;
+      Error DecodeError = Error::success();
+    };
+    ArrayRef<uint32_t> Threads = T.threads();
+    std::vector<ThreadAccount> Accounts(Threads.size());
+    auto AccountThread = [&](ThreadAccount &A, StackTrie &Trie, uint32_t TId) {
+      ErrorAsOutParameter EAO(&A.DecodeError);
+      TraceRecordReader Reader = T.records(TId);
+      StackTrie::AccountRecordState AccountRecordState =
+          StackTrie::AccountRecordState::CreateInitialState();
+      while (true) {
+        auto RecordOrErr = Reader.next();
+        if (!RecordOrErr) {
+          A.DecodeError = RecordOrErr.takeError();
+          return;
+        }
+        if (!*RecordOrErr)
+          return;
+        const auto &Record = **RecordOrErr;
+        auto error = Trie.accountRecord(Record, &AccountRecordState);
+        if (error != StackTrie::AccountRecordStatus::OK) {
+          A.Failures.emplace_back(error, Record);
+          if (!StackKeepGoing)
+            return;
+        }
+      }
+    };
+    for (size_t I = 0, E = Threads.size(); I != E; ++I) {
+      auto &Trie = ThreadTries[Threads[I]];
+      if (!Trie) {
+        Trie = llvm::make_unique<StackTrie>();
+        ThreadOrder.push_back(Threads[I]);
+      }
+      Pool.async(AccountThread, std::ref(Accounts[I]), std::ref(*Trie),
+                 Threads[I]);
+    }
+    Pool.wait();
+
+    Error DecodeErrors = Error::success();
+    for (auto &A : Accounts)
+      DecodeErrors =
+          joinErrors(std::move(DecodeErrors), std::move(A.DecodeError));
+    for (const auto &A : Accounts) {
+      for (const auto &Failure : A.Failures) {
+        if (!StackKeepGoing) {
+          consumeError(std::move(DecodeErrors));
           return make_error<StringError>(
-              CreateErrorMessage(error, Record, FuncIdHelper),
+              CreateErrorMessage(Failure.first, Failure.second, FuncIdHelper),
               make_error_code(errc::illegal_byte_sequence));
-        errs() << CreateErrorMessage(error, Record, FuncIdHelper);
+        }
+        errs() << CreateErrorMessage(Failure.first, Failure.second,
+                                     FuncIdHelper);
       }
     }
+    if (DecodeErrors)
+      if (auto E = LoadError(std::move(DecodeErrors)))
+        return E;
   }
+  for (uint32_t TId : ThreadOrder)
+    ST.merge(std::move(*ThreadTries[TId]));
   if (ST.isEmpty()) {
     return make_error<StringError>(
         "No instrumented calls were accounted in the input file.",
@@ -15,6 +15,7 @@
 #include "BreakpointPrinter.h"
 #include "NewPMDriver.h"
 #include "PassPrinters.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
@@ -39,6 +40,7 @@
 #include "llvm/LinkAllIR.h"
 #include "llvm/LinkAllPasses.h"
 #include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Remarks/BinaryRemarks.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
@@ -250,9 +252,17 @@ static cl::opt<unsigned> PassRemarksHotnessThreshold(
 
 static cl::opt<std::string>
     RemarksFilename("pass-remarks-output",
-                    cl::desc("YAML output filename for pass remarks"),
+                    cl::desc("Output filename for pass remarks"),
                     cl::value_desc("filename"));
 
+enum RemarkFileFormat { RFF_YAML, RFF_Binary };
+static cl::opt<RemarkFileFormat> RemarksFormat(
+    "pass-remarks-format", cl::desc("The format of the pass remarks file"),
+    cl::init(RFF_YAML),
+    cl::values(clEnumValN(RFF_YAML, "yaml", "YAML documents"),
+               clEnumValN(RFF_Binary, "binary",
+                          "Binary remarks, see llvm-remarkutil")));
+
 static inline void addPass(legacy::PassManagerBase &PM, Pass *P) {
   // Add the pass to the pass manager...
   PM.add(P);
@@ -444,9 +454,17 @@ int main(int argc, char **argv) {
       errs() << EC.message() << '\n';
       return 1;
     }
-    Context.setDiagnosticsOutputFile(
-        llvm::make_unique<yaml::Output>(OptRemarkFile->os()));
+    if (RemarksFormat == RFF_Binary)
+      Context.setDiagnosticsBinaryOutputFile(
+          llvm::make_unique<remarks::BinaryRemarkSerializer>(
+              OptRemarkFile->os()));
+    else
+      Context.setDiagnosticsOutputFile(
+          llvm::make_unique<yaml::Output>(OptRemarkFile->os()));
   }
+  // Binary remarks are buffered, so write them out before the file closes.
+  auto FlushRemarks = make_scope_exit(
+      [&] { Context.setDiagnosticsBinaryOutputFile(nullptr); });
 
   // Load the input module...
   std::unique_ptr<Module> M;
@@ -0,0 +1,219 @@
+//===- ItaniumDemangleTest.cpp --------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Demangle/Demangle.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+// Symbols taken from the symbol tables of LLVM's own libraries and the C++
+// standard library it links against.
+const char *const Corpus[] = {
+    "_ZN4llvm6ModuleD1Ev",
+    "_ZNK4llvm11GlobalValue12getPartitionEv",
+    "_ZN4llvm14LandingPadInstC2ERKS0_",
+    "_ZN4llvm8SmallSetIjLj4ESt4lessIjEE5eraseERKj",
+    "_ZN4llvm3sys4path16convert_to_slashB5cxx11ENS_9StringRefENS1_5StyleE",
+    "_ZN4llvm11InstVisitorINS_15SCCPInstVisitorEvE5visitERNS_11InstructionE",
+    "_ZN4llvm3rdf13DataFlowGraph13linkBlockRefsERSt13unordered_mapIjNS1_"
+    "8DefStackESt4hashIjESt8equal_toIjESaISt4pairIKjS3_EEENS0_8NodeAddrIPNS0_"
+    "9BlockNodeEEE",
+    "_ZN4llvm7hashing6detail29hash_combine_recursive_helper7combineINS_"
+    "9StringRefEJNS_9hash_codeES5_EEES5_mPcS6_RKT_DpRKT0_",
+    "_ZN4llvm13PassInfoMixinINS_19RequireAnalysisPassINS_13CycleAnalysisENS_"
+    "8FunctionENS_15AnalysisManagerIS3_JEEEJEEEE4nameEv",
+    "_ZN4llvm12DenseMapBaseINS_8DenseMapIPKNS_23RuntimeCheckingPtrGroupEPNS_"
+    "6MDNodeENS_12DenseMapInfoIS4_vEENS_6detail12DenseMapPairIS4_S6_EEEES4_S6_"
+    "S8_SB_E15LookupBucketForIS4_EEbRKT_RPSB_",
+    "_ZN4llvm11PassManagerINS_8FunctionENS_15AnalysisManagerIS1_JEEEJEE7addPass"
+    "INS_25UniformityInfoPrinterPassEEENSt9enable_ifIXntsr3stdE9is_same_vIT_"
+    "S4_EEvE4typeEOS8_",
+    "_ZN4llvm6detail18UniqueFunctionBaseINS_8ExpectedISt10unique_ptrINS_"
+    "7jitlink20JITLinkMemoryManagerESt14default_deleteIS5_EEEEJRNS_3orc"
+    "15SimpleRemoteEPCEEED2Ev",
+    "_ZNK4llvm12PatternMatch22SpecificCmpClass_matchINS0_11class_matchINS_"
+    "5ValueEEENS0_14cstval_pred_tyINS0_11is_all_onesENS_11ConstantIntELb1EEENS_"
+    "8ICmpInstELb0EE5matchINS_11InstructionEEEbPT_",
+    "_ZN4llvm15SmallVectorImplINS_5MachO6TargetEE12emplace_backIJRKS2_EEERS2_"
+    "DpOT_",
+    "_ZN4llvm22llvm_execute_on_threadEPFvPvES0_j",
+    "_ZN4llvm13TinyPtrVectorIPNS_5ValueEE6insertIPPNS_11InstructionEEEPS2_S8_"
+    "T_S9_",
+    "_ZN4llvm18ExecutionDomainFix7releaseEPNS_11DomainValueE.warm",
+    "_ZTVN4llvm18R600TargetLoweringE",
+    "_ZTIN4llvm2cl3optIbLb0ENS0_6parserIbEEEE",
+    "_ZGVZN4llvm2cl18getGeneralCategoryEvE15GeneralCategory",
+    "_ZNSt6vectorISt4pairIjPN4llvm10BasicBlockEESaIS4_EE17_M_realloc_insertIJ"
+    "S4_EEEvN9__gnu_cxx17__normal_iteratorIPS4_S6_EEDpOT_",
+    "_ZNKSt8functionIFvPN4llvm8FunctionEEEclES2_",
+};
+
+std::string demangle(const char *Mangled) {
+  int Status;
+  char *Demangled = itaniumDemangle(Mangled, nullptr, nullptr, &Status);
+  if (!Demangled)
+    return "<invalid>";
+  std::string Result = Demangled;
+  std::free(Demangled);
+  return Result;
+}
+
+TEST(ItaniumDemangleTest, Basic) {
+  EXPECT_EQ("llvm::Module::~Module()", demangle("_ZN4llvm6ModuleD1Ev"));
+  EXPECT_EQ("llvm::GlobalValue::getPartition() const",
+            demangle("_ZNK4llvm11GlobalValue12getPartitionEv"));
+  EXPECT_EQ("llvm::llvm_execute_on_thread(void (*)(void*), void*, "
+            "unsigned int)",
+            demangle("_ZN4llvm22llvm_execute_on_threadEPFvPvES0_j"));
+  EXPECT_EQ("vtable for llvm::R600TargetLowering",
+            demangle("_ZTVN4llvm18R600TargetLoweringE"));
+  EXPECT_EQ("guard variable for "
+            "llvm::cl::getGeneralCategory()::GeneralCategory",
+            demangle("_ZGVZN4llvm2cl18getGeneralCategoryEvE15GeneralCategory"));
+  EXPECT_EQ("llvm::ExecutionDomainFix::release(llvm::DomainValue*) (.warm)",
+            demangle("_ZN4llvm18ExecutionDomainFix7releaseEPNS_"
+                     "11DomainValueE.warm"));
+  EXPECT_EQ("invocation function for block in foo()",
+            demangle("___Z3foov_block_invoke"));
+  EXPECT_EQ("unsigned int", demangle("j"));
+  EXPECT_EQ("<invalid>", demangle("_Z"));
+  EXPECT_EQ("<invalid>", demangle("_ZN4llvm"));
+  EXPECT_EQ("<invalid>", demangle("not_mangled"));
+}
+
+TEST(ItaniumDemangleTest, Templates) {
+  EXPECT_EQ("llvm::SmallSet<unsigned int, 4u, std::less<unsigned int> >::"
+            "erase(unsigned int const&)",
+            demangle("_ZN4llvm8SmallSetIjLj4ESt4lessIjEE5eraseERKj"));
+  EXPECT_EQ("std::function<void (llvm::Function*)>::operator()"
+            "(llvm::Function*) const",
+            demangle("_ZNKSt8functionIFvPN4llvm8FunctionEEEclES2_"));
+  EXPECT_EQ("llvm::hash_code llvm::hashing::detail::"
+            "hash_combine_recursive_helper::combine<llvm::StringRef, "
+            "llvm::hash_code, llvm::hash_code>(unsigned long, char*, char*, "
+            "llvm::StringRef const&, llvm::hash_code const&, "
+            "llvm::hash_code const&)",
+            demangle(Corpus[7]));
+  // A conversion operator whose type refers to the template arguments that
+  // follow it.
+  EXPECT_EQ("A::operator int<int>()", demangle("_ZN1AcvT_IiEEv"));
+  EXPECT_EQ("int foo<int, char>(int, char)",
+            demangle("_Z3fooIJicEEiDpT_"));
+  EXPECT_EQ("void foo<>()", demangle("_Z3fooIJEEvDpT_"));
+  // A pack expansion whose pattern refers to an earlier expansion through a
+  // substitution expands the pack below it.
+  EXPECT_EQ("std::enable_if<llvm::are_base_of<llvm::Type, llvm::Type>::value, "
+            "llvm::StructType*>::type llvm::StructType::get<llvm::Type>"
+            "(llvm::Type*, llvm::Type*)",
+            demangle("_ZN4llvm10StructType3getIJNS_4TypeEEEENSt9enable_ifIXsr"
+                     "NS_11are_base_ofIS2_JDpT_EEE5valueEPS0_E4typeEPS2_"
+                     "DpPS5_"));
+  EXPECT_EQ("void f<int, char>(int, char, int*, char*)",
+            demangle("_Z1fIJicEEvDpT_DpPS1_"));
+}
+
+TEST(ItaniumDemangleTest, ReferenceCollapsing) {
+  // Forwarding a const lvalue reference collapses to a single '&'.
+  EXPECT_EQ("llvm::MachO::Target& llvm::SmallVectorImpl<llvm::MachO::Target>"
+            "::emplace_back<llvm::MachO::Target const&>"
+            "(llvm::MachO::Target const&)",
+            demangle(Corpus[13]));
+  EXPECT_EQ("void f<int&>(int&)", demangle("_Z1fIRiEvOT_"));
+  EXPECT_EQ("void f<int>(int&&)", demangle("_Z1fIiEvOT_"));
+}
+
+TEST(ItaniumDemangleTest, QualifiersAndTags) {
+  EXPECT_EQ("llvm::sys::path::convert_to_slash[abi:cxx11]"
+            "(llvm::StringRef, llvm::sys::path::Style)",
+            demangle(Corpus[4]));
+  EXPECT_EQ("S::f() const &", demangle("_ZNKR1S1fEv"));
+  EXPECT_EQ("S::f() &&", demangle("_ZNO1S1fEv"));
+  EXPECT_EQ("int (*f<int>()) [4]", demangle("_Z1fIiEPA4_iv"));
+}
+
+TEST(ItaniumDemangleTest, CallerBuffer) {
+  // A buffer that is too small is grown with realloc and its new size is
+  // reported back.
+  size_t Size = 4;
+  char *Buf = static_cast<char *>(std::malloc(Size));
+  int Status;
+  Buf = itaniumDemangle("_ZN4llvm6ModuleD1Ev", Buf, &Size, &Status);
+  ASSERT_NE(nullptr, Buf);
+  EXPECT_EQ(0, Status);
+  EXPECT_STREQ("llvm::Module::~Module()", Buf);
+  EXPECT_EQ(std::strlen(Buf) + 1, Size);
+  std::free(Buf);
+
+  EXPECT_EQ(nullptr, itaniumDemangle(nullptr, nullptr, nullptr, &Status));
+  EXPECT_EQ(-3, Status);
+  EXPECT_EQ(nullptr, itaniumDemangle("_Zx", nullptr, nullptr, &Status));
+  EXPECT_EQ(-2, Status);
+}
+
+TEST(ItaniumDemangleTest, Batch) {
+  ItaniumBatchDemangler Demangler;
+  // Demangle everything twice so that the second round runs on recycled
+  // arena blocks.
+  for (int Round = 0; Round != 2; ++Round) {
+    for (const char *Mangled : Corpus) {
+      const char *Demangled = Demangler.demangle(Mangled);
+      ASSERT_NE(nullptr, Demangled) << Mangled;
+      EXPECT_EQ(demangle(Mangled), Demangled);
+    }
+    EXPECT_EQ(nullptr, Demangler.demangle("_ZN4llvm"));
+  }
+
+  // Only the given prefix of the input is demangled.
+  const char *Mangled = "_ZN4llvm6ModuleD1Evxyz";
+  EXPECT_STREQ("llvm::Module::~Module()",
+               Demangler.demangle(Mangled, std::strlen(Mangled) - 3));
+}
+
+TEST(ItaniumDemangleTest, DISABLED_Throughput) {
+  const unsigned Rounds = 20000;
+  size_t Bytes = 0;
+  for (const char *Mangled : Corpus)
+    Bytes += std::strlen(Mangled);
+
+  auto Time = [&](const char *Name, const std::function<void()> &Fn) {
+    auto Start = std::chrono::steady_clock::now();
+    Fn();
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    double Names = double(Rounds) * (sizeof(Corpus) / sizeof(Corpus[0]));
+    outs() << Name << ": "
+           << format("%.0f names/s, %.1f MB/s\n", Names / Elapsed.count(),
+                     Bytes * double(Rounds) / Elapsed.count() / 1e6);
+  };
+
+  Time("itaniumDemangle", [&] {
+    for (unsigned I = 0; I != Rounds; ++I)
+      for (const char *Mangled : Corpus) {
+        int Status;
+        std::free(itaniumDemangle(Mangled, nullptr, nullptr, &Status));
+      }
+  });
+  Time("ItaniumBatchDemangler", [&] {
+    ItaniumBatchDemangler Demangler;
+    for (unsigned I = 0; I != Rounds; ++I)
+      for (const char *Mangled : Corpus)
+        Demangler.demangle(Mangled);
+  });
+}
+
+} // end anonymous namespace
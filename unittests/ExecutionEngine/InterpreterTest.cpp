@@ -0,0 +1,255 @@
+//===- InterpreterTest.cpp - Unit tests for the IR interpreter ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/ExecutionEngine/Interpreter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <chrono>
+
+using namespace llvm;
+
+namespace {
+
+class InterpreterTest : public testing::Test {
+  llvm_shutdown_obj Y; // Call llvm_shutdown() on exit.
+
+protected:
+  void load(StringRef Source) {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> Owner = parseAssemblyString(Source, Err, Context);
+    ASSERT_TRUE(Owner) << Err.getMessage().str();
+    M = Owner.get();
+    std::string Error;
+    Engine.reset(EngineBuilder(std::move(Owner))
+                     .setEngineKind(EngineKind::Interpreter)
+                     .setErrorStr(&Error)
+                     .create());
+    ASSERT_TRUE(Engine) << Error;
+  }
+
+  GenericValue run(StringRef Name, ArrayRef<GenericValue> Args = None) {
+    return Engine->runFunction(M->getFunction(Name), Args);
+  }
+
+  static GenericValue i32(uint64_t V) {
+    GenericValue GV;
+    GV.IntVal = APInt(32, V);
+    return GV;
+  }
+
+  LLVMContext Context;
+  Module *M = nullptr; // Owned by Engine.
+  std::unique_ptr<ExecutionEngine> Engine;
+};
+
+const char *const FibSource = R"(
+define i32 @fib(i32 %n) {
+entry:
+  %small = icmp slt i32 %n, 2
+  br i1 %small, label %done, label %recurse
+recurse:
+  %n1 = sub i32 %n, 1
+  %f1 = call i32 @fib(i32 %n1)
+  %n2 = sub i32 %n, 2
+  %f2 = call i32 @fib(i32 %n2)
+  %sum = add i32 %f1, %f2
+  ret i32 %sum
+done:
+  ret i32 %n
+}
+
+define i32 @fib_loop(i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %a = phi i32 [ 0, %entry ], [ %b, %loop ]
+  %b = phi i32 [ 1, %entry ], [ %c, %loop ]
+  %c = add i32 %a, %b
+  %i.next = add i32 %i, 1
+  %more = icmp ult i32 %i.next, %n
+  br i1 %more, label %loop, label %exit
+exit:
+  ret i32 %b
+}
+)";
+
+TEST_F(InterpreterTest, Calls) {
+  load(FibSource);
+  EXPECT_EQ(6765u, run("fib", i32(20)).IntVal.getZExtValue());
+  EXPECT_EQ(1u, run("fib", i32(1)).IntVal.getZExtValue());
+}
+
+TEST_F(InterpreterTest, ParallelPHIs) {
+  // %a and %b are swapped along the backedge, which only works if all PHI
+  // nodes read their incoming values before any of them is written.
+  load(FibSource);
+  EXPECT_EQ(6765u, run("fib_loop", i32(20)).IntVal.getZExtValue());
+}
+
+TEST_F(InterpreterTest, MemoryAndSwitch) {
+  load(R"(
+    %pair = type { i8, i32 }
+
+    define i32 @sum(i32 %n) {
+    entry:
+      %buf = alloca [16 x %pair]
+      br label %fill
+    fill:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %fill ]
+      %p = getelementptr [16 x %pair], [16 x %pair]* %buf, i32 0, i32 %i, i32 1
+      store i32 %i, i32* %p
+      %i.next = add i32 %i, 1
+      %more = icmp slt i32 %i.next, 16
+      br i1 %more, label %fill, label %sum
+    sum:
+      %j = phi i32 [ 0, %fill ], [ %j.next, %next ]
+      %acc = phi i32 [ 0, %fill ], [ %acc.next, %next ]
+      %q = getelementptr [16 x %pair], [16 x %pair]* %buf, i32 0, i32 %j, i32 1
+      %v = load i32, i32* %q
+      switch i32 %v, label %other [ i32 3, label %three
+                                   i32 5, label %five ]
+    three:
+      br label %next
+    five:
+      br label %next
+    other:
+      br label %next
+    next:
+      %w = phi i32 [ 300, %three ], [ 500, %five ], [ %v, %other ]
+      %acc.next = add i32 %acc, %w
+      %j.next = add i32 %j, 1
+      %done = icmp eq i32 %j.next, %n
+      br i1 %done, label %exit, label %sum
+    exit:
+      ret i32 %acc.next
+    }
+  )");
+  // 0 + 1 + ... + 15, with 3 and 5 replaced by 300 and 500.
+  EXPECT_EQ(120u - 8 + 800, run("sum", i32(16)).IntVal.getZExtValue());
+}
+
+TEST_F(InterpreterTest, FloatingPoint) {
+  load(R"(
+    define i32 @compare(double %x) {
+      %nan = fdiv double 0.0, 0.0
+      %uno = fcmp uno double %x, %nan
+      %olt = fcmp olt double %x, %nan
+      %one = fcmp one double %x, 2.5
+      %a = zext i1 %uno to i32
+      %b = zext i1 %olt to i32
+      %c = zext i1 %one to i32
+      %b2 = shl i32 %b, 1
+      %c2 = shl i32 %c, 2
+      %ab = or i32 %a, %b2
+      %abc = or i32 %ab, %c2
+      ret i32 %abc
+    }
+
+    define double @poly(double %x) {
+      %x2 = fmul double %x, %x
+      %t = fadd double %x2, %x
+      %r = fsub double %t, 1.0
+      ret double %r
+    }
+  )");
+  GenericValue X;
+  X.DoubleVal = 2.5;
+  EXPECT_EQ(1u, run("compare", X).IntVal.getZExtValue());
+  X.DoubleVal = 3.0;
+  EXPECT_EQ(5u, run("compare", X).IntVal.getZExtValue());
+  EXPECT_EQ(11.0, run("poly", X).DoubleVal);
+}
+
+TEST_F(InterpreterTest, LoweredIntrinsicsAndGenericOps) {
+  // Intrinsics are lowered when a function is first called, and aggregate
+  // operations are executed by the generic visitor.
+  load(R"(
+    declare i32 @llvm.ctpop.i32(i32)
+    declare i32 @llvm.bswap.i32(i32)
+
+    define i32 @f(i32 %x) {
+    entry:
+      %pop = call i32 @llvm.ctpop.i32(i32 %x)
+      %swapped = call i32 @llvm.bswap.i32(i32 %x)
+      %s = insertvalue { i32, i32 } undef, i32 %pop, 0
+      %s2 = insertvalue { i32, i32 } %s, i32 %swapped, 1
+      %low = extractvalue { i32, i32 } %s2, 1
+      %hi = extractvalue { i32, i32 } %s2, 0
+      %lowbyte = and i32 %low, 255
+      %shifted = shl i32 %hi, 8
+      %r = or i32 %shifted, %lowbyte
+      ret i32 %r
+    }
+  )");
+  EXPECT_EQ((8u << 8) | 0x78, run("f", i32(0x780000F0)).IntVal.getZExtValue());
+  EXPECT_EQ((8u << 8) | 0x78, run("f", i32(0x780000F0)).IntVal.getZExtValue());
+}
+
+// Measures the interpreter on a loop nest of integer arithmetic, memory and
+// calls.
+TEST_F(InterpreterTest, DISABLED_Throughput) {
+  load(R"(
+    define i32 @sieve(i32 %n) {
+    entry:
+      %flags = alloca i8, i32 %n
+      br label %clear
+    clear:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %clear ]
+      %p = getelementptr i8, i8* %flags, i32 %i
+      store i8 1, i8* %p
+      %i.next = add i32 %i, 1
+      %c = icmp slt i32 %i.next, %n
+      br i1 %c, label %clear, label %outer
+    outer:
+      %k = phi i32 [ 2, %clear ], [ %k.next, %outer.next ]
+      %count = phi i32 [ 0, %clear ], [ %count.next, %outer.next ]
+      %pk = getelementptr i8, i8* %flags, i32 %k
+      %fk = load i8, i8* %pk
+      %prime = icmp ne i8 %fk, 0
+      %inc = zext i1 %prime to i32
+      %count.next = add i32 %count, %inc
+      br i1 %prime, label %mark, label %outer.next
+    mark:
+      %m = phi i32 [ %k, %outer ], [ %m.next, %mark ]
+      %pm = getelementptr i8, i8* %flags, i32 %m
+      store i8 0, i8* %pm
+      %m.next = call i32 @add(i32 %m, i32 %k)
+      %cm = icmp slt i32 %m.next, %n
+      br i1 %cm, label %mark, label %outer.next
+    outer.next:
+      %k.next = add i32 %k, 1
+      %ck = icmp slt i32 %k.next, %n
+      br i1 %ck, label %outer, label %exit
+    exit:
+      ret i32 %count.next
+    }
+
+    define i32 @add(i32 %a, i32 %b) {
+      %r = add i32 %a, %b
+      ret i32 %r
+    }
+  )");
+  auto Start = std::chrono::steady_clock::now();
+  GenericValue Primes = run("sieve", i32(2000000));
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  EXPECT_EQ(148933u, Primes.IntVal.getZExtValue());
+  outs() << format("sieve(2000000): %.3f s\n", Elapsed.count());
+}
+
+} // end anonymous namespace
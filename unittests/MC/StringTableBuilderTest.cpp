@@ -10,8 +10,13 @@
 #include "llvm/MC/StringTableBuilder.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Endian.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
+#include <chrono>
+#include <functional>
 #include <string>
+#include <vector>
 
 using namespace llvm;
 
@@ -104,4 +109,98 @@ TEST(StringTableBuilderTest, ELFInOrder) {
   EXPECT_EQ(9U, B.getOffset("foobar"));
 }
 
+// Builds a symbol-table-like corpus with duplicates and shared suffixes.
+static std::vector<std::string> makeCorpus(unsigned N) {
+  std::vector<std::string> Corpus;
+  for (unsigned I = 0; I != N; ++I) {
+    std::string Suffix = "Ev" + std::to_string(I % 1000);
+    switch (I % 4) {
+    case 0:
+      Corpus.push_back("_ZN4llvm" + std::to_string(I) + Suffix);
+      break;
+    case 1:
+      Corpus.push_back(std::to_string(I) + Suffix);
+      break;
+    case 2:
+      Corpus.push_back(Suffix);
+      break;
+    case 3:
+      Corpus.push_back(Corpus[I / 2]);
+      break;
+    }
+  }
+  return Corpus;
+}
+
+static void expectParallelMatchesSequential(StringTableBuilder::Kind K,
+                                            unsigned Alignment, bool InOrder) {
+  std::vector<std::string> Corpus = makeCorpus(20000);
+  std::vector<CachedHashStringRef> Strings(Corpus.begin(), Corpus.end());
+
+  StringTableBuilder Seq(K, Alignment);
+  StringTableBuilder Par(K, Alignment);
+  // Strings that are already in the table keep their offsets.
+  Seq.add("Ev1");
+  Par.add("Ev1");
+  for (CachedHashStringRef S : Strings)
+    Seq.add(S);
+  Par.addParallel(Strings);
+  if (InOrder) {
+    Seq.finalizeInOrder();
+    Par.finalizeInOrder();
+  } else {
+    Seq.finalize();
+    Par.finalizeParallel();
+  }
+
+  ASSERT_EQ(Seq.getSize(), Par.getSize());
+  for (CachedHashStringRef S : Strings)
+    EXPECT_EQ(Seq.getOffset(S), Par.getOffset(S));
+
+  SmallString<0> SeqData, ParData;
+  raw_svector_ostream SeqOS(SeqData), ParOS(ParData);
+  Seq.write(SeqOS);
+  Par.write(ParOS);
+  EXPECT_EQ(SeqData, ParData);
+}
+
+TEST(StringTableBuilderTest, ParallelELF) {
+  expectParallelMatchesSequential(StringTableBuilder::ELF, 1, false);
+}
+
+TEST(StringTableBuilderTest, ParallelAligned) {
+  expectParallelMatchesSequential(StringTableBuilder::RAW, 4, false);
+}
+
+TEST(StringTableBuilderTest, ParallelInOrder) {
+  expectParallelMatchesSequential(StringTableBuilder::MachO, 1, true);
+}
+
+// Microbenchmark comparing the sequential and parallel builders. Run with
+// --gtest_also_run_disabled_tests.
+TEST(StringTableBuilderTest, DISABLED_ParallelBenchmark) {
+  std::vector<std::string> Corpus = makeCorpus(2000000);
+  std::vector<CachedHashStringRef> Strings(Corpus.begin(), Corpus.end());
+
+  auto Time = [](const char *Name, std::function<void()> Fn) {
+    auto Start = std::chrono::steady_clock::now();
+    Fn();
+    std::chrono::duration<double, std::milli> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    outs() << Name << ": " << format("%.1f ms\n", Elapsed.count());
+  };
+
+  Time("sequential", [&] {
+    StringTableBuilder B(StringTableBuilder::ELF);
+    for (CachedHashStringRef S : Strings)
+      B.add(S);
+    B.finalize();
+  });
+  Time("parallel", [&] {
+    StringTableBuilder B(StringTableBuilder::ELF);
+    B.addParallel(Strings);
+    B.finalizeParallel();
+  });
+}
+
 }
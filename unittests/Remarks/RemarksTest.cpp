@@ -0,0 +1,218 @@
+//===- RemarksTest.cpp - Unit tests for the remark file formats -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Remarks/BinaryRemarks.h"
+#include "llvm/Remarks/YAMLRemarks.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::remarks;
+
+namespace {
+
+// The serializer pads "Args:" like any other key, so it is followed by spaces.
+const char *const YAMLInput =
+    "--- !Passed\n"
+    "Pass:            inline\n"
+    "Name:            Inlined\n"
+    "DebugLoc:        { File: q.c, Line: 14, Column: 10 }\n"
+    "Function:        main\n"
+    "Hotness:         300\n"
+    "Args:            \n"
+    "  - Callee:          foo\n"
+    "    DebugLoc:        { File: q.c, Line: 2, Column: 0 }\n"
+    "  - String:          ' inlined into '\n"
+    "  - Caller:          main\n"
+    "...\n"
+    "--- !Missed\n"
+    "Pass:            loop-vectorize\n"
+    "Name:            MissedDetails\n"
+    "Function:        'bar\"baz'\n"
+    "...\n"
+    "--- !Analysis\n"
+    "Pass:            loop-unroll\n"
+    "Name:            Unrolled\n"
+    "DebugLoc:        { File: q.c, Line: 8, Column: 3 }\n"
+    "Function:        main\n"
+    "Args:            \n"
+    "  - UnrollCount:     '4'\n"
+    "...\n";
+
+template <typename ParserT> std::string reserialize(ParserT &Parser) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  YAMLRemarkSerializer Serializer(OS);
+  while (true) {
+    Expected<const Remark *> R = Parser.next();
+    if (!R) {
+      ADD_FAILURE() << toString(R.takeError());
+      break;
+    }
+    if (!*R)
+      break;
+    Serializer.emit(**R);
+  }
+  return OS.str();
+}
+
+std::string toBinary(StringRef YAML) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  {
+    YAMLRemarkParser Parser(YAML);
+    BinaryRemarkSerializer Serializer(OS);
+    while (true) {
+      Expected<const Remark *> R = Parser.next();
+      if (!R) {
+        ADD_FAILURE() << toString(R.takeError());
+        break;
+      }
+      if (!*R)
+        break;
+      Serializer.emit(**R);
+    }
+  }
+  return OS.str();
+}
+
+TEST(RemarksTest, YAMLRoundTrip) {
+  YAMLRemarkParser Parser(YAMLInput);
+  EXPECT_EQ(YAMLInput, reserialize(Parser));
+}
+
+TEST(RemarksTest, YAMLParse) {
+  YAMLRemarkParser Parser(YAMLInput);
+  Expected<const Remark *> R = Parser.next();
+  ASSERT_TRUE(!!R);
+  ASSERT_NE(nullptr, *R);
+  const Remark &First = **R;
+  EXPECT_EQ(Type::Passed, First.RemarkType);
+  EXPECT_EQ("inline", First.PassName);
+  EXPECT_EQ("q.c", First.Loc.File);
+  EXPECT_EQ(14u, First.Loc.Line);
+  EXPECT_EQ(300u, *First.Hotness);
+  ASSERT_EQ(3u, First.Args.size());
+  EXPECT_EQ("Callee", First.Args[0].Key);
+  EXPECT_EQ(2u, First.Args[0].Loc.Line);
+  EXPECT_EQ(" inlined into ", First.Args[1].Val);
+  EXPECT_FALSE(First.Args[1].Loc.isValid());
+
+  R = Parser.next();
+  ASSERT_TRUE(!!R);
+  ASSERT_NE(nullptr, *R);
+  EXPECT_EQ("bar\"baz", (*R)->FunctionName);
+  EXPECT_FALSE((*R)->Loc.isValid());
+  EXPECT_FALSE((*R)->Hotness.hasValue());
+  EXPECT_TRUE((*R)->Args.empty());
+
+  R = Parser.next();
+  ASSERT_TRUE(!!R);
+  EXPECT_NE(nullptr, *R);
+  R = Parser.next();
+  ASSERT_TRUE(!!R);
+  EXPECT_EQ(nullptr, *R);
+}
+
+TEST(RemarksTest, YAMLErrors) {
+  YAMLRemarkParser Untagged("--- \nPass: inline\nName: Inlined\n...\n");
+  Expected<const Remark *> R = Untagged.next();
+  ASSERT_FALSE(!!R);
+  EXPECT_NE(std::string::npos,
+            toString(R.takeError()).find("expected a remark tag"));
+
+  YAMLRemarkParser BadLine(
+      "--- !Passed\nPass: a\nName: b\nDebugLoc: { File: f, Line: x }\n");
+  R = BadLine.next();
+  ASSERT_FALSE(!!R);
+  consumeError(R.takeError());
+}
+
+TEST(RemarksTest, BinaryRoundTrip) {
+  std::string Binary = toBinary(YAMLInput);
+  ASSERT_TRUE(BinaryRemarkParser::isBinaryRemarkFile(Binary));
+  auto Parser = BinaryRemarkParser::create(Binary);
+  ASSERT_TRUE(!!Parser) << toString(Parser.takeError());
+  EXPECT_EQ(YAMLInput, reserialize(**Parser));
+}
+
+TEST(RemarksTest, BinaryStringsAreShared) {
+  // Every string is stored once, however many remarks use it.
+  std::string Once = toBinary(YAMLInput);
+  std::string Twice = toBinary(std::string(YAMLInput) + YAMLInput);
+  std::string Strings[] = {"loop-vectorize", "MissedDetails", "q.c", "Callee"};
+  for (const std::string &S : Strings) {
+    EXPECT_EQ(Once.find(S), Twice.find(S));
+    EXPECT_EQ(std::string::npos, Twice.find(S, Twice.find(S) + 1));
+  }
+}
+
+TEST(RemarksTest, BinaryErrors) {
+  std::string Binary = toBinary(YAMLInput);
+
+  // Every truncation of the file fails cleanly, except for the ones that
+  // end right after a remark.
+  for (size_t Size = 0; Size < Binary.size(); ++Size) {
+    StringRef Truncated(Binary.data(), Size);
+    auto Parser = BinaryRemarkParser::create(Truncated);
+    if (!Parser) {
+      consumeError(Parser.takeError());
+      continue;
+    }
+    while (true) {
+      Expected<const Remark *> R = (*Parser)->next();
+      if (!R) {
+        consumeError(R.takeError());
+        break;
+      }
+      if (!*R)
+        break;
+    }
+  }
+
+  std::string BadVersion = Binary;
+  BadVersion[4] = 2;
+  auto Parser = BinaryRemarkParser::create(BadVersion);
+  ASSERT_FALSE(!!Parser);
+  EXPECT_NE(std::string::npos,
+            toString(Parser.takeError()).find("unsupported version 2"));
+
+  std::string BadRecord = Binary;
+  BadRecord[8] = 7;
+  Parser = BinaryRemarkParser::create(BadRecord);
+  ASSERT_TRUE(!!Parser);
+  Expected<const Remark *> R = (*Parser)->next();
+  ASSERT_FALSE(!!R);
+  EXPECT_NE(std::string::npos,
+            toString(R.takeError()).find("unknown record 7"));
+
+  // A remark that refers to a string that was not defined before it.
+  Remark Bad;
+  Bad.PassName = "p";
+  Bad.RemarkName = "n";
+  std::string Str;
+  raw_string_ostream OS(Str);
+  {
+    BinaryRemarkSerializer Serializer(OS);
+    Serializer.emit(Bad);
+  }
+  OS.flush();
+  // Drop the string records that define "p", "n" and "", and keep the header
+  // and the remark record.
+  size_t RemarkStart = Str.size() - (1 + 3 + 4 * 4);
+  std::string NoStrings = Str.substr(0, 8) + Str.substr(RemarkStart);
+  Parser = BinaryRemarkParser::create(NoStrings);
+  ASSERT_TRUE(!!Parser);
+  R = (*Parser)->next();
+  ASSERT_FALSE(!!R);
+  EXPECT_NE(std::string::npos,
+            toString(R.takeError()).find("undefined string 0"));
+}
+
+} // end anonymous namespace
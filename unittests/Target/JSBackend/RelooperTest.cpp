@@ -0,0 +1,738 @@
+//===- RelooperTest.cpp - Unit tests for the Relooper ---------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Relooper tests that check the rendered code against the control flow graph
+// it was built from. Each block's code records that the block ran and chooses
+// one of its branches, and the rendered code is run by a small evaluator for
+// the JavaScript the Relooper emits. The code is correct if it runs the same
+// blocks and branches, in the same order, as walking the graph does.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Relooper.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// A control flow graph. A node without successors returns from the function;
+// otherwise it branches to one of them, and the last one is its default.
+struct Graph {
+  struct Node {
+    std::vector<unsigned> Succs;
+    bool Switch = false; // Whether the node branches with a switch.
+  };
+  std::vector<Node> Nodes;
+  unsigned Entry = 0;
+};
+
+uint64_t splitMix(uint64_t X) {
+  X += 0x9e3779b97f4a7c15ULL;
+  X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+  return X ^ (X >> 31);
+}
+
+// Chooses the successor node \p Node branches to on its \p Visit'th run.
+unsigned choose(uint64_t Seed, unsigned Node, unsigned Visit,
+                unsigned NumSuccs) {
+  return splitMix(splitMix(Seed) ^ (uint64_t(Node) << 32 | Visit)) % NumSuccs;
+}
+
+// Walks the graph for at most \p Limit blocks, and returns the blocks (" tN")
+// and branches (" pN.K") taken.
+std::string runGraph(const Graph &G, uint64_t Seed, unsigned Limit) {
+  std::string Trace;
+  std::vector<unsigned> Visits(G.Nodes.size());
+  unsigned Curr = G.Entry;
+  for (unsigned Step = 0; Step != Limit; ++Step) {
+    const Graph::Node &N = G.Nodes[Curr];
+    Trace += " t" + std::to_string(Curr);
+    if (N.Succs.empty())
+      return Trace;
+    unsigned K = choose(Seed, Curr, Visits[Curr]++, N.Succs.size());
+    Trace += " p" + std::to_string(Curr) + "." + std::to_string(K);
+    Curr = N.Succs[K];
+  }
+  return Trace + " limit";
+}
+
+std::string describe(const Graph &G) {
+  std::string Desc = "entry " + std::to_string(G.Entry) + "\n";
+  for (unsigned I = 0; I != G.Nodes.size(); ++I) {
+    Desc += std::to_string(I) + (G.Nodes[I].Switch ? " switch:" : ":");
+    for (unsigned S : G.Nodes[I].Succs)
+      Desc += " " + std::to_string(S);
+    Desc += "\n";
+  }
+  return Desc;
+}
+
+// Adds the nodes of \p G to \p R and returns the entry block. Node N's code is
+// "t(N);", followed by "return;" if it has no successors, and its branch to
+// successor K is taken if "c(N, K)" holds, or if "s(N)" is K for switches.
+Block *addGraph(Relooper &R, const Graph &G) {
+  std::vector<Block *> Blocks;
+  for (unsigned I = 0; I != G.Nodes.size(); ++I) {
+    const Graph::Node &N = G.Nodes[I];
+    std::string Code = "t(" + std::to_string(I) + ");";
+    if (N.Succs.empty())
+      Code += "\nreturn;";
+    std::string Var = "s(" + std::to_string(I) + ")";
+    Blocks.push_back(new Block(Code.c_str(), N.Switch ? Var.c_str() : nullptr));
+    R.AddBlock(Blocks.back());
+  }
+  for (unsigned I = 0; I != G.Nodes.size(); ++I) {
+    const Graph::Node &N = G.Nodes[I];
+    for (unsigned K = 0; K != N.Succs.size(); ++K) {
+      std::string Condition =
+          N.Switch ? "case " + std::to_string(K) + ":"
+                   : "c(" + std::to_string(I) + ", " + std::to_string(K) + ")";
+      std::string Code =
+          "p(" + std::to_string(I) + ", " + std::to_string(K) + ");";
+      Blocks[I]->AddBranchTo(Blocks[N.Succs[K]],
+                             K + 1 == N.Succs.size() ? nullptr
+                                                     : Condition.c_str(),
+                             Code.c_str());
+    }
+  }
+  return Blocks[G.Entry];
+}
+
+struct Options {
+  bool Emulate = false;
+  bool MinSize = false;
+  int SplitLimit = -1;
+};
+
+std::string reloop(const Graph &G, const Options &Opts,
+                   unsigned *SplitBytes = nullptr) {
+  Relooper::MakeOutputBuffer(1024);
+  Relooper::SetAsmJSMode(1);
+  Relooper R;
+  R.SetEmulate(Opts.Emulate);
+  R.SetMinSize(Opts.MinSize);
+  R.SetSplitLimit(Opts.SplitLimit);
+  R.Calculate(addGraph(R, G));
+  R.Render();
+  if (SplitBytes)
+    *SplitBytes = R.GetSplitBytes();
+  return Relooper::GetOutputBuffer();
+}
+
+// Runs the code rendered for a graph built by addGraph(). Only the statements
+// and expressions the Relooper emits are supported.
+class Evaluator {
+public:
+  Evaluator(const Graph &G, StringRef Code) : G(G) {
+    tokenize(Code);
+    while (Pos < Tokens.size() && Error.empty())
+      Body.push_back(parseStatement());
+  }
+
+  const std::string &error() const { return Error; }
+
+  // Runs the code for at most \p Limit blocks, with the same choices and
+  // result as runGraph().
+  std::string run(uint64_t Seed, unsigned Limit) {
+    this->Seed = Seed;
+    this->Limit = Limit;
+    Trace.clear();
+    Visits.assign(G.Nodes.size(), 0);
+    Choices.assign(G.Nodes.size(), 0);
+    Steps = 0;
+    Fuel = 100000;
+    LabelVar = 0;
+    Completion C = exec(Body, 0);
+    switch (C.Kind) {
+    case Normal:
+      return Trace + " end";
+    case Break:
+    case Continue:
+      return Trace + " escaped";
+    case Return:
+    case Stop:
+      return Trace;
+    }
+    return Trace;
+  }
+
+private:
+  struct Expr {
+    enum KindTy { Number, Label, Call, Not, And, BitOr, Equal } Kind;
+    int Value = 0;
+    char Callee = 0;
+    std::vector<int> Args;
+    std::unique_ptr<Expr> LHS, RHS;
+
+    explicit Expr(KindTy Kind) : Kind(Kind) {}
+  };
+
+  struct Stmt {
+    enum KindTy {
+      Call,
+      SetLabel,
+      Return,
+      Break,
+      Continue,
+      Block,
+      If,
+      While,
+      DoWhile,
+      Switch,
+      Case,
+      Default
+    } Kind;
+    // The label of a loop or switch, or the target of a break or continue.
+    int Label = -1;
+    // The value of a label assignment or case.
+    int Value = 0;
+    char Callee = 0;
+    std::vector<int> Args;
+    std::unique_ptr<Expr> Cond;
+    std::vector<std::unique_ptr<Stmt>> Body, Else;
+  };
+
+  enum CompletionKind { Normal, Break, Continue, Return, Stop };
+  struct Completion {
+    CompletionKind Kind;
+    int Label;
+  };
+
+  void tokenize(StringRef Code) {
+    while (!Code.empty()) {
+      char C = Code.front();
+      size_t Len = 1;
+      if (isspace(C)) {
+        Code = Code.drop_front();
+        continue;
+      }
+      if (isalnum(C) || C == '_')
+        Len = std::min(
+            Code.find_if([](char C) { return !isalnum(C) && C != '_'; }),
+            Code.size());
+      else if (Code.startswith("==") || Code.startswith("&&"))
+        Len = 2;
+      Tokens.push_back(Code.take_front(Len).str());
+      Code = Code.drop_front(Len);
+    }
+  }
+
+  StringRef peek(unsigned Ahead = 0) const {
+    return Pos + Ahead < Tokens.size() ? StringRef(Tokens[Pos + Ahead]) : "";
+  }
+
+  bool accept(StringRef Token) {
+    if (peek() != Token)
+      return false;
+    ++Pos;
+    return true;
+  }
+
+  void expect(StringRef Token) {
+    if (!accept(Token) && Error.empty())
+      Error = "expected '" + Token.str() + "' before '" + peek().str() +
+              "' (token " + std::to_string(Pos) + ")";
+  }
+
+  int parseNumber() {
+    int Value = 0;
+    if (peek().getAsInteger(10, Value) && Error.empty())
+      Error = "expected a number before '" + peek().str() + "'";
+    ++Pos;
+    return Value;
+  }
+
+  // Parses a label such as "L3", returning -1 if there is none.
+  int parseLabel() {
+    int Label;
+    if (!peek().startswith("L") || peek().drop_front().getAsInteger(10, Label))
+      return -1;
+    ++Pos;
+    return Label;
+  }
+
+  std::vector<int> parseArgs() {
+    std::vector<int> Args;
+    expect("(");
+    while (Error.empty() && !accept(")")) {
+      if (!Args.empty())
+        expect(",");
+      Args.push_back(parseNumber());
+    }
+    return Args;
+  }
+
+  void parseBlock(std::vector<std::unique_ptr<Stmt>> &Body) {
+    expect("{");
+    while (Error.empty() && Pos < Tokens.size() && !accept("}"))
+      Body.push_back(parseStatement());
+  }
+
+  std::unique_ptr<Stmt> parseStatement() {
+    auto S = make_unique<Stmt>();
+    if (peek(1) == ":") {
+      S->Label = parseLabel();
+      expect(":");
+    }
+    if (accept("while")) {
+      S->Kind = Stmt::While;
+      expect("(");
+      S->Cond = parseExpr();
+      expect(")");
+      parseBlock(S->Body);
+    } else if (accept("do")) {
+      S->Kind = Stmt::DoWhile;
+      parseBlock(S->Body);
+      expect("while");
+      expect("(");
+      S->Cond = parseExpr();
+      expect(")");
+      expect(";");
+    } else if (accept("if")) {
+      S->Kind = Stmt::If;
+      expect("(");
+      S->Cond = parseExpr();
+      expect(")");
+      parseBlock(S->Body);
+      if (accept("else")) {
+        if (peek() == "if")
+          S->Else.push_back(parseStatement());
+        else
+          parseBlock(S->Else);
+      }
+    } else if (accept("switch")) {
+      S->Kind = Stmt::Switch;
+      expect("(");
+      S->Cond = parseExpr();
+      expect(")");
+      expect("{");
+      while (Error.empty() && Pos < Tokens.size() && !accept("}")) {
+        auto Item = make_unique<Stmt>();
+        if (accept("case")) {
+          Item->Kind = Stmt::Case;
+          Item->Value = parseNumber();
+          expect(":");
+        } else if (accept("default")) {
+          Item->Kind = Stmt::Default;
+          expect(":");
+        } else {
+          Item = parseStatement();
+        }
+        S->Body.push_back(std::move(Item));
+      }
+    } else if (peek() == "break" || peek() == "continue") {
+      S->Kind = Tokens[Pos++] == "break" ? Stmt::Break : Stmt::Continue;
+      S->Label = parseLabel();
+      expect(";");
+    } else if (accept("return")) {
+      S->Kind = Stmt::Return;
+      expect(";");
+    } else if (peek() == "{") {
+      S->Kind = Stmt::Block;
+      parseBlock(S->Body);
+    } else if (accept("label")) {
+      S->Kind = Stmt::SetLabel;
+      expect("=");
+      S->Value = parseNumber();
+      expect(";");
+    } else if (peek() == "t" || peek() == "p") {
+      S->Kind = Stmt::Call;
+      S->Callee = Tokens[Pos++][0];
+      S->Args = parseArgs();
+      expect(";");
+    } else if (Error.empty()) {
+      Error = "unexpected '" + peek().str() + "' after '" +
+              Tokens[Pos - 1] + "' (token " + std::to_string(Pos) + ")";
+      ++Pos;
+    }
+    return S;
+  }
+
+  std::unique_ptr<Expr> parseExpr() {
+    std::unique_ptr<Expr> LHS = parseBitOr();
+    while (accept("&&"))
+      LHS = makeBinary(Expr::And, std::move(LHS), parseBitOr());
+    return LHS;
+  }
+
+  std::unique_ptr<Expr> parseBitOr() {
+    std::unique_ptr<Expr> LHS = parseEqual();
+    while (accept("|"))
+      LHS = makeBinary(Expr::BitOr, std::move(LHS), parseEqual());
+    return LHS;
+  }
+
+  std::unique_ptr<Expr> parseEqual() {
+    std::unique_ptr<Expr> LHS = parseUnary();
+    while (accept("=="))
+      LHS = makeBinary(Expr::Equal, std::move(LHS), parseUnary());
+    return LHS;
+  }
+
+  std::unique_ptr<Expr> parseUnary() {
+    if (accept("!")) {
+      auto E = make_unique<Expr>(Expr::Not);
+      E->LHS = parseUnary();
+      return E;
+    }
+    if (accept("(")) {
+      std::unique_ptr<Expr> E = parseExpr();
+      expect(")");
+      return E;
+    }
+    if (accept("label"))
+      return make_unique<Expr>(Expr::Label);
+    if (peek() == "c" || peek() == "s") {
+      auto E = make_unique<Expr>(Expr::Call);
+      E->Callee = Tokens[Pos++][0];
+      E->Args = parseArgs();
+      return E;
+    }
+    auto E = make_unique<Expr>(Expr::Number);
+    E->Value = parseNumber();
+    return E;
+  }
+
+  static std::unique_ptr<Expr> makeBinary(Expr::KindTy Kind,
+                                          std::unique_ptr<Expr> LHS,
+                                          std::unique_ptr<Expr> RHS) {
+    auto E = make_unique<Expr>(Kind);
+    E->LHS = std::move(LHS);
+    E->RHS = std::move(RHS);
+    return E;
+  }
+
+  int eval(const Expr &E) {
+    switch (E.Kind) {
+    case Expr::Number:
+      return E.Value;
+    case Expr::Label:
+      return LabelVar;
+    case Expr::Call:
+      if (E.Callee == 's')
+        return Choices[E.Args[0]];
+      return Choices[E.Args[0]] == unsigned(E.Args[1]);
+    case Expr::Not:
+      return !eval(*E.LHS);
+    case Expr::And:
+      return eval(*E.LHS) && eval(*E.RHS);
+    case Expr::BitOr:
+      return eval(*E.LHS) | eval(*E.RHS);
+    case Expr::Equal:
+      return eval(*E.LHS) == eval(*E.RHS);
+    }
+    return 0;
+  }
+
+  static bool targets(const Completion &C, const Stmt &S) {
+    return C.Label == -1 || C.Label == S.Label;
+  }
+
+  Completion exec(const std::vector<std::unique_ptr<Stmt>> &Stmts,
+                  size_t From) {
+    for (size_t I = From; I < Stmts.size(); ++I) {
+      Completion C = exec(*Stmts[I]);
+      if (C.Kind != Normal)
+        return C;
+    }
+    return {Normal, -1};
+  }
+
+  Completion exec(const Stmt &S) {
+    if (Fuel-- == 0) {
+      Trace += " hang";
+      return {Stop, -1};
+    }
+    switch (S.Kind) {
+    case Stmt::Call: {
+      unsigned Node = S.Args[0];
+      if (S.Callee == 'p') {
+        Trace += " p" + std::to_string(Node) + "." + std::to_string(S.Args[1]);
+        return {Normal, -1};
+      }
+      if (Steps++ == Limit) {
+        Trace += " limit";
+        return {Stop, -1};
+      }
+      Trace += " t" + std::to_string(Node);
+      if (!G.Nodes[Node].Succs.empty())
+        Choices[Node] =
+            choose(Seed, Node, Visits[Node]++, G.Nodes[Node].Succs.size());
+      return {Normal, -1};
+    }
+    case Stmt::SetLabel:
+      LabelVar = S.Value;
+      return {Normal, -1};
+    case Stmt::Return:
+      return {Return, -1};
+    case Stmt::Break:
+      return {Break, S.Label};
+    case Stmt::Continue:
+      return {Continue, S.Label};
+    case Stmt::Case:
+    case Stmt::Default:
+      return {Normal, -1};
+    case Stmt::Block:
+      return exec(S.Body, 0);
+    case Stmt::If:
+      return eval(*S.Cond) ? exec(S.Body, 0) : exec(S.Else, 0);
+    case Stmt::While:
+      while (eval(*S.Cond)) {
+        Completion C = exec(S.Body, 0);
+        if (C.Kind == Break && targets(C, S))
+          break;
+        if (C.Kind != Normal && !(C.Kind == Continue && targets(C, S)))
+          return C;
+      }
+      return {Normal, -1};
+    case Stmt::DoWhile:
+      do {
+        Completion C = exec(S.Body, 0);
+        if (C.Kind == Break && targets(C, S))
+          break;
+        if (C.Kind != Normal && !(C.Kind == Continue && targets(C, S)))
+          return C;
+      } while (eval(*S.Cond));
+      return {Normal, -1};
+    case Stmt::Switch: {
+      int Value = eval(*S.Cond);
+      size_t Start = S.Body.size();
+      for (size_t I = 0; I != S.Body.size(); ++I) {
+        if (S.Body[I]->Kind == Stmt::Case && S.Body[I]->Value == Value) {
+          Start = I;
+          break;
+        }
+        if (S.Body[I]->Kind == Stmt::Default)
+          Start = I;
+      }
+      Completion C = exec(S.Body, Start);
+      if (C.Kind == Break && targets(C, S))
+        return {Normal, -1};
+      return C;
+    }
+    }
+    return {Normal, -1};
+  }
+
+  const Graph &G;
+  std::vector<std::string> Tokens;
+  size_t Pos = 0;
+  std::string Error;
+  std::vector<std::unique_ptr<Stmt>> Body;
+
+  uint64_t Seed = 0;
+  unsigned Limit = 0;
+  std::string Trace;
+  std::vector<unsigned> Visits;
+  std::vector<unsigned> Choices;
+  unsigned Steps = 0;
+  unsigned Fuel = 0;
+  int LabelVar = 0;
+};
+
+// Checks that the code rendered for \p G behaves like \p G.
+void checkGraph(const Graph &G, const Options &Opts) {
+  std::string Code = reloop(G, Opts);
+  Evaluator E(G, Code);
+  ASSERT_EQ("", E.error()) << describe(G) << Code;
+  for (uint64_t Seed = 0; Seed != 8; ++Seed)
+    ASSERT_EQ(runGraph(G, Seed, 200), E.run(Seed, 200))
+        << "seed " << Seed << "\n"
+        << describe(G) << Code;
+}
+
+struct Random {
+  uint64_t State;
+
+  explicit Random(uint64_t Seed) : State(Seed) {}
+  unsigned operator()(unsigned N) { return splitMix(State++) % N; }
+};
+
+// Creates a graph with mostly forward branches, as most code has.
+Graph randomGraph(Random &R, unsigned MaxNodes) {
+  Graph G;
+  unsigned NumNodes = 1 + R(MaxNodes);
+  G.Nodes.resize(NumNodes);
+  for (unsigned I = 0; I != NumNodes; ++I) {
+    Graph::Node &N = G.Nodes[I];
+    unsigned NumSuccs = R(4);
+    for (unsigned K = 0; K != NumSuccs; ++K) {
+      unsigned Target = I + 1 < NumNodes && R(4) != 0
+                            ? I + 1 + R(NumNodes - I - 1)
+                            : R(NumNodes);
+      if (!is_contained(N.Succs, Target))
+        N.Succs.push_back(Target);
+    }
+    N.Switch = N.Succs.size() > 1 && R(4) == 0;
+  }
+  return G;
+}
+
+// Reads a graph from the C API calls the Relooper prints when it is built with
+// DEBUG.
+Graph readRecording(StringRef Recording) {
+  Graph G;
+  std::map<int, unsigned> Nodes;
+  std::vector<bool> HasDefault;
+  SmallVector<StringRef, 32> Lines;
+  Recording.split(Lines, '\n');
+  for (StringRef Line : Lines) {
+    std::string L = Line.trim().str();
+    int From, To, Len = 0;
+    if (sscanf(L.c_str(), "void *b%d = rl_new_block(%*[^,], %n", &From,
+               &Len) == 1 &&
+        Len) {
+      Nodes[From] = G.Nodes.size();
+      G.Nodes.emplace_back();
+      HasDefault.push_back(false);
+      G.Nodes.back().Switch = !StringRef(L).substr(Len).startswith("NULL");
+    } else if (sscanf(L.c_str(),
+                      "rl_block_add_branch_to(block_map[%d], block_map[%d], %n",
+                      &From, &To, &Len) == 2 &&
+               Len) {
+      unsigned Node = Nodes[From];
+      std::vector<unsigned> &Succs = G.Nodes[Node].Succs;
+      // The branch without a condition is the default, and goes last.
+      if (StringRef(L).substr(Len).startswith("NULL")) {
+        Succs.push_back(Nodes[To]);
+        HasDefault[Node] = true;
+      } else {
+        Succs.insert(Succs.end() - HasDefault[Node], Nodes[To]);
+      }
+    } else if (sscanf(L.c_str(), "rl_relooper_calculate(rl, block_map[%d]",
+                      &From) == 1) {
+      G.Entry = Nodes[From];
+    }
+  }
+  return G;
+}
+
+// A resumable function, as generated for a coroutine: the entry switch
+// resumes either at the start or in the middle of the loop, which makes the
+// loop irreducible.
+const char *const CoroutineRecording = R"(
+  void *block_map[10000];
+  void *rl = rl_new_relooper();
+  void *b1 = rl_new_block("// code 1", "$state");
+  block_map[1] = b1;
+  void *b2 = rl_new_block("// code 2", NULL);
+  block_map[2] = b2;
+  void *b3 = rl_new_block("// code 3", NULL);
+  block_map[3] = b3;
+  void *b4 = rl_new_block("// code 4", NULL);
+  block_map[4] = b4;
+  void *b5 = rl_new_block("// code 5", NULL);
+  block_map[5] = b5;
+  void *b6 = rl_new_block("// code 6", NULL);
+  block_map[6] = b6;
+  void *b7 = rl_new_block("// code 7", NULL);
+  block_map[7] = b7;
+  rl_block_add_branch_to(block_map[1], block_map[2], "case 0: ", NULL);
+  rl_block_add_branch_to(block_map[1], block_map[5], "case 1: ", NULL);
+  rl_block_add_branch_to(block_map[1], block_map[7], NULL, NULL);
+  rl_block_add_branch_to(block_map[2], block_map[3], NULL, "$i = 0;");
+  rl_block_add_branch_to(block_map[3], block_map[4], "$more", NULL);
+  rl_block_add_branch_to(block_map[3], block_map[7], NULL, NULL);
+  rl_block_add_branch_to(block_map[4], block_map[6], "$yield", NULL);
+  rl_block_add_branch_to(block_map[4], block_map[5], NULL, NULL);
+  rl_block_add_branch_to(block_map[5], block_map[3], NULL, "$i = $i + 1;");
+  rl_relooper_add_block(rl, block_map[1]);
+  rl_relooper_add_block(rl, block_map[2]);
+  rl_relooper_add_block(rl, block_map[3]);
+  rl_relooper_add_block(rl, block_map[4]);
+  rl_relooper_add_block(rl, block_map[5]);
+  rl_relooper_add_block(rl, block_map[6]);
+  rl_relooper_add_block(rl, block_map[7]);
+  rl_relooper_calculate(rl, block_map[1]);
+)";
+
+TEST(RelooperTest, RandomGraphs) {
+  Random R(0);
+  for (unsigned I = 0; I != 500; ++I) {
+    Graph G = randomGraph(R, 24);
+    SCOPED_TRACE("graph " + std::to_string(I));
+    Options Opts;
+    checkGraph(G, Opts);
+    Opts.SplitLimit = 0;
+    checkGraph(G, Opts);
+    Opts.SplitLimit = 100000;
+    checkGraph(G, Opts);
+    Opts.MinSize = true;
+    checkGraph(G, Opts);
+    Opts.Emulate = true;
+    checkGraph(G, Opts);
+    if (HasFatalFailure())
+      return;
+  }
+}
+
+TEST(RelooperTest, RecordedGraphs) {
+  Graph G = readRecording(CoroutineRecording);
+  ASSERT_EQ(7u, G.Nodes.size());
+  EXPECT_TRUE(G.Nodes[0].Switch);
+  EXPECT_EQ((std::vector<unsigned>{1, 4, 6}), G.Nodes[0].Succs);
+
+  Options Opts;
+  checkGraph(G, Opts);
+  Opts.SplitLimit = 0;
+  checkGraph(G, Opts);
+  unsigned SplitBytes;
+  reloop(G, Opts, &SplitBytes);
+  EXPECT_EQ(0u, SplitBytes);
+
+  // Resuming in the middle of the loop is split off.
+  Opts.SplitLimit = 100000;
+  checkGraph(G, Opts);
+  reloop(G, Opts, &SplitBytes);
+  EXPECT_NE(0u, SplitBytes);
+}
+
+// Measures Calculate and Render on random graphs of a few hundred blocks.
+TEST(RelooperTest, DISABLED_Throughput) {
+  Random R(0);
+  std::vector<Graph> Graphs;
+  size_t NumBlocks = 0;
+  for (unsigned I = 0; I != 200; ++I) {
+    Graphs.push_back(randomGraph(R, 400));
+    NumBlocks += Graphs.back().Nodes.size();
+  }
+
+  std::chrono::duration<double> Calculate(0), Render(0);
+  size_t Bytes = 0;
+  for (const Graph &G : Graphs) {
+    Relooper::MakeOutputBuffer(1024);
+    Relooper Rl;
+    Block *Entry = addGraph(Rl, G);
+    auto Start = std::chrono::steady_clock::now();
+    Rl.Calculate(Entry);
+    auto Calculated = std::chrono::steady_clock::now();
+    Rl.Render();
+    Calculate += Calculated - Start;
+    Render += std::chrono::steady_clock::now() - Calculated;
+    Bytes += strlen(Relooper::GetOutputBuffer());
+  }
+  outs() << format("Calculate: %.0f blocks/s\n", NumBlocks / Calculate.count());
+  outs() << format("Render: %.0f blocks/s, %.1f MB/s\n",
+                   NumBlocks / Render.count(), Bytes / Render.count() / 1e6);
+}
+
+} // end anonymous namespace
@@ -10,6 +10,7 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/AsmParser/Parser.h"
 #include "llvm/IR/Argument.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/DIBuilder.h"
@@ -22,6 +23,8 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
 
 using namespace llvm;
@@ -614,4 +617,74 @@ TEST_F(CloneModule, Comdat) {
   Function *NewF = NewM->getFunction("f");
   EXPECT_EQ(CD, NewF->getComdat());
 }
+
+TEST_F(CloneModule, IntoContextRejectsDebugInfo) {
+  LLVMContext OtherC;
+  EXPECT_EQ(nullptr, CloneModuleIntoContext(*OldM, OtherC));
+}
+
+static std::string printModule(const Module &M) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  OS << M;
+  return OS.str();
+}
+
+TEST(CloneModuleIntoContext, RebuildsEverythingInNewContext) {
+  LLVMContext C;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> OldM = parseAssemblyString(R"(
+    %list = type { %list*, i32, [2 x float] }
+    %opaque = type opaque
+
+    @str = private unnamed_addr constant [4 x i8] c"abc\00", align 1
+    @vals = global [2 x double] [double 1.5, double -2.0], section "data"
+    @head = global %list { %list* null, i32 7, [2 x float] zeroinitializer }
+    @vec = constant <4 x i16> <i16 1, i16 2, i16 3, i16 4>
+    @ptr = global i8* getelementptr ([4 x i8], [4 x i8]* @str, i32 0, i32 1)
+    @ext = external global %opaque
+    @target = global i8* blockaddress(@f, %other)
+    @alias = alias i32 (%list*, i32), i32 (%list*, i32)* @f
+
+    declare i32 @callee(i32 signext) nounwind readnone
+
+    define i32 @f(%list* %l, i32 %x) "custom"="attr" {
+    entry:
+      %p = getelementptr %list, %list* %l, i32 0, i32 1
+      %v = load atomic i32, i32* %p syncscope("agent") acquire, align 4, !range !0, !custom !1
+      switch i32 %x, label %other [ i32 1, label %one ]
+    one:
+      %c = call i32 @callee(i32 signext %v) nounwind
+      br label %other
+    other:
+      %r = phi i32 [ %v, %entry ], [ %c, %one ]
+      fence syncscope("agent") seq_cst
+      ret i32 %r
+    }
+
+    !named = !{!0, !1, !2}
+    !0 = !{i32 0, i32 10}
+    !1 = distinct !{!1, !"self"}
+    !2 = !{!"str", float 1.0, i32 (%list*, i32)* @f}
+  )", Err, C);
+  ASSERT_TRUE(OldM);
+
+  std::string OldIR = printModule(*OldM);
+
+  LLVMContext NewC;
+  std::unique_ptr<Module> NewM = CloneModuleIntoContext(*OldM, NewC);
+  ASSERT_TRUE(NewM);
+  EXPECT_EQ(&NewC, &NewM->getContext());
+  EXPECT_FALSE(verifyModule(*NewM, &errs()));
+
+  EXPECT_EQ(OldIR, printModule(*NewM));
+
+  // The source module must not have been modified.
+  EXPECT_EQ(OldIR, printModule(*OldM));
+  EXPECT_FALSE(verifyModule(*OldM, &errs()));
+
+  // Destroying the source must not affect the clone.
+  OldM.reset();
+  EXPECT_FALSE(verifyModule(*NewM, &errs()));
+}
 }
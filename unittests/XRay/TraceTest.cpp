@@ -0,0 +1,238 @@
+//===- llvm/unittest/XRay/TraceTest.cpp - XRay Trace unit tests -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/XRay/Trace.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace llvm;
+using namespace xray;
+
+namespace {
+
+// Builds the bytes of a little-endian binary log.
+class LogBuilder {
+public:
+  LogBuilder &u8(uint8_t V) {
+    Bytes.push_back(V);
+    return *this;
+  }
+  LogBuilder &u16(uint16_t V) { return u8(V).u8(V >> 8); }
+  LogBuilder &u32(uint32_t V) { return u16(V).u16(V >> 16); }
+  LogBuilder &u64(uint64_t V) { return u32(V).u32(V >> 32); }
+  LogBuilder &pad(size_t N) {
+    Bytes.append(N, '\0');
+    return *this;
+  }
+  LogBuilder &padTo(size_t Size) { return pad(Size - Bytes.size()); }
+
+  LogBuilder &header(uint16_t Version, uint16_t Type, uint64_t BufferSize) {
+    return u16(Version).u16(Type).u32(3).u64(1000000).u64(BufferSize).pad(8);
+  }
+
+  // Naive mode records.
+  LogBuilder &naiveRecord(uint8_t Type, int32_t FuncId, uint64_t TSC,
+                          uint32_t TId) {
+    return u16(0).u8(0).u8(Type).u32(FuncId).u64(TSC).u32(TId).pad(12);
+  }
+  LogBuilder &naivePayload(int32_t FuncId, uint32_t TId, uint64_t Arg) {
+    return u16(1).pad(2).u32(FuncId).u32(TId).pad(4).u64(Arg).pad(8);
+  }
+
+  // FDR mode records.
+  LogBuilder &metadata(uint8_t Kind) { return u8((Kind << 1) | 0x01); }
+  LogBuilder &bufferExtents(uint64_t Size) {
+    return metadata(7).u64(Size).pad(7);
+  }
+  LogBuilder &newBuffer(uint16_t TId) { return metadata(0).u16(TId).pad(13); }
+  LogBuilder &wallTime() { return metadata(4).pad(15); }
+  LogBuilder &newCPU(uint16_t CPU, uint64_t TSC) {
+    return metadata(2).u16(CPU).u64(TSC).pad(5);
+  }
+  LogBuilder &callArgument(uint64_t Arg) { return metadata(6).u64(Arg).pad(7); }
+  LogBuilder &endOfBuffer() { return metadata(1).pad(15); }
+  LogBuilder &function(uint8_t Type, uint32_t FuncId, uint32_t Delta) {
+    return u32(FuncId << 4 | Type << 1).u32(Delta);
+  }
+
+  std::string Bytes;
+};
+
+class TraceTest : public testing::Test {
+protected:
+  void TearDown() override {
+    if (!Path.empty())
+      sys::fs::remove(Path);
+  }
+
+  StringRef write(const LogBuilder &Log) {
+    TearDown();
+    int FD;
+    EXPECT_FALSE(sys::fs::createTemporaryFile("xray-trace", "xray", FD, Path));
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Log.Bytes;
+    return Path;
+  }
+
+  static std::vector<XRayRecord> readAll(TraceRecordReader Reader) {
+    std::vector<XRayRecord> Records;
+    while (true) {
+      auto RecordOrErr = Reader.next();
+      EXPECT_TRUE(bool(RecordOrErr));
+      if (!RecordOrErr) {
+        consumeError(RecordOrErr.takeError());
+        break;
+      }
+      if (!*RecordOrErr)
+        break;
+      Records.push_back(**RecordOrErr);
+    }
+    return Records;
+  }
+
+  SmallString<128> Path;
+};
+
+std::vector<int32_t> funcIds(const std::vector<XRayRecord> &Records) {
+  std::vector<int32_t> Ids;
+  for (const auto &Record : Records)
+    Ids.push_back(Record.FuncId);
+  return Ids;
+}
+
+TEST_F(TraceTest, NaiveInterleavedThreads) {
+  LogBuilder Log;
+  Log.header(1, 0, 0)
+      .naiveRecord(0, 1, 10, 7)
+      .naivePayload(1, 7, 42)
+      .naiveRecord(0, 2, 11, 8)
+      .naiveRecord(0, 3, 12, 8)
+      .naiveRecord(1, 1, 13, 7)
+      .naiveRecord(1, 3, 14, 8)
+      .naiveRecord(1, 2, 15, 8);
+  auto FileOrErr = openTraceFile(write(Log));
+  ASSERT_TRUE(bool(FileOrErr));
+  auto &File = **FileOrErr;
+
+  // Consecutive records of one thread share a buffer.
+  ASSERT_EQ(4u, File.buffers().size());
+  EXPECT_EQ(32u, File.buffers()[0].Offset);
+  EXPECT_EQ(64u, File.buffers()[0].Size);
+  EXPECT_EQ(8u, File.buffers()[1].TId);
+  EXPECT_EQ(64u, File.buffers()[1].Size);
+  ASSERT_EQ(2u, File.threads().size());
+  EXPECT_EQ(7u, File.threads()[0]);
+  EXPECT_EQ(8u, File.threads()[1]);
+
+  auto All = readAll(File.records());
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 3, 1, 3, 2}), funcIds(All));
+  ASSERT_EQ(1u, All[0].CallArgs.size());
+  EXPECT_EQ(42u, All[0].CallArgs[0]);
+  EXPECT_TRUE(All[1].CallArgs.empty());
+
+  auto Thread8 = readAll(File.records(8));
+  EXPECT_EQ((std::vector<int32_t>{2, 3, 3, 2}), funcIds(Thread8));
+  EXPECT_EQ(15u, Thread8.back().TSC);
+  EXPECT_TRUE(readAll(File.records(9)).empty());
+
+  // Loading the whole trace yields the same records.
+  auto TraceOrErr = loadTraceFile(Path);
+  ASSERT_TRUE(bool(TraceOrErr));
+  EXPECT_EQ(All.size(), TraceOrErr->size());
+  EXPECT_EQ(All.back().TSC, (TraceOrErr->end() - 1)->TSC);
+}
+
+TEST_F(TraceTest, FDRVersion1) {
+  const uint64_t BufferSize = 112;
+  LogBuilder Log;
+  Log.header(1, 1, BufferSize);
+  Log.newBuffer(5).wallTime().newCPU(2, 1000);
+  Log.function(0, 1, 10).callArgument(99);
+  Log.endOfBuffer().padTo(32 + BufferSize);
+  Log.newBuffer(6).wallTime().newCPU(3, 2000);
+  Log.function(0, 2, 5).function(1, 2, 5);
+  Log.endOfBuffer().padTo(32 + 2 * BufferSize);
+  Log.newBuffer(5).wallTime().newCPU(2, 1500);
+  Log.function(1, 1, 20);
+  Log.endOfBuffer().padTo(32 + 3 * BufferSize);
+  auto FileOrErr = openTraceFile(write(Log));
+  ASSERT_TRUE(bool(FileOrErr));
+  auto &File = **FileOrErr;
+
+  ASSERT_EQ(3u, File.buffers().size());
+  EXPECT_EQ(32u + BufferSize, File.buffers()[1].Offset);
+  EXPECT_EQ(6u, File.buffers()[1].TId);
+  ASSERT_EQ(2u, File.threads().size());
+
+  // Each buffer is decoded from its own NewCPUId TSC.
+  auto Thread5 = readAll(File.records(5));
+  ASSERT_EQ(2u, Thread5.size());
+  EXPECT_EQ(RecordTypes::ENTER_ARG, Thread5[0].Type);
+  EXPECT_EQ(1010u, Thread5[0].TSC);
+  EXPECT_EQ(2u, Thread5[0].CPU);
+  ASSERT_EQ(1u, Thread5[0].CallArgs.size());
+  EXPECT_EQ(99u, Thread5[0].CallArgs[0]);
+  EXPECT_EQ(RecordTypes::EXIT, Thread5[1].Type);
+  EXPECT_EQ(1520u, Thread5[1].TSC);
+  EXPECT_TRUE(Thread5[1].CallArgs.empty());
+
+  auto All = readAll(File.records());
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 2, 1}), funcIds(All));
+  EXPECT_EQ(2010u, All[2].TSC);
+  EXPECT_EQ(6u, All[2].TId);
+}
+
+TEST_F(TraceTest, FDRVersion2) {
+  LogBuilder Log;
+  Log.header(2, 1, 4096);
+  Log.bufferExtents(64).newBuffer(5).wallTime().newCPU(2, 1000);
+  Log.function(0, 1, 10).function(1, 1, 10);
+  // A buffer that only holds its extents.
+  Log.bufferExtents(0);
+  Log.bufferExtents(56).newBuffer(6).wallTime().newCPU(3, 2000);
+  Log.function(0, 2, 1);
+  auto FileOrErr = openTraceFile(write(Log));
+  ASSERT_TRUE(bool(FileOrErr));
+  auto &File = **FileOrErr;
+
+  ASSERT_EQ(2u, File.buffers().size());
+  EXPECT_EQ(32u + 80 + 16, File.buffers()[1].Offset);
+  EXPECT_EQ(16u + 56, File.buffers()[1].Size);
+
+  auto All = readAll(File.records());
+  ASSERT_EQ(3u, All.size());
+  EXPECT_EQ(1020u, All[1].TSC);
+  EXPECT_EQ(2001u, All[2].TSC);
+  EXPECT_EQ(6u, All[2].TId);
+}
+
+TEST_F(TraceTest, FDRErrors) {
+  // The last buffer is shorter than the buffer size.
+  LogBuilder Truncated;
+  Truncated.header(1, 1, 112).newBuffer(5).wallTime().newCPU(2, 1000);
+  auto FileOrErr = openTraceFile(write(Truncated));
+  ASSERT_FALSE(bool(FileOrErr));
+  consumeError(FileOrErr.takeError());
+
+  // A function record before the buffer was set up is found when the buffer
+  // is decoded.
+  LogBuilder Malformed;
+  Malformed.header(1, 1, 48).newBuffer(5).function(0, 1, 10).padTo(32 + 48);
+  FileOrErr = openTraceFile(write(Malformed));
+  ASSERT_TRUE(bool(FileOrErr));
+  auto Reader = (*FileOrErr)->records();
+  auto RecordOrErr = Reader.next();
+  EXPECT_FALSE(bool(RecordOrErr));
+  consumeError(RecordOrErr.takeError());
+}
+
+} // end anonymous namespace